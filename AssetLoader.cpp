@@ -128,7 +128,7 @@ vector<Texture> AssetLoader::getMaterialTextures(aiMaterial *material, aiTexture
         Texture tmp;
         tmp.type = name;
         tmp.path = str.C_Str();
-        tmp.id = initializeModelTextures(str.C_Str());
+        tmp.material = initializeModelTextures(str.C_Str());
         textures.push_back(tmp);
         std::cout <<"textMat : " <<  tmp.path << std::endl;
     }
@@ -139,9 +139,6 @@ vector<Texture> AssetLoader::getMaterialTextures(aiMaterial *material, aiTexture
 int AssetLoader::initializeModelTextures(std::string name){
     std::cout << "- initialize model textures..." << std::endl;
 
-    unsigned int textureID;
-
-
     int textureWidth;
     int textureHeight;
 
@@ -156,36 +153,15 @@ int AssetLoader::initializeModelTextures(std::string name){
          exit(1);
      }
 
-     //std::cout << image << std::endl;
-
-     glGenTextures(1, &textureID);
-
-     // Bind modelTexture
-     //glActiveTexture( GL_TEXTURE0 );
-     glBindTexture(GL_TEXTURE_2D, textureID);
-
-     // - Filetring: use linear interpolation
-     glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR );
-     glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
-
-     // - wrapping: many modes available (repeat, clam, mirrored_repeat...)
-     glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
-     glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT );
-
-     std::cout << "textureID = " << textureID << std::endl;
+     // GL textures are created later (no GL context yet): the image is kept by the material library
+     int material = -1;
+     if(materials != nullptr){
+         material = materials->addImage(textureFilename, image, textureWidth, textureHeight);
+     }
 
-     glTexImage2D(
-         GL_TEXTURE_2D/*target*/,
-         0/*level*/,
-         GL_RGB/*internal format*/,
-         textureWidth, textureHeight, // les dimensions de l’image lue
-         0/*border*/,
-         GL_RGB/*format*/,
-         GL_UNSIGNED_BYTE/*type*/,
-         image/*pixels => le contenu de l’image chargée*/
-     );
+     std::cout << "material = " << material << std::endl;
 
      SOIL_free_image_data( image );
 
-    return textureID;
+    return material;
 }
@@ -9,6 +9,8 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "Materials.h"
+
 // - GL
 #ifdef _WIN32
 #include <windows.h>
@@ -28,8 +30,9 @@
 #include "SOIL.h"
 
 struct Texture {
-    const char *path;
-    unsigned int id;
+    std::string path;
+    // - index in the MaterialLibrary
+    int material;
     std::string type;
 };
 
@@ -39,7 +42,9 @@ public:
     aiScene* _scene;
     Assimp::Importer* _importer;
     std::string directory;
-    AssetLoader():mIsInitialized(false),_scene(nullptr){
+    // - receives the material images
+    MaterialLibrary* materials;
+    AssetLoader():mIsInitialized(false),_scene(nullptr),materials(nullptr){
         _importer = new Assimp::Importer();
         _importer->SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE,0);
         _importer->GetErrorString();
@@ -0,0 +1,56 @@
+#ifndef CPUFEATURES_H
+#define CPUFEATURES_H
+
+/******************************************************************************
+ * SIMD code paths chosen at run time
+ *
+ * With the LMG_USE_AVX2 option the AVX2 functions are compiled in, each one
+ * marked with LMG_TARGET_AVX2: only their own code uses AVX2 instructions,
+ * the rest of the program stays baseline x86-64. Callers take them when
+ * cpuHasAvx2() says so, and the scalar paths otherwise.
+ ******************************************************************************/
+#if defined( LMG_USE_AVX2 ) && ( defined( __x86_64__ ) || defined( __i386__ ) || defined( _M_X64 ) || defined( _M_IX86 ) )
+#define LMG_HAS_AVX2_PATH 1
+#endif
+
+#ifdef LMG_HAS_AVX2_PATH
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#if defined( __GNUC__ ) || defined( __clang__ )
+#define LMG_TARGET_AVX2 __attribute__(( target( "avx2" ) ))
+#else
+#define LMG_TARGET_AVX2
+#endif
+#endif
+
+// - the CPU (and the OS) run AVX2 instructions
+inline bool cpuHasAvx2()
+{
+#if !defined( LMG_HAS_AVX2_PATH )
+    return false;
+#elif defined( __GNUC__ ) || defined( __clang__ )
+    static const bool hasAvx2 = __builtin_cpu_supports( "avx2" );
+    return hasAvx2;
+#elif defined( _MSC_VER )
+    static const bool hasAvx2 = []()
+    {
+        int info[ 4 ];
+        __cpuid( info, 1 );
+        // - OSXSAVE and AVX, then the OS saves the YMM registers
+        if ( ( info[ 2 ] & ( 1 << 27 ) ) == 0 || ( info[ 2 ] & ( 1 << 28 ) ) == 0 )
+            return false;
+        if ( ( _xgetbv( 0 ) & 6 ) != 6 )
+            return false;
+        __cpuidex( info, 7, 0 );
+        return ( info[ 1 ] & ( 1 << 5 ) ) != 0;
+    }();
+    return hasAvx2;
+#else
+    return false;
+#endif
+}
+
+#endif
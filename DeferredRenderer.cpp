@@ -0,0 +1,410 @@
+#include "DeferredRenderer.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+
+#include "ShaderProgram.h"
+#include "GLStateCache.h"
+
+DeferredRenderer::DeferredRenderer(){
+    width = 0;
+    height = 0;
+
+    mLightTexture = 0;
+    mTileTexture = 0;
+    mLightIndexTexture = 0;
+    tileTextureWidth = 0;
+    tileTextureHeight = 0;
+    lightIndexTextureHeight = 0;
+
+    mLightingShaderProgram = 0;
+    mFullScreenVertexArray = 0;
+
+    ambientColor = glm::vec3( 0.05f, 0.05f, 0.08f );
+    mainLightPosition = glm::vec3( 0.f, 10.f, 0.f );
+    mainLightColor = glm::vec3( 0.1f, 0.1f, 0.15f );
+
+    numberOfVisibleLights = 0;
+    numberOfLightTileEntries = 0;
+}
+
+bool DeferredRenderer::initializeDeferredRenderer(){
+    bool statusOK = true;
+
+    std::cout << "Initialize deferred renderer..." << std::endl;
+
+    if ( statusOK )
+    {
+        statusOK = initializeLightTextures();
+    }
+
+    if ( statusOK )
+    {
+        statusOK = initializeShaderProgram();
+    }
+
+    return statusOK;
+}
+
+/******************************************************************************
+ * Declare the G-buffer textures
+ * - albedo (RGBA8), eye-space normal (RGB10_A2, packed in [0,1]) and depth
+ ******************************************************************************/
+void DeferredRenderer::declareGBuffer( RenderGraph& renderGraph )
+{
+    renderGraph.addTransientTexture( "gbuffer albedo", GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE );
+    renderGraph.addTransientTexture( "gbuffer normal", GL_RGB10_A2, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV );
+    renderGraph.addTransientTexture( "gbuffer depth", GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT );
+}
+
+/******************************************************************************
+ * Initialize light textures
+ * - lights: 2 texels per light (eye-space position + radius, color)
+ * - tiles: (offset,count) in the light index list
+ ******************************************************************************/
+bool DeferredRenderer::initializeLightTextures()
+{
+    bool statusOK = true;
+
+    std::cout << "- initialize light textures..." << std::endl;
+
+    glGenTextures( 1, &mLightTexture );
+    glBindTexture( GL_TEXTURE_2D, mLightTexture );
+    glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA32F, 2 * MaxLights, 1, 0, GL_RGBA, GL_FLOAT, nullptr );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+
+    glGenTextures( 1, &mTileTexture );
+    glGenTextures( 1, &mLightIndexTexture );
+    lightIndexTextureHeight = 0;
+
+    glBindTexture( GL_TEXTURE_2D, 0 );
+
+    return statusOK;
+}
+
+/******************************************************************************
+ * Initialize shader program
+ ******************************************************************************/
+bool DeferredRenderer::initializeShaderProgram()
+{
+    glGenVertexArrays( 1, &mFullScreenVertexArray );
+
+    // Vertex shader: full-screen triangle generated from the vertex ID
+    const char* vertexShaderSource =
+        "#version 300 es\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    vec2 position = vec2( float( ( gl_VertexID & 1 ) << 2 ) - 1.0, float( ( gl_VertexID & 2 ) << 1 ) - 1.0 );\n"
+        "    gl_Position = vec4( position, 0.0, 1.0 );\n"
+        "}\n";
+
+    // Fragment shader
+    const char* fragmentShaderSource =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "precision highp int;\n"
+        "precision highp usampler2D;\n"
+        "\n"
+        "// UNIFORM\n"
+        "// - G-buffer\n"
+        "uniform sampler2D albedoTexture;\n"
+        "uniform sampler2D normalTexture;\n"
+        "uniform sampler2D depthTexture;\n"
+        "uniform mat4 inverseProjectionMatrix;\n"
+        "// - rendered area of the G-buffer (dynamic resolution)\n"
+        "uniform vec2 viewportSize;\n"
+        "// - light lists\n"
+        "uniform sampler2D lightTexture;\n"
+        "uniform usampler2D tileTexture;\n"
+        "uniform usampler2D lightIndexTexture;\n"
+        "uniform int tileSize;\n"
+        "uniform int lightIndexTextureWidth;\n"
+        "// - lighting not binned to tiles\n"
+        "uniform vec3 ambientColor;\n"
+        "uniform vec3 eyeMainLightPosition;\n"
+        "uniform vec3 mainLightColor;\n"
+        "\n"
+        "// OUTPUT\n"
+        "layout( location = 0 ) out vec4 fragmentColor;\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    ivec2 pixel = ivec2( gl_FragCoord.xy );\n"
+        "    float depth = texelFetch( depthTexture, pixel, 0 ).r;\n"
+        "    // Nothing rendered here: keep the skybox\n"
+        "    if ( depth >= 1.0 )\n"
+        "        discard;\n"
+        "\n"
+        "    // Eye-space position from depth\n"
+        "    vec2 ndc = ( gl_FragCoord.xy / viewportSize ) * 2.0 - 1.0;\n"
+        "    vec4 eyePosition = inverseProjectionMatrix * vec4( ndc, depth * 2.0 - 1.0, 1.0 );\n"
+        "    eyePosition /= eyePosition.w;\n"
+        "\n"
+        "    vec3 albedo = texelFetch( albedoTexture, pixel, 0 ).rgb;\n"
+        "    vec3 N = normalize( texelFetch( normalTexture, pixel, 0 ).xyz * 2.0 - 1.0 );\n"
+        "\n"
+        "    vec3 color = ambientColor * albedo;\n"
+        "    vec3 L = normalize( eyeMainLightPosition - eyePosition.xyz );\n"
+        "    color += mainLightColor * albedo * max( 0.0, dot( N, L ) );\n"
+        "\n"
+        "    // Point lights of this tile\n"
+        "    uvec2 tile = texelFetch( tileTexture, pixel / tileSize, 0 ).xy;\n"
+        "    for ( uint i = 0u; i < tile.y; ++i )\n"
+        "    {\n"
+        "        int entry = int( tile.x + i );\n"
+        "        int light = int( texelFetch( lightIndexTexture, ivec2( entry % lightIndexTextureWidth, entry / lightIndexTextureWidth ), 0 ).r );\n"
+        "        vec4 lightPosition = texelFetch( lightTexture, ivec2( 2 * light, 0 ), 0 );\n"
+        "        vec3 lightColor = texelFetch( lightTexture, ivec2( 2 * light + 1, 0 ), 0 ).rgb;\n"
+        "        vec3 toLight = lightPosition.xyz - eyePosition.xyz;\n"
+        "        float d = length( toLight );\n"
+        "        if ( d < lightPosition.w )\n"
+        "        {\n"
+        "            // Windowed inverse square falloff, reaches 0 at the light radius\n"
+        "            float f = d / lightPosition.w;\n"
+        "            float window = clamp( 1.0 - f * f * f * f, 0.0, 1.0 );\n"
+        "            float attenuation = window * window / ( 1.0 + d * d );\n"
+        "            color += lightColor * albedo * max( 0.0, dot( N, toLight / d ) ) * attenuation;\n"
+        "        }\n"
+        "    }\n"
+        "\n"
+        "    fragmentColor = vec4( color, 1.0 );\n"
+        "    gl_FragDepth = depth;\n"
+        "}\n";
+
+    mLightingShaderProgram = ShaderProgram::create( vertexShaderSource, fragmentShaderSource, "deferred lighting" );
+
+    return mLightingShaderProgram != 0;
+}
+
+/******************************************************************************
+ * Rendered area of the G-buffer (light tiles, eye position of the pixels)
+ ******************************************************************************/
+void DeferredRenderer::resize( int pWidth, int pHeight )
+{
+    width = pWidth;
+    height = pHeight;
+
+    // Tile texture large enough for the tiles of the rendered area
+    // - a smaller area (dynamic resolution) only uses its first tiles
+    const int tilesX = ( width + TileSize - 1 ) / TileSize;
+    const int tilesY = ( height + TileSize - 1 ) / TileSize;
+    if ( tilesX > tileTextureWidth || tilesY > tileTextureHeight )
+    {
+        tileTextureWidth = std::max( tilesX, tileTextureWidth );
+        tileTextureHeight = std::max( tilesY, tileTextureHeight );
+        GLStateCache::bindTexture( 4, GL_TEXTURE_2D, mTileTexture );
+        glTexImage2D( GL_TEXTURE_2D, 0, GL_RG32UI, tileTextureWidth, tileTextureHeight, 0, GL_RG_INTEGER, GL_UNSIGNED_INT, nullptr );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+    }
+}
+
+/******************************************************************************
+ * Geometry pass: terrain and models are drawn after this call
+ * - the G-buffer framebuffer is bound by the render graph
+ ******************************************************************************/
+void DeferredRenderer::beginGeometryPass()
+{
+    glClearColor( 0.f, 0.f, 0.f, 0.f );
+    glClearDepth( 1.f );
+    glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+}
+
+/******************************************************************************
+ * Bin lights to screen tiles
+ *
+ * Lights are sent to eye-space, the screen rectangle of their bounding cube
+ * gives the tiles they touch. Tile lists are built with a counting sort so
+ * no memory is allocated once the arrays have grown.
+ ******************************************************************************/
+void DeferredRenderer::binLights( const std::vector< PointLight >& lights, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix )
+{
+    const int tilesX = ( width + TileSize - 1 ) / TileSize;
+    const int tilesY = ( height + TileSize - 1 ) / TileSize;
+    const int numberOfLights = std::min( static_cast< int >( lights.size() ), static_cast< int >( MaxLights ) );
+
+    // Near plane distance from the projection matrix
+    const float zNear = projectionMatrix[ 3 ][ 2 ] / ( projectionMatrix[ 2 ][ 2 ] - 1.f );
+
+    lightData.resize( 2 * numberOfLights );
+    lightTiles.resize( numberOfLights );
+    tileData.assign( 2 * tilesX * tilesY, 0 );
+
+    numberOfVisibleLights = 0;
+    for ( int l = 0; l < numberOfLights; ++l )
+    {
+        const PointLight& light = lights[ l ];
+        const glm::vec3 center = glm::vec3( viewMatrix * glm::vec4( light.position, 1.f ) );
+        const float r = light.radius;
+
+        lightData[ 2 * l ] = glm::vec4( center, r );
+        lightData[ 2 * l + 1 ] = glm::vec4( light.color, 0.f );
+
+        // - behind the camera
+        glm::ivec4& rect = lightTiles[ l ];
+        rect = glm::ivec4( 0, 0, -1, -1 );
+        if ( center.z - r > -zNear )
+        {
+            continue;
+        }
+
+        // - crossing the near plane: full screen, otherwise project the bounding cube
+        glm::vec2 ndcMin( -1.f );
+        glm::vec2 ndcMax( 1.f );
+        if ( center.z + r < -zNear )
+        {
+            ndcMin = glm::vec2( 1.f );
+            ndcMax = glm::vec2( -1.f );
+            for ( int corner = 0; corner < 8; ++corner )
+            {
+                const glm::vec4 p = projectionMatrix * glm::vec4( center + r * glm::vec3( ( corner & 1 ) ? 1.f : -1.f, ( corner & 2 ) ? 1.f : -1.f, ( corner & 4 ) ? 1.f : -1.f ), 1.f );
+                const glm::vec2 ndc = glm::vec2( p ) / p.w;
+                ndcMin = glm::min( ndcMin, ndc );
+                ndcMax = glm::max( ndcMax, ndc );
+            }
+            if ( ndcMax.x < -1.f || ndcMax.y < -1.f || ndcMin.x > 1.f || ndcMin.y > 1.f )
+            {
+                continue;
+            }
+        }
+
+        rect.x = std::max( 0, static_cast< int >( ( ndcMin.x * 0.5f + 0.5f ) * width ) / TileSize );
+        rect.y = std::max( 0, static_cast< int >( ( ndcMin.y * 0.5f + 0.5f ) * height ) / TileSize );
+        rect.z = std::min( tilesX - 1, static_cast< int >( ( ndcMax.x * 0.5f + 0.5f ) * width ) / TileSize );
+        rect.w = std::min( tilesY - 1, static_cast< int >( ( ndcMax.y * 0.5f + 0.5f ) * height ) / TileSize );
+
+        for ( int ty = rect.y; ty <= rect.w; ++ty )
+            for ( int tx = rect.x; tx <= rect.z; ++tx )
+                ++tileData[ 2 * ( ty * tilesX + tx ) + 1 ];
+        ++numberOfVisibleLights;
+    }
+
+    // Offsets (prefix sum of counts)
+    GLuint offset = 0;
+    for ( int tile = 0; tile < tilesX * tilesY; ++tile )
+    {
+        tileData[ 2 * tile ] = offset;
+        offset += tileData[ 2 * tile + 1 ];
+        tileData[ 2 * tile + 1 ] = 0;
+    }
+    numberOfLightTileEntries = static_cast< int >( offset );
+
+    // Fill lists
+    const int rows = std::max( 1, ( numberOfLightTileEntries + LightIndexTextureWidth - 1 ) / LightIndexTextureWidth );
+    lightIndices.resize( rows * LightIndexTextureWidth );
+    for ( int l = 0; l < numberOfLights; ++l )
+    {
+        const glm::ivec4& rect = lightTiles[ l ];
+        for ( int ty = rect.y; ty <= rect.w; ++ty )
+            for ( int tx = rect.x; tx <= rect.z; ++tx )
+            {
+                const int tile = ty * tilesX + tx;
+                lightIndices[ tileData[ 2 * tile ] + tileData[ 2 * tile + 1 ]++ ] = l;
+            }
+    }
+
+    // Upload (each texture on the unit it is sampled from)
+    GLStateCache::bindTexture( 3, GL_TEXTURE_2D, mLightTexture );
+    if ( numberOfLights > 0 )
+    {
+        glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, 2 * numberOfLights, 1, GL_RGBA, GL_FLOAT, lightData.data() );
+    }
+
+    GLStateCache::bindTexture( 4, GL_TEXTURE_2D, mTileTexture );
+    glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, tilesX, tilesY, GL_RG_INTEGER, GL_UNSIGNED_INT, tileData.data() );
+
+    GLStateCache::bindTexture( 5, GL_TEXTURE_2D, mLightIndexTexture );
+    if ( rows > lightIndexTextureHeight )
+    {
+        lightIndexTextureHeight = rows;
+        glTexImage2D( GL_TEXTURE_2D, 0, GL_R32UI, LightIndexTextureWidth, rows, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, lightIndices.data() );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+    }
+    else
+    {
+        glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, LightIndexTextureWidth, rows, GL_RED_INTEGER, GL_UNSIGNED_INT, lightIndices.data() );
+    }
+}
+
+/******************************************************************************
+ * Lighting pass: shade the G-buffer into the current framebuffer
+ ******************************************************************************/
+void DeferredRenderer::lightingPass( const std::vector< PointLight >& lights, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix,
+                                     GLuint albedoTexture, GLuint normalTexture, GLuint depthTexture )
+{
+    binLights( lights, viewMatrix, projectionMatrix );
+
+    GLint uniformLocation;
+
+    GLStateCache::useProgram( mLightingShaderProgram );
+
+    // G-buffer depth is written back so that later passes are depth tested against the scene
+    GLStateCache::depthFunc( GL_ALWAYS );
+
+    const GLuint textures[] = { albedoTexture, normalTexture, depthTexture, mLightTexture, mTileTexture, mLightIndexTexture };
+    const char* samplers[] = { "albedoTexture", "normalTexture", "depthTexture", "lightTexture", "tileTexture", "lightIndexTexture" };
+    for ( int unit = 0; unit < 6; ++unit )
+    {
+        GLStateCache::bindTexture( unit, GL_TEXTURE_2D, textures[ unit ] );
+        uniformLocation = glGetUniformLocation( mLightingShaderProgram, samplers[ unit ] );
+        if ( uniformLocation >= 0 )
+        {
+            glUniform1i( uniformLocation, unit );
+        }
+    }
+
+    uniformLocation = glGetUniformLocation( mLightingShaderProgram, "inverseProjectionMatrix" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniformMatrix4fv( uniformLocation, 1, GL_FALSE, glm::value_ptr( glm::inverse( projectionMatrix ) ) );
+    }
+    uniformLocation = glGetUniformLocation( mLightingShaderProgram, "viewportSize" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform2f( uniformLocation, static_cast< float >( width ), static_cast< float >( height ) );
+    }
+    uniformLocation = glGetUniformLocation( mLightingShaderProgram, "tileSize" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1i( uniformLocation, TileSize );
+    }
+    uniformLocation = glGetUniformLocation( mLightingShaderProgram, "lightIndexTextureWidth" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1i( uniformLocation, LightIndexTextureWidth );
+    }
+    uniformLocation = glGetUniformLocation( mLightingShaderProgram, "ambientColor" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform3fv( uniformLocation, 1, glm::value_ptr( ambientColor ) );
+    }
+    uniformLocation = glGetUniformLocation( mLightingShaderProgram, "eyeMainLightPosition" );
+    if ( uniformLocation >= 0 )
+    {
+        const glm::vec3 eyeMainLightPosition = glm::vec3( viewMatrix * glm::vec4( mainLightPosition, 1.f ) );
+        glUniform3fv( uniformLocation, 1, glm::value_ptr( eyeMainLightPosition ) );
+    }
+    uniformLocation = glGetUniformLocation( mLightingShaderProgram, "mainLightColor" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform3fv( uniformLocation, 1, glm::value_ptr( mainLightColor ) );
+    }
+
+    // Draw command
+    GLStateCache::bindVertexArray( mFullScreenVertexArray );
+    glDrawArrays( GL_TRIANGLES, 0, 3 );
+
+    // Reset GL state(s)
+    // - G-buffer textures are render targets again next frame
+    for ( int unit = 0; unit < 3; ++unit )
+    {
+        GLStateCache::bindTexture( unit, GL_TEXTURE_2D, 0 );
+    }
+    GLStateCache::depthFunc( GL_LESS );
+}
@@ -0,0 +1,91 @@
+#ifndef DEFERREDRENDERER_H
+#define DEFERREDRENDERER_H
+
+// STL
+#include <iostream>
+#include <vector>
+
+// Graphics
+// - GLEW (always before "gl.h")
+#include <GL/glew.h>
+// - GL
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+
+// glm
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "PointLight.h"
+#include "RenderGraph.h"
+
+/******************************************************************************
+ * Deferred shading path
+ *
+ * Geometry pass: terrain and models write albedo, eye-space normal and depth
+ * into a G-buffer (transient textures of the render graph, see
+ * declareGBuffer()). Lighting pass: one full-screen triangle where each pixel
+ * only loops over the lights binned (on CPU) to its screen tile, so the cost
+ * follows the screen coverage of the lights, not lights x objects.
+ ******************************************************************************/
+class DeferredRenderer{
+public:
+    // - light binning
+    static const int TileSize = 16;
+    static const int MaxLights = 1024;
+    static const int LightIndexTextureWidth = 1024;
+
+    // - rendered area of the G-buffer
+    int width;
+    int height;
+
+    // - light lists
+    GLuint mLightTexture;
+    GLuint mTileTexture;
+    GLuint mLightIndexTexture;
+    // - allocated sizes (grown, never shrunk: tiles and rows are sub-images)
+    int tileTextureWidth;
+    int tileTextureHeight;
+    int lightIndexTextureHeight;
+
+    // - shader
+    GLuint mLightingShaderProgram;
+    GLuint mFullScreenVertexArray;
+
+    // - lighting not binned to tiles
+    glm::vec3 ambientColor;
+    glm::vec3 mainLightPosition;
+    glm::vec3 mainLightColor;
+
+    // - statistics of the last frame
+    int numberOfVisibleLights;
+    int numberOfLightTileEntries;
+
+    DeferredRenderer();
+
+    // Methode d'initialisation
+    bool initializeDeferredRenderer();
+    bool initializeLightTextures();
+    bool initializeShaderProgram();
+
+    // - "gbuffer albedo", "gbuffer normal" and "gbuffer depth"
+    static void declareGBuffer( RenderGraph& renderGraph );
+
+    void resize( int pWidth, int pHeight );
+    void beginGeometryPass();
+    void lightingPass( const std::vector< PointLight >& lights, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix,
+                       GLuint albedoTexture, GLuint normalTexture, GLuint depthTexture );
+
+private:
+    std::vector< glm::vec4 > lightData;
+    std::vector< GLuint > tileData;
+    std::vector< GLuint > lightIndices;
+    std::vector< glm::ivec4 > lightTiles;
+
+    void binLights( const std::vector< PointLight >& lights, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix );
+};
+
+#endif
@@ -0,0 +1,305 @@
+#include "DynamicResolution.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+
+#include "ShaderProgram.h"
+#include "GLStateCache.h"
+
+DynamicResolution::DynamicResolution(){
+    enabled = true;
+    supported = false;
+
+    minimumScale = 0.5f;
+    maximumScale = 1.f;
+    frameTimeBudget = 14.f;
+    adjustInterval = 8;
+    sharpness = 0.5f;
+
+    scale = 1.f;
+    renderWidth = 0;
+    renderHeight = 0;
+
+    gpuFrameTime = 0.f;
+
+    mUpscaleShaderProgram = 0;
+    mFullScreenVertexArray = 0;
+
+    for ( int q = 0; q < NumberOfQueries; ++q )
+    {
+        timerQueries[ q ] = 0;
+        queryIssued[ q ] = false;
+    }
+    queryIndex = 0;
+    queryActive = false;
+    framesSinceAdjustment = 0;
+}
+
+bool DynamicResolution::initializeDynamicResolution(){
+    bool statusOK = true;
+
+    std::cout << "Initialize dynamic resolution..." << std::endl;
+
+    // Without timer queries the scene is rendered at the window resolution
+    supported = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+    if ( supported )
+    {
+        glGenQueries( NumberOfQueries, timerQueries );
+    }
+    else
+    {
+        std::cout << "- timer queries not supported: fixed resolution" << std::endl;
+    }
+
+    if ( statusOK )
+    {
+        statusOK = initializeShaderProgram();
+    }
+
+    return statusOK;
+}
+
+/******************************************************************************
+ * Declare the scene textures
+ * - color (RGBA16F, HDR) and depth of the 3D scene, rendered in the scaled viewport
+ ******************************************************************************/
+void DynamicResolution::declareSceneTarget( RenderGraph& renderGraph )
+{
+    renderGraph.addTransientTexture( "scene color", GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT );
+    renderGraph.addTransientTexture( "scene depth", GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT );
+}
+
+/******************************************************************************
+ * Initialize shader program
+ ******************************************************************************/
+bool DynamicResolution::initializeShaderProgram()
+{
+    glGenVertexArrays( 1, &mFullScreenVertexArray );
+
+    // Vertex shader: full-screen triangle generated from the vertex ID
+    const char* vertexShaderSource =
+        "#version 300 es\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    vec2 position = vec2( float( ( gl_VertexID & 1 ) << 2 ) - 1.0, float( ( gl_VertexID & 2 ) << 1 ) - 1.0 );\n"
+        "    gl_Position = vec4( position, 0.0, 1.0 );\n"
+        "}\n";
+
+    // Fragment shader
+    const char* fragmentShaderSource =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "precision highp int;\n"
+        "\n"
+        "// UNIFORM\n"
+        "uniform sampler2D colorTexture;\n"
+        "uniform sampler2D depthTexture;\n"
+        "// - rendered area of the scene textures (texels), window size (pixels)\n"
+        "uniform vec2 renderSize;\n"
+        "uniform vec2 outputSize;\n"
+        "uniform float sharpness;\n"
+        "\n"
+        "// OUTPUT\n"
+        "layout( location = 0 ) out vec4 fragmentColor;\n"
+        "\n"
+        "// - scene texel, clamped to the rendered area\n"
+        "ivec2 texel( ivec2 t )\n"
+        "{\n"
+        "    return clamp( t, ivec2( 0 ), ivec2( renderSize ) - 1 );\n"
+        "}\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    // Position in the rendered area (texel centers at integers)\n"
+        "    vec2 position = gl_FragCoord.xy * renderSize / outputSize - 0.5;\n"
+        "    ivec2 base = ivec2( floor( position ) );\n"
+        "    vec2 f = position - vec2( base );\n"
+        "\n"
+        "    // Bilinear filter over the texels covered by the scene (the sky is already drawn)\n"
+        "    vec3 color = vec3( 0.0 );\n"
+        "    float weight = 0.0;\n"
+        "    // - bounds of the covered texels (HDR: no limit but the half float range)\n"
+        "    vec3 lowest = vec3( 65504.0 );\n"
+        "    vec3 highest = vec3( -65504.0 );\n"
+        "    for ( int t = 0; t < 4; ++t )\n"
+        "    {\n"
+        "        ivec2 offset = ivec2( t & 1, t >> 1 );\n"
+        "        ivec2 p = texel( base + offset );\n"
+        "        float d = texelFetch( depthTexture, p, 0 ).r;\n"
+        "        if ( d < 1.0 )\n"
+        "        {\n"
+        "            vec3 c = texelFetch( colorTexture, p, 0 ).rgb;\n"
+        "            float w = mix( 1.0 - f.x, f.x, float( offset.x ) ) * mix( 1.0 - f.y, f.y, float( offset.y ) );\n"
+        "            color += w * c;\n"
+        "            weight += w;\n"
+        "            lowest = min( lowest, c );\n"
+        "            highest = max( highest, c );\n"
+        "        }\n"
+        "    }\n"
+        "    if ( weight <= 0.0 )\n"
+        "        discard;\n"
+        "    color /= weight;\n"
+        "\n"
+        "    // Unsharp mask at the nearest texel, clamped to the filtered texels (no halo)\n"
+        "    ivec2 nearest = texel( ivec2( floor( position + 0.5 ) ) );\n"
+        "    vec3 center = texelFetch( colorTexture, nearest, 0 ).rgb;\n"
+        "    vec3 blur = 0.25 * ( texelFetch( colorTexture, texel( nearest + ivec2( 1, 0 ) ), 0 ).rgb\n"
+        "                       + texelFetch( colorTexture, texel( nearest - ivec2( 1, 0 ) ), 0 ).rgb\n"
+        "                       + texelFetch( colorTexture, texel( nearest + ivec2( 0, 1 ) ), 0 ).rgb\n"
+        "                       + texelFetch( colorTexture, texel( nearest - ivec2( 0, 1 ) ), 0 ).rgb );\n"
+        "    color = clamp( color + sharpness * ( center - blur ), lowest, highest );\n"
+        "\n"
+        "    // Premultiplied by the coverage: edges blend with the sky\n"
+        "    fragmentColor = vec4( color * weight, weight );\n"
+        "}\n";
+
+    mUpscaleShaderProgram = ShaderProgram::create( vertexShaderSource, fragmentShaderSource, "dynamic resolution upscale" );
+
+    return mUpscaleShaderProgram != 0;
+}
+
+/******************************************************************************
+ * Frame timing
+ ******************************************************************************/
+void DynamicResolution::beginFrame( int windowWidth, int windowHeight )
+{
+    if ( enabled && supported )
+    {
+        readQueries();
+        if ( ++framesSinceAdjustment >= adjustInterval )
+        {
+            adjustScale();
+            framesSinceAdjustment = 0;
+        }
+    }
+    else
+    {
+        scale = maximumScale;
+    }
+
+    renderWidth = std::max( 1, static_cast< int >( windowWidth * scale + 0.5f ) );
+    renderHeight = std::max( 1, static_cast< int >( windowHeight * scale + 0.5f ) );
+
+    // - a query still in flight is left for a later frame
+    queryActive = false;
+    if ( enabled && supported && ! queryIssued[ queryIndex ] )
+    {
+        glBeginQuery( GL_TIME_ELAPSED, timerQueries[ queryIndex ] );
+        queryActive = true;
+    }
+}
+
+void DynamicResolution::endFrame()
+{
+    if ( ! queryActive )
+        return;
+
+    glEndQuery( GL_TIME_ELAPSED );
+    queryIssued[ queryIndex ] = true;
+    queryIndex = ( queryIndex + 1 ) % NumberOfQueries;
+    queryActive = false;
+}
+
+/******************************************************************************
+ * Read back the finished timer queries, oldest first, without waiting
+ ******************************************************************************/
+void DynamicResolution::readQueries()
+{
+    for ( int k = 0; k < NumberOfQueries; ++k )
+    {
+        const int q = ( queryIndex + k ) % NumberOfQueries;
+        if ( ! queryIssued[ q ] )
+            continue;
+
+        GLuint available = 0;
+        glGetQueryObjectuiv( timerQueries[ q ], GL_QUERY_RESULT_AVAILABLE, &available );
+        if ( ! available )
+            break;
+
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v( timerQueries[ q ], GL_QUERY_RESULT, &elapsed );
+        queryIssued[ q ] = false;
+
+        const float time = static_cast< float >( elapsed ) * 1e-6f;
+        gpuFrameTime = ( gpuFrameTime == 0.f ) ? time : gpuFrameTime + 0.25f * ( time - gpuFrameTime );
+    }
+}
+
+/******************************************************************************
+ * Scale toward the frame time budget
+ * - cost ~ scale^2: the scale fitting the budget is scale * sqrt( budget / time ),
+ *   half of the way is taken and small changes are ignored (no flickering
+ *   between two close sizes)
+ ******************************************************************************/
+void DynamicResolution::adjustScale()
+{
+    if ( gpuFrameTime <= 0.f )
+        return;
+
+    const float target = std::min( std::max( scale * std::sqrt( frameTimeBudget / gpuFrameTime ), minimumScale ), maximumScale );
+    const float change = target - scale;
+    if ( std::abs( change ) < 0.02f )
+        return;
+    scale += ( std::abs( change ) < 0.04f ) ? change : 0.5f * change;
+}
+
+/******************************************************************************
+ * Upscale pass
+ * - full-screen triangle blended over the skybox
+ ******************************************************************************/
+void DynamicResolution::upscalePass( GLuint colorTexture, GLuint depthTexture, int outputWidth, int outputHeight )
+{
+    GLint uniformLocation;
+
+    GLStateCache::useProgram( mUpscaleShaderProgram );
+    GLStateCache::depthFunc( GL_ALWAYS );
+    GLStateCache::depthMask( GL_FALSE );
+    GLStateCache::enable( GL_BLEND );
+    glBlendFunc( GL_ONE, GL_ONE_MINUS_SRC_ALPHA );
+
+    GLStateCache::bindTexture( 0, GL_TEXTURE_2D, colorTexture );
+    GLStateCache::bindTexture( 1, GL_TEXTURE_2D, depthTexture );
+    uniformLocation = glGetUniformLocation( mUpscaleShaderProgram, "colorTexture" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1i( uniformLocation, 0 );
+    }
+    uniformLocation = glGetUniformLocation( mUpscaleShaderProgram, "depthTexture" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1i( uniformLocation, 1 );
+    }
+    uniformLocation = glGetUniformLocation( mUpscaleShaderProgram, "renderSize" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform2f( uniformLocation, static_cast< float >( renderWidth ), static_cast< float >( renderHeight ) );
+    }
+    uniformLocation = glGetUniformLocation( mUpscaleShaderProgram, "outputSize" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform2f( uniformLocation, static_cast< float >( outputWidth ), static_cast< float >( outputHeight ) );
+    }
+    uniformLocation = glGetUniformLocation( mUpscaleShaderProgram, "sharpness" );
+    if ( uniformLocation >= 0 )
+    {
+        // - nothing to give back at the window resolution
+        const bool upscaled = ( renderWidth < outputWidth || renderHeight < outputHeight );
+        glUniform1f( uniformLocation, upscaled ? sharpness : 0.f );
+    }
+
+    // Draw command
+    GLStateCache::bindVertexArray( mFullScreenVertexArray );
+    glDrawArrays( GL_TRIANGLES, 0, 3 );
+
+    // Reset GL state(s)
+    // - scene textures are render targets again next frame
+    GLStateCache::bindTexture( 0, GL_TEXTURE_2D, 0 );
+    GLStateCache::bindTexture( 1, GL_TEXTURE_2D, 0 );
+    GLStateCache::disable( GL_BLEND );
+    GLStateCache::depthMask( GL_TRUE );
+    GLStateCache::depthFunc( GL_LESS );
+}
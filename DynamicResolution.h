@@ -0,0 +1,89 @@
+#ifndef DYNAMICRESOLUTION_H
+#define DYNAMICRESOLUTION_H
+
+// STL
+#include <iostream>
+
+// Graphics
+// - GLEW (always before "gl.h")
+#include <GL/glew.h>
+// - GL
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+
+#include "RenderGraph.h"
+
+/******************************************************************************
+ * Dynamic resolution
+ *
+ * The 3D scene is rendered into the "scene color" and "scene depth"
+ * transient textures (see declareSceneTarget()), in a viewport scaled from
+ * the window size; the textures keep the window size so a change of scale
+ * never reallocates them. The GPU time of the frame is measured with timer
+ * queries (read a few frames later, never waiting on the GPU) and every few
+ * frames the scale moves toward the one fitting the frame time budget, the
+ * cost being about proportional to the number of pixels (scale^2).
+ *
+ * The upscale pass resamples the scene to the window (bilinear over the
+ * covered texels only, then an unsharp mask clamped to the neighborhood to
+ * give back some of the lost detail) and blends it, premultiplied by its
+ * coverage, over the skybox drawn before at the window resolution.
+ ******************************************************************************/
+class DynamicResolution{
+public:
+    // - frames between the GPU time measure and its read back
+    static const int NumberOfQueries = 4;
+
+    bool enabled;
+    // - timer queries available
+    bool supported;
+
+    // - scale range, GPU frame time to reach (ms), frames between two adjustments
+    float minimumScale;
+    float maximumScale;
+    float frameTimeBudget;
+    int adjustInterval;
+    // - unsharp mask strength of the upscale (0: bilinear only)
+    float sharpness;
+
+    // - current scale and rendered area of the scene textures
+    float scale;
+    int renderWidth;
+    int renderHeight;
+
+    // - statistics (ms, smoothed)
+    float gpuFrameTime;
+
+    GLuint mUpscaleShaderProgram;
+    GLuint mFullScreenVertexArray;
+
+    DynamicResolution();
+
+    // Methode d'initialisation
+    bool initializeDynamicResolution();
+    bool initializeShaderProgram();
+
+    // - "scene color" and "scene depth"
+    static void declareSceneTarget( RenderGraph& renderGraph );
+
+    // - around the frame rendering: read back the finished queries, adjust the scale, time the frame
+    void beginFrame( int windowWidth, int windowHeight );
+    void endFrame();
+
+    // - scene textures blended into the bound framebuffer (window size viewport)
+    void upscalePass( GLuint colorTexture, GLuint depthTexture, int outputWidth, int outputHeight );
+
+private:
+    GLuint timerQueries[ NumberOfQueries ];
+    bool queryIssued[ NumberOfQueries ];
+    int queryIndex;
+    bool queryActive;
+    int framesSinceAdjustment;
+
+    void readQueries();
+    void adjustScale();
+};
+
+#endif
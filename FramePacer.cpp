@@ -0,0 +1,234 @@
+#include "FramePacer.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+// - GLEW (always before "gl.h"), swap control extensions
+#include <GL/glew.h>
+#ifdef _WIN32
+#include <GL/wglew.h>
+#else
+#include <GL/glxew.h>
+#endif
+
+namespace
+{
+    // - weight of the last frame in the smoothed statistics
+    const float Smoothing = 0.1f;
+    // - longer intervals are pauses of the on demand mode, not frames
+    const float PauseInterval = 250.f;
+    // - frames between two changes of the adaptive pace
+    const int PaceFrames = 30;
+
+    float milliseconds( FramePacer::Clock::duration duration )
+    {
+        return std::chrono::duration< float, std::milli >( duration ).count();
+    }
+}
+
+FramePacer::FramePacer(){
+    targetFrameRate = 60.f;
+    onDemand = true;
+    adaptive = true;
+    settleFrames = 3;
+    swapInterval = 1;
+
+    frameInterval = 0.f;
+    frameWorkTime = 0.f;
+    frameJitter = 0.f;
+    paceDivisor = 1;
+    numberOfFrames = 0;
+    numberOfIdleWaits = 0;
+
+    redrawRequested = true;
+    pendingFrames = 0;
+    paced = false;
+    hasLastFrame = false;
+    framesAtPace = 0;
+}
+
+/******************************************************************************
+ * Initialize the frame pacer (GL context current)
+ * - without swap control the driver setting is kept
+ ******************************************************************************/
+bool FramePacer::initializeFramePacer()
+{
+    std::cout << "Initialize frame pacer..." << std::endl;
+
+    if ( ! setSwapInterval( swapInterval ) )
+    {
+        std::cout << "- swap control not supported: driver vsync setting kept" << std::endl;
+    }
+
+    return true;
+}
+
+/******************************************************************************
+ * Swap interval of the current window
+ * - adaptive vsync (-1) falls back to vsync without the "tear" extension
+ ******************************************************************************/
+bool FramePacer::setSwapInterval( int interval )
+{
+#ifdef _WIN32
+    if ( ! WGLEW_EXT_swap_control )
+        return false;
+    if ( interval < 0 && ! WGLEW_EXT_swap_control_tear )
+    {
+        interval = 1;
+    }
+    if ( ! wglSwapIntervalEXT( interval ) )
+        return false;
+#else
+    if ( GLXEW_EXT_swap_control )
+    {
+        if ( interval < 0 && ! GLXEW_EXT_swap_control_tear )
+        {
+            interval = 1;
+        }
+        glXSwapIntervalEXT( glXGetCurrentDisplay(), glXGetCurrentDrawable(), interval );
+    }
+    else if ( GLXEW_MESA_swap_control )
+    {
+        interval = std::max( interval, 0 );
+        if ( glXSwapIntervalMESA( static_cast< unsigned int >( interval ) ) != 0 )
+            return false;
+    }
+    else
+    {
+        return false;
+    }
+#endif
+
+    swapInterval = interval;
+    return true;
+}
+
+void FramePacer::requestRedraw()
+{
+    redrawRequested = true;
+}
+
+/******************************************************************************
+ * Idle wait
+ * - returns false when the idle call ends without a frame: GLUT handles the
+ *   pending events then calls idle again
+ ******************************************************************************/
+bool FramePacer::wait()
+{
+    if ( redrawRequested.exchange( false ) )
+    {
+        pendingFrames = std::max( pendingFrames, settleFrames );
+    }
+
+    // Nothing changed: no frame
+    if ( onDemand && pendingFrames == 0 )
+    {
+        ++numberOfIdleWaits;
+        std::this_thread::sleep_for( std::chrono::milliseconds( IdleSleep ) );
+        return false;
+    }
+
+    // Next frame start at the current pace
+    if ( targetFrameRate > 0.f && hasLastFrame )
+    {
+        const std::chrono::duration< double > period( paceDivisor / static_cast< double >( targetFrameRate ) );
+        const Clock::time_point due = lastFrameStart + std::chrono::duration_cast< Clock::duration >( period );
+        const Clock::time_point now = Clock::now();
+        if ( now < due )
+        {
+            const Clock::time_point spinStart = due - std::chrono::milliseconds( SpinMargin );
+            if ( now + std::chrono::milliseconds( IdleSleep ) < spinStart )
+            {
+                std::this_thread::sleep_for( std::chrono::milliseconds( IdleSleep ) );
+                return false;
+            }
+            std::this_thread::sleep_until( spinStart );
+            while ( Clock::now() < due )
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    paced = true;
+    return true;
+}
+
+/******************************************************************************
+ * Frame statistics
+ ******************************************************************************/
+void FramePacer::beginFrame()
+{
+    const Clock::time_point frameStart = Clock::now();
+
+    // - frame drawn for an input callback: the scene changed
+    if ( ! paced )
+    {
+        pendingFrames = std::max( pendingFrames, settleFrames );
+    }
+    paced = false;
+    if ( pendingFrames > 0 )
+    {
+        --pendingFrames;
+    }
+
+    if ( hasLastFrame )
+    {
+        const float interval = milliseconds( frameStart - lastFrameStart );
+        if ( interval < PauseInterval )
+        {
+            if ( frameInterval == 0.f )
+            {
+                frameInterval = interval;
+            }
+            frameJitter += Smoothing * ( std::abs( interval - frameInterval ) - frameJitter );
+            frameInterval += Smoothing * ( interval - frameInterval );
+        }
+    }
+    lastFrameStart = frameStart;
+    hasLastFrame = true;
+    ++numberOfFrames;
+}
+
+void FramePacer::endFrame()
+{
+    const float workTime = milliseconds( Clock::now() - lastFrameStart );
+    frameWorkTime = ( frameWorkTime == 0.f ) ? workTime : frameWorkTime + Smoothing * ( workTime - frameWorkTime );
+
+    // Adaptive pace: slower when the frames overrun, back when they fit again with a margin
+    // - the smoothed time needs a few frames to follow a change of pace
+    ++framesAtPace;
+    if ( adaptive && targetFrameRate > 0.f )
+    {
+        const float period = 1000.f / targetFrameRate;
+        const int divisor = paceDivisor;
+        if ( frameWorkTime > 1.1f * period * paceDivisor && paceDivisor < MaximumPaceDivisor )
+        {
+            ++paceDivisor;
+        }
+        else if ( paceDivisor > 1 && frameWorkTime < 0.8f * period * ( paceDivisor - 1 ) )
+        {
+            --paceDivisor;
+        }
+        if ( framesAtPace < PaceFrames )
+        {
+            paceDivisor = divisor;
+        }
+        else if ( paceDivisor != divisor )
+        {
+            framesAtPace = 0;
+        }
+    }
+    else
+    {
+        paceDivisor = 1;
+    }
+}
+
+float FramePacer::frameRate() const
+{
+    return ( frameInterval > 0.f ) ? 1000.f / frameInterval : 0.f;
+}
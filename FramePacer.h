@@ -0,0 +1,87 @@
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+
+// STL
+#include <atomic>
+#include <chrono>
+
+/******************************************************************************
+ * Frame pacer
+ *
+ * Decides in the GLUT idle callback when the next frame is drawn, instead
+ * of redrawing as fast as possible:
+ * - on demand: nothing is drawn while the scene does not change; input,
+ *   camera motion or streaming ask for a redraw, then a few more frames are
+ *   drawn so the delayed work (feedback read back, blending) settles,
+ * - target frame rate: frames start at a fixed period, the idle wait sleeps
+ *   then spins the last moment for precision; long waits are cut in short
+ *   sleeps so the GLUT loop keeps handling the events,
+ * - adaptive: while frames do not fit in the period, the pace drops to an
+ *   integer divisor of the target (60, 30, 20...) to keep an even cadence,
+ * - swap interval (vsync) through the WGL/GLX swap control extensions.
+ *
+ * Frame times are smoothed (exponential moving average) for the statistics.
+ ******************************************************************************/
+class FramePacer{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    // - sleep of an idle call with nothing to draw, longest sleep of a wait (ms)
+    static const int IdleSleep = 10;
+    // - end of a wait spent spinning, the sleep being too coarse (ms)
+    static const int SpinMargin = 1;
+    static const int MaximumPaceDivisor = 4;
+
+    // - frames per second (0: no limit)
+    float targetFrameRate;
+    // - draw only when the scene changes
+    bool onDemand;
+    // - drop to a divisor of the target rate when frames are too slow
+    bool adaptive;
+    // - frames drawn after the last change
+    int settleFrames;
+    // - window swap interval (-1: adaptive vsync, 0: off, 1: vsync)
+    int swapInterval;
+
+    // - statistics (milliseconds, smoothed)
+    // - time between two frame starts, display() duration, deviation of the interval
+    float frameInterval;
+    float frameWorkTime;
+    float frameJitter;
+    // - current pace: target rate / paceDivisor
+    int paceDivisor;
+    long numberOfFrames;
+    long numberOfIdleWaits;
+
+    FramePacer();
+
+    // Methode d'initialisation
+    bool initializeFramePacer();
+
+    // - false when the swap control extension is missing
+    bool setSwapInterval( int interval );
+
+    // - the scene changed (any thread)
+    void requestRedraw();
+
+    // - GLUT idle: true when the next frame must be drawn now
+    bool wait();
+
+    // - around display()
+    void beginFrame();
+    void endFrame();
+
+    // - smoothed frames per second
+    float frameRate() const;
+
+private:
+    std::atomic< bool > redrawRequested;
+    int pendingFrames;
+    // - the frame was started by wait() (not by an input callback)
+    bool paced;
+    bool hasLastFrame;
+    int framesAtPace;
+    Clock::time_point lastFrameStart;
+};
+
+#endif
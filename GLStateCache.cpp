@@ -0,0 +1,260 @@
+#include "GLStateCache.h"
+
+// STL
+#include <cstring>
+
+namespace
+{
+    // -1: unknown (the next call is always sent)
+    const GLint Unknown = -1;
+
+    const GLenum TextureTargets[] = { GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_3D };
+    const int NumberOfTextureTargets = 4;
+
+    const GLenum Capabilities[] = { GL_DEPTH_TEST, GL_BLEND, GL_CULL_FACE, GL_POLYGON_OFFSET_FILL, GL_SCISSOR_TEST };
+    const int NumberOfCapabilities = 5;
+
+    GLint program = Unknown;
+    GLint vertexArray = Unknown;
+    GLint arrayBuffer = Unknown;
+    GLint framebuffer = Unknown;
+    GLint activeUnit = Unknown;
+    // - zero: default texture bound (GL initial state)
+    GLint textures[ GLStateCache::MaxTextureUnits ][ NumberOfTextureTargets ];
+    GLint viewportRectangle[ 4 ] = { Unknown, Unknown, Unknown, Unknown };
+    GLint capabilities[ NumberOfCapabilities ] = { Unknown, Unknown, Unknown, Unknown, Unknown };
+    GLint depthFunction = Unknown;
+    GLint depthWrite = Unknown;
+
+    int textureTargetIndex( GLenum target )
+    {
+        for ( int t = 0; t < NumberOfTextureTargets; ++t )
+        {
+            if ( TextureTargets[ t ] == target )
+                return t;
+        }
+        return -1;
+    }
+
+    int capabilityIndex( GLenum capability )
+    {
+        for ( int c = 0; c < NumberOfCapabilities; ++c )
+        {
+            if ( Capabilities[ c ] == capability )
+                return c;
+        }
+        return -1;
+    }
+}
+
+GLStateCache::Statistics GLStateCache::currentFrame = GLStateCache::Statistics();
+GLStateCache::Statistics GLStateCache::previousFrame = GLStateCache::Statistics();
+
+/******************************************************************************
+ * Count a call, returns true when it must be sent to the driver
+ ******************************************************************************/
+bool GLStateCache::count( Kind kind, bool redundant )
+{
+    ++currentFrame.calls[ kind ];
+    if ( redundant )
+    {
+        ++currentFrame.redundantCalls[ kind ];
+    }
+    return ! redundant;
+}
+
+void GLStateCache::bindTexture( int unit, GLenum target, GLuint texture )
+{
+    const int t = textureTargetIndex( target );
+    const bool redundant = ( t >= 0 && unit < MaxTextureUnits && textures[ unit ][ t ] == static_cast< GLint >( texture ) );
+    if ( count( Texture, redundant ) )
+    {
+        if ( activeUnit != unit )
+        {
+            glActiveTexture( GL_TEXTURE0 + unit );
+            activeUnit = unit;
+        }
+        glBindTexture( target, texture );
+        if ( t >= 0 && unit < MaxTextureUnits )
+        {
+            textures[ unit ][ t ] = static_cast< GLint >( texture );
+        }
+    }
+}
+
+void GLStateCache::useProgram( GLuint pProgram )
+{
+    if ( count( Program, program == static_cast< GLint >( pProgram ) ) )
+    {
+        glUseProgram( pProgram );
+        program = static_cast< GLint >( pProgram );
+    }
+}
+
+void GLStateCache::bindVertexArray( GLuint pVertexArray )
+{
+    if ( count( VertexArray, vertexArray == static_cast< GLint >( pVertexArray ) ) )
+    {
+        glBindVertexArray( pVertexArray );
+        vertexArray = static_cast< GLint >( pVertexArray );
+    }
+}
+
+void GLStateCache::bindArrayBuffer( GLuint buffer )
+{
+    if ( count( Buffer, arrayBuffer == static_cast< GLint >( buffer ) ) )
+    {
+        glBindBuffer( GL_ARRAY_BUFFER, buffer );
+        arrayBuffer = static_cast< GLint >( buffer );
+    }
+}
+
+void GLStateCache::bindFramebuffer( GLuint pFramebuffer )
+{
+    if ( count( Framebuffer, framebuffer == static_cast< GLint >( pFramebuffer ) ) )
+    {
+        glBindFramebuffer( GL_FRAMEBUFFER, pFramebuffer );
+        framebuffer = static_cast< GLint >( pFramebuffer );
+    }
+}
+
+void GLStateCache::viewport( GLint x, GLint y, GLsizei width, GLsizei height )
+{
+    const bool redundant = viewportRectangle[ 0 ] == x && viewportRectangle[ 1 ] == y
+                        && viewportRectangle[ 2 ] == width && viewportRectangle[ 3 ] == height;
+    if ( count( Viewport, redundant ) )
+    {
+        glViewport( x, y, width, height );
+        viewportRectangle[ 0 ] = x;
+        viewportRectangle[ 1 ] = y;
+        viewportRectangle[ 2 ] = width;
+        viewportRectangle[ 3 ] = height;
+    }
+}
+
+void GLStateCache::enable( GLenum capability )
+{
+    const int c = capabilityIndex( capability );
+    if ( count( Capability, c >= 0 && capabilities[ c ] == GL_TRUE ) )
+    {
+        glEnable( capability );
+        if ( c >= 0 )
+        {
+            capabilities[ c ] = GL_TRUE;
+        }
+    }
+}
+
+void GLStateCache::disable( GLenum capability )
+{
+    const int c = capabilityIndex( capability );
+    if ( count( Capability, c >= 0 && capabilities[ c ] == GL_FALSE ) )
+    {
+        glDisable( capability );
+        if ( c >= 0 )
+        {
+            capabilities[ c ] = GL_FALSE;
+        }
+    }
+}
+
+void GLStateCache::depthFunc( GLenum function )
+{
+    if ( count( DepthState, depthFunction == static_cast< GLint >( function ) ) )
+    {
+        glDepthFunc( function );
+        depthFunction = static_cast< GLint >( function );
+    }
+}
+
+void GLStateCache::depthMask( GLboolean mask )
+{
+    if ( count( DepthState, depthWrite == static_cast< GLint >( mask ) ) )
+    {
+        glDepthMask( mask );
+        depthWrite = static_cast< GLint >( mask );
+    }
+}
+
+void GLStateCache::invalidate()
+{
+    program = Unknown;
+    vertexArray = Unknown;
+    arrayBuffer = Unknown;
+    framebuffer = Unknown;
+    activeUnit = Unknown;
+    for ( int u = 0; u < MaxTextureUnits; ++u )
+    {
+        for ( int t = 0; t < NumberOfTextureTargets; ++t )
+        {
+            textures[ u ][ t ] = Unknown;
+        }
+    }
+    for ( int i = 0; i < 4; ++i )
+    {
+        viewportRectangle[ i ] = Unknown;
+    }
+    for ( int c = 0; c < NumberOfCapabilities; ++c )
+    {
+        capabilities[ c ] = Unknown;
+    }
+    depthFunction = Unknown;
+    depthWrite = Unknown;
+}
+
+void GLStateCache::forgetTexture( GLuint texture )
+{
+    for ( int u = 0; u < MaxTextureUnits; ++u )
+    {
+        for ( int t = 0; t < NumberOfTextureTargets; ++t )
+        {
+            if ( textures[ u ][ t ] == static_cast< GLint >( texture ) )
+            {
+                textures[ u ][ t ] = Unknown;
+            }
+        }
+    }
+}
+
+void GLStateCache::forgetFramebuffer( GLuint pFramebuffer )
+{
+    if ( framebuffer == static_cast< GLint >( pFramebuffer ) )
+    {
+        framebuffer = Unknown;
+    }
+}
+
+void GLStateCache::forgetProgram( GLuint pProgram )
+{
+    if ( program == static_cast< GLint >( pProgram ) )
+    {
+        program = Unknown;
+    }
+}
+
+void GLStateCache::beginFrame()
+{
+    previousFrame = currentFrame;
+    std::memset( &currentFrame, 0, sizeof( currentFrame ) );
+}
+
+const GLStateCache::Statistics& GLStateCache::lastFrame()
+{
+    return previousFrame;
+}
+
+void GLStateCache::printStatistics()
+{
+    const char* names[ NumberOfKinds ] = { "program", "vertex array", "texture", "buffer", "framebuffer", "viewport", "capability", "depth state" };
+
+    int calls = 0;
+    int redundantCalls = 0;
+    std::cout << "GL state changes (last frame):" << std::endl;
+    for ( int k = 0; k < NumberOfKinds; ++k )
+    {
+        std::cout << "- " << names[ k ] << ": " << previousFrame.calls[ k ] << " calls, " << previousFrame.redundantCalls[ k ] << " skipped" << std::endl;
+        calls += previousFrame.calls[ k ];
+        redundantCalls += previousFrame.redundantCalls[ k ];
+    }
+    std::cout << "- total: " << calls << " calls, " << redundantCalls << " skipped" << std::endl;
+}
@@ -0,0 +1,87 @@
+#ifndef GLSTATECACHE_H
+#define GLSTATECACHE_H
+
+// STL
+#include <iostream>
+
+// Graphics
+// - GLEW (always before "gl.h")
+#include <GL/glew.h>
+// - GL
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+
+/******************************************************************************
+ * GL state cache
+ *
+ * Thin layer over the GL state changes issued each frame (program, vertex
+ * array, texture units, framebuffer, viewport, capabilities, depth state and
+ * array buffer): calls that would not change the current state are not sent
+ * to the driver. Everything drawn each frame must go through it; code that
+ * changes the state directly (initialization) calls invalidate() afterwards.
+ * Code deleting a texture, framebuffer or program calls the matching forget
+ * function: GL hands the name out again at once, and a binding still cached
+ * for it would skip the bind of the new object.
+ *
+ * Calls and skipped calls of the current and previous frames are counted per
+ * kind of state.
+ ******************************************************************************/
+class GLStateCache{
+public:
+    static const int MaxTextureUnits = 16;
+
+    enum Kind
+    {
+        Program,
+        VertexArray,
+        Texture,
+        Buffer,
+        Framebuffer,
+        Viewport,
+        Capability,
+        DepthState,
+        NumberOfKinds
+    };
+
+    struct Statistics
+    {
+        int calls[ NumberOfKinds ];
+        int redundantCalls[ NumberOfKinds ];
+    };
+
+    // - the unit is made active only when the binding changes
+    static void bindTexture( int unit, GLenum target, GLuint texture );
+    static void useProgram( GLuint program );
+    static void bindVertexArray( GLuint vertexArray );
+    static void bindArrayBuffer( GLuint buffer );
+    static void bindFramebuffer( GLuint framebuffer );
+    static void viewport( GLint x, GLint y, GLsizei width, GLsizei height );
+    static void enable( GLenum capability );
+    static void disable( GLenum capability );
+    static void depthFunc( GLenum function );
+    static void depthMask( GLboolean mask );
+
+    // - forget the cached state (next calls are all sent)
+    static void invalidate();
+    // - deleted objects: bindings of these names are forgotten
+    static void forgetTexture( GLuint texture );
+    static void forgetFramebuffer( GLuint framebuffer );
+    static void forgetProgram( GLuint program );
+
+    // - statistics
+    static void beginFrame();
+    static const Statistics& lastFrame();
+    static void printStatistics();
+
+    GLStateCache() = delete;
+
+private:
+    static Statistics currentFrame;
+    static Statistics previousFrame;
+
+    static bool count( Kind kind, bool redundant );
+};
+
+#endif
@@ -0,0 +1,170 @@
+#include "GroundPlacement.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+
+#include "CpuFeatures.h"
+
+namespace
+{
+    // Bilinear height and slopes (per grid cell) at one position
+    void sampleOne( const float* heights, int nb, float x, float z, float& height, float& slopeJ, float& slopeI )
+    {
+        const float gj = std::min( std::max( ( x + 1.f ) * 0.5f * nb, 0.f ), static_cast< float >( nb - 1 ) );
+        const float gi = std::min( std::max( ( z + 1.f ) * 0.5f * nb, 0.f ), static_cast< float >( nb - 1 ) );
+        const int j = std::min( static_cast< int >( gj ), nb - 2 );
+        const int i = std::min( static_cast< int >( gi ), nb - 2 );
+        const float fj = gj - j;
+        const float fi = gi - i;
+
+        const float* h = heights + j * nb + i;
+        const float h00 = h[ 0 ];
+        const float h01 = h[ 1 ];
+        const float h10 = h[ nb ];
+        const float h11 = h[ nb + 1 ];
+
+        const float h0 = h00 + ( h01 - h00 ) * fi;
+        const float h1 = h10 + ( h11 - h10 ) * fi;
+        height = h0 + ( h1 - h0 ) * fj;
+        slopeJ = h1 - h0;
+        slopeI = ( h01 - h00 ) + ( ( h11 - h10 ) - ( h01 - h00 ) ) * fj;
+    }
+
+#ifdef LMG_HAS_AVX2_PATH
+    // 8 positions per step, returns the number of positions done (a multiple of 8)
+    LMG_TARGET_AVX2
+    int sampleGroundAvx2( const float* grid, int nb, const float* x, const float* z, int count, float* heights, glm::vec3* normals )
+    {
+        int n = 0;
+        const __m256 toGrid = _mm256_set1_ps( 0.5f * nb );
+        const __m256 one = _mm256_set1_ps( 1.f );
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 last = _mm256_set1_ps( static_cast< float >( nb - 1 ) );
+        const __m256i lastCell = _mm256_set1_epi32( nb - 2 );
+        const __m256i rowSize = _mm256_set1_epi32( nb );
+        const __m256i nextColumn = _mm256_set1_epi32( 1 );
+        for ( ; n + 8 <= count; n += 8 )
+        {
+            const __m256 gj = _mm256_min_ps( _mm256_max_ps( _mm256_mul_ps( _mm256_add_ps( _mm256_loadu_ps( x + n ), one ), toGrid ), zero ), last );
+            const __m256 gi = _mm256_min_ps( _mm256_max_ps( _mm256_mul_ps( _mm256_add_ps( _mm256_loadu_ps( z + n ), one ), toGrid ), zero ), last );
+            const __m256i j = _mm256_min_epi32( _mm256_cvttps_epi32( gj ), lastCell );
+            const __m256i i = _mm256_min_epi32( _mm256_cvttps_epi32( gi ), lastCell );
+            const __m256 fj = _mm256_sub_ps( gj, _mm256_cvtepi32_ps( j ) );
+            const __m256 fi = _mm256_sub_ps( gi, _mm256_cvtepi32_ps( i ) );
+
+            const __m256i k00 = _mm256_add_epi32( _mm256_mullo_epi32( j, rowSize ), i );
+            const __m256i k10 = _mm256_add_epi32( k00, rowSize );
+            const __m256 h00 = _mm256_i32gather_ps( grid, k00, 4 );
+            const __m256 h01 = _mm256_i32gather_ps( grid, _mm256_add_epi32( k00, nextColumn ), 4 );
+            const __m256 h10 = _mm256_i32gather_ps( grid, k10, 4 );
+            const __m256 h11 = _mm256_i32gather_ps( grid, _mm256_add_epi32( k10, nextColumn ), 4 );
+
+            const __m256 d0 = _mm256_sub_ps( h01, h00 );
+            const __m256 d1 = _mm256_sub_ps( h11, h10 );
+            const __m256 h0 = _mm256_add_ps( h00, _mm256_mul_ps( d0, fi ) );
+            const __m256 h1 = _mm256_add_ps( h10, _mm256_mul_ps( d1, fi ) );
+            const __m256 slopeJ = _mm256_sub_ps( h1, h0 );
+            _mm256_storeu_ps( heights + n, _mm256_add_ps( h0, _mm256_mul_ps( slopeJ, fj ) ) );
+
+            if ( normals != nullptr )
+            {
+                const __m256 slopeI = _mm256_add_ps( d0, _mm256_mul_ps( _mm256_sub_ps( d1, d0 ), fj ) );
+                float sj[ 8 ];
+                float si[ 8 ];
+                _mm256_storeu_ps( sj, _mm256_mul_ps( slopeJ, toGrid ) );
+                _mm256_storeu_ps( si, _mm256_mul_ps( slopeI, toGrid ) );
+                for ( int l = 0; l < 8; ++l )
+                {
+                    normals[ n + l ] = glm::normalize( glm::vec3( -sj[ l ], 1.f, -si[ l ] ) );
+                }
+            }
+        }
+        return n;
+    }
+#endif
+}
+
+/******************************************************************************
+ * Sample the terrain under many positions
+ *
+ * Same parametrization as plane(): grid vertex (j,i) is at
+ * x = j / nb * 2 - 1, z = i / nb * 2 - 1; outside positions take the border.
+ ******************************************************************************/
+void GroundPlacement::sampleGround( const HeightPyramid& heightfield, const float* x, const float* z, int count, float* heights, glm::vec3* normals )
+{
+    const int nb = heightfield.gridResolution;
+    const float* grid = heightfield.heights.data();
+    // - slope per cell to slope per local unit
+    const float cellsPerUnit = 0.5f * nb;
+
+    int n = 0;
+#ifdef LMG_HAS_AVX2_PATH
+    if ( cpuHasAvx2() )
+    {
+        n = sampleGroundAvx2( grid, nb, x, z, count, heights, normals );
+    }
+#endif
+    for ( ; n < count; ++n )
+    {
+        float slopeJ;
+        float slopeI;
+        sampleOne( grid, nb, x[ n ], z[ n ], heights[ n ], slopeJ, slopeI );
+        if ( normals != nullptr )
+        {
+            normals[ n ] = glm::normalize( glm::vec3( -slopeJ * cellsPerUnit, 1.f, -slopeI * cellsPerUnit ) );
+        }
+    }
+}
+
+/******************************************************************************
+ * Transforms of instances standing on the terrain
+ * - translation to the ground point, tilt toward the normal, then yaw
+ ******************************************************************************/
+void GroundPlacement::placeInstances( const HeightPyramid& heightfield, const glm::mat4& terrainMatrix,
+                                      const std::vector< glm::vec2 >& positions, const std::vector< float >& yaws,
+                                      float normalAlignment, std::vector< glm::mat4 >& transforms )
+{
+    const int count = static_cast< int >( positions.size() );
+    const glm::mat4 toLocal = glm::inverse( terrainMatrix );
+    const glm::mat3 normalMatrix = glm::transpose( glm::inverse( glm::mat3( terrainMatrix ) ) );
+
+    // World to local positions (structure of arrays for the batch query)
+    std::vector< float > x( count );
+    std::vector< float > z( count );
+    for ( int n = 0; n < count; ++n )
+    {
+        const glm::vec4 local = toLocal * glm::vec4( positions[ n ].x, 0.f, positions[ n ].y, 1.f );
+        x[ n ] = local.x;
+        z[ n ] = local.z;
+    }
+
+    std::vector< float > heights( count );
+    std::vector< glm::vec3 > normals( count );
+    sampleGround( heightfield, x.data(), z.data(), count, heights.data(), normals.data() );
+
+    const glm::vec3 up( 0.f, 1.f, 0.f );
+    transforms.resize( count );
+    for ( int n = 0; n < count; ++n )
+    {
+        const glm::vec3 ground( terrainMatrix * glm::vec4( x[ n ], heights[ n ], z[ n ], 1.f ) );
+        glm::mat4 transform = glm::translate( glm::mat4( 1.f ), ground );
+
+        if ( normalAlignment > 0.f )
+        {
+            const glm::vec3 target = glm::normalize( glm::mix( up, glm::normalize( normalMatrix * normals[ n ] ), normalAlignment ) );
+            const glm::vec3 axis = glm::cross( up, target );
+            const float sine = glm::length( axis );
+            if ( sine > 1e-6f )
+            {
+                transform = glm::rotate( transform, std::atan2( sine, glm::dot( up, target ) ), axis / sine );
+            }
+        }
+        if ( !yaws.empty() )
+        {
+            transform = glm::rotate( transform, yaws[ n ], up );
+        }
+
+        transforms[ n ] = transform;
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef GROUNDPLACEMENT_H
+#define GROUNDPLACEMENT_H
+
+// STL
+#include <vector>
+
+// glm
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "HeightPyramid.h"
+
+/******************************************************************************
+ * Ground placement
+ *
+ * Batch queries of the terrain height and normal under many positions
+ * (bilinear interpolation of the grid heights, 8 positions per AVX2 step
+ * when the CPU has it),
+ * and transforms of instances standing on the terrain.
+ ******************************************************************************/
+class GroundPlacement{
+public:
+    GroundPlacement() = delete;
+
+    // - heights and normals under count local (x,z) positions (terrain local space)
+    static void sampleGround(
+        const HeightPyramid& heightfield,   // Grid heights
+        const float* x,                     // Local x of each position
+        const float* z,                     // Local z of each position
+        int count,
+        float* heights,                     // Output : local height
+        glm::vec3* normals                  // Output : local normal (can be null)
+    );
+
+    // - world transforms of instances standing on the terrain
+    static void placeInstances(
+        const HeightPyramid& heightfield,
+        const glm::mat4& terrainMatrix,             // Terrain model matrix (no tilt: scale, yaw, translation)
+        const std::vector< glm::vec2 >& positions,  // World (x,z) of each instance
+        const std::vector< float >& yaws,           // Rotation around the up axis (radians), or empty
+        float normalAlignment,                      // 0: upright, 1: up axis along the terrain normal
+        std::vector< glm::mat4 >& transforms        // Output : instance space (base at the origin, y up) to world
+    );
+};
+
+#endif
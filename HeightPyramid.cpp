@@ -0,0 +1,285 @@
+#include "HeightPyramid.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+    // Ray interval inside an axis aligned box, false if it misses
+    bool clipRay( const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& boxMin, const glm::vec3& boxMax, float& t0, float& t1 )
+    {
+        t0 = 0.f;
+        t1 = std::numeric_limits< float >::max();
+        for ( int a = 0; a < 3; ++a )
+        {
+            if ( direction[ a ] == 0.f )
+            {
+                if ( origin[ a ] < boxMin[ a ] || origin[ a ] > boxMax[ a ] )
+                    return false;
+                continue;
+            }
+            float tNear = ( boxMin[ a ] - origin[ a ] ) / direction[ a ];
+            float tFar = ( boxMax[ a ] - origin[ a ] ) / direction[ a ];
+            if ( tNear > tFar )
+                std::swap( tNear, tFar );
+            t0 = std::max( t0, tNear );
+            t1 = std::min( t1, tFar );
+            if ( t0 > t1 )
+                return false;
+        }
+        return true;
+    }
+
+    // Moller-Trumbore, t of the hit or a negative value
+    float intersectTriangle( const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c )
+    {
+        const glm::vec3 ab = b - a;
+        const glm::vec3 ac = c - a;
+        const glm::vec3 p = glm::cross( direction, ac );
+        const float determinant = glm::dot( ab, p );
+        if ( std::fabs( determinant ) < 1e-12f )
+            return -1.f;
+        const float inverse = 1.f / determinant;
+        const glm::vec3 s = origin - a;
+        const float u = glm::dot( s, p ) * inverse;
+        if ( u < 0.f || u > 1.f )
+            return -1.f;
+        const glm::vec3 q = glm::cross( s, ab );
+        const float v = glm::dot( direction, q ) * inverse;
+        if ( v < 0.f || u + v > 1.f )
+            return -1.f;
+        return glm::dot( ac, q ) * inverse;
+    }
+}
+
+HeightPyramid::HeightPyramid(){
+    gridResolution = 0;
+    numberOfCells = 0;
+}
+
+/******************************************************************************
+ * Build all levels
+ ******************************************************************************/
+void HeightPyramid::build( const std::vector< glm::vec3 >& points, int nb )
+{
+    gridResolution = nb;
+    numberOfCells = nb - 1;
+
+    heights.resize( nb * nb );
+    for ( int k = 0; k < nb * nb; ++k )
+    {
+        heights[ k ] = points[ k ].y;
+    }
+
+    levels.clear();
+    levelSizes.clear();
+    int size = numberOfCells;
+    while ( true )
+    {
+        levelSizes.push_back( size );
+        levels.push_back( std::vector< glm::vec2 >( size * size ) );
+        if ( size == 1 )
+            break;
+        size = ( size + 1 ) / 2;
+    }
+
+    updateNodes( 0, 0, nb - 1, nb - 1 );
+}
+
+/******************************************************************************
+ * Update the heights of a region and the nodes above it
+ ******************************************************************************/
+void HeightPyramid::update( const std::vector< glm::vec3 >& points, int j0, int i0, int j1, int i1 )
+{
+    const int nb = gridResolution;
+    for ( int j = j0; j <= j1; ++j )
+    {
+        for ( int i = i0; i <= i1; ++i )
+        {
+            heights[ j * nb + i ] = points[ j * nb + i ].y;
+        }
+    }
+
+    updateNodes( j0, i0, j1, i1 );
+}
+
+void HeightPyramid::updateNodes( int j0, int i0, int j1, int i1 )
+{
+    const int nb = gridResolution;
+
+    // Cells having a corner in the region
+    int cj0 = std::max( j0 - 1, 0 );
+    int ci0 = std::max( i0 - 1, 0 );
+    int cj1 = std::min( j1, numberOfCells - 1 );
+    int ci1 = std::min( i1, numberOfCells - 1 );
+
+    std::vector< glm::vec2 >& cells = levels[ 0 ];
+    for ( int j = cj0; j <= cj1; ++j )
+    {
+        for ( int i = ci0; i <= ci1; ++i )
+        {
+            const float h00 = heights[ j * nb + i ];
+            const float h01 = heights[ j * nb + i + 1 ];
+            const float h10 = heights[ ( j + 1 ) * nb + i ];
+            const float h11 = heights[ ( j + 1 ) * nb + i + 1 ];
+            cells[ j * numberOfCells + i ] = glm::vec2( std::min( std::min( h00, h01 ), std::min( h10, h11 ) ),
+                                                        std::max( std::max( h00, h01 ), std::max( h10, h11 ) ) );
+        }
+    }
+
+    for ( size_t l = 1; l < levels.size(); ++l )
+    {
+        cj0 /= 2;
+        ci0 /= 2;
+        cj1 /= 2;
+        ci1 /= 2;
+
+        const int size = levelSizes[ l ];
+        const int childSize = levelSizes[ l - 1 ];
+        const std::vector< glm::vec2 >& children = levels[ l - 1 ];
+        for ( int j = cj0; j <= cj1; ++j )
+        {
+            for ( int i = ci0; i <= ci1; ++i )
+            {
+                glm::vec2 bounds( std::numeric_limits< float >::max(), -std::numeric_limits< float >::max() );
+                for ( int cj = 2 * j; cj <= std::min( 2 * j + 1, childSize - 1 ); ++cj )
+                {
+                    for ( int ci = 2 * i; ci <= std::min( 2 * i + 1, childSize - 1 ); ++ci )
+                    {
+                        const glm::vec2& child = children[ cj * childSize + ci ];
+                        bounds.x = std::min( bounds.x, child.x );
+                        bounds.y = std::max( bounds.y, child.y );
+                    }
+                }
+                levels[ l ][ j * size + i ] = bounds;
+            }
+        }
+    }
+}
+
+/******************************************************************************
+ * Ray casting
+ *
+ * The ray is expressed in grid space (j, height, i), an affine change of the
+ * local space that keeps the ray parameter. From the current position the
+ * walk either skips the node (the ray is above its highest or below its
+ * lowest height until it leaves the node) and goes back up one level, or
+ * goes down one level; cells test their two triangles.
+ ******************************************************************************/
+bool HeightPyramid::intersect( const glm::vec3& origin, const glm::vec3& direction, float& distance, glm::vec3& point, glm::vec3& normal ) const
+{
+    if ( levels.empty() )
+        return false;
+
+    const float toGrid = 0.5f * gridResolution;
+    const glm::vec3 o( ( origin.x + 1.f ) * toGrid, origin.y, ( origin.z + 1.f ) * toGrid );
+    const glm::vec3 d( direction.x * toGrid, direction.y, direction.z * toGrid );
+
+    const int top = static_cast< int >( levels.size() ) - 1;
+    const glm::vec2 rootBounds = levels[ top ][ 0 ];
+    const float cells = static_cast< float >( numberOfCells );
+
+    float tEnter;
+    float tExit;
+    if ( !clipRay( o, d, glm::vec3( 0.f, rootBounds.x, 0.f ), glm::vec3( cells, rootBounds.y, cells ), tEnter, tExit ) )
+        return false;
+
+    // Step past a node border (a thousandth of a cell along the ray)
+    const float epsilon = 1e-3f / glm::length( d );
+
+    float t = tEnter;
+    int level = top;
+    while ( t <= tExit )
+    {
+        const glm::vec3 p = o + d * t;
+        const int size = 1 << level;
+        const int j = std::min( std::max( static_cast< int >( std::floor( p.x ) ), 0 ), numberOfCells - 1 ) >> level;
+        const int i = std::min( std::max( static_cast< int >( std::floor( p.z ) ), 0 ), numberOfCells - 1 ) >> level;
+        const glm::vec2& bounds = levels[ level ][ j * levelSizes[ level ] + i ];
+
+        // Where the ray leaves the node (in xz)
+        float tNodeExit = tExit;
+        if ( d.x > 0.f )
+            tNodeExit = std::min( tNodeExit, ( std::min( ( j + 1 ) * size, numberOfCells ) - o.x ) / d.x );
+        else if ( d.x < 0.f )
+            tNodeExit = std::min( tNodeExit, ( j * size - o.x ) / d.x );
+        if ( d.z > 0.f )
+            tNodeExit = std::min( tNodeExit, ( std::min( ( i + 1 ) * size, numberOfCells ) - o.z ) / d.z );
+        else if ( d.z < 0.f )
+            tNodeExit = std::min( tNodeExit, ( i * size - o.z ) / d.z );
+
+        const float yEnter = p.y;
+        const float yExit = o.y + d.y * tNodeExit;
+        const bool above = std::min( yEnter, yExit ) > bounds.y;
+        const bool below = std::max( yEnter, yExit ) < bounds.x;
+
+        if ( !above && !below )
+        {
+            if ( level > 0 )
+            {
+                --level;
+                continue;
+            }
+
+            float tHit;
+            glm::vec3 hitNormal;
+            if ( intersectCell( j, i, o, d, std::max( t - epsilon, 0.f ), tNodeExit + epsilon, tHit, hitNormal ) )
+            {
+                distance = tHit;
+                point = origin + direction * tHit;
+                normal = hitNormal;
+                return true;
+            }
+        }
+
+        if ( tNodeExit >= tExit )
+            break;
+        t = std::max( t, tNodeExit ) + epsilon;
+        if ( level < top )
+            ++level;
+    }
+
+    return false;
+}
+
+/******************************************************************************
+ * Nearest hit with the two triangles of cell (j,i) in [tMin,tMax]
+ * - same triangles as plane(), normal in local space, pointing up
+ ******************************************************************************/
+bool HeightPyramid::intersectCell( int j, int i, const glm::vec3& origin, const glm::vec3& direction, float tMin, float tMax, float& t, glm::vec3& normal ) const
+{
+    const int nb = gridResolution;
+    const glm::vec3 corner00( j, heights[ j * nb + i ], i );
+    const glm::vec3 corner01( j, heights[ j * nb + i + 1 ], i + 1 );
+    const glm::vec3 corner10( j + 1, heights[ ( j + 1 ) * nb + i ], i );
+    const glm::vec3 corner11( j + 1, heights[ ( j + 1 ) * nb + i + 1 ], i + 1 );
+
+    const glm::vec3 triangles[ 2 ][ 3 ] = {
+        { corner11, corner01, corner00 },
+        { corner11, corner00, corner10 }
+    };
+
+    bool hit = false;
+    t = tMax;
+    for ( int n = 0; n < 2; ++n )
+    {
+        const float tTriangle = intersectTriangle( origin, direction, triangles[ n ][ 0 ], triangles[ n ][ 1 ], triangles[ n ][ 2 ] );
+        if ( tTriangle >= tMin && tTriangle <= t )
+        {
+            t = tTriangle;
+            hit = true;
+
+            // Back to local space (x and z scaled by 2 / nb)
+            const float toLocal = 2.f / nb;
+            const glm::vec3 a = triangles[ n ][ 0 ] * glm::vec3( toLocal, 1.f, toLocal );
+            const glm::vec3 b = triangles[ n ][ 1 ] * glm::vec3( toLocal, 1.f, toLocal );
+            const glm::vec3 c = triangles[ n ][ 2 ] * glm::vec3( toLocal, 1.f, toLocal );
+            normal = glm::normalize( glm::cross( b - a, c - a ) );
+            if ( normal.y < 0.f )
+                normal = -normal;
+        }
+    }
+    return hit;
+}
@@ -0,0 +1,47 @@
+#ifndef HEIGHTPYRAMID_H
+#define HEIGHTPYRAMID_H
+
+// STL
+#include <vector>
+
+// glm
+#include <glm/glm.hpp>
+
+/******************************************************************************
+ * Min/max height pyramid of the terrain grid (ray casting)
+ *
+ * Level 0 stores the lowest and highest corner of each grid cell, each next
+ * level the bounds of 2x2 nodes of the previous one. A ray walks the pyramid
+ * from the root: nodes the ray crosses entirely above (or below) are skipped
+ * at once, the others are refined down to the cells, where the two triangles
+ * of plane() are intersected exactly.
+ *
+ * Space: terrain local space (x = j / nb * 2 - 1, z = i / nb * 2 - 1).
+ ******************************************************************************/
+class HeightPyramid{
+public:
+    int gridResolution;
+    int numberOfCells;
+
+    // - heights of the grid vertices (k = j * nb + i)
+    std::vector< float > heights;
+    // - per level, per node (row along j): lowest and highest height
+    std::vector< std::vector< glm::vec2 > > levels;
+    std::vector< int > levelSizes;
+
+    HeightPyramid();
+
+    // - nb x nb grid (only the first nb * nb points are read)
+    void build( const std::vector< glm::vec3 >& points, int nb );
+    // - after an edit of the grid vertices [j0,j1] x [i0,i1]
+    void update( const std::vector< glm::vec3 >& points, int j0, int i0, int j1, int i1 );
+
+    // - first hit of a local space ray: distance along the (unnormalized) direction, point and upward normal
+    bool intersect( const glm::vec3& origin, const glm::vec3& direction, float& distance, glm::vec3& point, glm::vec3& normal ) const;
+
+private:
+    void updateNodes( int j0, int i0, int j1, int i1 );
+    bool intersectCell( int j, int i, const glm::vec3& origin, const glm::vec3& direction, float tMin, float tMax, float& t, glm::vec3& normal ) const;
+};
+
+#endif
@@ -1,5 +1,64 @@
 #include "HeigthMap.h"
 
+#include <algorithm>
+#include <cmath>
+
+#include "ShaderProgram.h"
+#include "LightClusters.h"
+#include "ShadowMaps.h"
+#include "GLStateCache.h"
+
+namespace
+{
+    // Forward fragment shader, shared by the grid and tessellation programs
+    // - shadow and virtual texture code is inserted between the header and the main
+    std::string forwardFragmentShaderSource( const std::string& versionLine )
+    {
+        return versionLine +
+            "precision highp float;                           \n"
+            "                                               \n"
+            + ShadowMaps::ShaderSource
+            + VirtualTexture::ShaderSource +
+            "                                               \n"
+            "// INPUT                                       \n"
+            "in vec4 vertexColor;                                 \n"
+            "in vec3 vertexLight;\n"
+            "in vec3 shadowEyePosition;\n"
+            "in vec2 horizonUV;\n"
+            "                                               \n"
+            "// UNIFORM                                     \n"
+            "uniform vec3 meshColor;                        \n"
+            "// - sky visibility (valleys are darker)\n"
+            "uniform sampler2D horizonMap;\n"
+            "// - imagery instead of height bands\n"
+            "uniform int virtualTextureEnabled;\n"
+            "                                               \n"
+            "// OUTPUT                                      \n"
+            "layout( location = 0 ) out vec4 fragmentColor;     \n"
+            "                                                   \n"
+            "// MAIN                                        \n"
+            "void main( void )                              \n"
+            "{                                                  \n"
+            "    float skyVisibility = texture( horizonMap, horizonUV ).r;\n"
+            "    vec3 color = vertexColor.rgb;\n"
+            "    if ( virtualTextureEnabled != 0 )\n"
+            "        color = virtualTexture( horizonUV ) * vertexLight;\n"
+            "    fragmentColor = vec4( color * skyVisibility * ( 0.3 + 0.7 * cascadedShadow( shadowEyePosition ) ), vertexColor.a );\n"
+            "}                                                  \n";
+    }
+}
+
+/******************************************************************************
+ * Height of grid vertex (j,i) of a nb x nb grid, read from the heigth map image
+ ******************************************************************************/
+float HeigthMap::heigthAt( int j, int i, int nb ) const
+{
+    int x_tex = (float)j/(float)nb * (this->textureWidth-1);
+    int y_tex = (float)i/(float)nb * (this->textureHeight-1);
+
+    return (float)image[x_tex+y_tex*(this->textureHeight)]/255.f -1;
+}
+
 void HeigthMap::plane( std::vector< glm::vec3 >& points,std::vector< glm::vec3 >& normals,std::vector< GLuint >& triangleIndices, int nb )
 {
     // Position and normal arrays
@@ -16,11 +75,8 @@ void HeigthMap::plane( std::vector< glm::vec3 >& points,std::vector< glm::vec3 >
             float x = ((float)j/(float)nb)*2-1;
             float y = ((float)i/(float)nb)*2-1;
 
-            int x_tex = (float)j/(float)nb * (this->textureWidth-1);
-            int y_tex = (float)i/(float)nb * (this->textureHeight-1);
-
             // Position
-            const float h = (float)image[x_tex+y_tex*(this->textureHeight)]/255.f -1;
+            const float h = heigthAt( j, i, nb );
             //const float h = -1;
             // - store position
             points[ k ] = { x, h, y };
@@ -83,6 +139,20 @@ bool HeigthMap::initializeHeigthMap(){
         statusOK = initializeVertexArray();
     }
 
+    if ( statusOK )
+    {
+        statusOK = initializeOccluders();
+    }
+
+    if ( statusOK )
+    {
+        statusOK = initializeHorizonMap();
+    }
+
+    if ( statusOK )
+    {
+        statusOK = initializeVirtualTexture();
+    }
 
 
     if ( statusOK )
@@ -90,6 +160,21 @@ bool HeigthMap::initializeHeigthMap(){
         statusOK = initializeShaderProgram();
     }
 
+    if ( statusOK )
+    {
+        statusOK = initializeGeometryShaderProgram();
+    }
+
+    if ( statusOK )
+    {
+        statusOK = initializeClusteredShaderProgram();
+    }
+
+    if ( statusOK )
+    {
+        statusOK = initializeTessellationShaderProgram();
+    }
+
     return statusOK;
 }
 
@@ -105,12 +190,20 @@ bool HeigthMap::initializeArrayBuffer()
     // In this example, we want to display one triangle
 
     // Buffer of positions on CPU (host)
-    std::vector< glm::vec3 > points;
-    std::vector< glm::vec3 > normals;
+    // - kept for editing
+    std::vector< glm::vec3 >& points = meshPoints;
+    std::vector< glm::vec3 >& normals = meshNormals;
     std::vector< glm::vec2 > textureCoordinates;
     std::vector< GLuint > triangleIndices;
 
-    plane(points,normals,triangleIndices,500);
+    plane(points,normals,triangleIndices,gridResolution);
+
+    // Ray casting (picking, ground placement, camera collision)
+    heightPyramid.build( points, gridResolution );
+
+    // Tiles and levels of detail (replaces the full grid indices)
+    std::vector< glm::vec2 >& morphs = meshMorphs;
+    statusOK = lod.build( gridResolution, points, normals, morphs, triangleIndices );
 
 #if 0
     // Positions
@@ -147,7 +240,7 @@ bool HeigthMap::initializeArrayBuffer()
     // buffer courant a manipuler
     glBindBuffer( GL_ARRAY_BUFFER, mHeigthMapVertexBuffer );
     // definit la taille du buffer et le remplit
-    glBufferData( GL_ARRAY_BUFFER, numberOfVertices_ * sizeof( glm::vec3 ), points.data(), GL_STATIC_DRAW );
+    glBufferData( GL_ARRAY_BUFFER, numberOfVertices_ * sizeof( glm::vec3 ), points.data(), GL_DYNAMIC_DRAW );
     // buffer courant : rien
     glBindBuffer( GL_ARRAY_BUFFER, 0 );
 
@@ -165,10 +258,22 @@ bool HeigthMap::initializeArrayBuffer()
     // buffer courant a manipuler
     glBindBuffer( GL_ARRAY_BUFFER, mHeigthMapNormalBuffer);
     // definit la taille du buffer et le remplit
-    glBufferData( GL_ARRAY_BUFFER, numberOfVertices_ * sizeof( glm::vec3 ), normals.data(), GL_STATIC_DRAW );
+    glBufferData( GL_ARRAY_BUFFER, numberOfVertices_ * sizeof( glm::vec3 ), normals.data(), GL_DYNAMIC_DRAW );
     // buffer courant : rien
     glBindBuffer( GL_ARRAY_BUFFER, 0 );
 
+    // Morph buffer (height on the next coarser level, level of the vertex)
+    glGenBuffers( 1, &mHeigthMapMorphBuffer );
+    glBindBuffer( GL_ARRAY_BUFFER, mHeigthMapMorphBuffer );
+    glBufferData( GL_ARRAY_BUFFER, numberOfVertices_ * sizeof( glm::vec2 ), morphs.data(), GL_DYNAMIC_DRAW );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+    // Patches and height texture of the tessellation path (reads the grid vertices only)
+    if ( statusOK )
+    {
+        statusOK = tessellation.initializeTessellation( points, gridResolution );
+    }
+
 #if 0
     // Texture coordinates buffer
     glGenBuffers( 1, &mHeigthMapTextureCoordinateBuffer );
@@ -183,6 +288,117 @@ bool HeigthMap::initializeArrayBuffer()
     return statusOK;
 }
 
+/******************************************************************************
+ * Initialize occluders
+ *
+ * Coarse version of the grid used by the CPU occlusion buffer. Each coarse
+ * vertex takes the minimum height of the fine vertices of its neighbouring
+ * cells, so the coarse surface never hides something the real terrain shows.
+ * Built from the grid vertices (after initializeArrayBuffer()).
+ ******************************************************************************/
+bool HeigthMap::initializeOccluders()
+{
+    bool statusOK = true;
+
+    std::cout << "Initialize occluders..." << std::endl;
+
+    const int nb = gridResolution;
+    const int nbc = occluderResolution;
+
+    // Fine grid index of each coarse vertex
+    occluderFine.resize( nbc );
+    for ( int c = 0; c < nbc; ++c )
+    {
+        occluderFine[ c ] = c * ( nb - 1 ) / ( nbc - 1 );
+    }
+
+    occluderPoints.resize( nbc * nbc );
+    for ( int J = 0; J < nbc; ++J )
+    {
+        for ( int I = 0; I < nbc; ++I )
+        {
+            computeOccluderPoint( J, I );
+        }
+    }
+
+    occluderIndices.clear();
+    occluderIndices.reserve( 6 * ( nbc - 1 ) * ( nbc - 1 ) );
+    for ( int J = 1; J < nbc; ++J )
+        for ( int I = 1; I < nbc; ++I )
+        {
+            const int k = J * nbc + I;
+            occluderIndices.push_back( k );
+            occluderIndices.push_back( k - nbc );
+            occluderIndices.push_back( k - nbc - 1 );
+
+            occluderIndices.push_back( k );
+            occluderIndices.push_back( k - nbc - 1 );
+            occluderIndices.push_back( k - 1 );
+        }
+
+    return statusOK;
+}
+
+/******************************************************************************
+ * Coarse vertex (J,I): lowest grid vertex of its neighbouring coarse cells
+ ******************************************************************************/
+void HeigthMap::computeOccluderPoint( int J, int I )
+{
+    const int nb = gridResolution;
+    const int nbc = occluderResolution;
+    const std::vector< int >& fine = occluderFine;
+
+    const int j0 = fine[ std::max( J - 1, 0 ) ];
+    const int j1 = fine[ std::min( J + 1, nbc - 1 ) ];
+    const int i0 = fine[ std::max( I - 1, 0 ) ];
+    const int i1 = fine[ std::min( I + 1, nbc - 1 ) ];
+
+    float h = 1.f;
+    for ( int j = j0; j <= j1; ++j )
+        for ( int i = i0; i <= i1; ++i )
+            h = std::min( h, meshPoints[ j * nb + i ].y );
+
+    // Same parametrization as plane()
+    const float x = ((float)fine[ J ]/(float)nb)*2-1;
+    const float y = ((float)fine[ I ]/(float)nb)*2-1;
+    occluderPoints[ J * nbc + I ] = glm::vec3( x, h, y );
+}
+
+/******************************************************************************
+ * Initialize horizon map
+ * - the bake runs in the background, the result is uploaded by horizonMap.update()
+ ******************************************************************************/
+bool HeigthMap::initializeHorizonMap()
+{
+    bool statusOK = horizonMap.initializeHorizonMap();
+
+    if ( statusOK )
+    {
+        // Terrain spans [-1,1] on x and z, one image unit is 1/255 in height
+        const glm::vec3 texelSize( 2.f / textureWidth, 1.f / 255.f, 2.f / textureHeight );
+        horizonMap.startBake( image, textureWidth, textureHeight, texelSize );
+    }
+
+    return statusOK;
+}
+
+/******************************************************************************
+ * Initialize virtual texture
+ * - without imagery the terrain keeps its height bands
+ ******************************************************************************/
+bool HeigthMap::initializeVirtualTexture()
+{
+    // Cut the source imagery the first time
+    std::ifstream description( ( ImageryRepository + "/pyramid.txt" ).c_str() );
+    std::ifstream source( ImagerySource.c_str() );
+    if ( !description && source )
+    {
+        VirtualTexture::buildPyramid( ImagerySource, ImageryRepository, virtualTexture.tileSize, virtualTexture.border );
+    }
+
+    return virtualTexture.initializeVirtualTexture( ImageryRepository );
+}
+
 /******************************************************************************
  * Initialize vertex array
  ******************************************************************************/
@@ -214,6 +430,11 @@ bool HeigthMap::initializeVertexArray()
     // - enable or disable a generic vertex attribute array
     glEnableVertexAttribArray( 1/*index of the generic vertex attribute*/ );
 
+    // - LOD morph attribute
+    glBindBuffer( GL_ARRAY_BUFFER, mHeigthMapMorphBuffer );
+    glVertexAttribPointer( 3, 2, GL_FLOAT, GL_FALSE, 0, 0 );
+    glEnableVertexAttribArray( 3 );
+
     // Index buffer
     glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, mHeigthMapIndexBuffer );
 
@@ -292,13 +513,16 @@ bool HeigthMap::initializeShaderProgram()
     GLuint fragmentShader = glCreateShader( GL_FRAGMENT_SHADER );
 
     // Vertex shader
+    // - LOD morphing code is inserted after the header
     const char* vertexShaderSource[] = {
-        "#version 300 es                             \n"
+        "#version 300 es                             \n",
+        TerrainLod::ShaderSource.c_str(),
         //"#version 130                                  \n"
         "                                              \n"
         "// INPUT                                      \n"
-        "layout (location = 0) in vec3 position;     \n"
+        "layout (location = 0) in vec3 gridPosition;     \n"
         "layout (location = 1) in vec3 normal;       \n"
+        "layout (location = 3) in vec2 morph;\n"
         "                                              \n"
         "// UNIFORM                                    \n"
         "// - camera                                   \n"
@@ -319,10 +543,14 @@ bool HeigthMap::initializeShaderProgram()
         "                                              \n"
         "// OUTPUT                                     \n"
         "out vec4 vertexColor;                               \n"
+        "out vec3 vertexLight;\n"
+        "out vec3 shadowEyePosition;\n"
+        "out vec2 horizonUV;\n"
         "                                              \n"
         "// MAIN                                       \n"
         "void main( void )                             \n"
         "{                                             \n"
+        "    vec3 position = morphVertex( gridPosition, morph, modelMatrix );\n"
         "float heigth = position.y+1.0;                                       \n"
         "vec4 color = vec4(1,0,0,1);                                       \n"
         "    if(heigth<0.3)                                          \n"
@@ -345,6 +573,9 @@ bool HeigthMap::initializeShaderProgram()
         "    vec3 L = normalize( eyeLightPosition.xyz - eyePosition.xyz );                      \n"
         "    float diffuse = max( 0.0, dot( eyeNormal, L ) );                                   \n"
         "    vertexColor = vec4( lightColor, 1.0 ) * color * diffuse;                 \n"
+        "    vertexLight = lightColor * diffuse;\n"
+        "    shadowEyePosition = eyePosition.xyz;\n"
+        "    horizonUV = position.xz * 0.5 + 0.5;\n"
         //"    vertexColor = vec4( lightColor, 1.0 ) * vec4( materialKd, 1 );                 \n"
         "                                                                                       \n"
         "#if 0                                                                                 \n"
@@ -363,32 +594,14 @@ bool HeigthMap::initializeShaderProgram()
     };
 
     // Fragment shader
-    const char* fragmentShaderSource[] = {
-        "#version 300 es                             \n"
-        "precision highp float;                           \n"
-        "                                               \n"
-        "                                               \n"
-        "// INPUT                                       \n"
-        "in vec4 vertexColor;                                 \n"
-        "                                               \n"
-        "// UNIFORM                                     \n"
-        "uniform vec3 meshColor;                        \n"
-        "                                               \n"
-        "// OUTPUT                                      \n"
-        "layout( location = 0 ) out vec4 fragmentColor;     \n"
-        "                                                   \n"
-        "// MAIN                                        \n"
-        "void main( void )                              \n"
-        "{                                                  \n"
-        "    fragmentColor = vertexColor;                     \n"
-        "}                                                  \n"
-    };
+    const std::string fragmentShaderString = forwardFragmentShaderSource( "#version 300 es                             \n" );
+    const char* fragmentShaderSource = fragmentShaderString.c_str();
 
     // Load shader source
 #if 1
     // Load from string
-    glShaderSource( vertexShader, 1, vertexShaderSource, nullptr );
-    glShaderSource( fragmentShader, 1, fragmentShaderSource, nullptr );
+    glShaderSource( vertexShader, 3, vertexShaderSource, nullptr );
+    glShaderSource( fragmentShader, 1, &fragmentShaderSource, nullptr );
 #else
     // TEST
     // Load from files
@@ -397,7 +610,7 @@ bool HeigthMap::initializeShaderProgram()
     getFileContent( vertexShaderFilename, vertexShaderFileContent );
     const char* sourceCode = vertexShaderFileContent.c_str();
     glShaderSource( vertexShader, 1, &sourceCode, nullptr );
-    glShaderSource( fragmentShader, 1, fragmentShaderSource, nullptr );
+    glShaderSource( fragmentShader, 1, &fragmentShaderSource, nullptr );
 #endif
 
     glCompileShader( vertexShader );
@@ -443,3 +656,461 @@ bool HeigthMap::initializeShaderProgram()
 
     return statusOK;
 }
+
+/******************************************************************************
+ * Initialize geometry shader program (deferred shading)
+ * - same height bands as the forward shader, lighting is done per pixel later
+ ******************************************************************************/
+bool HeigthMap::initializeGeometryShaderProgram()
+{
+    // Vertex shader
+    const std::string vertexShaderSource =
+        "#version 300 es\n"
+        "\n"
+        + TerrainLod::ShaderSource +
+        "\n"
+        "// INPUT\n"
+        "layout (location = 0) in vec3 gridPosition;\n"
+        "layout (location = 1) in vec3 normal;\n"
+        "layout (location = 3) in vec2 morph;\n"
+        "\n"
+        "// UNIFORM\n"
+        "uniform mat4 viewMatrix;\n"
+        "uniform mat4 projectionMatrix;\n"
+        "uniform mat4 modelMatrix;\n"
+        "uniform mat3 normalMatrix;\n"
+        "\n"
+        "// OUTPUT\n"
+        "out vec3 albedo;\n"
+        "out vec3 eyeNormal;\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    vec3 position = morphVertex( gridPosition, morph, modelMatrix );\n"
+        "    float heigth = position.y+1.0;\n"
+        "    albedo = vec3(heigth,heigth,heigth);\n"
+        "    if(heigth<0.3)\n"
+        "       albedo = vec3(0,0,heigth);\n"
+        "    if(heigth>=0.3 && heigth < 0.6)\n"
+        "       albedo = vec3(0,heigth,0);\n"
+        "    eyeNormal = normalMatrix * normal;\n"
+        "    gl_Position = projectionMatrix * viewMatrix * modelMatrix * vec4( position, 1.0 );\n"
+        "}\n";
+
+    // Fragment shader
+    const char* fragmentShaderSource =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "\n"
+        "// INPUT\n"
+        "in vec3 albedo;\n"
+        "in vec3 eyeNormal;\n"
+        "\n"
+        "// OUTPUT\n"
+        "layout( location = 0 ) out vec4 gAlbedo;\n"
+        "layout( location = 1 ) out vec4 gNormal;\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    gAlbedo = vec4( albedo, 1.0 );\n"
+        "    gNormal = vec4( normalize( eyeNormal ) * 0.5 + 0.5, 1.0 );\n"
+        "}\n";
+
+    mHeigthMapGeometryShaderProgram = ShaderProgram::create( vertexShaderSource.c_str(), fragmentShaderSource, "heigth map geometry" );
+
+    return mHeigthMapGeometryShaderProgram != 0;
+}
+
+/******************************************************************************
+ * Initialize clustered shader program (clustered forward shading)
+ * - same height bands as the forward shader, lit per pixel by the lights of
+ *   the fragment cluster
+ ******************************************************************************/
+bool HeigthMap::initializeClusteredShaderProgram()
+{
+    // Vertex shader
+    const std::string vertexShaderSource =
+        "#version 300 es\n"
+        "\n"
+        + TerrainLod::ShaderSource +
+        "\n"
+        "// INPUT\n"
+        "layout (location = 0) in vec3 gridPosition;\n"
+        "layout (location = 1) in vec3 normal;\n"
+        "layout (location = 3) in vec2 morph;\n"
+        "\n"
+        "// UNIFORM\n"
+        "uniform mat4 viewMatrix;\n"
+        "uniform mat4 projectionMatrix;\n"
+        "uniform mat4 modelMatrix;\n"
+        "uniform mat3 normalMatrix;\n"
+        "\n"
+        "// OUTPUT\n"
+        "out vec3 albedo;\n"
+        "out vec3 eyePosition;\n"
+        "out vec3 eyeNormal;\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    vec3 position = morphVertex( gridPosition, morph, modelMatrix );\n"
+        "    float heigth = position.y+1.0;\n"
+        "    albedo = vec3(heigth,heigth,heigth);\n"
+        "    if(heigth<0.3)\n"
+        "       albedo = vec3(0,0,heigth);\n"
+        "    if(heigth>=0.3 && heigth < 0.6)\n"
+        "       albedo = vec3(0,heigth,0);\n"
+        "    vec4 eye = viewMatrix * modelMatrix * vec4( position, 1.0 );\n"
+        "    eyePosition = eye.xyz;\n"
+        "    eyeNormal = normalMatrix * normal;\n"
+        "    gl_Position = projectionMatrix * eye;\n"
+        "}\n";
+
+    // Fragment shader
+    const std::string fragmentShaderSource =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "\n"
+        + LightClusters::ShaderSource +
+        "\n"
+        "// INPUT\n"
+        "in vec3 albedo;\n"
+        "in vec3 eyePosition;\n"
+        "in vec3 eyeNormal;\n"
+        "\n"
+        "// OUTPUT\n"
+        "layout( location = 0 ) out vec4 fragmentColor;\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    fragmentColor = vec4( clusteredLighting( eyePosition, normalize( eyeNormal ), albedo ), 1.0 );\n"
+        "}\n";
+
+    mHeigthMapClusteredShaderProgram = ShaderProgram::create( vertexShaderSource.c_str(), fragmentShaderSource.c_str(), "heigth map clustered" );
+
+    return mHeigthMapClusteredShaderProgram != 0;
+}
+
+/******************************************************************************
+ * Initialize tessellation shader program (GL 4.0)
+ * - same shading as the forward shader, per generated vertex
+ * - on failure the terrain falls back to the CPU grid
+ ******************************************************************************/
+bool HeigthMap::initializeTessellationShaderProgram()
+{
+    mHeigthMapTessellationShaderProgram = 0;
+    if ( !tessellation.supported )
+    {
+        return true;
+    }
+
+    // Evaluation shader
+    const std::string evaluationShaderSource =
+        "#version 400 core\n"
+        "\n"
+        + TerrainTessellation::EvaluationShaderSource +
+        "\n"
+        "// UNIFORM\n"
+        "uniform mat4 viewMatrix;\n"
+        "uniform mat4 projectionMatrix;\n"
+        "uniform mat4 modelMatrix;\n"
+        "uniform mat3 normalMatrix;\n"
+        "uniform vec3 lightPosition;\n"
+        "uniform vec3 lightColor;\n"
+        "\n"
+        "// OUTPUT\n"
+        "out vec4 vertexColor;\n"
+        "out vec3 vertexLight;\n"
+        "out vec3 shadowEyePosition;\n"
+        "out vec2 horizonUV;\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    vec3 normal;\n"
+        "    vec3 position = patchPosition( normal );\n"
+        "    float heigth = position.y+1.0;\n"
+        "    vec4 color = vec4(heigth,heigth,heigth,1);\n"
+        "    if(heigth<0.3)\n"
+        "       color = vec4(0,0,heigth,1);\n"
+        "    if(heigth>=0.3 && heigth < 0.6)\n"
+        "       color = vec4(0,heigth,0,1);\n"
+        "    vec4 eyePosition = viewMatrix * modelMatrix * vec4( position, 1 );\n"
+        "    vec3 eyeNormal = normalize( normalMatrix * normal );\n"
+        "    vec4 eyeLightPosition = viewMatrix * vec4( lightPosition, 1 );\n"
+        "    vec3 L = normalize( eyeLightPosition.xyz - eyePosition.xyz );\n"
+        "    float diffuse = max( 0.0, dot( eyeNormal, L ) );\n"
+        "    vertexColor = vec4( lightColor, 1.0 ) * color * diffuse;\n"
+        "    vertexLight = lightColor * diffuse;\n"
+        "    shadowEyePosition = eyePosition.xyz;\n"
+        "    horizonUV = position.xz * 0.5 + 0.5;\n"
+        "    gl_Position = projectionMatrix * eyePosition;\n"
+        "}\n";
+
+    // Fragment shader
+    const std::string fragmentShaderSource = forwardFragmentShaderSource( "#version 400 core\n" );
+
+    mHeigthMapTessellationShaderProgram = ShaderProgram::create( TerrainTessellation::VertexShaderSource.c_str(),
+                                                                 TerrainTessellation::ControlShaderSource.c_str(),
+                                                                 evaluationShaderSource.c_str(),
+                                                                 fragmentShaderSource.c_str(),
+                                                                 "heigth map tessellation" );
+    if ( mHeigthMapTessellationShaderProgram == 0 )
+    {
+        std::cout << "- tessellation disabled, CPU grid only" << std::endl;
+        tessellation.supported = false;
+    }
+
+    return true;
+}
+
+/******************************************************************************
+ * Apply a brush to the height field
+ *
+ * Grid heights inside the brush disk (local xz center and radius) move by
+ * strength times a smooth falloff: up, down, toward the mean of their
+ * neighbours or toward the height under the brush center. Only the CPU copy
+ * changes here; the touched rectangle is uploaded by updateEditedRegions().
+ ******************************************************************************/
+void HeigthMap::applyBrush( BrushMode mode, const glm::vec2& center, float radius, float strength )
+{
+    const int nb = gridResolution;
+    if ( meshPoints.empty() || radius <= 0.f )
+        return;
+
+    // Same parametrization as plane(): x = j / nb * 2 - 1
+    const float cj = ( center.x + 1.f ) * 0.5f * nb;
+    const float ci = ( center.y + 1.f ) * 0.5f * nb;
+    const float r = radius * 0.5f * nb;
+
+    EditRegion region;
+    region.j0 = std::max( static_cast< int >( std::floor( cj - r ) ), 0 );
+    region.i0 = std::max( static_cast< int >( std::floor( ci - r ) ), 0 );
+    region.j1 = std::min( static_cast< int >( std::ceil( cj + r ) ), nb - 1 );
+    region.i1 = std::min( static_cast< int >( std::ceil( ci + r ) ), nb - 1 );
+    if ( region.j0 > region.j1 || region.i0 > region.i1 )
+        return;
+
+    const int centerJ = std::min( std::max( static_cast< int >( cj + 0.5f ), 0 ), nb - 1 );
+    const int centerI = std::min( std::max( static_cast< int >( ci + 0.5f ), 0 ), nb - 1 );
+    const float centerHeigth = meshPoints[ centerJ * nb + centerI ].y;
+
+    // Smoothing reads the heights before the brush
+    const EditRegion around = expand( region, 1 );
+    const int width = around.i1 - around.i0 + 1;
+    std::vector< float > before;
+    if ( mode == BrushSmooth )
+    {
+        before.resize( width * ( around.j1 - around.j0 + 1 ) );
+        for ( int j = around.j0; j <= around.j1; ++j )
+            for ( int i = around.i0; i <= around.i1; ++i )
+                before[ ( j - around.j0 ) * width + ( i - around.i0 ) ] = meshPoints[ j * nb + i ].y;
+    }
+
+    for ( int j = region.j0; j <= region.j1; ++j )
+    {
+        for ( int i = region.i0; i <= region.i1; ++i )
+        {
+            const float d2 = ( ( j - cj ) * ( j - cj ) + ( i - ci ) * ( i - ci ) ) / ( r * r );
+            if ( d2 >= 1.f )
+                continue;
+            const float weight = strength * ( 1.f - d2 ) * ( 1.f - d2 );
+
+            float& h = meshPoints[ j * nb + i ].y;
+            switch ( mode )
+            {
+            case BrushRaise:
+                h += weight;
+                break;
+            case BrushLower:
+                h -= weight;
+                break;
+            case BrushSmooth:
+            {
+                float sum = 0.f;
+                int count = 0;
+                for ( int jj = std::max( j - 1, around.j0 ); jj <= std::min( j + 1, around.j1 ); ++jj )
+                    for ( int ii = std::max( i - 1, around.i0 ); ii <= std::min( i + 1, around.i1 ); ++ii, ++count )
+                        sum += before[ ( jj - around.j0 ) * width + ( ii - around.i0 ) ];
+                h += std::min( weight, 1.f ) * ( sum / count - h );
+                break;
+            }
+            case BrushFlatten:
+                h += std::min( weight, 1.f ) * ( centerHeigth - h );
+                break;
+            default:
+                break;
+            }
+            // - the terrain stays in its [-1,1] cube
+            h = std::min( std::max( h, -1.f ), 1.f );
+        }
+    }
+
+    // Ray casting sees the edit at once (CPU only)
+    heightPyramid.update( meshPoints, region.j0, region.i0, region.j1, region.i1 );
+
+    // Merge with an overlapping pending region (a stroke touches the same area every frame)
+    for ( size_t p = 0; p < editedRegions.size(); ++p )
+    {
+        EditRegion& pending = editedRegions[ p ];
+        if ( pending.j0 <= region.j1 && region.j0 <= pending.j1 && pending.i0 <= region.i1 && region.i0 <= pending.i1 )
+        {
+            pending.j0 = std::min( pending.j0, region.j0 );
+            pending.i0 = std::min( pending.i0, region.i0 );
+            pending.j1 = std::max( pending.j1, region.j1 );
+            pending.i1 = std::max( pending.i1, region.i1 );
+            return;
+        }
+    }
+    editedRegions.push_back( region );
+}
+
+/******************************************************************************
+ * Upload the regions edited since the last frame
+ *
+ * Normals move one vertex around the edited heights, morph attributes up to
+ * lod.morphReach(); only those rows of the vertex buffers are sent, plus the
+ * skirt vertices in between and the height texture rectangle.
+ * The horizon map keeps the original relief.
+ ******************************************************************************/
+void HeigthMap::updateEditedRegions()
+{
+    const int nb = gridResolution;
+
+    for ( size_t r = 0; r < editedRegions.size(); ++r )
+    {
+        const EditRegion& region = editedRegions[ r ];
+        const EditRegion normalRegion = expand( region, 1 );
+        const EditRegion morphRegion = expand( region, lod.morphReach() );
+
+        updateNormals( normalRegion );
+
+        for ( int j = morphRegion.j0; j <= morphRegion.j1; ++j )
+            for ( int i = morphRegion.i0; i <= morphRegion.i1; ++i )
+                meshMorphs[ j * nb + i ] = lod.morphOf( meshPoints, nb, j, i );
+
+        // Skirts copy their border vertex
+        GLuint firstSkirt = static_cast< GLuint >( meshPoints.size() );
+        GLuint lastSkirt = 0;
+        for ( int j = morphRegion.j0; j <= morphRegion.j1; ++j )
+        {
+            for ( int i = morphRegion.i0; i <= morphRegion.i1; ++i )
+            {
+                const int k = j * nb + i;
+                const GLuint skirt = lod.skirtVertices[ k ];
+                if ( skirt == 0 )
+                    continue;
+                meshPoints[ skirt ] = meshPoints[ k ] - glm::vec3( 0.f, lod.skirtDepth, 0.f );
+                meshNormals[ skirt ] = meshNormals[ k ];
+                meshMorphs[ skirt ] = meshMorphs[ k ] - glm::vec2( lod.skirtDepth, 0.f );
+                firstSkirt = std::min( firstSkirt, skirt );
+                lastSkirt = std::max( lastSkirt, skirt );
+            }
+        }
+
+        lod.updateTileBounds( meshPoints, nb, region.j0, region.i0, region.j1, region.i1 );
+        tessellation.updateHeights( meshPoints, region.j0, region.i0, region.j1, region.i1 );
+        updateOccluders( region );
+
+        // Rows of the grid (vertex k = j * nb + i)
+        uploadRows( mHeigthMapVertexBuffer, meshPoints.data(), sizeof( glm::vec3 ), region );
+        uploadRows( mHeigthMapNormalBuffer, meshNormals.data(), sizeof( glm::vec3 ), normalRegion );
+        uploadRows( mHeigthMapMorphBuffer, meshMorphs.data(), sizeof( glm::vec2 ), morphRegion );
+
+        // Skirt vertices (stored after the grid in the same order)
+        if ( firstSkirt <= lastSkirt )
+        {
+            const GLsizeiptr count = lastSkirt - firstSkirt + 1;
+            GLStateCache::bindArrayBuffer( mHeigthMapVertexBuffer );
+            glBufferSubData( GL_ARRAY_BUFFER, firstSkirt * sizeof( glm::vec3 ), count * sizeof( glm::vec3 ), &meshPoints[ firstSkirt ] );
+            GLStateCache::bindArrayBuffer( mHeigthMapNormalBuffer );
+            glBufferSubData( GL_ARRAY_BUFFER, firstSkirt * sizeof( glm::vec3 ), count * sizeof( glm::vec3 ), &meshNormals[ firstSkirt ] );
+            GLStateCache::bindArrayBuffer( mHeigthMapMorphBuffer );
+            glBufferSubData( GL_ARRAY_BUFFER, firstSkirt * sizeof( glm::vec2 ), count * sizeof( glm::vec2 ), &meshMorphs[ firstSkirt ] );
+        }
+    }
+
+    editedRegions.clear();
+}
+
+HeigthMap::EditRegion HeigthMap::expand( const EditRegion& region, int margin ) const
+{
+    EditRegion expanded;
+    expanded.j0 = std::max( region.j0 - margin, 0 );
+    expanded.i0 = std::max( region.i0 - margin, 0 );
+    expanded.j1 = std::min( region.j1 + margin, gridResolution - 1 );
+    expanded.i1 = std::min( region.i1 + margin, gridResolution - 1 );
+    return expanded;
+}
+
+/******************************************************************************
+ * Recompute the normals of a region
+ * - same sum of face normals as plane(), over the cells touching the region
+ ******************************************************************************/
+void HeigthMap::updateNormals( const EditRegion& region )
+{
+    const int nb = gridResolution;
+    const std::vector< glm::vec3 >& points = meshPoints;
+
+    for ( int j = region.j0; j <= region.j1; ++j )
+        for ( int i = region.i0; i <= region.i1; ++i )
+            meshNormals[ j * nb + i ] = glm::vec3( 0.f );
+
+    for ( int j = std::max( region.j0, 1 ); j <= std::min( region.j1 + 1, nb - 1 ); ++j )
+        for ( int i = std::max( region.i0, 1 ); i <= std::min( region.i1 + 1, nb - 1 ); ++i )
+        {
+            const int k = j * nb + i;
+            const int triangles[ 2 ][ 3 ] = { { k, k - nb, k - nb - 1 }, { k, k - nb - 1, k - 1 } };
+            const glm::vec3 faceNormals[ 2 ] = {
+                glm::normalize( glm::cross( points[ k - nb - 1 ] - points[ k ], points[ k - nb ] - points[ k ] ) ),
+                glm::normalize( glm::cross( points[ k - 1 ] - points[ k ], points[ k - nb - 1 ] - points[ k ] ) )
+            };
+            for ( int t = 0; t < 2; ++t )
+                for ( int v = 0; v < 3; ++v )
+                {
+                    const int vj = triangles[ t ][ v ] / nb;
+                    const int vi = triangles[ t ][ v ] % nb;
+                    if ( vj >= region.j0 && vj <= region.j1 && vi >= region.i0 && vi <= region.i1 )
+                        meshNormals[ triangles[ t ][ v ] ] += faceNormals[ t ];
+                }
+        }
+}
+
+/******************************************************************************
+ * Recompute the coarse occluder vertices whose cells cover a region
+ ******************************************************************************/
+void HeigthMap::updateOccluders( const EditRegion& region )
+{
+    const int nbc = occluderResolution;
+    for ( int J = 0; J < nbc; ++J )
+    {
+        if ( occluderFine[ std::max( J - 1, 0 ) ] > region.j1 || occluderFine[ std::min( J + 1, nbc - 1 ) ] < region.j0 )
+            continue;
+        for ( int I = 0; I < nbc; ++I )
+        {
+            if ( occluderFine[ std::max( I - 1, 0 ) ] > region.i1 || occluderFine[ std::min( I + 1, nbc - 1 ) ] < region.i0 )
+                continue;
+            computeOccluderPoint( J, I );
+        }
+    }
+}
+
+/******************************************************************************
+ * Upload the grid rows of a region (one contiguous range per row)
+ ******************************************************************************/
+void HeigthMap::uploadRows( GLuint buffer, const void* data, size_t elementSize, const EditRegion& region ) const
+{
+    const int nb = gridResolution;
+    const char* bytes = static_cast< const char* >( data );
+    const GLsizeiptr rowSize = ( region.i1 - region.i0 + 1 ) * elementSize;
+
+    GLStateCache::bindArrayBuffer( buffer );
+    for ( int j = region.j0; j <= region.j1; ++j )
+    {
+        const GLintptr offset = ( j * nb + region.i0 ) * elementSize;
+        glBufferSubData( GL_ARRAY_BUFFER, offset, rowSize, bytes + offset );
+    }
+}
@@ -25,6 +25,12 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "HorizonMap.h"
+#include "VirtualTexture.h"
+#include "TerrainLod.h"
+#include "TerrainTessellation.h"
+#include "HeightPyramid.h"
+
 class HeigthMap{
 public:
     // - mesh
@@ -33,23 +39,58 @@ public:
     GLuint mHeigthMapIndexBuffer;
     GLuint mHeigthMapTextureCoordinateBuffer;
     GLuint mHeigthMapNormalBuffer;
+    GLuint mHeigthMapMorphBuffer;
+    // - tiles drawn at a level of detail chosen from the camera distance
+    TerrainLod lod;
+    // - GL 4.0 path: patches tessellated from their screen size (falls back to the tiles above)
+    TerrainTessellation tessellation;
 
     // - shader
     GLuint mHeigthMapShaderProgram;
+    // - shader writing the G-buffer (deferred shading)
+    GLuint mHeigthMapGeometryShaderProgram;
+    // - shader looping over the lights of its cluster (clustered forward shading)
+    GLuint mHeigthMapClusteredShaderProgram;
+    // - tessellated forward shader (0 when tessellation is not supported)
+    GLuint mHeigthMapTessellationShaderProgram;
     // - texture
     GLuint texture;
+    // - sky visibility, baked in the background from the heigth map image
+    HorizonMap horizonMap;
+    // - imagery draped on the terrain (tile pyramid streamed from disk)
+    VirtualTexture virtualTexture;
 
     int numberOfVertices_;
     int numberOfIndices_;
 
+    // - CPU copy of the vertex buffers (grid vertices, then skirts), edited in place
+    std::vector< glm::vec3 > meshPoints;
+    std::vector< glm::vec3 > meshNormals;
+    std::vector< glm::vec2 > meshMorphs;
+    // - min/max heights of the grid for ray casting
+    HeightPyramid heightPyramid;
+
+    // - grid resolution (nb x nb vertices, nb - 1 multiple of lod.tileCells)
+    int gridResolution;
+
+    // - occluders: coarse grid that always stays below the rendered surface
+    int occluderResolution;
+    std::vector< glm::vec3 > occluderPoints;
+    std::vector< GLuint > occluderIndices;
+    // - grid index of each coarse row/column
+    std::vector< int > occluderFine;
+
     // - repository
     std::string ImgRepository;
+    // - imagery: tile pyramid directory, image cut there when the pyramid is missing
+    std::string ImageryRepository;
+    std::string ImagerySource;
 
     unsigned char* image;
     int textureWidth;
     int textureHeight;
 
-    HeigthMap(){}
+    HeigthMap():gridResolution(513),occluderResolution(64){}
 
     // Methode d'initialisation
     bool initializeHeigthMap();
@@ -57,7 +98,37 @@ public:
     bool initializeVertexArray();
     bool initializeMaterial();
     bool initializeShaderProgram();
+    bool initializeGeometryShaderProgram();
+    bool initializeClusteredShaderProgram();
+    bool initializeTessellationShaderProgram();
+    bool initializeOccluders();
+    bool initializeHorizonMap();
+    bool initializeVirtualTexture();
+
+    float heigthAt( int j, int i, int nb ) const;
+
+    // Editing
+    enum BrushMode { BrushRaise, BrushLower, BrushSmooth, BrushFlatten, NumberOfBrushModes };
+    // - local xz center and radius, height change per application (CPU only)
+    void applyBrush( BrushMode mode, const glm::vec2& center, float radius, float strength );
+    // - upload the edited regions (GL thread, once per frame)
+    void updateEditedRegions();
+
 private:
+    // - grid vertices [j0,j1] x [i0,i1]
+    struct EditRegion{
+        int j0;
+        int i0;
+        int j1;
+        int i1;
+    };
+    std::vector< EditRegion > editedRegions;
+
+    EditRegion expand( const EditRegion& region, int margin ) const;
+    void updateNormals( const EditRegion& region );
+    void updateOccluders( const EditRegion& region );
+    void uploadRows( GLuint buffer, const void* data, size_t elementSize, const EditRegion& region ) const;
+    void computeOccluderPoint( int J, int I );
     void plane( std::vector< glm::vec3 >& points,std::vector< glm::vec3 >& normals,std::vector< GLuint >& triangleIndices, int nb );
 };
 
@@ -0,0 +1,239 @@
+#include "HorizonMap.h"
+
+// STL
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "JobSystem.h"
+#include "GLStateCache.h"
+
+HorizonMap::HorizonMap(){
+    numberOfDirections = 16;
+    numberOfThreads = numberOfWorkerThreads();
+
+    mHorizonMapTexture = 0;
+    width = 0;
+    height = 0;
+
+    bakeTime = 0.0;
+    bakeDone = false;
+    bakeCancelled = false;
+}
+
+HorizonMap::~HorizonMap(){
+    stopBake();
+}
+
+/******************************************************************************
+ * Initialize horizon map texture
+ * - 1x1 open sky until a bake is uploaded
+ ******************************************************************************/
+bool HorizonMap::initializeHorizonMap()
+{
+    std::cout << "Initialize horizon map..." << std::endl;
+
+    const unsigned char openSky = 255;
+
+    glGenTextures( 1, &mHorizonMapTexture );
+    GLStateCache::bindTexture( TextureUnit, GL_TEXTURE_2D, mHorizonMapTexture );
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+    glTexImage2D( GL_TEXTURE_2D, 0, GL_R8, 1, 1, 0, GL_RED, GL_UNSIGNED_BYTE, &openSky );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+
+    return true;
+}
+
+/******************************************************************************
+ * Sweep the height field along one azimuth and accumulate sin^2 of the
+ * horizon angle seen from each texel (looking back along the sweep)
+ *
+ * Lines advance one texel along the major axis of the direction; as they are
+ * one texel apart along the minor axis, each texel is visited exactly once.
+ ******************************************************************************/
+void HorizonMap::sweep( const unsigned char* heights, const glm::vec3& texelSize, float angle, std::vector< float >& occlusion )
+{
+    const float dx = std::cos( angle );
+    const float dz = std::sin( angle );
+
+    const bool majorX = std::fabs( dx ) >= std::fabs( dz );
+    const int majorLength = majorX ? width : height;
+    const int minorLength = majorX ? height : width;
+    const float majorDirection = majorX ? dx : dz;
+    const float minorDirection = majorX ? dz : dx;
+    const float majorSpacing = majorX ? texelSize.x : texelSize.z;
+    const float minorSpacing = majorX ? texelSize.z : texelSize.x;
+
+    // - minor offset per major step, and distance covered by a step
+    const float slope = minorDirection / std::fabs( majorDirection );
+    const float stepLength = std::sqrt( majorSpacing * majorSpacing + slope * minorSpacing * slope * minorSpacing );
+
+    // Lines starting outside of the map still cross it
+    const int margin = static_cast< int >( std::ceil( std::fabs( slope ) * ( majorLength - 1 ) ) );
+    const int numberOfLines = minorLength + 2 * margin;
+
+    const int LinesPerChunk = 16;
+    std::atomic< int > nextLine( 0 );
+
+    JobSystem::instance().forEachTask( numberOfThreads, [&]( unsigned int )
+    {
+        // Upper convex hull of the visited profile: (distance along the line, height)
+        std::vector< glm::vec2 > hull;
+        hull.reserve( majorLength );
+
+        for ( int first = nextLine.fetch_add( LinesPerChunk ); first < numberOfLines && ! bakeCancelled; first = nextLine.fetch_add( LinesPerChunk ) )
+        {
+            const int last = std::min( first + LinesPerChunk, numberOfLines );
+            for ( int line = first; line < last; ++line )
+            {
+                const float start = static_cast< float >( line - margin );
+
+                // Steps where the line is inside of the map
+                float sBegin = 0.f;
+                float sEnd = static_cast< float >( majorLength );
+                if ( slope > 0.f )
+                {
+                    sBegin = std::max( sBegin, std::floor( ( -0.5f - start ) / slope ) );
+                    sEnd = std::min( sEnd, std::ceil( ( minorLength - 0.5f - start ) / slope ) + 1.f );
+                }
+                else if ( slope < 0.f )
+                {
+                    sBegin = std::max( sBegin, std::floor( ( minorLength - 0.5f - start ) / slope ) );
+                    sEnd = std::min( sEnd, std::ceil( ( -0.5f - start ) / slope ) + 1.f );
+                }
+
+                hull.clear();
+                for ( int s = static_cast< int >( sBegin ); s < static_cast< int >( sEnd ); ++s )
+                {
+                    const int n = static_cast< int >( std::floor( start + slope * s + 0.5f ) );
+                    if ( n < 0 || n >= minorLength )
+                        continue;
+                    const int m = ( majorDirection >= 0.f ) ? s : majorLength - 1 - s;
+                    const int index = majorX ? ( m + n * width ) : ( n + m * width );
+
+                    const glm::vec2 p( s * stepLength, heights[ index ] * texelSize.y );
+
+                    // Remove hull points hidden behind a farther, higher one
+                    while ( hull.size() >= 2 )
+                    {
+                        const glm::vec2& a = hull[ hull.size() - 1 ];
+                        const glm::vec2& b = hull[ hull.size() - 2 ];
+                        if ( ( b.y - p.y ) * ( p.x - a.x ) >= ( a.y - p.y ) * ( p.x - b.x ) )
+                            hull.pop_back();
+                        else
+                            break;
+                    }
+
+                    if ( ! hull.empty() )
+                    {
+                        const float tangent = std::max( 0.f, ( hull.back().y - p.y ) / ( p.x - hull.back().x ) );
+                        occlusion[ index ] += tangent * tangent / ( 1.f + tangent * tangent );
+                    }
+
+                    hull.push_back( p );
+                }
+            }
+        }
+    } );
+}
+
+/******************************************************************************
+ * Compute the horizon map of a height field (blocking)
+ * - texelSize: world size of a texel along x and z, world height of one unit
+ ******************************************************************************/
+void HorizonMap::bake( const unsigned char* heights, int pWidth, int pHeight, const glm::vec3& texelSize )
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    width = pWidth;
+    height = pHeight;
+
+    // Directions are swept one after the other: within a direction texels are written once
+    std::vector< float > occlusion( width * height, 0.f );
+    for ( int d = 0; d < numberOfDirections && ! bakeCancelled; ++d )
+    {
+        sweep( heights, texelSize, 2.f * 3.14159265f * d / numberOfDirections, occlusion );
+    }
+    if ( bakeCancelled )
+    {
+        return;
+    }
+
+    visibility.resize( width * height );
+    for ( size_t i = 0; i < visibility.size(); ++i )
+    {
+        const float v = 1.f - occlusion[ i ] / numberOfDirections;
+        visibility[ i ] = static_cast< unsigned char >( std::min( 255.f, std::max( 0.f, v * 255.f + 0.5f ) ) );
+    }
+
+    bakeTime = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+}
+
+/******************************************************************************
+ * Compute the horizon map on a background thread
+ ******************************************************************************/
+void HorizonMap::startBake( const unsigned char* heights, int pWidth, int pHeight, const glm::vec3& texelSize )
+{
+    if ( bakeThread.joinable() )
+    {
+        bakeThread.join();
+    }
+
+    bakeDone = false;
+    bakeCancelled = false;
+    bakeThread = std::thread( [this, heights, pWidth, pHeight, texelSize]()
+    {
+        bake( heights, pWidth, pHeight, texelSize );
+        bakeDone = ! bakeCancelled;
+    } );
+}
+
+/******************************************************************************
+ * Stop a background bake
+ * - the sweeps check the flag between chunks of lines, the thread ends soon
+ ******************************************************************************/
+void HorizonMap::stopBake()
+{
+    bakeCancelled = true;
+    if ( bakeThread.joinable() )
+    {
+        bakeThread.join();
+    }
+    bakeDone = false;
+}
+
+/******************************************************************************
+ * Upload the result of a background bake (GL thread)
+ *
+ * Returns true the frame the texture is replaced.
+ ******************************************************************************/
+bool HorizonMap::update()
+{
+    if ( ! bakeDone )
+    {
+        return false;
+    }
+    bakeThread.join();
+    bakeDone = false;
+
+    GLStateCache::bindTexture( TextureUnit, GL_TEXTURE_2D, mHorizonMapTexture );
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+    glTexImage2D( GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, visibility.data() );
+
+    std::cout << "Horizon map " << width << "x" << height << " baked in " << bakeTime << " s (" << numberOfThreads << " threads)" << std::endl;
+
+    return true;
+}
+
+void HorizonMap::bindTexture()
+{
+    GLStateCache::bindTexture( TextureUnit, GL_TEXTURE_2D, mHorizonMapTexture );
+}
+
+void HorizonMap::unbindTexture()
+{
+    GLStateCache::bindTexture( TextureUnit, GL_TEXTURE_2D, 0 );
+}
@@ -0,0 +1,79 @@
+#ifndef HORIZONMAP_H
+#define HORIZONMAP_H
+
+// STL
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// Graphics
+// - GLEW (always before "gl.h")
+#include <GL/glew.h>
+// - GL
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+
+// glm
+#include <glm/glm.hpp>
+
+/******************************************************************************
+ * Horizon based ambient occlusion of a height field
+ *
+ * For each of numberOfDirections azimuths, the height field is swept along
+ * parallel lines; a convex hull of the profile already visited gives the
+ * horizon angle of each texel in amortized constant time. The cosine weighted
+ * sky visibility is stored in an 8 bits texture sampled by the terrain shader.
+ * The bake runs in the background (lines are spread over the worker threads)
+ * and the texture stays white until the result is uploaded by update().
+ ******************************************************************************/
+class HorizonMap{
+public:
+    // - texture unit used by the terrain shader
+    static const int TextureUnit = 5;
+
+    // - quality
+    int numberOfDirections;
+
+    // - parallel tasks of bake() (job system)
+    unsigned int numberOfThreads;
+
+    GLuint mHorizonMapTexture;
+    int width;
+    int height;
+
+    // - sky visibility (255: open sky)
+    std::vector< unsigned char > visibility;
+
+    // - statistics
+    double bakeTime;
+
+    HorizonMap();
+    ~HorizonMap();
+
+    // Methode d'initialisation
+    bool initializeHorizonMap();
+
+    // - heights (width x height, row major) are read until the bake is over
+    void bake( const unsigned char* heights, int pWidth, int pHeight, const glm::vec3& texelSize );
+    void startBake( const unsigned char* heights, int pWidth, int pHeight, const glm::vec3& texelSize );
+    bool update();
+    // - cancels a running bake and waits for its thread (before the job system goes away)
+    void stopBake();
+    // - a finished bake waits for update()
+    bool isBakeReady() const { return bakeDone; }
+
+    void bindTexture();
+    void unbindTexture();
+
+private:
+    std::thread bakeThread;
+    std::atomic< bool > bakeDone;
+    std::atomic< bool > bakeCancelled;
+
+    void sweep( const unsigned char* heights, const glm::vec3& texelSize, float angle, std::vector< float >& occlusion );
+};
+
+#endif
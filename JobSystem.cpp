@@ -0,0 +1,358 @@
+#include "JobSystem.h"
+
+namespace
+{
+    // - index of the calling thread in the pool (-1: not a pool thread)
+    thread_local int currentThread = -1;
+}
+
+JobSystem& JobSystem::instance()
+{
+    static JobSystem jobSystem( numberOfWorkerThreads() );
+    return jobSystem;
+}
+
+JobSystem::JobSystem( unsigned int n ){
+    numberOfQueuedJobs = 0;
+    numberOfActiveSlots = 0;
+    stopping = false;
+
+    for ( int s = 0; s < MaxTaskSlots; ++s )
+    {
+        taskSlots[ s ].claimed = false;
+        taskSlots[ s ].active = false;
+        taskSlots[ s ].readers = 0;
+        taskSlots[ s ].function = nullptr;
+        taskSlots[ s ].context = nullptr;
+        taskSlots[ s ].numberOfTasks = 0;
+        taskSlots[ s ].nextTask = 0;
+        taskSlots[ s ].remainingTasks = 0;
+    }
+
+    queues.resize( std::max( 1u, n ) );
+    for ( size_t q = 0; q < queues.size(); ++q )
+    {
+        queues[ q ] = new Queue();
+    }
+
+    // The creating thread is thread 0
+    currentThread = 0;
+    for ( unsigned int t = 1; t < queues.size(); ++t )
+    {
+        workers.push_back( std::thread( &JobSystem::workerLoop, this, t ) );
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard< std::mutex > lock( sleepMutex );
+        stopping = true;
+    }
+    sleepCondition.notify_all();
+    for ( size_t t = 0; t < workers.size(); ++t )
+    {
+        workers[ t ].join();
+    }
+    for ( size_t q = 0; q < queues.size(); ++q )
+    {
+        delete queues[ q ];
+    }
+}
+
+/******************************************************************************
+ * Jobs
+ ******************************************************************************/
+void JobSystem::run( const Job& job, JobCounter* counter )
+{
+    if ( counter )
+    {
+        ++counter->pending;
+    }
+    Entry entry;
+    entry.job = job;
+    entry.counter = counter;
+    push( entry );
+}
+
+void JobSystem::runAfter( JobCounter& dependency, const Job& job, JobCounter* counter )
+{
+    if ( counter )
+    {
+        ++counter->pending;
+    }
+    {
+        // - the last job of the dependency drains the continuations under the same lock
+        std::lock_guard< std::mutex > lock( dependency.mutex );
+        if ( !dependency.done() )
+        {
+            dependency.continuations.push_back( job );
+            dependency.continuationCounters.push_back( counter );
+            return;
+        }
+    }
+    Entry entry;
+    entry.job = job;
+    entry.counter = counter;
+    push( entry );
+}
+
+void JobSystem::wait( JobCounter& counter )
+{
+    while ( !counter.done() )
+    {
+        Entry entry;
+        if ( pop( entry, currentThread < 0 ) )
+        {
+            execute( entry );
+        }
+        else if ( currentThread < 0 || !runActiveTasks() )
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    // - the last job is out of finish()
+    std::lock_guard< std::mutex > lock( counter.mutex );
+}
+
+void JobSystem::execute( Entry& entry )
+{
+    entry.job();
+    finish( entry.counter );
+}
+
+void JobSystem::finish( JobCounter* counter )
+{
+    if ( !counter )
+        return;
+
+    // - under the lock: a waiter may destroy the counter as soon as it is released
+    std::vector< Job > continuations;
+    std::vector< JobCounter* > continuationCounters;
+    {
+        std::lock_guard< std::mutex > lock( counter->mutex );
+        if ( --counter->pending > 0 )
+            return;
+        continuations.swap( counter->continuations );
+        continuationCounters.swap( counter->continuationCounters );
+    }
+    for ( size_t c = 0; c < continuations.size(); ++c )
+    {
+        Entry entry;
+        entry.job = continuations[ c ];
+        entry.counter = continuationCounters[ c ];
+        push( entry );
+    }
+}
+
+/******************************************************************************
+ * Task slots
+ * - the slot is filled before it is made active, and released only once no
+ *   other thread reads it any more
+ ******************************************************************************/
+void JobSystem::forEachTask( unsigned int n, TaskFunction function, void* context )
+{
+    TaskSlot* slot = nullptr;
+    if ( n >= 2 && numberOfThreads() >= 2 )
+    {
+        for ( int s = 0; s < MaxTaskSlots && !slot; ++s )
+        {
+            bool expected = false;
+            if ( taskSlots[ s ].claimed.compare_exchange_strong( expected, true ) )
+            {
+                slot = &taskSlots[ s ];
+            }
+        }
+    }
+    if ( !slot )
+    {
+        for ( unsigned int task = 0; task < n; ++task )
+        {
+            function( context, task );
+        }
+        return;
+    }
+
+    slot->function = function;
+    slot->context = context;
+    slot->numberOfTasks = n;
+    slot->nextTask = 0;
+    slot->remainingTasks = n;
+    slot->active = true;
+    ++numberOfActiveSlots;
+    {
+        std::lock_guard< std::mutex > lock( sleepMutex );
+    }
+    sleepCondition.notify_all();
+
+    // - this thread takes tasks too, then waits for the ones taken by others
+    runTasks( *slot );
+    while ( slot->remainingTasks.load() > 0 )
+    {
+        std::this_thread::yield();
+    }
+
+    slot->active = false;
+    --numberOfActiveSlots;
+    while ( slot->readers.load() > 0 )
+    {
+        std::this_thread::yield();
+    }
+    slot->claimed = false;
+}
+
+bool JobSystem::runTasks( TaskSlot& slot )
+{
+    bool ran = false;
+    ++slot.readers;
+    if ( slot.active.load() )
+    {
+        for ( ;; )
+        {
+            const unsigned int task = slot.nextTask++;
+            if ( task >= slot.numberOfTasks )
+                break;
+            slot.function( slot.context, task );
+            --slot.remainingTasks;
+            ran = true;
+        }
+    }
+    --slot.readers;
+    return ran;
+}
+
+bool JobSystem::runActiveTasks()
+{
+    if ( numberOfActiveSlots.load() == 0 )
+        return false;
+
+    bool ran = false;
+    for ( int s = 0; s < MaxTaskSlots; ++s )
+    {
+        if ( taskSlots[ s ].active.load() )
+        {
+            ran = runTasks( taskSlots[ s ] ) || ran;
+        }
+    }
+    return ran;
+}
+
+/******************************************************************************
+ * Deques
+ * - own jobs at the back, stolen jobs at the front
+ * - background jobs (queued outside of the pool) last, oldest first
+ ******************************************************************************/
+void JobSystem::push( const Entry& entry )
+{
+    Queue& queue = ( currentThread >= 0 ) ? *queues[ currentThread ] : backgroundQueue;
+    {
+        std::lock_guard< std::mutex > lock( queue.mutex );
+        queue.entries.push_back( entry );
+    }
+    ++numberOfQueuedJobs;
+
+    // - a worker checking for jobs right now sees the count before sleeping
+    {
+        std::lock_guard< std::mutex > lock( sleepMutex );
+    }
+    sleepCondition.notify_one();
+}
+
+bool JobSystem::pop( Entry& entry, bool background )
+{
+    if ( numberOfQueuedJobs.load() == 0 )
+        return false;
+
+    const int n = static_cast< int >( queues.size() );
+    const int self = currentThread;
+    if ( self >= 0 )
+    {
+        Queue& queue = *queues[ self ];
+        std::lock_guard< std::mutex > lock( queue.mutex );
+        if ( !queue.entries.empty() )
+        {
+            entry = queue.entries.back();
+            queue.entries.pop_back();
+            --numberOfQueuedJobs;
+            return true;
+        }
+    }
+
+    // Steal
+    for ( int k = 1; k <= n; ++k )
+    {
+        const int victim = ( self + k + n ) % n;
+        if ( victim == self )
+            continue;
+
+        Queue& queue = *queues[ victim ];
+        std::lock_guard< std::mutex > lock( queue.mutex );
+        if ( !queue.entries.empty() )
+        {
+            entry = queue.entries.front();
+            queue.entries.pop_front();
+            --numberOfQueuedJobs;
+            return true;
+        }
+    }
+
+    if ( background )
+    {
+        std::lock_guard< std::mutex > lock( backgroundQueue.mutex );
+        if ( !backgroundQueue.entries.empty() )
+        {
+            entry = backgroundQueue.entries.front();
+            backgroundQueue.entries.pop_front();
+            --numberOfQueuedJobs;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void JobSystem::workerLoop( unsigned int thread )
+{
+    currentThread = static_cast< int >( thread );
+
+    for ( ;; )
+    {
+        if ( runActiveTasks() )
+            continue;
+
+        Entry entry;
+        if ( pop( entry, true ) )
+        {
+            execute( entry );
+            continue;
+        }
+
+        std::unique_lock< std::mutex > lock( sleepMutex );
+        sleepCondition.wait( lock, [&]() { return stopping || numberOfQueuedJobs.load() > 0 || numberOfActiveSlots.load() > 0; } );
+        if ( stopping && numberOfQueuedJobs.load() == 0 )
+            return;
+    }
+}
+
+/******************************************************************************
+ * GL jobs
+ ******************************************************************************/
+void JobSystem::runOnMainThread( const Job& job )
+{
+    std::lock_guard< std::mutex > lock( mainThreadMutex );
+    mainThreadJobs.push_back( job );
+}
+
+void JobSystem::executeMainThreadJobs()
+{
+    std::vector< Job > jobs;
+    {
+        std::lock_guard< std::mutex > lock( mainThreadMutex );
+        jobs.swap( mainThreadJobs );
+    }
+    for ( size_t j = 0; j < jobs.size(); ++j )
+    {
+        jobs[ j ]();
+    }
+}
@@ -0,0 +1,186 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+// STL
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "WorkerThreads.h"
+
+/******************************************************************************
+ * Job counter
+ *
+ * Number of jobs of a group not finished yet. Jobs started with
+ * JobSystem::runAfter() wait for a counter to reach zero.
+ ******************************************************************************/
+class JobCounter{
+public:
+    JobCounter() : pending( 0 ) {}
+
+    bool done() const { return pending.load() == 0; }
+
+private:
+    friend class JobSystem;
+
+    std::atomic< int > pending;
+    // - jobs started when the counter reaches zero
+    std::mutex mutex;
+    std::vector< std::function< void() > > continuations;
+    std::vector< JobCounter* > continuationCounters;
+};
+
+/******************************************************************************
+ * Job system
+ *
+ * One pool of worker threads for the CPU side work of the frame (culling,
+ * sorting, light binning...), started once. Each thread owns a deque of
+ * jobs: it pushes and pops its own jobs at the back (last in, first out,
+ * still hot in its cache) and, when it runs out, steals the oldest jobs at
+ * the front of the other deques. The calling thread of the first instance()
+ * is thread 0 and takes part in the work while it waits: main() creates the
+ * job system on the GLUT thread before the horizon bake thread uses it.
+ *
+ * Jobs queued by threads outside of the pool (background work such as the
+ * horizon bake) go to a background deque, taken by idle workers and by
+ * those threads, never by a pool thread waiting for its own jobs: a frame
+ * does not stall on a long background task.
+ *
+ * forEachTask() with a plain function and a context does not allocate (no
+ * std::function, no deque entry): its tasks are published in one of a few
+ * preallocated task slots, where idle and waiting pool threads take task
+ * indices. When all the slots are in use the tasks run on the calling thread.
+ *
+ * Jobs must not call GL: runOnMainThread() queues the ones that have to, they
+ * are run by executeMainThreadJobs() on the GLUT thread.
+ ******************************************************************************/
+class JobSystem{
+public:
+    typedef std::function< void() > Job;
+    // - plain function task: "function( context, task )"
+    typedef void ( *TaskFunction )( void* context, unsigned int task );
+
+    static JobSystem& instance();
+
+    // - worker threads, the main thread included
+    unsigned int numberOfThreads() const { return static_cast< unsigned int >( queues.size() ); }
+
+    // - counter (may be null) is decremented when the job is done
+    void run( const Job& job, JobCounter* counter );
+    // - the job starts once the dependency counter reaches zero
+    void runAfter( JobCounter& dependency, const Job& job, JobCounter* counter );
+    // - runs other jobs until the counter reaches zero (background jobs only
+    //   from a thread outside of the pool)
+    void wait( JobCounter& counter );
+
+    // - "function( task )" for task in [0,n[, returns when all are done
+    template< typename Function >
+    void forEachTask( unsigned int n, Function function );
+    // - same with a plain function, dispatched through a task slot: no allocation
+    void forEachTask( unsigned int n, TaskFunction function, void* context );
+    // - "function( begin, end )" over ranges of at least grain items of [begin,end[
+    template< typename Function >
+    void parallelFor( size_t begin, size_t end, size_t grain, Function function );
+
+    // GL jobs
+    void runOnMainThread( const Job& job );
+    void executeMainThreadJobs();
+
+    ~JobSystem();
+
+private:
+    struct Entry{
+        Job job;
+        JobCounter* counter;
+    };
+    struct Queue{
+        std::mutex mutex;
+        std::deque< Entry > entries;
+    };
+    // Tasks of a forEachTask() call with a plain function, taken by index
+    struct TaskSlot{
+        // - owned by a forEachTask() call
+        std::atomic< bool > claimed;
+        // - tasks can be taken
+        std::atomic< bool > active;
+        // - threads reading the slot (it is released once they are out)
+        std::atomic< int > readers;
+        TaskFunction function;
+        void* context;
+        unsigned int numberOfTasks;
+        std::atomic< unsigned int > nextTask;
+        std::atomic< unsigned int > remainingTasks;
+    };
+    static const int MaxTaskSlots = 8;
+
+    std::vector< Queue* > queues;
+    // - jobs queued by threads outside of the pool
+    Queue backgroundQueue;
+    TaskSlot taskSlots[ MaxTaskSlots ];
+    std::vector< std::thread > workers;
+    // - queued jobs (all deques) and active task slots, sleeping workers wake up on them
+    std::atomic< int > numberOfQueuedJobs;
+    std::atomic< int > numberOfActiveSlots;
+    std::mutex sleepMutex;
+    std::condition_variable sleepCondition;
+    bool stopping;
+
+    std::mutex mainThreadMutex;
+    std::vector< Job > mainThreadJobs;
+
+    explicit JobSystem( unsigned int n );
+    JobSystem( const JobSystem& ) = delete;
+    JobSystem& operator=( const JobSystem& ) = delete;
+
+    void push( const Entry& entry );
+    bool pop( Entry& entry, bool background );
+    void execute( Entry& entry );
+    void finish( JobCounter* counter );
+    bool runTasks( TaskSlot& slot );
+    bool runActiveTasks();
+    void workerLoop( unsigned int thread );
+};
+
+template< typename Function >
+void JobSystem::forEachTask( unsigned int n, Function function )
+{
+    if ( n < 2 || numberOfThreads() < 2 )
+    {
+        for ( unsigned int task = 0; task < n; ++task )
+        {
+            function( task );
+        }
+        return;
+    }
+
+    JobCounter counter;
+    for ( unsigned int task = 1; task < n; ++task )
+    {
+        run( [&function, task]() { function( task ); }, &counter );
+    }
+    // - the first task on this thread
+    function( 0 );
+    wait( counter );
+}
+
+template< typename Function >
+void JobSystem::parallelFor( size_t begin, size_t end, size_t grain, Function function )
+{
+    const size_t count = ( end > begin ) ? end - begin : 0;
+    // - a few ranges per thread so that stealing can even out the load
+    const size_t range = std::max( std::max< size_t >( grain, 1 ), count / ( 4 * numberOfThreads() ) + 1 );
+    const unsigned int n = static_cast< unsigned int >( ( count + range - 1 ) / range );
+    forEachTask( n, [&]( unsigned int task )
+    {
+        const size_t first = begin + task * range;
+        function( first, std::min( end, first + range ) );
+    } );
+}
+
+#endif
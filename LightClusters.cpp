@@ -0,0 +1,366 @@
+#include "LightClusters.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+
+#include "JobSystem.h"
+#include "GLStateCache.h"
+
+const std::string LightClusters::ShaderSource =
+    "precision highp int;\n"
+    "precision highp usampler2D;\n"
+    "\n"
+    "// UNIFORM\n"
+    "// - light lists\n"
+    "uniform sampler2D lightTexture;\n"
+    "uniform usampler2D clusterTexture;\n"
+    "uniform usampler2D lightIndexTexture;\n"
+    "uniform int lightIndexTextureWidth;\n"
+    "// - cluster grid\n"
+    "uniform ivec3 clusterGrid;\n"
+    "uniform vec2 clusterTileScale;\n"
+    "uniform float clusterSliceScale;\n"
+    "uniform float clusterZNear;\n"
+    "// - lighting not binned to clusters\n"
+    "uniform vec3 ambientColor;\n"
+    "uniform vec3 eyeMainLightPosition;\n"
+    "uniform vec3 mainLightColor;\n"
+    "\n"
+    "vec3 clusteredLighting( vec3 eyePosition, vec3 N, vec3 albedo )\n"
+    "{\n"
+    "    vec3 color = ambientColor * albedo;\n"
+    "    vec3 L = normalize( eyeMainLightPosition - eyePosition );\n"
+    "    color += mainLightColor * albedo * max( 0.0, dot( N, L ) );\n"
+    "\n"
+    "    // Cluster of this fragment\n"
+    "    ivec2 tile = clamp( ivec2( gl_FragCoord.xy * clusterTileScale ), ivec2( 0 ), clusterGrid.xy - 1 );\n"
+    "    int slice = clamp( int( log( max( -eyePosition.z, clusterZNear ) / clusterZNear ) * clusterSliceScale ), 0, clusterGrid.z - 1 );\n"
+    "    uvec2 cluster = texelFetch( clusterTexture, ivec2( tile.y * clusterGrid.x + tile.x, slice ), 0 ).xy;\n"
+    "\n"
+    "    for ( uint i = 0u; i < cluster.y; ++i )\n"
+    "    {\n"
+    "        int entry = int( cluster.x + i );\n"
+    "        int light = int( texelFetch( lightIndexTexture, ivec2( entry % lightIndexTextureWidth, entry / lightIndexTextureWidth ), 0 ).r );\n"
+    "        vec4 lightPosition = texelFetch( lightTexture, ivec2( 2 * light, 0 ), 0 );\n"
+    "        vec3 lightColor = texelFetch( lightTexture, ivec2( 2 * light + 1, 0 ), 0 ).rgb;\n"
+    "        vec3 toLight = lightPosition.xyz - eyePosition;\n"
+    "        float d = length( toLight );\n"
+    "        if ( d < lightPosition.w )\n"
+    "        {\n"
+    "            // Windowed inverse square falloff, reaches 0 at the light radius\n"
+    "            float f = d / lightPosition.w;\n"
+    "            float window = clamp( 1.0 - f * f * f * f, 0.0, 1.0 );\n"
+    "            float attenuation = window * window / ( 1.0 + d * d );\n"
+    "            color += lightColor * albedo * max( 0.0, dot( N, toLight / d ) ) * attenuation;\n"
+    "        }\n"
+    "    }\n"
+    "\n"
+    "    return color;\n"
+    "}\n";
+
+LightClusters::LightClusters(){
+    mLightTexture = 0;
+    mClusterTexture = 0;
+    mLightIndexTexture = 0;
+    lightIndexTextureHeight = 0;
+
+    zNear = 0.1f;
+    zFar = 100.f;
+    width = 1;
+    height = 1;
+
+    ambientColor = glm::vec3( 0.05f, 0.05f, 0.08f );
+    mainLightPosition = glm::vec3( 0.f, 10.f, 0.f );
+    mainLightColor = glm::vec3( 0.1f, 0.1f, 0.15f );
+
+    numberOfThreads = std::min( numberOfWorkerThreads(), static_cast< unsigned int >( GridZ ) );
+
+    numberOfVisibleLights = 0;
+    numberOfLightClusterEntries = 0;
+}
+
+/******************************************************************************
+ * Initialize light textures
+ * - lights: 2 texels per light (eye-space position + radius, color)
+ * - clusters: (offset,count) in the light index list, one row per slice
+ ******************************************************************************/
+bool LightClusters::initializeLightClusters()
+{
+    bool statusOK = true;
+
+    std::cout << "Initialize light clusters..." << std::endl;
+
+    glGenTextures( 1, &mLightTexture );
+    glBindTexture( GL_TEXTURE_2D, mLightTexture );
+    glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA32F, 2 * MaxLights, 1, 0, GL_RGBA, GL_FLOAT, nullptr );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+
+    glGenTextures( 1, &mClusterTexture );
+    glBindTexture( GL_TEXTURE_2D, mClusterTexture );
+    glTexImage2D( GL_TEXTURE_2D, 0, GL_RG32UI, GridX * GridY, GridZ, 0, GL_RG_INTEGER, GL_UNSIGNED_INT, nullptr );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+
+    glGenTextures( 1, &mLightIndexTexture );
+    lightIndexTextureHeight = 0;
+
+    glBindTexture( GL_TEXTURE_2D, 0 );
+
+    return statusOK;
+}
+
+/******************************************************************************
+ * Eye-space data, tile rectangle and slice range of lights [first,last[
+ ******************************************************************************/
+void LightClusters::assignLights( const std::vector< PointLight >& lights, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, size_t first, size_t last )
+{
+    const float sliceScale = GridZ / std::log( zFar / zNear );
+
+    for ( size_t l = first; l < last; ++l )
+    {
+        const PointLight& light = lights[ l ];
+        const glm::vec3 center = glm::vec3( viewMatrix * glm::vec4( light.position, 1.f ) );
+        const float r = light.radius;
+
+        lightData[ 2 * l ] = glm::vec4( center, r );
+        lightData[ 2 * l + 1 ] = glm::vec4( light.color, 0.f );
+
+        // Empty ranges: light outside of the frustum depth range
+        lightTiles[ l ] = glm::ivec4( 0, 0, -1, -1 );
+        lightSlices[ l ] = glm::ivec2( 0, -1 );
+
+        const float depthMin = -center.z - r;
+        const float depthMax = -center.z + r;
+        if ( depthMax < zNear || depthMin > zFar )
+        {
+            continue;
+        }
+
+        // - crossing the near plane: full screen, otherwise project the bounding cube
+        glm::vec2 ndcMin( -1.f );
+        glm::vec2 ndcMax( 1.f );
+        if ( depthMin > zNear )
+        {
+            ndcMin = glm::vec2( 1.f );
+            ndcMax = glm::vec2( -1.f );
+            for ( int corner = 0; corner < 8; ++corner )
+            {
+                const glm::vec4 p = projectionMatrix * glm::vec4( center + r * glm::vec3( ( corner & 1 ) ? 1.f : -1.f, ( corner & 2 ) ? 1.f : -1.f, ( corner & 4 ) ? 1.f : -1.f ), 1.f );
+                const glm::vec2 ndc = glm::vec2( p ) / p.w;
+                ndcMin = glm::min( ndcMin, ndc );
+                ndcMax = glm::max( ndcMax, ndc );
+            }
+            if ( ndcMax.x < -1.f || ndcMax.y < -1.f || ndcMin.x > 1.f || ndcMin.y > 1.f )
+            {
+                continue;
+            }
+        }
+
+        lightTiles[ l ] = glm::ivec4(
+            std::max( 0, static_cast< int >( ( ndcMin.x * 0.5f + 0.5f ) * GridX ) ),
+            std::max( 0, static_cast< int >( ( ndcMin.y * 0.5f + 0.5f ) * GridY ) ),
+            std::min( GridX - 1, static_cast< int >( ( ndcMax.x * 0.5f + 0.5f ) * GridX ) ),
+            std::min( GridY - 1, static_cast< int >( ( ndcMax.y * 0.5f + 0.5f ) * GridY ) ) );
+        lightSlices[ l ] = glm::ivec2(
+            std::max( 0, static_cast< int >( std::log( std::max( depthMin, zNear ) / zNear ) * sliceScale ) ),
+            std::min( GridZ - 1, static_cast< int >( std::log( std::min( depthMax, zFar ) / zNear ) * sliceScale ) ) );
+    }
+}
+
+/******************************************************************************
+ * Assign lights to clusters and upload the lists
+ *
+ * 1) lights are sent to eye-space (tasks split the lights)
+ * 2) clusters are counted then filled (tasks split the depth slices, so
+ *    each cluster is only written by one task), offsets are a prefix sum
+ ******************************************************************************/
+void LightClusters::build( const std::vector< PointLight >& lights, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, int pWidth, int pHeight )
+{
+    const unsigned int n = numberOfThreads;
+    const size_t numberOfLights = std::min( lights.size(), static_cast< size_t >( MaxLights ) );
+    const int clustersPerSlice = GridX * GridY;
+
+    width = pWidth;
+    height = pHeight;
+    // Frustum depth range from the projection matrix
+    zNear = projectionMatrix[ 3 ][ 2 ] / ( projectionMatrix[ 2 ][ 2 ] - 1.f );
+    zFar = projectionMatrix[ 3 ][ 2 ] / ( projectionMatrix[ 2 ][ 2 ] + 1.f );
+
+    lightData.resize( 2 * numberOfLights );
+    lightTiles.resize( numberOfLights );
+    lightSlices.resize( numberOfLights );
+    clusterData.assign( 2 * clustersPerSlice * GridZ, 0 );
+
+    JobSystem::instance().forEachTask( n, [&]( unsigned int task )
+    {
+        assignLights( lights, viewMatrix, projectionMatrix, numberOfLights * task / n, numberOfLights * ( task + 1 ) / n );
+    } );
+
+    // Count
+    JobSystem::instance().forEachTask( n, [&]( unsigned int task )
+    {
+        for ( int slice = task; slice < GridZ; slice += n )
+        {
+            GLuint* sliceData = &clusterData[ 2 * slice * clustersPerSlice ];
+            for ( size_t l = 0; l < numberOfLights; ++l )
+            {
+                if ( slice < lightSlices[ l ].x || slice > lightSlices[ l ].y )
+                {
+                    continue;
+                }
+                const glm::ivec4& rect = lightTiles[ l ];
+                for ( int ty = rect.y; ty <= rect.w; ++ty )
+                    for ( int tx = rect.x; tx <= rect.z; ++tx )
+                        ++sliceData[ 2 * ( ty * GridX + tx ) + 1 ];
+            }
+        }
+    } );
+
+    // Offsets (prefix sum of counts)
+    GLuint offset = 0;
+    for ( int cluster = 0; cluster < clustersPerSlice * GridZ; ++cluster )
+    {
+        clusterData[ 2 * cluster ] = offset;
+        offset += clusterData[ 2 * cluster + 1 ];
+        clusterData[ 2 * cluster + 1 ] = 0;
+    }
+    numberOfLightClusterEntries = static_cast< int >( offset );
+
+    // Fill
+    const int rows = std::max( 1, ( numberOfLightClusterEntries + LightIndexTextureWidth - 1 ) / LightIndexTextureWidth );
+    lightIndices.resize( rows * LightIndexTextureWidth );
+    JobSystem::instance().forEachTask( n, [&]( unsigned int task )
+    {
+        for ( int slice = task; slice < GridZ; slice += n )
+        {
+            GLuint* sliceData = &clusterData[ 2 * slice * clustersPerSlice ];
+            for ( size_t l = 0; l < numberOfLights; ++l )
+            {
+                if ( slice < lightSlices[ l ].x || slice > lightSlices[ l ].y )
+                {
+                    continue;
+                }
+                const glm::ivec4& rect = lightTiles[ l ];
+                for ( int ty = rect.y; ty <= rect.w; ++ty )
+                    for ( int tx = rect.x; tx <= rect.z; ++tx )
+                    {
+                        GLuint* cluster = &sliceData[ 2 * ( ty * GridX + tx ) ];
+                        lightIndices[ cluster[ 0 ] + cluster[ 1 ]++ ] = static_cast< GLuint >( l );
+                    }
+            }
+        }
+    } );
+
+    numberOfVisibleLights = 0;
+    for ( size_t l = 0; l < numberOfLights; ++l )
+    {
+        if ( lightSlices[ l ].x <= lightSlices[ l ].y && lightTiles[ l ].x <= lightTiles[ l ].z )
+        {
+            ++numberOfVisibleLights;
+        }
+    }
+
+    // Upload (each texture on the unit it is sampled from)
+    GLStateCache::bindTexture( FirstTextureUnit, GL_TEXTURE_2D, mLightTexture );
+    if ( numberOfLights > 0 )
+    {
+        glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, 2 * static_cast< GLsizei >( numberOfLights ), 1, GL_RGBA, GL_FLOAT, lightData.data() );
+    }
+
+    GLStateCache::bindTexture( FirstTextureUnit + 1, GL_TEXTURE_2D, mClusterTexture );
+    glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, clustersPerSlice, GridZ, GL_RG_INTEGER, GL_UNSIGNED_INT, clusterData.data() );
+
+    GLStateCache::bindTexture( FirstTextureUnit + 2, GL_TEXTURE_2D, mLightIndexTexture );
+    if ( rows > lightIndexTextureHeight )
+    {
+        lightIndexTextureHeight = rows;
+        glTexImage2D( GL_TEXTURE_2D, 0, GL_R32UI, LightIndexTextureWidth, rows, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, lightIndices.data() );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+    }
+    else
+    {
+        glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, LightIndexTextureWidth, rows, GL_RED_INTEGER, GL_UNSIGNED_INT, lightIndices.data() );
+    }
+}
+
+/******************************************************************************
+ * Send cluster uniforms to a program using "ShaderSource"
+ ******************************************************************************/
+void LightClusters::setUniforms( GLuint program, const glm::mat4& viewMatrix )
+{
+    GLint uniformLocation;
+
+    GLStateCache::useProgram( program );
+
+    const char* samplers[] = { "lightTexture", "clusterTexture", "lightIndexTexture" };
+    for ( int i = 0; i < 3; ++i )
+    {
+        uniformLocation = glGetUniformLocation( program, samplers[ i ] );
+        if ( uniformLocation >= 0 )
+        {
+            glUniform1i( uniformLocation, FirstTextureUnit + i );
+        }
+    }
+
+    uniformLocation = glGetUniformLocation( program, "lightIndexTextureWidth" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1i( uniformLocation, LightIndexTextureWidth );
+    }
+    uniformLocation = glGetUniformLocation( program, "clusterGrid" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform3i( uniformLocation, GridX, GridY, GridZ );
+    }
+    uniformLocation = glGetUniformLocation( program, "clusterTileScale" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform2f( uniformLocation, static_cast< float >( GridX ) / width, static_cast< float >( GridY ) / height );
+    }
+    uniformLocation = glGetUniformLocation( program, "clusterSliceScale" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1f( uniformLocation, GridZ / std::log( zFar / zNear ) );
+    }
+    uniformLocation = glGetUniformLocation( program, "clusterZNear" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1f( uniformLocation, zNear );
+    }
+    uniformLocation = glGetUniformLocation( program, "ambientColor" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform3fv( uniformLocation, 1, glm::value_ptr( ambientColor ) );
+    }
+    uniformLocation = glGetUniformLocation( program, "eyeMainLightPosition" );
+    if ( uniformLocation >= 0 )
+    {
+        const glm::vec3 eyeMainLightPosition = glm::vec3( viewMatrix * glm::vec4( mainLightPosition, 1.f ) );
+        glUniform3fv( uniformLocation, 1, glm::value_ptr( eyeMainLightPosition ) );
+    }
+    uniformLocation = glGetUniformLocation( program, "mainLightColor" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform3fv( uniformLocation, 1, glm::value_ptr( mainLightColor ) );
+    }
+}
+
+void LightClusters::bindTextures()
+{
+    const GLuint textures[] = { mLightTexture, mClusterTexture, mLightIndexTexture };
+    for ( int i = 0; i < 3; ++i )
+    {
+        GLStateCache::bindTexture( FirstTextureUnit + i, GL_TEXTURE_2D, textures[ i ] );
+    }
+}
+
+void LightClusters::unbindTextures()
+{
+    for ( int i = 0; i < 3; ++i )
+    {
+        GLStateCache::bindTexture( FirstTextureUnit + i, GL_TEXTURE_2D, 0 );
+    }
+}
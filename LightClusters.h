@@ -0,0 +1,95 @@
+#ifndef LIGHTCLUSTERS_H
+#define LIGHTCLUSTERS_H
+
+// STL
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Graphics
+// - GLEW (always before "gl.h")
+#include <GL/glew.h>
+// - GL
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+
+// glm
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "PointLight.h"
+
+/******************************************************************************
+ * Clustered forward shading
+ *
+ * The view frustum is cut in GridX x GridY screen tiles and GridZ slices
+ * (exponential in depth). Each frame a CPU job, spread over the worker
+ * threads, assigns lights to clusters and uploads compact index lists.
+ * Forward shaders include "ShaderSource" and only loop over the lights of
+ * the cluster of their fragment.
+ ******************************************************************************/
+class LightClusters{
+public:
+    // - cluster grid
+    static const int GridX = 16;
+    static const int GridY = 8;
+    static const int GridZ = 24;
+    static const int MaxLights = 1024;
+    static const int LightIndexTextureWidth = 1024;
+
+    // - texture units used by the light lists (unit 0 is the mesh texture)
+    static const int FirstTextureUnit = 1;
+
+    // - GLSL: uniforms and "vec3 clusteredLighting( eyePosition, eyeNormal, albedo )"
+    static const std::string ShaderSource;
+
+    // - light lists
+    GLuint mLightTexture;
+    GLuint mClusterTexture;
+    GLuint mLightIndexTexture;
+    int lightIndexTextureHeight;
+
+    // - frustum slicing
+    float zNear;
+    float zFar;
+    int width;
+    int height;
+
+    // - lighting not binned to clusters
+    glm::vec3 ambientColor;
+    glm::vec3 mainLightPosition;
+    glm::vec3 mainLightColor;
+
+    // - parallel tasks of build() (job system)
+    unsigned int numberOfThreads;
+
+    // - statistics of the last frame
+    int numberOfVisibleLights;
+    int numberOfLightClusterEntries;
+
+    LightClusters();
+
+    // Methode d'initialisation
+    bool initializeLightClusters();
+
+    void build( const std::vector< PointLight >& lights, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, int pWidth, int pHeight );
+    void setUniforms( GLuint program, const glm::mat4& viewMatrix );
+    void bindTextures();
+    void unbindTextures();
+
+private:
+    std::vector< glm::vec4 > lightData;
+    // - per light: tile rectangle and slice range
+    std::vector< glm::ivec4 > lightTiles;
+    std::vector< glm::ivec2 > lightSlices;
+    // - per cluster: (offset,count)
+    std::vector< GLuint > clusterData;
+    std::vector< GLuint > lightIndices;
+
+    void assignLights( const std::vector< PointLight >& lights, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, size_t first, size_t last );
+};
+
+#endif
@@ -0,0 +1,138 @@
+#include "Materials.h"
+
+#include "GLStateCache.h"
+
+const std::string MaterialLibrary::ShaderSource =
+    "precision highp sampler2DArray;\n"
+    "\n"
+    "// UNIFORM\n"
+    "// - diffuse images of the same size (one layer per material)\n"
+    "uniform sampler2DArray diffuseTex;\n"
+    "// - -1: no texture\n"
+    "uniform int materialLayer;\n"
+    "\n"
+    "vec3 materialAlbedo( vec2 uv )\n"
+    "{\n"
+    "    if ( materialLayer < 0 )\n"
+    "        return vec3( 1.0 );\n"
+    "    return texture( diffuseTex, vec3( uv.s, 1.0 - uv.t, float( materialLayer ) ) ).rgb;\n"
+    "}\n";
+
+MaterialLibrary::MaterialLibrary(){
+}
+
+/******************************************************************************
+ * Register a material image (CPU side, before initializeMaterials())
+ ******************************************************************************/
+int MaterialLibrary::addImage( const std::string& filename, const unsigned char* image, int width, int height )
+{
+    for ( size_t m = 0; m < filenames.size(); ++m )
+    {
+        if ( filenames[ m ] == filename )
+        {
+            return static_cast< int >( m );
+        }
+    }
+
+    Material material;
+    material.array = -1;
+    material.layer = -1;
+    material.width = width;
+    material.height = height;
+    materials.push_back( material );
+
+    filenames.push_back( filename );
+    images.push_back( std::vector< unsigned char >( image, image + width * height * 3 ) );
+
+    return static_cast< int >( materials.size() ) - 1;
+}
+
+/******************************************************************************
+ * Initialize material textures
+ * - one texture array per image size, layers in registration order
+ ******************************************************************************/
+bool MaterialLibrary::initializeMaterials()
+{
+    std::cout << "Initialize materials..." << std::endl;
+
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+
+    for ( size_t m = 0; m < materials.size(); ++m )
+    {
+        if ( materials[ m ].array >= 0 )
+            continue;
+
+        // Gather the materials of this size
+        std::vector< size_t > sameSize;
+        for ( size_t n = m; n < materials.size(); ++n )
+        {
+            if ( materials[ n ].width == materials[ m ].width && materials[ n ].height == materials[ m ].height )
+            {
+                materials[ n ].array = static_cast< int >( mArrayTextures.size() );
+                materials[ n ].layer = static_cast< int >( sameSize.size() );
+                sameSize.push_back( n );
+            }
+        }
+
+        GLuint texture;
+        glGenTextures( 1, &texture );
+        GLStateCache::bindTexture( TextureUnit, GL_TEXTURE_2D_ARRAY, texture );
+        glTexImage3D( GL_TEXTURE_2D_ARRAY, 0, GL_RGB8, materials[ m ].width, materials[ m ].height, static_cast< GLsizei >( sameSize.size() ), 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr );
+        for ( size_t l = 0; l < sameSize.size(); ++l )
+        {
+            glTexSubImage3D( GL_TEXTURE_2D_ARRAY, 0, 0, 0, static_cast< GLint >( l ), materials[ m ].width, materials[ m ].height, 1, GL_RGB, GL_UNSIGNED_BYTE, images[ sameSize[ l ] ].data() );
+        }
+        glGenerateMipmap( GL_TEXTURE_2D_ARRAY );
+
+        glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
+        glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+        glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT );
+        glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT );
+
+        mArrayTextures.push_back( texture );
+
+        std::cout << "- " << materials[ m ].width << "x" << materials[ m ].height << ": " << sameSize.size() << " layer(s)" << std::endl;
+    }
+
+    // CPU copies are not needed anymore
+    std::vector< std::vector< unsigned char > >().swap( images );
+
+    std::cout << "- " << materials.size() << " materials in " << mArrayTextures.size() << " texture array(s)" << std::endl;
+
+    return true;
+}
+
+GLuint MaterialLibrary::arrayTexture( int material ) const
+{
+    if ( material < 0 || material >= static_cast< int >( materials.size() ) || materials[ material ].array < 0 )
+    {
+        return 0;
+    }
+    return mArrayTextures[ materials[ material ].array ];
+}
+
+int MaterialLibrary::layer( int material ) const
+{
+    if ( material < 0 || material >= static_cast< int >( materials.size() ) )
+    {
+        return -1;
+    }
+    return materials[ material ].layer;
+}
+
+/******************************************************************************
+ * Bind the material of the next draw
+ * - the array texture is only rebound when the image size changes
+ ******************************************************************************/
+void MaterialLibrary::bindMaterial( GLint layerLocation, int material ) const
+{
+    const GLuint texture = arrayTexture( material );
+    if ( texture != 0 )
+    {
+        GLStateCache::bindTexture( TextureUnit, GL_TEXTURE_2D_ARRAY, texture );
+    }
+    if ( layerLocation >= 0 )
+    {
+        glUniform1i( layerLocation, ( texture != 0 ) ? layer( material ) : -1 );
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef MATERIALS_H
+#define MATERIALS_H
+
+// STL
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Graphics
+// - GLEW (always before "gl.h")
+#include <GL/glew.h>
+// - GL
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+
+/******************************************************************************
+ * Material library
+ *
+ * Diffuse images of the model materials are collected while the model is
+ * loaded (no GL context yet), then packed by size into GL_TEXTURE_2D_ARRAY
+ * textures: a material is a layer of one of these arrays. Meshes sharing an
+ * image size are drawn with the same texture bound, only the layer index
+ * uniform changes between draws.
+ ******************************************************************************/
+class MaterialLibrary{
+public:
+    // - texture unit used by the model shaders
+    static const int TextureUnit = 0;
+
+    // - GLSL: uniforms and "vec3 materialAlbedo( uv )" (white without texture)
+    static const std::string ShaderSource;
+
+    struct Material
+    {
+        // - index in mArrayTextures
+        int array;
+        int layer;
+        int width;
+        int height;
+    };
+
+    std::vector< Material > materials;
+    std::vector< GLuint > mArrayTextures;
+
+    MaterialLibrary();
+
+    // Methode d'initialisation
+    bool initializeMaterials();
+
+    // - RGB image (8 bits per channel) shared by all materials using filename, returns the material index
+    int addImage( const std::string& filename, const unsigned char* image, int width, int height );
+
+    // - 0 / -1 when material is -1 (no texture)
+    GLuint arrayTexture( int material ) const;
+    int layer( int material ) const;
+
+    // - GL: material of the next draw (layerLocation: "materialLayer" uniform of the current program)
+    void bindMaterial( GLint layerLocation, int material ) const;
+
+private:
+    std::vector< std::string > filenames;
+    // - released once uploaded
+    std::vector< std::vector< unsigned char > > images;
+};
+
+#endif
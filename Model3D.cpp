@@ -10,6 +10,7 @@ Model3D::Model3D(){
 void Model3D::loadMesh(const std::string filename){
     bool statusOk = _Loader->import(filename);
     assert(statusOk);
+    _Loader->materials = &materials;
     bool loadOk = _Loader->loadData(vertices,normals,indices,textures,AllTexture,modelTexture);
 
     assert(loadOk);
@@ -18,11 +19,18 @@ void Model3D::loadMesh(const std::string filename){
     OBBs.resize(nb_mesh);
     aabb_min.resize(nb_mesh);
     aabb_max.resize(nb_mesh);
-    transform.resize(nb_mesh);
+    bounds_min.resize(nb_mesh);
+    bounds_max.resize(nb_mesh);
+    meshNode.resize(nb_mesh);
+    meshMaterial.resize(nb_mesh);
+
+    scene = SceneGraph();
+    rootNode = scene.addNode(-1, glm::mat4());
 
     for(int i=0;i<nb_mesh;i++){
         glm::mat4 transMatrix   = glm::mat4();
-        transform[i]=transMatrix;
+        meshNode[i] = scene.addNode(rootNode, transMatrix);
+        meshMaterial[i] = (AllTexture[i][0].size() > 0) ? AllTexture[i][0][0].material : -1;
 
         auto minMax_x = std::minmax_element(vertices[i].begin(), vertices[i].end(),[](const glm::vec3& v1, const glm::vec3& v2) {
             return v1.x < v2.x;
@@ -38,8 +46,13 @@ void Model3D::loadMesh(const std::string filename){
 
         aabb_max[i] = glm::vec3(minMax_x.second->x,minMax_y.second->y-abs(minMax_y.first->y-minMax_y.second->y),minMax_z.second->z);
         aabb_min[i] = glm::vec3(minMax_x.first->x,minMax_y.first->y-2*abs(minMax_y.first->y-minMax_y.second->y),minMax_z.first->z);
+
+        bounds_min[i] = glm::vec3(minMax_x.first->x,minMax_y.first->y,minMax_z.first->z);
+        bounds_max[i] = glm::vec3(minMax_x.second->x,minMax_y.second->y,minMax_z.second->z);
     }
 
+    scene.update();
+
 
 
 
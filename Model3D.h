@@ -4,6 +4,8 @@
 #include <iostream>
 #include <vector>
 
+// - GLEW (always before "gl.h")
+#include <GL/glew.h>
 // - GL
 #ifdef _WIN32
 #include <windows.h>
@@ -16,6 +18,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "AssetLoader.h"
+#include "SceneGraph.h"
 
 using namespace std;
 class Model3D{
@@ -28,20 +31,43 @@ public:
     vector<vector<vector<Texture>>> AllTexture;
     vector<GLuint> modelTexture;
 
+    // - diffuse images packed in texture arrays, material of each mesh (-1: none)
+    MaterialLibrary materials;
+    vector<int> meshMaterial;
+
     std::string path;
     vector<vector<glm::vec3>> OBBs;
     int nb_mesh;
-    vector<glm::mat4> transform;
+
+    // - scene graph: model root node, one child node per mesh
+    SceneGraph scene;
+    int rootNode;
+    vector<int> meshNode;
 
     vector<glm::vec3> aabb_min;
     vector<glm::vec3> aabb_max;
 
+    // - exact mesh bounds (aabb_* above are shifted for picking)
+    vector<glm::vec3> bounds_min;
+    vector<glm::vec3> bounds_max;
+
     int selectedModel;
 
     void setSelect(int n){
         selectedModel = n;
     }
 
+    // - world matrix of a mesh (and its normal matrix, last scene update)
+    const glm::mat4& transform(int i) const{
+        return scene.world[meshNode[i]];
+    }
+    const glm::mat3& normalTransform(int i) const{
+        return scene.normal[meshNode[i]];
+    }
+    void setTransform(int i, const glm::mat4& world){
+        scene.setWorld(meshNode[i], world);
+    }
+
     Model3D();
     void loadMesh(const std::string filename);
     void initialize(const std::vector<std::vector<glm::vec3>>& position,std::vector<std::vector<unsigned int> > &);
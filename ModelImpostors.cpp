@@ -0,0 +1,536 @@
+#include "ModelImpostors.h"
+
+#include "GLStateCache.h"
+#include "Materials.h"
+#include "ShaderProgram.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+
+// glm
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace
+{
+    // GLSL: octahedral map and frame axes (same as the C++ functions of the class)
+    const char* OctahedralShaderSource =
+        "vec2 signNotZero( vec2 v )\n"
+        "{\n"
+        "    return vec2( v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0 );\n"
+        "}\n"
+        "\n"
+        "vec3 octahedralDecode( vec2 p )\n"
+        "{\n"
+        "    vec3 d = vec3( p.x, 1.0 - abs( p.x ) - abs( p.y ), p.y );\n"
+        "    if ( d.y < 0.0 )\n"
+        "        d.xz = ( 1.0 - abs( d.zx ) ) * signNotZero( d.xz );\n"
+        "    return normalize( d );\n"
+        "}\n"
+        "\n"
+        "void frameAxes( vec3 direction, out vec3 right, out vec3 up )\n"
+        "{\n"
+        "    vec3 reference = ( abs( direction.y ) > 0.99 ) ? vec3( 0.0, 0.0, 1.0 ) : vec3( 0.0, 1.0, 0.0 );\n"
+        "    right = normalize( cross( reference, direction ) );\n"
+        "    up = cross( direction, right );\n"
+        "}\n";
+
+    const char* BakeVertexShaderSource =
+        "#version 300 es\n"
+        "\n"
+        "// INPUT\n"
+        "layout (location = 0) in vec3 position;\n"
+        "layout (location = 1) in vec3 normal;\n"
+        "layout (location = 2) in vec2 tex;\n"
+        "\n"
+        "// UNIFORM\n"
+        "// - orthographic view of the frame (mesh space)\n"
+        "uniform mat4 frameMatrix;\n"
+        "\n"
+        "// OUTPUT\n"
+        "out vec3 meshPosition;\n"
+        "out vec3 meshNormal;\n"
+        "out vec2 uv;\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    meshPosition = position;\n"
+        "    meshNormal = normal;\n"
+        "    uv = tex;\n"
+        "    gl_Position = frameMatrix * vec4( position, 1.0 );\n"
+        "}\n";
+
+    const char* BakeFragmentShaderHeader =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "\n";
+
+    const char* BakeFragmentShaderSource =
+        "\n"
+        "// INPUT\n"
+        "in vec3 meshPosition;\n"
+        "in vec3 meshNormal;\n"
+        "in vec2 uv;\n"
+        "\n"
+        "// UNIFORM\n"
+        "// - bounding sphere and frame view direction (toward the camera)\n"
+        "uniform vec4 sphere;\n"
+        "uniform vec3 frameDirection;\n"
+        "\n"
+        "// OUTPUT\n"
+        "layout( location = 0 ) out vec4 impostorAlbedo;\n"
+        "layout( location = 1 ) out vec4 impostorNormal;\n"
+        "layout( location = 2 ) out vec4 impostorDepth;\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    impostorAlbedo = vec4( materialAlbedo( uv ), 1.0 );\n"
+        "    impostorNormal = vec4( normalize( meshNormal ) * 0.5 + 0.5, 1.0 );\n"
+        "    float depth = dot( meshPosition - sphere.xyz, frameDirection ) / sphere.w;\n"
+        "    impostorDepth = vec4( depth * 0.5 + 0.5 );\n"
+        "}\n";
+
+    const char* ImpostorVertexShaderHeader =
+        "#version 300 es\n"
+        "\n";
+
+    const char* ImpostorVertexShaderSource =
+        "\n"
+        "// INPUT\n"
+        "// - quad corner in [0,1]^2\n"
+        "layout (location = 0) in vec2 corner;\n"
+        "// - mesh transform rows, bounding sphere, (layer, frame x, frame y, selected)\n"
+        "layout (location = 1) in vec4 instanceRow0;\n"
+        "layout (location = 2) in vec4 instanceRow1;\n"
+        "layout (location = 3) in vec4 instanceRow2;\n"
+        "layout (location = 4) in vec4 instanceSphere;\n"
+        "layout (location = 5) in vec4 instanceData;\n"
+        "\n"
+        "// UNIFORM\n"
+        "uniform mat4 viewMatrix;\n"
+        "uniform mat4 projectionMatrix;\n"
+        "uniform float framesPerSide;\n"
+        "\n"
+        "// OUTPUT\n"
+        "out vec2 frameUV;\n"
+        "out vec3 worldPosition;\n"
+        "flat out vec3 frameOrigin;\n"
+        "flat out float layer;\n"
+        "flat out float selected;\n"
+        "// - mesh to world (linear part) and depth axis (world, one sphere radius long)\n"
+        "flat out mat3 meshToWorld;\n"
+        "flat out vec3 depthAxis;\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    vec2 frame = instanceData.yz;\n"
+        "    vec3 direction = octahedralDecode( ( frame + 0.5 ) / framesPerSide * 2.0 - 1.0 );\n"
+        "    vec3 right;\n"
+        "    vec3 up;\n"
+        "    frameAxes( direction, right, up );\n"
+        "\n"
+        "    // Quad through the sphere center, in the plane of the frame image\n"
+        "    vec4 p = vec4( instanceSphere.xyz + ( right * ( corner.x * 2.0 - 1.0 ) + up * ( corner.y * 2.0 - 1.0 ) ) * instanceSphere.w, 1.0 );\n"
+        "    worldPosition = vec3( dot( instanceRow0, p ), dot( instanceRow1, p ), dot( instanceRow2, p ) );\n"
+        "\n"
+        "    meshToWorld = transpose( mat3( instanceRow0.xyz, instanceRow1.xyz, instanceRow2.xyz ) );\n"
+        "    depthAxis = meshToWorld * direction * instanceSphere.w;\n"
+        "    frameUV = corner;\n"
+        "    frameOrigin = vec3( frame, 0.0 );\n"
+        "    layer = instanceData.x;\n"
+        "    selected = instanceData.w;\n"
+        "\n"
+        "    gl_Position = projectionMatrix * viewMatrix * vec4( worldPosition, 1.0 );\n"
+        "}\n";
+
+    const char* ImpostorFragmentShaderSource =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "precision highp sampler2DArray;\n"
+        "\n"
+        "// INPUT\n"
+        "in vec2 frameUV;\n"
+        "in vec3 worldPosition;\n"
+        "flat in vec3 frameOrigin;\n"
+        "flat in float layer;\n"
+        "flat in float selected;\n"
+        "flat in mat3 meshToWorld;\n"
+        "flat in vec3 depthAxis;\n"
+        "\n"
+        "// UNIFORM\n"
+        "uniform sampler2DArray impostorAlbedo;\n"
+        "uniform sampler2DArray impostorNormal;\n"
+        "uniform sampler2DArray impostorDepth;\n"
+        "uniform float framesPerSide;\n"
+        "uniform float frameResolution;\n"
+        "uniform mat4 viewMatrix;\n"
+        "uniform mat4 projectionMatrix;\n"
+        "uniform vec3 lightPosition;\n"
+        "uniform vec3 lightColor;\n"
+        "\n"
+        "// OUTPUT\n"
+        "layout( location = 0 ) out vec4 fragmentColor;\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    // - half a texel inside the frame: no bleeding from the neighbouring frames\n"
+        "    float margin = 0.5 / frameResolution;\n"
+        "    vec2 uv = ( frameOrigin.xy + clamp( frameUV, margin, 1.0 - margin ) ) / framesPerSide;\n"
+        "    vec4 albedo = texture( impostorAlbedo, vec3( uv, layer ) );\n"
+        "    if ( albedo.a < 0.5 )\n"
+        "        discard;\n"
+        "\n"
+        "    // Surface point: baked depth along the frame direction\n"
+        "    float depth = texture( impostorDepth, vec3( uv, layer ) ).r * 2.0 - 1.0;\n"
+        "    vec3 surface = worldPosition + depthAxis * depth;\n"
+        "    vec4 clipPosition = projectionMatrix * viewMatrix * vec4( surface, 1.0 );\n"
+        "    gl_FragDepth = clipPosition.z / clipPosition.w * 0.5 + 0.5;\n"
+        "\n"
+        "    // Same lighting as the model meshes (material color of drawModels)\n"
+        "    vec3 normal = normalize( meshToWorld * ( texture( impostorNormal, vec3( uv, layer ) ).xyz * 2.0 - 1.0 ) );\n"
+        "    vec3 L = normalize( lightPosition - surface );\n"
+        "    float diffuse = max( 0.0, dot( normal, L ) );\n"
+        "    vec3 materialKd = ( selected > 0.5 ) ? vec3( 0.0, 1.0, 0.0 ) : vec3( 0.0, 0.0, 1.0 );\n"
+        "    fragmentColor = vec4( albedo.rgb * lightColor * materialKd * diffuse, 1.0 );\n"
+        "}\n";
+
+    // Array texture of the atlas layers
+    GLuint createAtlas( int unit, GLenum internalFormat, GLenum format, int size, int layers )
+    {
+        GLuint texture;
+        glGenTextures( 1, &texture );
+        GLStateCache::bindTexture( unit, GL_TEXTURE_2D_ARRAY, texture );
+        glTexImage3D( GL_TEXTURE_2D_ARRAY, 0, internalFormat, size, size, layers, 0, format, GL_UNSIGNED_BYTE, nullptr );
+        glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+        glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+        glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+        glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+        return texture;
+    }
+}
+
+ModelImpostors::ModelImpostors(){
+    enabled = true;
+    ready = false;
+
+    framesPerSide = 8;
+    frameResolution = 32;
+    distance = 6.f;
+
+    numberOfImpostors = 0;
+
+    mBakeShaderProgram = 0;
+    mImpostorShaderProgram = 0;
+    mAlbedoTexture = 0;
+    mNormalTexture = 0;
+    mDepthTexture = 0;
+    mInstanceBuffer = 0;
+    mQuadVertexBuffer = 0;
+    mQuadVertexArray = 0;
+}
+
+/******************************************************************************
+ * Octahedral map
+ * - upper hemisphere in the center diamond, lower one folded on the corners
+ ******************************************************************************/
+glm::vec2 ModelImpostors::octahedralEncode( const glm::vec3& direction )
+{
+    const glm::vec3 d = direction / ( std::fabs( direction.x ) + std::fabs( direction.y ) + std::fabs( direction.z ) );
+    glm::vec2 p( d.x, d.z );
+    if ( d.y < 0.f )
+    {
+        p = glm::vec2( ( 1.f - std::fabs( d.z ) ) * ( d.x >= 0.f ? 1.f : -1.f ),
+                       ( 1.f - std::fabs( d.x ) ) * ( d.z >= 0.f ? 1.f : -1.f ) );
+    }
+    return p;
+}
+
+glm::vec3 ModelImpostors::octahedralDecode( const glm::vec2& coordinates )
+{
+    glm::vec3 d( coordinates.x, 1.f - std::fabs( coordinates.x ) - std::fabs( coordinates.y ), coordinates.y );
+    if ( d.y < 0.f )
+    {
+        const float x = d.x;
+        d.x = ( 1.f - std::fabs( d.z ) ) * ( x >= 0.f ? 1.f : -1.f );
+        d.z = ( 1.f - std::fabs( x ) ) * ( d.z >= 0.f ? 1.f : -1.f );
+    }
+    return glm::normalize( d );
+}
+
+glm::vec3 ModelImpostors::frameDirection( int fx, int fy ) const
+{
+    return octahedralDecode( ( glm::vec2( fx, fy ) + 0.5f ) / static_cast< float >( framesPerSide ) * 2.f - 1.f );
+}
+
+void ModelImpostors::frameAxes( const glm::vec3& direction, glm::vec3& right, glm::vec3& up )
+{
+    const glm::vec3 reference = ( std::fabs( direction.y ) > 0.99f ) ? glm::vec3( 0.f, 0.f, 1.f ) : glm::vec3( 0.f, 1.f, 0.f );
+    right = glm::normalize( glm::cross( reference, direction ) );
+    up = glm::cross( direction, right );
+}
+
+/******************************************************************************
+ * Initialize impostors
+ ******************************************************************************/
+bool ModelImpostors::initializeImpostors( const Model3D& model, const std::vector< GLuint >& vertexArrays )
+{
+    std::cout << "Initialize model impostors..." << std::endl;
+
+    const char* bakeFragmentShaderSource[] = { BakeFragmentShaderHeader, MaterialLibrary::ShaderSource.c_str(), BakeFragmentShaderSource };
+    const std::string bakeFragmentShaderString = std::string( bakeFragmentShaderSource[ 0 ] ) + bakeFragmentShaderSource[ 1 ] + bakeFragmentShaderSource[ 2 ];
+    mBakeShaderProgram = ShaderProgram::create( BakeVertexShaderSource, bakeFragmentShaderString.c_str(), "impostor bake" );
+
+    const std::string impostorVertexShaderString = std::string( ImpostorVertexShaderHeader ) + OctahedralShaderSource + ImpostorVertexShaderSource;
+    mImpostorShaderProgram = ShaderProgram::create( impostorVertexShaderString.c_str(), ImpostorFragmentShaderSource, "impostor" );
+
+    if ( mBakeShaderProgram == 0 || mImpostorShaderProgram == 0 )
+    {
+        return false;
+    }
+
+    // Bounding spheres (mesh space)
+    spheres.resize( model.nb_mesh );
+    for ( int i = 0; i < model.nb_mesh; i++ )
+    {
+        const glm::vec3 center = 0.5f * ( model.bounds_min[ i ] + model.bounds_max[ i ] );
+        const float radius = std::max( 0.5f * glm::length( model.bounds_max[ i ] - model.bounds_min[ i ] ), 1e-4f );
+        spheres[ i ] = glm::vec4( center, radius );
+    }
+
+    GLint maxLayers = 256;
+    glGetIntegerv( GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers );
+    if ( model.nb_mesh == 0 || model.nb_mesh > maxLayers )
+    {
+        std::cout << "- " << model.nb_mesh << " meshes for " << maxLayers << " texture layers, no impostors" << std::endl;
+        return true;
+    }
+
+    // Quad and instances (corner 0, instance attributes 1 to 5)
+    const glm::vec2 corners[ 4 ] = { glm::vec2( 0.f, 0.f ), glm::vec2( 1.f, 0.f ), glm::vec2( 0.f, 1.f ), glm::vec2( 1.f, 1.f ) };
+    glGenBuffers( 1, &mQuadVertexBuffer );
+    glBindBuffer( GL_ARRAY_BUFFER, mQuadVertexBuffer );
+    glBufferData( GL_ARRAY_BUFFER, sizeof( corners ), corners, GL_STATIC_DRAW );
+    glGenBuffers( 1, &mInstanceBuffer );
+
+    glGenVertexArrays( 1, &mQuadVertexArray );
+    glBindVertexArray( mQuadVertexArray );
+    glVertexAttribPointer( 0, 2, GL_FLOAT, GL_FALSE, 0, 0 );
+    glEnableVertexAttribArray( 0 );
+    glBindBuffer( GL_ARRAY_BUFFER, mInstanceBuffer );
+    glBufferData( GL_ARRAY_BUFFER, model.nb_mesh * sizeof( Instance ), nullptr, GL_STREAM_DRAW );
+    for ( int a = 0; a < 5; ++a )
+    {
+        glVertexAttribPointer( 1 + a, 4, GL_FLOAT, GL_FALSE, sizeof( Instance ), (void*)( a * sizeof( glm::vec4 ) ) );
+        glEnableVertexAttribArray( 1 + a );
+        glVertexAttribDivisor( 1 + a, 1 );
+    }
+    glBindVertexArray( 0 );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+    ready = bake( model, vertexArrays );
+
+    return true;
+}
+
+/******************************************************************************
+ * Bake the frames of every mesh
+ *
+ * Frame (fx,fy): orthographic view of the bounding sphere from its
+ * direction, written in the (fx,fy) cell of the mesh layer.
+ ******************************************************************************/
+bool ModelImpostors::bake( const Model3D& model, const std::vector< GLuint >& vertexArrays )
+{
+    const int atlas = framesPerSide * frameResolution;
+    std::cout << "- bake " << model.nb_mesh << " meshes, " << framesPerSide * framesPerSide << " views of "
+              << frameResolution << "x" << frameResolution << std::endl;
+
+    mAlbedoTexture = createAtlas( TextureUnit, GL_RGBA8, GL_RGBA, atlas, model.nb_mesh );
+    mNormalTexture = createAtlas( TextureUnit + 1, GL_RGBA8, GL_RGBA, atlas, model.nb_mesh );
+    mDepthTexture = createAtlas( TextureUnit + 2, GL_R8, GL_RED, atlas, model.nb_mesh );
+
+    GLuint depthRenderbuffer;
+    glGenRenderbuffers( 1, &depthRenderbuffer );
+    glBindRenderbuffer( GL_RENDERBUFFER, depthRenderbuffer );
+    glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, atlas, atlas );
+    glBindRenderbuffer( GL_RENDERBUFFER, 0 );
+
+    GLuint framebuffer;
+    glGenFramebuffers( 1, &framebuffer );
+    GLStateCache::bindFramebuffer( framebuffer );
+    glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer );
+    const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+    glDrawBuffers( 3, drawBuffers );
+
+    GLint viewport[ 4 ];
+    glGetIntegerv( GL_VIEWPORT, viewport );
+
+    GLStateCache::useProgram( mBakeShaderProgram );
+    GLStateCache::enable( GL_DEPTH_TEST );
+    GLint uniformLocation = glGetUniformLocation( mBakeShaderProgram, "diffuseTex" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1i( uniformLocation, MaterialLibrary::TextureUnit );
+    }
+    const GLint frameMatrixLocation = glGetUniformLocation( mBakeShaderProgram, "frameMatrix" );
+    const GLint sphereLocation = glGetUniformLocation( mBakeShaderProgram, "sphere" );
+    const GLint frameDirectionLocation = glGetUniformLocation( mBakeShaderProgram, "frameDirection" );
+    const GLint materialLayerLocation = glGetUniformLocation( mBakeShaderProgram, "materialLayer" );
+
+    bool statusOK = true;
+    for ( int i = 0; i < model.nb_mesh && statusOK; i++ )
+    {
+        glFramebufferTextureLayer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, mAlbedoTexture, 0, i );
+        glFramebufferTextureLayer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, mNormalTexture, 0, i );
+        glFramebufferTextureLayer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, mDepthTexture, 0, i );
+        if ( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE )
+        {
+            std::cout << "Error: impostor framebuffer is incomplete" << std::endl;
+            statusOK = false;
+            break;
+        }
+
+        GLStateCache::viewport( 0, 0, atlas, atlas );
+        glClearColor( 0.f, 0.f, 0.f, 0.f );
+        glClearDepth( 1.f );
+        glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+
+        const glm::vec3 center( spheres[ i ] );
+        const float radius = spheres[ i ].w;
+        glUniform4fv( sphereLocation, 1, glm::value_ptr( spheres[ i ] ) );
+        model.materials.bindMaterial( materialLayerLocation, model.meshMaterial[ i ] );
+        GLStateCache::bindVertexArray( vertexArrays[ i ] );
+
+        for ( int fy = 0; fy < framesPerSide; ++fy )
+        {
+            for ( int fx = 0; fx < framesPerSide; ++fx )
+            {
+                const glm::vec3 direction = frameDirection( fx, fy );
+                glm::vec3 right;
+                glm::vec3 up;
+                frameAxes( direction, right, up );
+                const glm::mat4 view = glm::lookAt( center + 2.f * radius * direction, center, up );
+                const glm::mat4 projection = glm::ortho( -radius, radius, -radius, radius, radius, 3.f * radius );
+                const glm::mat4 frameMatrix = projection * view;
+
+                GLStateCache::viewport( fx * frameResolution, fy * frameResolution, frameResolution, frameResolution );
+                glUniformMatrix4fv( frameMatrixLocation, 1, GL_FALSE, glm::value_ptr( frameMatrix ) );
+                glUniform3fv( frameDirectionLocation, 1, glm::value_ptr( direction ) );
+                glDrawElements( GL_TRIANGLES, model.indices[ i ].size(), GL_UNSIGNED_INT, (void*)0 );
+            }
+        }
+    }
+
+    GLStateCache::bindFramebuffer( 0 );
+    GLStateCache::viewport( viewport[ 0 ], viewport[ 1 ], viewport[ 2 ], viewport[ 3 ] );
+    GLStateCache::forgetFramebuffer( framebuffer );
+    glDeleteFramebuffers( 1, &framebuffer );
+    glDeleteRenderbuffers( 1, &depthRenderbuffer );
+
+    return statusOK;
+}
+
+/******************************************************************************
+ * Select the impostors of the frame
+ * - frame nearest to the direction of the camera, in mesh space
+ ******************************************************************************/
+void ModelImpostors::select( const Model3D& model, const glm::vec3& cameraPosition, const std::vector< bool >& impostor, const std::vector< bool >& selected )
+{
+    instances.clear();
+    numberOfImpostors = 0;
+    if ( !enabled || !ready )
+        return;
+
+    for ( int i = 0; i < model.nb_mesh; i++ )
+    {
+        if ( !impostor[ i ] )
+            continue;
+
+        const glm::mat4& transform = model.transform( i );
+        const glm::vec3 toCamera = glm::vec3( glm::inverse( transform ) * glm::vec4( cameraPosition, 1.f ) ) - glm::vec3( spheres[ i ] );
+        const glm::vec2 uv = octahedralEncode( glm::normalize( toCamera ) ) * 0.5f + 0.5f;
+        const int fx = std::min( static_cast< int >( uv.x * framesPerSide ), framesPerSide - 1 );
+        const int fy = std::min( static_cast< int >( uv.y * framesPerSide ), framesPerSide - 1 );
+
+        Instance instance;
+        for ( int r = 0; r < 3; ++r )
+        {
+            instance.rows[ r ] = glm::vec4( transform[ 0 ][ r ], transform[ 1 ][ r ], transform[ 2 ][ r ], transform[ 3 ][ r ] );
+        }
+        instance.sphere = spheres[ i ];
+        instance.data = glm::vec4( static_cast< float >( i ), static_cast< float >( fx ), static_cast< float >( fy ),
+                                   selected[ i ] ? 1.f : 0.f );
+        instances.push_back( instance );
+    }
+
+    numberOfImpostors = static_cast< int >( instances.size() );
+    if ( !instances.empty() )
+    {
+        GLStateCache::bindArrayBuffer( mInstanceBuffer );
+        glBufferSubData( GL_ARRAY_BUFFER, 0, instances.size() * sizeof( Instance ), instances.data() );
+    }
+}
+
+/******************************************************************************
+ * Draw the impostors: one instanced quad per mesh
+ ******************************************************************************/
+void ModelImpostors::draw( const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix,
+                           const glm::vec3& lightPosition, const glm::vec3& lightColor ) const
+{
+    if ( instances.empty() )
+        return;
+
+    GLint uniformLocation;
+    const GLuint program = mImpostorShaderProgram;
+
+    GLStateCache::useProgram( program );
+    uniformLocation = glGetUniformLocation( program, "viewMatrix" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniformMatrix4fv( uniformLocation, 1, GL_FALSE, glm::value_ptr( viewMatrix ) );
+    }
+    uniformLocation = glGetUniformLocation( program, "projectionMatrix" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniformMatrix4fv( uniformLocation, 1, GL_FALSE, glm::value_ptr( projectionMatrix ) );
+    }
+    uniformLocation = glGetUniformLocation( program, "lightPosition" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform3fv( uniformLocation, 1, glm::value_ptr( lightPosition ) );
+    }
+    uniformLocation = glGetUniformLocation( program, "lightColor" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform3fv( uniformLocation, 1, glm::value_ptr( lightColor ) );
+    }
+    uniformLocation = glGetUniformLocation( program, "framesPerSide" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1f( uniformLocation, static_cast< float >( framesPerSide ) );
+    }
+    uniformLocation = glGetUniformLocation( program, "frameResolution" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1f( uniformLocation, static_cast< float >( frameResolution ) );
+    }
+
+    const char* samplers[ 3 ] = { "impostorAlbedo", "impostorNormal", "impostorDepth" };
+    const GLuint textures[ 3 ] = { mAlbedoTexture, mNormalTexture, mDepthTexture };
+    for ( int t = 0; t < 3; ++t )
+    {
+        uniformLocation = glGetUniformLocation( program, samplers[ t ] );
+        if ( uniformLocation >= 0 )
+        {
+            glUniform1i( uniformLocation, TextureUnit + t );
+        }
+        GLStateCache::bindTexture( TextureUnit + t, GL_TEXTURE_2D_ARRAY, textures[ t ] );
+    }
+
+    GLStateCache::bindVertexArray( mQuadVertexArray );
+    glDrawArraysInstanced( GL_TRIANGLE_STRIP, 0, 4, static_cast< GLsizei >( instances.size() ) );
+}
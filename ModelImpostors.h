@@ -0,0 +1,99 @@
+#ifndef MODELIMPOSTORS_H
+#define MODELIMPOSTORS_H
+
+// STL
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Graphics
+// - GLEW (always before "gl.h")
+#include <GL/glew.h>
+// - GL
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+
+// glm
+#include <glm/glm.hpp>
+
+#include "Model3D.h"
+
+/******************************************************************************
+ * Model impostors
+ *
+ * Each mesh of the model is rendered offscreen, once after loading, from
+ * framesPerSide x framesPerSide view directions spread over the sphere by an
+ * octahedral map: frame (fx,fy) is the view from the direction whose
+ * octahedral coordinates are the frame center. The frames of a mesh fill
+ * one layer of three texture arrays: albedo (alpha: coverage), mesh space
+ * normal and depth along the view direction (bounding sphere range).
+ *
+ * Meshes further than the swap distance are drawn as one quad each, in the
+ * frame nearest to the direction of the camera: lit with the baked normal,
+ * and the baked depth written so the quad intersects the terrain like the
+ * mesh would.
+ ******************************************************************************/
+class ModelImpostors{
+public:
+    // - texture units of the albedo, normal and depth arrays
+    static const int TextureUnit = 9;
+
+    bool enabled;
+    // - baked and program built
+    bool ready;
+
+    int framesPerSide;
+    int frameResolution;
+    // - world distance beyond which a mesh is drawn as an impostor (level of detail of the scene store)
+    float distance;
+
+    // - per mesh: bounding sphere in mesh space
+    std::vector< glm::vec4 > spheres;
+
+    // - last frame
+    int numberOfImpostors;
+
+    GLuint mBakeShaderProgram;
+    GLuint mImpostorShaderProgram;
+    GLuint mAlbedoTexture;
+    GLuint mNormalTexture;
+    GLuint mDepthTexture;
+    GLuint mInstanceBuffer;
+    GLuint mQuadVertexBuffer;
+    GLuint mQuadVertexArray;
+
+    ModelImpostors();
+
+    // Methode d'initialisation
+    // - vertexArrays: VAO of each mesh (position 0, normal 1, texture coordinates 2)
+    bool initializeImpostors( const Model3D& model, const std::vector< GLuint >& vertexArrays );
+
+    // - impostors of the flagged meshes (beyond the distance, once per frame), selected ones highlighted
+    void select( const Model3D& model, const glm::vec3& cameraPosition, const std::vector< bool >& impostor, const std::vector< bool >& selected );
+
+    // - impostors selected last, forward shading with the main light
+    void draw( const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix,
+               const glm::vec3& lightPosition, const glm::vec3& lightColor ) const;
+
+    // - octahedral map of the unit sphere ([-1,1]^2)
+    static glm::vec2 octahedralEncode( const glm::vec3& direction );
+    static glm::vec3 octahedralDecode( const glm::vec2& coordinates );
+    // - view direction of a frame, and the right / up axes of its image
+    glm::vec3 frameDirection( int fx, int fy ) const;
+    static void frameAxes( const glm::vec3& direction, glm::vec3& right, glm::vec3& up );
+
+private:
+    // - 3 rows of the mesh transform, bounding sphere, (layer, frame x, frame y, selected)
+    struct Instance{
+        glm::vec4 rows[ 3 ];
+        glm::vec4 sphere;
+        glm::vec4 data;
+    };
+    std::vector< Instance > instances;
+
+    bool bake( const Model3D& model, const std::vector< GLuint >& vertexArrays );
+};
+
+#endif
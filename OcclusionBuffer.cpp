@@ -0,0 +1,338 @@
+#include "OcclusionBuffer.h"
+
+// STL
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#include "CpuFeatures.h"
+#include "JobSystem.h"
+
+namespace
+{
+    // One row of a triangle: edge functions e(x) = a*x + rowEdge, depth z(x) = dzdx*x + rowZ
+    void rasterizeSpan( const float* a, const float* rowEdge, float dzdx, float rowZ, float* row, int xmin, int xmax )
+    {
+        for ( int x = xmin; x <= xmax; ++x )
+        {
+            const float px = static_cast< float >( x ) + 0.5f;
+            if ( a[ 0 ] * px + rowEdge[ 0 ] >= 0.f
+              && a[ 1 ] * px + rowEdge[ 1 ] >= 0.f
+              && a[ 2 ] * px + rowEdge[ 2 ] >= 0.f )
+            {
+                const float z = dzdx * px + rowZ;
+                row[ x ] = std::min( row[ x ], z );
+            }
+        }
+    }
+
+#ifdef LMG_HAS_AVX2_PATH
+    // - 8 pixels wide blocks from xmin (the blocks never leave the tile)
+    LMG_TARGET_AVX2
+    void rasterizeSpanAvx2( const float* a, const float* rowEdge, float dzdx, float rowZ, float* row, int xmin, int xmax )
+    {
+        const __m256 offsets = _mm256_setr_ps( 0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f );
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 a0 = _mm256_set1_ps( a[ 0 ] );
+        const __m256 a1 = _mm256_set1_ps( a[ 1 ] );
+        const __m256 a2 = _mm256_set1_ps( a[ 2 ] );
+        const __m256 e0 = _mm256_set1_ps( rowEdge[ 0 ] );
+        const __m256 e1 = _mm256_set1_ps( rowEdge[ 1 ] );
+        const __m256 e2 = _mm256_set1_ps( rowEdge[ 2 ] );
+        const __m256 slope = _mm256_set1_ps( dzdx );
+        const __m256 z0 = _mm256_set1_ps( rowZ );
+
+        for ( int x = xmin; x <= xmax; x += 8 )
+        {
+            const __m256 px = _mm256_add_ps( _mm256_set1_ps( static_cast< float >( x ) ), offsets );
+            __m256 mask = _mm256_cmp_ps( _mm256_add_ps( _mm256_mul_ps( a0, px ), e0 ), zero, _CMP_GE_OQ );
+            mask = _mm256_and_ps( mask, _mm256_cmp_ps( _mm256_add_ps( _mm256_mul_ps( a1, px ), e1 ), zero, _CMP_GE_OQ ) );
+            mask = _mm256_and_ps( mask, _mm256_cmp_ps( _mm256_add_ps( _mm256_mul_ps( a2, px ), e2 ), zero, _CMP_GE_OQ ) );
+            if ( _mm256_movemask_ps( mask ) == 0 )
+            {
+                continue;
+            }
+            const __m256 z = _mm256_add_ps( _mm256_mul_ps( slope, px ), z0 );
+            const __m256 d = _mm256_loadu_ps( row + x );
+            _mm256_storeu_ps( row + x, _mm256_blendv_ps( d, _mm256_min_ps( d, z ), mask ) );
+        }
+    }
+
+    // - one of the first 8 pixel blocks of [x, x1] at or beyond zmin; x is left after the last whole block
+    LMG_TARGET_AVX2
+    bool anyFartherAvx2( const float* row, int& x, int x1, float zmin )
+    {
+        const __m256 z = _mm256_set1_ps( zmin );
+        for ( ; x + 7 <= x1; x += 8 )
+        {
+            if ( _mm256_movemask_ps( _mm256_cmp_ps( _mm256_loadu_ps( row + x ), z, _CMP_GE_OQ ) ) != 0 )
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+#endif
+}
+
+OcclusionBuffer::OcclusionBuffer(){
+    depth.resize( Width * Height, 1.f );
+
+    numberOfThreads = std::min( numberOfWorkerThreads(), static_cast< unsigned int >( TilesX * TilesY ) );
+    useAvx2 = cpuHasAvx2();
+
+    numberOfOccluders = 0;
+    numberOfTestedBoxes = 0;
+    numberOfCulledBoxes = 0;
+}
+
+/******************************************************************************
+ * Reset depth to the far plane
+ ******************************************************************************/
+void OcclusionBuffer::clear()
+{
+    std::fill( depth.begin(), depth.end(), 1.f );
+
+    numberOfOccluders = 0;
+    numberOfTestedBoxes = 0;
+    numberOfCulledBoxes = 0;
+}
+
+/******************************************************************************
+ * Rasterize occluder triangles into the depth buffer
+ *
+ * 1) vertices are sent to clip-space and triangles are set up and binned
+ *    to the tiles they overlap (each task owns one bin per tile)
+ * 2) tiles are rasterized in parallel, so no two tasks write the same pixel
+ ******************************************************************************/
+void OcclusionBuffer::rasterize( const std::vector< glm::vec3 >& points, const std::vector< unsigned int >& triangleIndices, const glm::mat4& modelViewProjectionMatrix )
+{
+    const unsigned int n = numberOfThreads;
+    const size_t numberOfTriangles = triangleIndices.size() / 3;
+
+    std::vector< glm::vec4 > clipPoints( points.size() );
+    triangles.resize( numberOfTriangles );
+    bins.resize( n );
+    for ( unsigned int t = 0; t < n; ++t )
+    {
+        bins[ t ].resize( TilesX * TilesY );
+        for ( size_t tile = 0; tile < bins[ t ].size(); ++tile )
+        {
+            bins[ t ][ tile ].clear();
+        }
+    }
+
+    // Transform and bin
+    JobSystem::instance().forEachTask( n, [&]( unsigned int task )
+    {
+        const size_t firstPoint = points.size() * task / n;
+        const size_t lastPoint = points.size() * ( task + 1 ) / n;
+        for ( size_t i = firstPoint; i < lastPoint; ++i )
+        {
+            clipPoints[ i ] = modelViewProjectionMatrix * glm::vec4( points[ i ], 1.f );
+        }
+    } );
+    JobSystem::instance().forEachTask( n, [&]( unsigned int task )
+    {
+        setupTriangles( clipPoints, triangleIndices, task, numberOfTriangles * task / n, numberOfTriangles * ( task + 1 ) / n );
+    } );
+
+    // Rasterize
+    std::atomic< int > nextTile( 0 );
+    JobSystem::instance().forEachTask( n, [&]( unsigned int )
+    {
+        for ( int tile = nextTile++; tile < TilesX * TilesY; tile = nextTile++ )
+        {
+            rasterizeTile( tile );
+        }
+    } );
+
+    numberOfOccluders += static_cast< int >( numberOfTriangles );
+}
+
+/******************************************************************************
+ * Compute edge functions and depth plane of triangles [first,last[
+ ******************************************************************************/
+void OcclusionBuffer::setupTriangles( const std::vector< glm::vec4 >& clipPoints, const std::vector< unsigned int >& triangleIndices, unsigned int thread, size_t first, size_t last )
+{
+    std::vector< std::vector< int > >& threadBins = bins[ thread ];
+
+    for ( size_t t = first; t < last; ++t )
+    {
+        glm::vec3 v[ 3 ];
+        bool isClipped = false;
+        for ( int k = 0; k < 3; ++k )
+        {
+            const glm::vec4& p = clipPoints[ triangleIndices[ 3 * t + k ] ];
+            // Dropping an occluder is always conservative, so triangles crossing the near plane are skipped
+            if ( p.w <= 1e-5f )
+            {
+                isClipped = true;
+                break;
+            }
+            v[ k ] = glm::vec3( ( p.x / p.w * 0.5f + 0.5f ) * Width, ( p.y / p.w * 0.5f + 0.5f ) * Height, p.z / p.w * 0.5f + 0.5f );
+        }
+        if ( isClipped )
+        {
+            continue;
+        }
+
+        // Both windings are occluders: make the triangle counter-clockwise
+        const float area = ( v[ 1 ].x - v[ 0 ].x ) * ( v[ 2 ].y - v[ 0 ].y ) - ( v[ 1 ].y - v[ 0 ].y ) * ( v[ 2 ].x - v[ 0 ].x );
+        if ( std::fabs( area ) < 1e-6f )
+        {
+            continue;
+        }
+        if ( area < 0.f )
+        {
+            std::swap( v[ 1 ], v[ 2 ] );
+        }
+
+        Triangle& triangle = triangles[ t ];
+        triangle.xmin = std::max( 0, static_cast< int >( std::floor( std::min( v[ 0 ].x, std::min( v[ 1 ].x, v[ 2 ].x ) ) ) ) );
+        triangle.xmax = std::min( Width - 1, static_cast< int >( std::ceil( std::max( v[ 0 ].x, std::max( v[ 1 ].x, v[ 2 ].x ) ) ) ) );
+        triangle.ymin = std::max( 0, static_cast< int >( std::floor( std::min( v[ 0 ].y, std::min( v[ 1 ].y, v[ 2 ].y ) ) ) ) );
+        triangle.ymax = std::min( Height - 1, static_cast< int >( std::ceil( std::max( v[ 0 ].y, std::max( v[ 1 ].y, v[ 2 ].y ) ) ) ) );
+        if ( triangle.xmin > triangle.xmax || triangle.ymin > triangle.ymax )
+        {
+            continue;
+        }
+
+        for ( int k = 0; k < 3; ++k )
+        {
+            const glm::vec3& p0 = v[ k ];
+            const glm::vec3& p1 = v[ ( k + 1 ) % 3 ];
+            triangle.a[ k ] = p0.y - p1.y;
+            triangle.b[ k ] = p1.x - p0.x;
+            triangle.c[ k ] = ( p1.y - p0.y ) * p0.x - ( p1.x - p0.x ) * p0.y;
+            // Push edges by a thousandth of a pixel so pixels centered on a shared edge are not lost by both triangles
+            triangle.c[ k ] += 1e-3f * ( std::fabs( triangle.a[ k ] ) + std::fabs( triangle.b[ k ] ) );
+        }
+
+        const glm::vec3 normal = glm::cross( v[ 1 ] - v[ 0 ], v[ 2 ] - v[ 0 ] );
+        triangle.dzdx = -normal.x / normal.z;
+        triangle.dzdy = -normal.y / normal.z;
+        triangle.z0 = v[ 0 ].z - triangle.dzdx * v[ 0 ].x - triangle.dzdy * v[ 0 ].y;
+
+        for ( int ty = triangle.ymin / TileSize; ty <= triangle.ymax / TileSize; ++ty )
+        {
+            for ( int tx = triangle.xmin / TileSize; tx <= triangle.xmax / TileSize; ++tx )
+            {
+                threadBins[ ty * TilesX + tx ].push_back( static_cast< int >( t ) );
+            }
+        }
+    }
+}
+
+/******************************************************************************
+ * Rasterize all triangles binned to one tile
+ ******************************************************************************/
+void OcclusionBuffer::rasterizeTile( int tile )
+{
+    const int tileX = ( tile % TilesX ) * TileSize;
+    const int tileY = ( tile / TilesX ) * TileSize;
+
+    for ( size_t thread = 0; thread < bins.size(); ++thread )
+    {
+        const std::vector< int >& bin = bins[ thread ][ tile ];
+        for ( size_t i = 0; i < bin.size(); ++i )
+        {
+            const Triangle& triangle = triangles[ bin[ i ] ];
+
+            // 8 pixels wide blocks (AVX2), aligned on the tile so that they never leave it
+            const int xmin = useAvx2 ? ( std::max( triangle.xmin, tileX ) & ~7 ) : std::max( triangle.xmin, tileX );
+            const int xmax = std::min( triangle.xmax, tileX + TileSize - 1 );
+            const int ymin = std::max( triangle.ymin, tileY );
+            const int ymax = std::min( triangle.ymax, tileY + TileSize - 1 );
+
+            for ( int y = ymin; y <= ymax; ++y )
+            {
+                const float py = static_cast< float >( y ) + 0.5f;
+                float* row = &depth[ y * Width ];
+                const float rowEdge[ 3 ] = {
+                    triangle.b[ 0 ] * py + triangle.c[ 0 ],
+                    triangle.b[ 1 ] * py + triangle.c[ 1 ],
+                    triangle.b[ 2 ] * py + triangle.c[ 2 ]
+                };
+                const float rowZ = triangle.z0 + triangle.dzdy * py;
+#ifdef LMG_HAS_AVX2_PATH
+                if ( useAvx2 )
+                {
+                    rasterizeSpanAvx2( triangle.a, rowEdge, triangle.dzdx, rowZ, row, xmin, xmax );
+                    continue;
+                }
+#endif
+                rasterizeSpan( triangle.a, rowEdge, triangle.dzdx, rowZ, row, xmin, xmax );
+            }
+        }
+    }
+}
+
+/******************************************************************************
+ * Test a bounding box (in model space) against the depth buffer
+ *
+ * The box is visible if one pixel of its screen rectangle is farther than
+ * its nearest corner.
+ ******************************************************************************/
+bool OcclusionBuffer::isVisible( const glm::vec3& aabb_min, const glm::vec3& aabb_max, const glm::mat4& modelViewProjectionMatrix )
+{
+    ++numberOfTestedBoxes;
+
+    float xmin = static_cast< float >( Width );
+    float xmax = 0.f;
+    float ymin = static_cast< float >( Height );
+    float ymax = 0.f;
+    float zmin = 1.f;
+    for ( int corner = 0; corner < 8; ++corner )
+    {
+        const glm::vec4 position( ( corner & 1 ) ? aabb_max.x : aabb_min.x,
+                                  ( corner & 2 ) ? aabb_max.y : aabb_min.y,
+                                  ( corner & 4 ) ? aabb_max.z : aabb_min.z,
+                                  1.f );
+        const glm::vec4 p = modelViewProjectionMatrix * position;
+        // Box crossing the near plane: always visible
+        if ( p.w <= 1e-5f )
+        {
+            return true;
+        }
+        const float x = ( p.x / p.w * 0.5f + 0.5f ) * Width;
+        const float y = ( p.y / p.w * 0.5f + 0.5f ) * Height;
+        xmin = std::min( xmin, x );
+        xmax = std::max( xmax, x );
+        ymin = std::min( ymin, y );
+        ymax = std::max( ymax, y );
+        zmin = std::min( zmin, p.z / p.w * 0.5f + 0.5f );
+    }
+    if ( zmin <= 0.f )
+    {
+        return true;
+    }
+
+    const int x0 = std::max( 0, static_cast< int >( std::floor( xmin ) ) );
+    const int x1 = std::min( Width - 1, static_cast< int >( std::ceil( xmax ) ) );
+    const int y0 = std::max( 0, static_cast< int >( std::floor( ymin ) ) );
+    const int y1 = std::min( Height - 1, static_cast< int >( std::ceil( ymax ) ) );
+
+    for ( int y = y0; y <= y1; ++y )
+    {
+        const float* row = &depth[ y * Width ];
+        int x = x0;
+#ifdef LMG_HAS_AVX2_PATH
+        if ( useAvx2 && anyFartherAvx2( row, x, x1, zmin ) )
+        {
+            return true;
+        }
+#endif
+        for ( ; x <= x1; ++x )
+        {
+            if ( row[ x ] >= zmin )
+            {
+                return true;
+            }
+        }
+    }
+
+    // Fully hidden (or fully outside the screen)
+    ++numberOfCulledBoxes;
+    return false;
+}
@@ -0,0 +1,72 @@
+#ifndef OCCLUSIONBUFFER_H
+#define OCCLUSIONBUFFER_H
+
+// STL
+#include <iostream>
+#include <vector>
+
+// glm
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+/******************************************************************************
+ * Software rasterized depth buffer used for CPU occlusion culling.
+ *
+ * Occluders (coarse terrain grid) are binned into screen tiles and rasterized
+ * by several threads, then bounding boxes are tested against the result.
+ * No GL call is made here so the class can run without any GPU context.
+ ******************************************************************************/
+class OcclusionBuffer{
+public:
+    // - resolution
+    static const int Width = 256;
+    static const int Height = 128;
+    // - tiles (one tile is rasterized by one thread at a time)
+    static const int TileSize = 32;
+    static const int TilesX = Width / TileSize;
+    static const int TilesY = Height / TileSize;
+
+    // - depth, in [0,1] (1 is the far plane)
+    std::vector< float > depth;
+
+    // - parallel tasks of rasterize() (job system), one set of bins each
+    unsigned int numberOfThreads;
+    // - AVX2 rasterization and tests (8 pixels per step), when the CPU has it
+    bool useAvx2;
+
+    // - statistics of the last frame
+    int numberOfOccluders;
+    int numberOfTestedBoxes;
+    int numberOfCulledBoxes;
+
+    OcclusionBuffer();
+
+    void clear();
+    void rasterize( const std::vector< glm::vec3 >& points, const std::vector< unsigned int >& triangleIndices, const glm::mat4& modelViewProjectionMatrix );
+    bool isVisible( const glm::vec3& aabb_min, const glm::vec3& aabb_max, const glm::mat4& modelViewProjectionMatrix );
+
+private:
+    // Screen space triangle ready to be rasterized
+    struct Triangle{
+        // - edge functions: e(x,y) = a*x + b*y + c
+        float a[ 3 ];
+        float b[ 3 ];
+        float c[ 3 ];
+        // - depth plane: z(x,y) = z0 + dzdx*x + dzdy*y
+        float z0;
+        float dzdx;
+        float dzdy;
+        // - screen bounding box (pixels)
+        int xmin, xmax, ymin, ymax;
+    };
+
+    std::vector< Triangle > triangles;
+    // - triangle indices per thread and per tile: bins[ thread ][ tile ]
+    std::vector< std::vector< std::vector< int > > > bins;
+
+    void setupTriangles( const std::vector< glm::vec4 >& clipPoints, const std::vector< unsigned int >& triangleIndices, unsigned int thread, size_t first, size_t last );
+    void rasterizeTile( int tile );
+};
+
+#endif
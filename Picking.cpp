@@ -169,3 +169,26 @@ bool Picking::TestRayOBBIntersection(
 
 }
 
+bool Picking::TestRayHeightfieldIntersection(
+    glm::vec3 ray_origin,
+    glm::vec3 ray_direction,
+    const HeightPyramid& heightfield,
+    glm::mat4 ModelMatrix,
+    float& intersection_distance,
+    glm::vec3& intersection_point,
+    glm::vec3& intersection_normal
+){
+    // Ray in terrain local space: the ray parameter is kept, so it is still the world distance
+    const glm::mat4 InverseModelMatrix = glm::inverse(ModelMatrix);
+    const glm::vec3 local_origin(InverseModelMatrix * glm::vec4(ray_origin, 1.0f));
+    const glm::vec3 local_direction(InverseModelMatrix * glm::vec4(ray_direction, 0.0f));
+
+    glm::vec3 local_point;
+    glm::vec3 local_normal;
+    if ( !heightfield.intersect(local_origin, local_direction, intersection_distance, local_point, local_normal) )
+        return false;
+
+    intersection_point = glm::vec3(ModelMatrix * glm::vec4(local_point, 1.0f));
+    intersection_normal = glm::normalize(glm::transpose(glm::inverse(glm::mat3(ModelMatrix))) * local_normal);
+    return true;
+}
@@ -10,6 +10,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "AssetLoader.h"
+#include "HeightPyramid.h"
 
 class Picking{
 public:
@@ -30,6 +31,15 @@ public:
         glm::mat4 ModelMatrix,       // Transformation applied to the mesh (which will thus be also applied to its bounding box)
         float& intersection_distance // Output : distance between ray_origin and the intersection with the OBB
     );
+    static bool TestRayHeightfieldIntersection(
+        glm::vec3 ray_origin,               // Ray origin, in world space
+        glm::vec3 ray_direction,            // Ray direction, in world space. Must be normalize()'d.
+        const HeightPyramid& heightfield,   // Min/max pyramid of the terrain grid
+        glm::mat4 ModelMatrix,              // Transformation applied to the terrain
+        float& intersection_distance,       // Output : distance between ray_origin and the terrain surface
+        glm::vec3& intersection_point,      // Output : surface point, in world space
+        glm::vec3& intersection_normal      // Output : surface normal, in world space
+    );
 };
 
 
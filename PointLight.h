@@ -0,0 +1,15 @@
+#ifndef POINTLIGHT_H
+#define POINTLIGHT_H
+
+// glm
+#include <glm/glm.hpp>
+
+// Dynamic point light (world space)
+struct PointLight{
+    glm::vec3 position;
+    // - no contribution beyond this distance
+    float radius;
+    glm::vec3 color;
+};
+
+#endif
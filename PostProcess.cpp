@@ -0,0 +1,517 @@
+#include "PostProcess.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+
+#include "ShaderProgram.h"
+#include "GLStateCache.h"
+
+PostProcess::PostProcess(){
+    bloomEnabled = true;
+    autoExposure = true;
+
+    bloomThreshold = 1.f;
+    bloomKnee = 0.5f;
+    bloomIntensity = 0.15f;
+    exposureKey = 0.18f;
+    minimumExposure = 0.25f;
+    maximumExposure = 4.f;
+    adaptationTime = 2.f;
+    exposure = 1.f;
+
+    width = 0;
+    height = 0;
+
+    mHdrTexture = 0;
+    mHdrFramebuffer = 0;
+    for ( int e = 0; e < 2; ++e )
+    {
+        mExposureTextures[ e ] = 0;
+        mExposureFramebuffers[ e ] = 0;
+    }
+
+    mDownsampleShaderProgram = 0;
+    mUpsampleShaderProgram = 0;
+    mExposureShaderProgram = 0;
+    mCompositeShaderProgram = 0;
+    mFullScreenVertexArray = 0;
+
+    exposureIndex = 0;
+    exposureValid = false;
+    hasLastFrame = false;
+}
+
+bool PostProcess::initializePostProcess(){
+    bool statusOK = true;
+
+    std::cout << "Initialize post-processing..." << std::endl;
+
+    // Exposure textures (1x1), 1 until the first adaptation
+    const float initialExposure = 1.f;
+    glGenTextures( 2, mExposureTextures );
+    glGenFramebuffers( 2, mExposureFramebuffers );
+    for ( int e = 0; e < 2; ++e )
+    {
+        GLStateCache::bindTexture( 0, GL_TEXTURE_2D, mExposureTextures[ e ] );
+        glTexImage2D( GL_TEXTURE_2D, 0, GL_R32F, 1, 1, 0, GL_RED, GL_FLOAT, &initialExposure );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+
+        GLStateCache::bindFramebuffer( mExposureFramebuffers[ e ] );
+        glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mExposureTextures[ e ], 0 );
+    }
+    GLStateCache::bindTexture( 0, GL_TEXTURE_2D, 0 );
+    GLStateCache::bindFramebuffer( 0 );
+
+    if ( statusOK )
+    {
+        statusOK = initializeShaderProgram();
+    }
+
+    return statusOK;
+}
+
+/******************************************************************************
+ * Initialize shader programs
+ ******************************************************************************/
+bool PostProcess::initializeShaderProgram()
+{
+    glGenVertexArrays( 1, &mFullScreenVertexArray );
+
+    // Vertex shader: full-screen triangle generated from the vertex ID
+    const char* vertexShaderSource =
+        "#version 300 es\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    vec2 position = vec2( float( ( gl_VertexID & 1 ) << 2 ) - 1.0, float( ( gl_VertexID & 2 ) << 1 ) - 1.0 );\n"
+        "    gl_Position = vec4( position, 0.0, 1.0 );\n"
+        "}\n";
+
+    // Fragment shader: downsample (4 bilinear taps = 4x4 source texels)
+    const char* downsampleShaderSource =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "\n"
+        "// UNIFORM\n"
+        "uniform sampler2D sourceTexture;\n"
+        "uniform vec2 targetSize;\n"
+        "// - first level: bloom threshold and log luminance of the HDR colors\n"
+        "uniform bool prefilter;\n"
+        "uniform float threshold;\n"
+        "uniform float knee;\n"
+        "\n"
+        "// OUTPUT\n"
+        "layout( location = 0 ) out vec4 fragmentColor;\n"
+        "\n"
+        "float luminance( vec3 color )\n"
+        "{\n"
+        "    return dot( color, vec3( 0.2126, 0.7152, 0.0722 ) );\n"
+        "}\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    vec2 uv = gl_FragCoord.xy / targetSize;\n"
+        "    vec2 texelSize = 1.0 / vec2( textureSize( sourceTexture, 0 ) );\n"
+        "    vec4 a = texture( sourceTexture, uv + texelSize * vec2( -1.0, -1.0 ) );\n"
+        "    vec4 b = texture( sourceTexture, uv + texelSize * vec2(  1.0, -1.0 ) );\n"
+        "    vec4 c = texture( sourceTexture, uv + texelSize * vec2( -1.0,  1.0 ) );\n"
+        "    vec4 d = texture( sourceTexture, uv + texelSize * vec2(  1.0,  1.0 ) );\n"
+        "    if ( ! prefilter )\n"
+        "    {\n"
+        "        fragmentColor = 0.25 * ( a + b + c + d );\n"
+        "        return;\n"
+        "    }\n"
+        "\n"
+        "    vec3 color = 0.25 * ( a.rgb + b.rgb + c.rgb + d.rgb );\n"
+        "    float logLuminance = 0.25 * ( log( luminance( a.rgb ) + 1e-4 ) + log( luminance( b.rgb ) + 1e-4 )\n"
+        "                                + log( luminance( c.rgb ) + 1e-4 ) + log( luminance( d.rgb ) + 1e-4 ) );\n"
+        "\n"
+        "    // Soft threshold: quadratic curve over [threshold - knee, threshold + knee]\n"
+        "    float brightness = max( color.r, max( color.g, color.b ) );\n"
+        "    float soft = clamp( brightness - threshold + knee, 0.0, 2.0 * knee );\n"
+        "    soft = soft * soft / ( 4.0 * knee + 1e-5 );\n"
+        "    float contribution = max( soft, brightness - threshold ) / max( brightness, 1e-5 );\n"
+        "\n"
+        "    fragmentColor = vec4( color * contribution, logLuminance );\n"
+        "}\n";
+
+    // Fragment shader: upsample (3x3 tent), added to the level
+    const char* upsampleShaderSource =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "\n"
+        "// UNIFORM\n"
+        "uniform sampler2D sourceTexture;\n"
+        "uniform vec2 targetSize;\n"
+        "\n"
+        "// OUTPUT\n"
+        "layout( location = 0 ) out vec4 fragmentColor;\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    vec2 uv = gl_FragCoord.xy / targetSize;\n"
+        "    vec2 t = 1.0 / vec2( textureSize( sourceTexture, 0 ) );\n"
+        "    vec3 color = 4.0 * texture( sourceTexture, uv ).rgb;\n"
+        "    color += 2.0 * ( texture( sourceTexture, uv + vec2( t.x, 0.0 ) ).rgb + texture( sourceTexture, uv - vec2( t.x, 0.0 ) ).rgb\n"
+        "                   + texture( sourceTexture, uv + vec2( 0.0, t.y ) ).rgb + texture( sourceTexture, uv - vec2( 0.0, t.y ) ).rgb );\n"
+        "    color += texture( sourceTexture, uv + t ).rgb + texture( sourceTexture, uv - t ).rgb\n"
+        "           + texture( sourceTexture, uv + vec2( t.x, -t.y ) ).rgb + texture( sourceTexture, uv + vec2( -t.x, t.y ) ).rgb;\n"
+        "    fragmentColor = vec4( color / 16.0, 0.0 );\n"
+        "}\n";
+
+    // Fragment shader: exposure (1x1)
+    const char* exposureShaderSource =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "\n"
+        "// UNIFORM\n"
+        "// - 1x1 pyramid level: average log luminance in alpha\n"
+        "uniform sampler2D luminanceTexture;\n"
+        "uniform sampler2D previousExposureTexture;\n"
+        "uniform float key;\n"
+        "uniform float minimumExposure;\n"
+        "uniform float maximumExposure;\n"
+        "// - part of the way to the target this frame (1: no adaptation)\n"
+        "uniform float adaptation;\n"
+        "\n"
+        "// OUTPUT\n"
+        "layout( location = 0 ) out vec4 fragmentColor;\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    float averageLuminance = exp( texelFetch( luminanceTexture, ivec2( 0 ), 0 ).a );\n"
+        "    float target = clamp( key / max( averageLuminance, 1e-4 ), minimumExposure, maximumExposure );\n"
+        "    float previous = texelFetch( previousExposureTexture, ivec2( 0 ), 0 ).r;\n"
+        "    fragmentColor = vec4( mix( previous, target, adaptation ), 0.0, 0.0, 1.0 );\n"
+        "}\n";
+
+    // Fragment shader: composite
+    const char* compositeShaderSource =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "\n"
+        "// UNIFORM\n"
+        "uniform sampler2D hdrTexture;\n"
+        "uniform sampler2D bloomTexture;\n"
+        "uniform sampler2D exposureTexture;\n"
+        "uniform vec2 outputSize;\n"
+        "uniform bool useBloom;\n"
+        "uniform float bloomIntensity;\n"
+        "uniform bool useAutoExposure;\n"
+        "uniform float exposure;\n"
+        "\n"
+        "// OUTPUT\n"
+        "layout( location = 0 ) out vec4 fragmentColor;\n"
+        "\n"
+        "// - filmic curve (ACES fit, Narkowicz)\n"
+        "vec3 toneMap( vec3 x )\n"
+        "{\n"
+        "    return clamp( ( x * ( 2.51 * x + 0.03 ) ) / ( x * ( 2.43 * x + 0.59 ) + 0.14 ), 0.0, 1.0 );\n"
+        "}\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    vec3 color = texelFetch( hdrTexture, ivec2( gl_FragCoord.xy ), 0 ).rgb;\n"
+        "    if ( useBloom )\n"
+        "        color += bloomIntensity * texture( bloomTexture, gl_FragCoord.xy / outputSize ).rgb;\n"
+        "    float e = useAutoExposure ? texelFetch( exposureTexture, ivec2( 0 ), 0 ).r : exposure;\n"
+        "    fragmentColor = vec4( toneMap( color * e ), 1.0 );\n"
+        "}\n";
+
+    mDownsampleShaderProgram = ShaderProgram::create( vertexShaderSource, downsampleShaderSource, "post-process downsample" );
+    mUpsampleShaderProgram = ShaderProgram::create( vertexShaderSource, upsampleShaderSource, "post-process upsample" );
+    mExposureShaderProgram = ShaderProgram::create( vertexShaderSource, exposureShaderSource, "post-process exposure" );
+    mCompositeShaderProgram = ShaderProgram::create( vertexShaderSource, compositeShaderSource, "post-process composite" );
+
+    return mDownsampleShaderProgram != 0 && mUpsampleShaderProgram != 0 && mExposureShaderProgram != 0 && mCompositeShaderProgram != 0;
+}
+
+/******************************************************************************
+ * HDR target and pyramid at the window size
+ ******************************************************************************/
+void PostProcess::resize( int pWidth, int pHeight )
+{
+    if ( pWidth == width && pHeight == height )
+    {
+        return;
+    }
+    deleteTextures();
+    width = pWidth;
+    height = pHeight;
+
+    std::vector< GLuint > textures( 1, 0 );
+    std::vector< int > widths( 1, width );
+    std::vector< int > heights( 1, height );
+    for ( int w = std::max( 1, width / 2 ), h = std::max( 1, height / 2 ); ; w = std::max( 1, w / 2 ), h = std::max( 1, h / 2 ) )
+    {
+        widths.push_back( w );
+        heights.push_back( h );
+        if ( w == 1 && h == 1 )
+            break;
+    }
+    textures.resize( widths.size() );
+    std::vector< GLuint > framebuffers( widths.size() );
+    glGenTextures( static_cast< GLsizei >( textures.size() ), textures.data() );
+    glGenFramebuffers( static_cast< GLsizei >( framebuffers.size() ), framebuffers.data() );
+
+    for ( size_t t = 0; t < textures.size(); ++t )
+    {
+        GLStateCache::bindTexture( 0, GL_TEXTURE_2D, textures[ t ] );
+        glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA16F, widths[ t ], heights[ t ], 0, GL_RGBA, GL_HALF_FLOAT, nullptr );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+
+        GLStateCache::bindFramebuffer( framebuffers[ t ] );
+        glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[ t ], 0 );
+        if ( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE )
+        {
+            std::cout << "Error: post-processing framebuffer " << widths[ t ] << "x" << heights[ t ] << " is incomplete" << std::endl;
+        }
+    }
+    GLStateCache::bindTexture( 0, GL_TEXTURE_2D, 0 );
+    GLStateCache::bindFramebuffer( 0 );
+
+    // - first texture: HDR target, then the pyramid levels
+    mHdrTexture = textures[ 0 ];
+    mHdrFramebuffer = framebuffers[ 0 ];
+    mPyramidTextures.assign( textures.begin() + 1, textures.end() );
+    mPyramidFramebuffers.assign( framebuffers.begin() + 1, framebuffers.end() );
+    pyramidWidths.assign( widths.begin() + 1, widths.end() );
+    pyramidHeights.assign( heights.begin() + 1, heights.end() );
+}
+
+void PostProcess::deleteTextures()
+{
+    if ( mHdrTexture == 0 )
+    {
+        return;
+    }
+
+    GLStateCache::forgetTexture( mHdrTexture );
+    GLStateCache::forgetFramebuffer( mHdrFramebuffer );
+    for ( size_t t = 0; t < mPyramidTextures.size(); ++t )
+    {
+        GLStateCache::forgetTexture( mPyramidTextures[ t ] );
+        GLStateCache::forgetFramebuffer( mPyramidFramebuffers[ t ] );
+    }
+    glDeleteTextures( 1, &mHdrTexture );
+    glDeleteFramebuffers( 1, &mHdrFramebuffer );
+    glDeleteTextures( static_cast< GLsizei >( mPyramidTextures.size() ), mPyramidTextures.data() );
+    glDeleteFramebuffers( static_cast< GLsizei >( mPyramidFramebuffers.size() ), mPyramidFramebuffers.data() );
+    mHdrTexture = 0;
+    mHdrFramebuffer = 0;
+    mPyramidTextures.clear();
+    mPyramidFramebuffers.clear();
+}
+
+/******************************************************************************
+ * HDR target of the frame
+ ******************************************************************************/
+void PostProcess::beginComposite( int pWidth, int pHeight )
+{
+    resize( pWidth, pHeight );
+    bindComposite();
+    glClearColor( 0.f, 0.f, 0.f, 0.f );
+    glClear( GL_COLOR_BUFFER_BIT );
+}
+
+void PostProcess::bindComposite()
+{
+    GLStateCache::bindFramebuffer( mHdrFramebuffer );
+    GLStateCache::viewport( 0, 0, width, height );
+}
+
+void PostProcess::drawFullScreen()
+{
+    GLStateCache::bindVertexArray( mFullScreenVertexArray );
+    glDrawArrays( GL_TRIANGLES, 0, 3 );
+}
+
+/******************************************************************************
+ * Post-processing chain
+ * - the pyramid is built when the bloom or the auto exposure needs it
+ ******************************************************************************/
+void PostProcess::execute()
+{
+    GLint uniformLocation;
+
+    // Time since the last frame (exposure adaptation)
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    const float deltaTime = hasLastFrame ? std::chrono::duration< float >( now - lastFrameTime ).count() : 0.f;
+    lastFrameTime = now;
+    hasLastFrame = true;
+
+    GLStateCache::depthFunc( GL_ALWAYS );
+    GLStateCache::depthMask( GL_FALSE );
+
+    const int numberOfLevels = static_cast< int >( mPyramidTextures.size() );
+
+    // Downsample: bloom threshold and luminance on the first level, then averages down to 1x1
+    if ( bloomEnabled || autoExposure )
+    {
+        GLStateCache::useProgram( mDownsampleShaderProgram );
+        const GLint sourceLocation = glGetUniformLocation( mDownsampleShaderProgram, "sourceTexture" );
+        const GLint targetSizeLocation = glGetUniformLocation( mDownsampleShaderProgram, "targetSize" );
+        const GLint prefilterLocation = glGetUniformLocation( mDownsampleShaderProgram, "prefilter" );
+        uniformLocation = glGetUniformLocation( mDownsampleShaderProgram, "threshold" );
+        if ( uniformLocation >= 0 )
+        {
+            glUniform1f( uniformLocation, bloomThreshold );
+        }
+        uniformLocation = glGetUniformLocation( mDownsampleShaderProgram, "knee" );
+        if ( uniformLocation >= 0 )
+        {
+            glUniform1f( uniformLocation, bloomKnee * bloomThreshold );
+        }
+        glUniform1i( sourceLocation, 0 );
+
+        for ( int level = 0; level < numberOfLevels; ++level )
+        {
+            GLStateCache::bindFramebuffer( mPyramidFramebuffers[ level ] );
+            GLStateCache::viewport( 0, 0, pyramidWidths[ level ], pyramidHeights[ level ] );
+            GLStateCache::bindTexture( 0, GL_TEXTURE_2D, ( level == 0 ) ? mHdrTexture : mPyramidTextures[ level - 1 ] );
+            glUniform2f( targetSizeLocation, static_cast< float >( pyramidWidths[ level ] ), static_cast< float >( pyramidHeights[ level ] ) );
+            glUniform1i( prefilterLocation, level == 0 );
+            drawFullScreen();
+        }
+    }
+
+    // Exposure: adapted toward the target (about 95% of the way after adaptationTime)
+    if ( autoExposure )
+    {
+        const int target = 1 - exposureIndex;
+        GLStateCache::bindFramebuffer( mExposureFramebuffers[ target ] );
+        GLStateCache::viewport( 0, 0, 1, 1 );
+        GLStateCache::useProgram( mExposureShaderProgram );
+        GLStateCache::bindTexture( 0, GL_TEXTURE_2D, mPyramidTextures[ numberOfLevels - 1 ] );
+        GLStateCache::bindTexture( 1, GL_TEXTURE_2D, mExposureTextures[ exposureIndex ] );
+
+        uniformLocation = glGetUniformLocation( mExposureShaderProgram, "luminanceTexture" );
+        if ( uniformLocation >= 0 )
+        {
+            glUniform1i( uniformLocation, 0 );
+        }
+        uniformLocation = glGetUniformLocation( mExposureShaderProgram, "previousExposureTexture" );
+        if ( uniformLocation >= 0 )
+        {
+            glUniform1i( uniformLocation, 1 );
+        }
+        uniformLocation = glGetUniformLocation( mExposureShaderProgram, "key" );
+        if ( uniformLocation >= 0 )
+        {
+            glUniform1f( uniformLocation, exposureKey );
+        }
+        uniformLocation = glGetUniformLocation( mExposureShaderProgram, "minimumExposure" );
+        if ( uniformLocation >= 0 )
+        {
+            glUniform1f( uniformLocation, minimumExposure );
+        }
+        uniformLocation = glGetUniformLocation( mExposureShaderProgram, "maximumExposure" );
+        if ( uniformLocation >= 0 )
+        {
+            glUniform1f( uniformLocation, maximumExposure );
+        }
+        uniformLocation = glGetUniformLocation( mExposureShaderProgram, "adaptation" );
+        if ( uniformLocation >= 0 )
+        {
+            const float adaptation = exposureValid ? 1.f - std::exp( -3.f * deltaTime / adaptationTime ) : 1.f;
+            glUniform1f( uniformLocation, adaptation );
+        }
+        drawFullScreen();
+
+        exposureIndex = target;
+        exposureValid = true;
+    }
+    else
+    {
+        exposureValid = false;
+    }
+
+    // Upsample: each level gets the blurred level below added (color only, the luminance stays)
+    if ( bloomEnabled )
+    {
+        GLStateCache::useProgram( mUpsampleShaderProgram );
+        const GLint targetSizeLocation = glGetUniformLocation( mUpsampleShaderProgram, "targetSize" );
+        uniformLocation = glGetUniformLocation( mUpsampleShaderProgram, "sourceTexture" );
+        if ( uniformLocation >= 0 )
+        {
+            glUniform1i( uniformLocation, 0 );
+        }
+
+        GLStateCache::enable( GL_BLEND );
+        glBlendFunc( GL_ONE, GL_ONE );
+        glColorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_FALSE );
+        const int bloomLevels = std::min( static_cast< int >( MaximumBloomLevels ), numberOfLevels );
+        for ( int level = bloomLevels - 2; level >= 0; --level )
+        {
+            GLStateCache::bindFramebuffer( mPyramidFramebuffers[ level ] );
+            GLStateCache::viewport( 0, 0, pyramidWidths[ level ], pyramidHeights[ level ] );
+            GLStateCache::bindTexture( 0, GL_TEXTURE_2D, mPyramidTextures[ level + 1 ] );
+            glUniform2f( targetSizeLocation, static_cast< float >( pyramidWidths[ level ] ), static_cast< float >( pyramidHeights[ level ] ) );
+            drawFullScreen();
+        }
+        glColorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
+        GLStateCache::disable( GL_BLEND );
+    }
+
+    // Composite: HDR + bloom, exposure, tone mapping into the back buffer
+    GLStateCache::bindFramebuffer( 0 );
+    GLStateCache::viewport( 0, 0, width, height );
+    GLStateCache::useProgram( mCompositeShaderProgram );
+
+    const GLuint textures[] = { mHdrTexture, mPyramidTextures[ 0 ], mExposureTextures[ exposureIndex ] };
+    const char* samplers[] = { "hdrTexture", "bloomTexture", "exposureTexture" };
+    for ( int unit = 0; unit < 3; ++unit )
+    {
+        GLStateCache::bindTexture( unit, GL_TEXTURE_2D, textures[ unit ] );
+        uniformLocation = glGetUniformLocation( mCompositeShaderProgram, samplers[ unit ] );
+        if ( uniformLocation >= 0 )
+        {
+            glUniform1i( uniformLocation, unit );
+        }
+    }
+    uniformLocation = glGetUniformLocation( mCompositeShaderProgram, "outputSize" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform2f( uniformLocation, static_cast< float >( width ), static_cast< float >( height ) );
+    }
+    uniformLocation = glGetUniformLocation( mCompositeShaderProgram, "useBloom" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1i( uniformLocation, bloomEnabled );
+    }
+    uniformLocation = glGetUniformLocation( mCompositeShaderProgram, "bloomIntensity" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1f( uniformLocation, bloomIntensity );
+    }
+    uniformLocation = glGetUniformLocation( mCompositeShaderProgram, "useAutoExposure" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1i( uniformLocation, autoExposure );
+    }
+    uniformLocation = glGetUniformLocation( mCompositeShaderProgram, "exposure" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1f( uniformLocation, exposure );
+    }
+    drawFullScreen();
+
+    // Reset GL state(s)
+    // - HDR target and pyramid are render targets again next frame
+    for ( int unit = 0; unit < 3; ++unit )
+    {
+        GLStateCache::bindTexture( unit, GL_TEXTURE_2D, 0 );
+    }
+    GLStateCache::depthMask( GL_TRUE );
+    GLStateCache::depthFunc( GL_LESS );
+}
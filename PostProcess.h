@@ -0,0 +1,99 @@
+#ifndef POSTPROCESS_H
+#define POSTPROCESS_H
+
+// STL
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+// Graphics
+// - GLEW (always before "gl.h")
+#include <GL/glew.h>
+// - GL
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+
+/******************************************************************************
+ * Post-processing (HDR)
+ *
+ * The skybox and the scene are composited into an RGBA16F target at the
+ * window size, then brought to the back buffer by a short chain where the
+ * work is fused into as few passes as possible:
+ * - downsample pyramid (half size down to 1x1): the first level also applies
+ *   the bloom threshold (soft knee) and stores the log luminance in alpha;
+ *   every level averages both, so the 1x1 level holds the average log
+ *   luminance of the frame (parallel reduction on the GPU, no read back),
+ * - exposure (1x1): adapted toward key / average luminance over time, kept
+ *   on the GPU from frame to frame,
+ * - upsample: tent filter added back up the first pyramid levels (bloom),
+ * - composite (the only full size pass): HDR + bloom, exposure, filmic tone
+ *   mapping (ACES fit) into the back buffer.
+ ******************************************************************************/
+class PostProcess{
+public:
+    // - pyramid levels spread by the bloom
+    static const int MaximumBloomLevels = 6;
+
+    bool bloomEnabled;
+    bool autoExposure;
+
+    // - bloom: threshold (HDR value), soft knee (fraction of the threshold), strength
+    float bloomThreshold;
+    float bloomKnee;
+    float bloomIntensity;
+    // - exposure: middle grey target, range, time to adapt (s), value without auto exposure
+    float exposureKey;
+    float minimumExposure;
+    float maximumExposure;
+    float adaptationTime;
+    float exposure;
+
+    // - composite size (window)
+    int width;
+    int height;
+
+    GLuint mHdrTexture;
+    GLuint mHdrFramebuffer;
+    // - pyramid: level 0 at half size
+    std::vector< GLuint > mPyramidTextures;
+    std::vector< GLuint > mPyramidFramebuffers;
+    std::vector< int > pyramidWidths;
+    std::vector< int > pyramidHeights;
+    // - 1x1 adapted exposure, last and next frame
+    GLuint mExposureTextures[ 2 ];
+    GLuint mExposureFramebuffers[ 2 ];
+
+    GLuint mDownsampleShaderProgram;
+    GLuint mUpsampleShaderProgram;
+    GLuint mExposureShaderProgram;
+    GLuint mCompositeShaderProgram;
+    GLuint mFullScreenVertexArray;
+
+    PostProcess();
+
+    // Methode d'initialisation
+    bool initializePostProcess();
+    bool initializeShaderProgram();
+
+    // - HDR target bound and cleared, first pass of the frame writing it
+    void beginComposite( int pWidth, int pHeight );
+    // - HDR target bound (later passes of the frame)
+    void bindComposite();
+
+    // - the chain, into the back buffer
+    void execute();
+
+private:
+    int exposureIndex;
+    bool exposureValid;
+    bool hasLastFrame;
+    std::chrono::steady_clock::time_point lastFrameTime;
+
+    void resize( int pWidth, int pHeight );
+    void deleteTextures();
+    void drawFullScreen();
+};
+
+#endif
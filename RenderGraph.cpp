@@ -0,0 +1,403 @@
+#include "RenderGraph.h"
+
+// STL
+#include <algorithm>
+
+#include "GLStateCache.h"
+
+const std::string RenderGraph::BackBuffer = "backbuffer";
+
+RenderGraph::RenderGraph(){
+    width = 0;
+    height = 0;
+    viewportWidth = 0;
+    viewportHeight = 0;
+
+    numberOfExecutedPasses = 0;
+    numberOfTransientTextures = 0;
+
+    dirty = true;
+}
+
+void RenderGraph::addTransientTexture( const std::string& name, GLenum internalFormat, GLenum format, GLenum type )
+{
+    TextureDescription description;
+    description.internalFormat = internalFormat;
+    description.format = format;
+    description.type = type;
+    transientTextures[ name ] = description;
+
+    dirty = true;
+}
+
+void RenderGraph::addPass( const std::string& name, const std::vector< std::string >& inputs, const std::vector< std::string >& outputs,
+                           std::function< void() > execute, std::function< bool() > enabled )
+{
+    Pass pass;
+    pass.name = name;
+    pass.inputs = inputs;
+    pass.outputs = outputs;
+    pass.execute = execute;
+    pass.enabled = enabled;
+    passes.push_back( pass );
+
+    dirty = true;
+}
+
+/******************************************************************************
+ * Transient textures follow the frame size
+ ******************************************************************************/
+void RenderGraph::resize( int pWidth, int pHeight )
+{
+    if ( pWidth == width && pHeight == height )
+    {
+        return;
+    }
+
+    deleteResources();
+    width = pWidth;
+    height = pHeight;
+    viewportWidth = pWidth;
+    viewportHeight = pHeight;
+    dirty = true;
+}
+
+void RenderGraph::setViewport( int pWidth, int pHeight )
+{
+    viewportWidth = std::max( 1, std::min( pWidth, width ) );
+    viewportHeight = std::max( 1, std::min( pHeight, height ) );
+}
+
+void RenderGraph::deleteResources()
+{
+    for ( size_t t = 0; t < physicalTextures.size(); ++t )
+    {
+        GLStateCache::forgetTexture( physicalTextures[ t ].texture );
+        glDeleteTextures( 1, &physicalTextures[ t ].texture );
+    }
+    physicalTextures.clear();
+    physicalTextureOfTransient.clear();
+
+    for ( std::map< std::vector< GLuint >, GLuint >::iterator it = framebufferCache.begin(); it != framebufferCache.end(); ++it )
+    {
+        GLStateCache::forgetFramebuffer( it->second );
+        glDeleteFramebuffers( 1, &it->second );
+    }
+    framebufferCache.clear();
+}
+
+bool RenderGraph::isDepthFormat( GLenum internalFormat )
+{
+    return internalFormat == GL_DEPTH_COMPONENT16 || internalFormat == GL_DEPTH_COMPONENT24 || internalFormat == GL_DEPTH_COMPONENT32F
+        || internalFormat == GL_DEPTH24_STENCIL8 || internalFormat == GL_DEPTH32F_STENCIL8;
+}
+
+/******************************************************************************
+ * Order the enabled passes and assign their resources
+ ******************************************************************************/
+void RenderGraph::compile( const std::vector< bool >& enabled )
+{
+    const int numberOfPasses = static_cast< int >( passes.size() );
+
+    // writes[ i ][ j ]: pass j writes an input of pass i
+    std::vector< std::vector< bool > > writes( numberOfPasses, std::vector< bool >( numberOfPasses, false ) );
+    for ( int i = 0; i < numberOfPasses; ++i )
+    {
+        for ( int j = 0; j < numberOfPasses; ++j )
+        {
+            if ( i == j || ! enabled[ i ] || ! enabled[ j ] )
+                continue;
+            for ( size_t in = 0; in < passes[ i ].inputs.size(); ++in )
+            {
+                if ( std::find( passes[ j ].outputs.begin(), passes[ j ].outputs.end(), passes[ i ].inputs[ in ] ) != passes[ j ].outputs.end() )
+                {
+                    writes[ i ][ j ] = true;
+                }
+            }
+        }
+    }
+
+    // Keep passes writing the back buffer, then the passes they depend on
+    std::vector< bool > needed( numberOfPasses, false );
+    std::vector< int > stack;
+    for ( int i = 0; i < numberOfPasses; ++i )
+    {
+        if ( enabled[ i ] && std::find( passes[ i ].outputs.begin(), passes[ i ].outputs.end(), BackBuffer ) != passes[ i ].outputs.end() )
+        {
+            needed[ i ] = true;
+            stack.push_back( i );
+        }
+    }
+    while ( ! stack.empty() )
+    {
+        const int i = stack.back();
+        stack.pop_back();
+        for ( int j = 0; j < numberOfPasses; ++j )
+        {
+            if ( writes[ i ][ j ] && ! needed[ j ] )
+            {
+                needed[ j ] = true;
+                stack.push_back( j );
+            }
+        }
+    }
+
+    // Topological sort, first declared pass first among the ready ones
+    order.clear();
+    std::vector< bool > scheduled( numberOfPasses, false );
+    int numberOfNeededPasses = static_cast< int >( std::count( needed.begin(), needed.end(), true ) );
+    while ( static_cast< int >( order.size() ) < numberOfNeededPasses )
+    {
+        int ready = -1;
+        for ( int i = 0; i < numberOfPasses && ready < 0; ++i )
+        {
+            if ( ! needed[ i ] || scheduled[ i ] )
+                continue;
+            bool waiting = false;
+            for ( int j = 0; j < numberOfPasses; ++j )
+            {
+                waiting = waiting || ( writes[ i ][ j ] && needed[ j ] && ! scheduled[ j ] );
+            }
+            if ( ! waiting )
+            {
+                ready = i;
+            }
+        }
+
+        if ( ready < 0 )
+        {
+            // Cycle: fall back to declaration order for the remaining passes
+            std::cout << "Warning: render graph has a cycle, remaining passes run in declaration order" << std::endl;
+            for ( int i = 0; i < numberOfPasses; ++i )
+            {
+                if ( needed[ i ] && ! scheduled[ i ] )
+                {
+                    scheduled[ i ] = true;
+                    order.push_back( i );
+                }
+            }
+            break;
+        }
+
+        scheduled[ ready ] = true;
+        order.push_back( ready );
+    }
+
+    allocateTextures();
+
+    passFramebuffers.resize( order.size() );
+    for ( size_t o = 0; o < order.size(); ++o )
+    {
+        passFramebuffers[ o ] = framebufferOf( passes[ order[ o ] ] );
+    }
+
+    compiledEnabled = enabled;
+    dirty = false;
+}
+
+/******************************************************************************
+ * Assign GL textures to the transient textures
+ *
+ * A texture whose last use comes before the first use of another transient
+ * texture of the same format is reused for it (passes writing a transient
+ * texture must not expect its previous content).
+ ******************************************************************************/
+void RenderGraph::allocateTextures()
+{
+    // Lifetime of each transient texture in the execution order
+    std::map< std::string, std::pair< int, int > > lifetimes;
+    for ( size_t o = 0; o < order.size(); ++o )
+    {
+        const Pass& pass = passes[ order[ o ] ];
+        std::vector< std::string > resources( pass.inputs );
+        resources.insert( resources.end(), pass.outputs.begin(), pass.outputs.end() );
+        for ( size_t r = 0; r < resources.size(); ++r )
+        {
+            if ( transientTextures.find( resources[ r ] ) == transientTextures.end() )
+                continue;
+            std::map< std::string, std::pair< int, int > >::iterator it = lifetimes.find( resources[ r ] );
+            if ( it == lifetimes.end() )
+                lifetimes[ resources[ r ] ] = std::make_pair( static_cast< int >( o ), static_cast< int >( o ) );
+            else
+                it->second.second = static_cast< int >( o );
+        }
+    }
+
+    std::vector< std::pair< std::pair< int, int >, std::string > > sorted;
+    for ( std::map< std::string, std::pair< int, int > >::iterator it = lifetimes.begin(); it != lifetimes.end(); ++it )
+    {
+        sorted.push_back( std::make_pair( it->second, it->first ) );
+    }
+    std::sort( sorted.begin(), sorted.end() );
+
+    for ( size_t t = 0; t < physicalTextures.size(); ++t )
+    {
+        physicalTextures[ t ].lastUse = -1;
+    }
+    physicalTextureOfTransient.clear();
+
+    for ( size_t s = 0; s < sorted.size(); ++s )
+    {
+        const TextureDescription& description = transientTextures[ sorted[ s ].second ];
+        const int firstUse = sorted[ s ].first.first;
+        const int lastUse = sorted[ s ].first.second;
+
+        int physical = -1;
+        for ( size_t t = 0; t < physicalTextures.size() && physical < 0; ++t )
+        {
+            const PhysicalTexture& candidate = physicalTextures[ t ];
+            if ( candidate.lastUse < firstUse
+                 && candidate.description.internalFormat == description.internalFormat
+                 && candidate.description.format == description.format
+                 && candidate.description.type == description.type )
+            {
+                physical = static_cast< int >( t );
+            }
+        }
+
+        if ( physical < 0 )
+        {
+            PhysicalTexture created;
+            created.description = description;
+            glGenTextures( 1, &created.texture );
+            GLStateCache::bindTexture( 0, GL_TEXTURE_2D, created.texture );
+            glTexImage2D( GL_TEXTURE_2D, 0, description.internalFormat, width, height, 0, description.format, description.type, nullptr );
+            glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+            glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+            glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+            glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+            GLStateCache::bindTexture( 0, GL_TEXTURE_2D, 0 );
+
+            physicalTextures.push_back( created );
+            physical = static_cast< int >( physicalTextures.size() ) - 1;
+        }
+
+        physicalTextures[ physical ].lastUse = lastUse;
+        physicalTextureOfTransient[ sorted[ s ].second ] = physical;
+    }
+
+    numberOfTransientTextures = static_cast< int >( physicalTextures.size() );
+}
+
+/******************************************************************************
+ * Framebuffer of a pass (framebuffers are shared by passes with the same attachments)
+ ******************************************************************************/
+GLint RenderGraph::framebufferOf( const Pass& pass )
+{
+    if ( std::find( pass.outputs.begin(), pass.outputs.end(), BackBuffer ) != pass.outputs.end() )
+    {
+        return 0;
+    }
+
+    std::vector< GLuint > colorAttachments;
+    GLuint depthAttachment = 0;
+    for ( size_t o = 0; o < pass.outputs.size(); ++o )
+    {
+        std::map< std::string, int >::const_iterator it = physicalTextureOfTransient.find( pass.outputs[ o ] );
+        if ( it == physicalTextureOfTransient.end() )
+            continue;
+        const PhysicalTexture& physical = physicalTextures[ it->second ];
+        if ( isDepthFormat( physical.description.internalFormat ) )
+            depthAttachment = physical.texture;
+        else
+            colorAttachments.push_back( physical.texture );
+    }
+
+    if ( colorAttachments.empty() && depthAttachment == 0 )
+    {
+        return -1;
+    }
+
+    std::vector< GLuint > key( colorAttachments );
+    key.push_back( depthAttachment );
+    std::map< std::vector< GLuint >, GLuint >::iterator cached = framebufferCache.find( key );
+    if ( cached != framebufferCache.end() )
+    {
+        return static_cast< GLint >( cached->second );
+    }
+
+    GLuint framebuffer;
+    glGenFramebuffers( 1, &framebuffer );
+    GLStateCache::bindFramebuffer( framebuffer );
+    std::vector< GLenum > drawBuffers;
+    for ( size_t c = 0; c < colorAttachments.size(); ++c )
+    {
+        glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + c, GL_TEXTURE_2D, colorAttachments[ c ], 0 );
+        drawBuffers.push_back( GL_COLOR_ATTACHMENT0 + c );
+    }
+    if ( depthAttachment != 0 )
+    {
+        glFramebufferTexture2D( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthAttachment, 0 );
+    }
+    if ( drawBuffers.empty() )
+    {
+        drawBuffers.push_back( GL_NONE );
+    }
+    glDrawBuffers( static_cast< GLsizei >( drawBuffers.size() ), drawBuffers.data() );
+
+    if ( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE )
+    {
+        std::cout << "Error: framebuffer of pass \"" << pass.name << "\" is incomplete" << std::endl;
+    }
+
+    GLStateCache::bindFramebuffer( 0 );
+
+    framebufferCache[ key ] = framebuffer;
+
+    return static_cast< GLint >( framebuffer );
+}
+
+/******************************************************************************
+ * Run the enabled passes of the frame
+ ******************************************************************************/
+void RenderGraph::execute()
+{
+    std::vector< bool > enabled( passes.size() );
+    for ( size_t i = 0; i < passes.size(); ++i )
+    {
+        enabled[ i ] = ! passes[ i ].enabled || passes[ i ].enabled();
+    }
+
+    if ( dirty || enabled != compiledEnabled )
+    {
+        compile( enabled );
+    }
+
+    numberOfExecutedPasses = 0;
+    for ( size_t o = 0; o < order.size(); ++o )
+    {
+        if ( passFramebuffers[ o ] >= 0 )
+        {
+            GLStateCache::bindFramebuffer( static_cast< GLuint >( passFramebuffers[ o ] ) );
+            if ( passFramebuffers[ o ] == 0 )
+                GLStateCache::viewport( 0, 0, width, height );
+            else
+                GLStateCache::viewport( 0, 0, viewportWidth, viewportHeight );
+        }
+
+        passes[ order[ o ] ].execute();
+        ++numberOfExecutedPasses;
+    }
+
+    GLStateCache::bindFramebuffer( 0 );
+}
+
+GLuint RenderGraph::texture( const std::string& name ) const
+{
+    std::map< std::string, int >::const_iterator it = physicalTextureOfTransient.find( name );
+    if ( it == physicalTextureOfTransient.end() )
+    {
+        return 0;
+    }
+    return physicalTextures[ it->second ].texture;
+}
+
+std::vector< std::string > RenderGraph::executionOrder() const
+{
+    std::vector< std::string > names;
+    for ( size_t o = 0; o < order.size(); ++o )
+    {
+        names.push_back( passes[ order[ o ] ].name );
+    }
+    return names;
+}
@@ -0,0 +1,114 @@
+#ifndef RENDERGRAPH_H
+#define RENDERGRAPH_H
+
+// STL
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// Graphics
+// - GLEW (always before "gl.h")
+#include <GL/glew.h>
+// - GL
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+
+/******************************************************************************
+ * Frame render graph
+ *
+ * Passes declare the resources they read and write by name. Each frame the
+ * enabled passes are ordered so that a pass runs after every pass writing one
+ * of its inputs (declaration order otherwise), and passes whose outputs reach
+ * neither the back buffer nor a needed pass are dropped.
+ *
+ * Transient textures are allocated by the graph at the frame size; textures
+ * with the same format whose lifetimes do not overlap share the same GL
+ * texture. A pass writing transient textures gets a framebuffer with these
+ * attachments bound (depth formats go to the depth attachment, the others
+ * to color attachments in declaration order); a pass writing "backbuffer"
+ * gets the default framebuffer. Other resources (CPU data, textures owned by
+ * other objects) only create dependencies.
+ *
+ * Passes writing transient textures may render a smaller area of them (the
+ * viewport, see setViewport()), the back buffer always gets the frame size.
+ ******************************************************************************/
+class RenderGraph{
+public:
+    // - name of the default framebuffer
+    static const std::string BackBuffer;
+
+    struct Pass{
+        std::string name;
+        std::vector< std::string > inputs;
+        std::vector< std::string > outputs;
+        std::function< void() > execute;
+        // - the pass is skipped when it returns false (always enabled if empty)
+        std::function< bool() > enabled;
+    };
+
+    int width;
+    int height;
+    // - rendered area of the transient textures
+    int viewportWidth;
+    int viewportHeight;
+
+    // - statistics of the last frame
+    int numberOfExecutedPasses;
+    int numberOfTransientTextures;
+
+    RenderGraph();
+
+    void addTransientTexture( const std::string& name, GLenum internalFormat, GLenum format, GLenum type );
+    void addPass( const std::string& name, const std::vector< std::string >& inputs, const std::vector< std::string >& outputs,
+                  std::function< void() > execute, std::function< bool() > enabled = std::function< bool() >() );
+
+    void resize( int pWidth, int pHeight );
+    // - clamped to the frame size
+    void setViewport( int pWidth, int pHeight );
+    void execute();
+
+    // - GL texture of a transient texture for the current frame
+    GLuint texture( const std::string& name ) const;
+
+    // - passes in execution order (last compilation)
+    std::vector< std::string > executionOrder() const;
+
+private:
+    struct TextureDescription{
+        GLenum internalFormat;
+        GLenum format;
+        GLenum type;
+    };
+
+    struct PhysicalTexture{
+        TextureDescription description;
+        GLuint texture;
+        // - last pass (in execution order) using it
+        int lastUse;
+    };
+
+    std::vector< Pass > passes;
+    std::map< std::string, TextureDescription > transientTextures;
+
+    // - compiled frame
+    std::vector< bool > compiledEnabled;
+    bool dirty;
+    std::vector< int > order;
+    std::map< std::string, int > physicalTextureOfTransient;
+    std::vector< PhysicalTexture > physicalTextures;
+    // - per ordered pass: framebuffer to bind, -1 when the pass manages its own
+    std::vector< GLint > passFramebuffers;
+    std::map< std::vector< GLuint >, GLuint > framebufferCache;
+
+    void compile( const std::vector< bool >& enabled );
+    void allocateTextures();
+    GLint framebufferOf( const Pass& pass );
+    void deleteResources();
+    static bool isDepthFormat( GLenum internalFormat );
+};
+
+#endif
@@ -0,0 +1,154 @@
+#include "RenderQueue.h"
+
+// STL
+#include <algorithm>
+#include <cstring>
+
+#include "JobSystem.h"
+
+namespace
+{
+    const int Radix = 256;
+
+    // One digit of RenderQueue::sort(), shared by its tasks
+    struct DigitPass
+    {
+        const RenderQueue::Item* source;
+        RenderQueue::Item* destination;
+        size_t size;
+        size_t chunk;
+        int shift;
+        size_t* histograms;
+        size_t* offsets;
+    };
+
+    void countDigits( void* context, unsigned int task )
+    {
+        const DigitPass& pass = *static_cast< const DigitPass* >( context );
+        const size_t begin = std::min( pass.size, task * pass.chunk );
+        const size_t end = std::min( pass.size, begin + pass.chunk );
+        size_t* histogram = &pass.histograms[ task * Radix ];
+        std::fill( histogram, histogram + Radix, 0 );
+        for ( size_t i = begin; i < end; ++i )
+        {
+            ++histogram[ ( pass.source[ i ].key >> pass.shift ) & 0xFF ];
+        }
+    }
+
+    void scatterDigits( void* context, unsigned int task )
+    {
+        const DigitPass& pass = *static_cast< const DigitPass* >( context );
+        const size_t begin = std::min( pass.size, task * pass.chunk );
+        const size_t end = std::min( pass.size, begin + pass.chunk );
+        size_t* offset = &pass.offsets[ task * Radix ];
+        for ( size_t i = begin; i < end; ++i )
+        {
+            pass.destination[ offset[ ( pass.source[ i ].key >> pass.shift ) & 0xFF ]++ ] = pass.source[ i ];
+        }
+    }
+}
+
+RenderQueue::RenderQueue(){
+    numberOfThreads = numberOfWorkerThreads();
+}
+
+/******************************************************************************
+ * Build a sort key (values are truncated to their bit ranges)
+ ******************************************************************************/
+uint64_t RenderQueue::makeKey( unsigned int pass, unsigned int program, unsigned int texture, float depth )
+{
+    // Positive floats sort like their bits
+    uint32_t depthBits;
+    depth = std::max( depth, 0.f );
+    std::memcpy( &depthBits, &depth, sizeof( depthBits ) );
+
+    return ( static_cast< uint64_t >( pass & 0xF ) << 60 )
+         | ( static_cast< uint64_t >( program & 0xFFF ) << 48 )
+         | ( static_cast< uint64_t >( texture & 0xFFFF ) << 32 )
+         | static_cast< uint64_t >( depthBits );
+}
+
+void RenderQueue::clear()
+{
+    // - keeps the capacity
+    items.clear();
+}
+
+void RenderQueue::push( uint64_t key, uint32_t index )
+{
+    Item item;
+    item.key = key;
+    item.index = index;
+    items.push_back( item );
+}
+
+/******************************************************************************
+ * Sort the items by key
+ *
+ * For each digit, every task counts the digits of its slice of the items,
+ * then, once all counts are known, scatters them after the ones of the
+ * previous digit values and of the previous tasks for the same value, which
+ * keeps the sort stable. Both phases go to the job system as plain functions
+ * (task slots), so a sort does not allocate once the arrays are big enough.
+ ******************************************************************************/
+void RenderQueue::sort()
+{
+    const size_t size = items.size();
+    if ( size < 2 )
+    {
+        return;
+    }
+
+    const unsigned int n = ( size < ParallelThreshold ) ? 1u : std::max( 1u, numberOfThreads );
+
+    scratch.resize( size );
+    histograms.resize( n * Radix );
+    offsets.resize( n * Radix );
+
+    JobSystem& jobs = JobSystem::instance();
+    Item* source = items.data();
+    Item* destination = scratch.data();
+
+    DigitPass pass;
+    pass.size = size;
+    pass.chunk = ( size + n - 1 ) / n;
+    pass.histograms = histograms.data();
+    pass.offsets = offsets.data();
+
+    for ( int digit = 0; digit < 8; ++digit )
+    {
+        pass.source = source;
+        pass.destination = destination;
+        pass.shift = 8 * digit;
+
+        jobs.forEachTask( n, countDigits, &pass );
+
+        // Write positions of each task, skip digits shared by all keys
+        size_t position = 0;
+        bool skip = false;
+        for ( int b = 0; b < Radix; ++b )
+        {
+            size_t count = 0;
+            for ( unsigned int t = 0; t < n; ++t )
+            {
+                offsets[ t * Radix + b ] = position + count;
+                count += histograms[ t * Radix + b ];
+            }
+            skip = skip || ( count == size );
+            position += count;
+        }
+        if ( skip )
+        {
+            continue;
+        }
+
+        jobs.forEachTask( n, scatterDigits, &pass );
+
+        std::swap( source, destination );
+    }
+
+    if ( source == scratch.data() )
+    {
+        items.swap( scratch );
+    }
+}
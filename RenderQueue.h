@@ -0,0 +1,56 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+// STL
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/******************************************************************************
+ * Render queue
+ *
+ * Draw items are collected each frame with a 64 bits sort key and sorted
+ * with a radix sort (8 bits digits, least significant first; digits shared
+ * by every key are skipped). Big queues are sorted by the job system.
+ * Arrays only grow and the tasks go through the job system's task slots,
+ * so a steady scene sorts without allocating.
+ *
+ * Key, from the most significant bits:
+ * - pass (4 bits)
+ * - shader program (12 bits)
+ * - texture / material (16 bits)
+ * - view depth (32 bits, float bits of a positive distance: front to back)
+ ******************************************************************************/
+class RenderQueue{
+public:
+    struct Item
+    {
+        uint64_t key;
+        // - index of the drawn object (mesh...)
+        uint32_t index;
+    };
+
+    // - below this size the queue is sorted on the calling thread
+    static const size_t ParallelThreshold = 16384;
+
+    std::vector< Item > items;
+
+    // - tasks of sort()
+    unsigned int numberOfThreads;
+
+    RenderQueue();
+
+    static uint64_t makeKey( unsigned int pass, unsigned int program, unsigned int texture, float depth );
+
+    void clear();
+    void push( uint64_t key, uint32_t index );
+    void sort();
+
+private:
+    std::vector< Item > scratch;
+    // - per task digit histograms and write positions
+    std::vector< size_t > histograms;
+    std::vector< size_t > offsets;
+};
+
+#endif
@@ -0,0 +1,106 @@
+#include "SceneGraph.h"
+
+// STL
+#include <atomic>
+#include <cassert>
+
+#include "JobSystem.h"
+
+SceneGraph::SceneGraph(){
+    numberOfUpdatedNodes = 0;
+}
+
+int SceneGraph::addNode( int parentNode, const glm::mat4& localMatrix )
+{
+    // Depth order: the parent is already stored
+    assert( parentNode < size() );
+
+    parent.push_back( parentNode );
+    local.push_back( localMatrix );
+    world.push_back( localMatrix );
+    normal.push_back( glm::mat3( 1.f ) );
+    dirty.push_back( 1 );
+    updated.push_back( 0 );
+
+    // - level of the node: one below its parent
+    const int node = size() - 1;
+    const size_t level = ( parentNode >= 0 ) ? depth[ parentNode ] + 1 : 0;
+    depth.push_back( static_cast< int >( level ) );
+    if ( levels.size() <= level )
+    {
+        levels.resize( level + 1 );
+    }
+    levels[ level ].push_back( node );
+
+    return node;
+}
+
+// The world matrix of the node itself is set at once (read back before the
+// next update, e.g. by repeated edits), its children wait for the update
+void SceneGraph::setLocal( int node, const glm::mat4& localMatrix )
+{
+    const int p = parent[ node ];
+    local[ node ] = localMatrix;
+    world[ node ] = ( p >= 0 ) ? world[ p ] * localMatrix : localMatrix;
+    dirty[ node ] = 1;
+}
+
+void SceneGraph::setWorld( int node, const glm::mat4& worldMatrix )
+{
+    const int p = parent[ node ];
+    local[ node ] = ( p >= 0 ) ? glm::inverse( world[ p ] ) * worldMatrix : worldMatrix;
+    world[ node ] = worldMatrix;
+    dirty[ node ] = 1;
+}
+
+/******************************************************************************
+ * Update the world matrices
+ * - small graphs: one pass in storage order, the parent of a node is always
+ *   done before it
+ * - big graphs: level after level, the nodes of a level split in ranges run
+ *   by the job system (their parents are all in the previous levels)
+ ******************************************************************************/
+void SceneGraph::update()
+{
+    const int count = size();
+    if ( count < static_cast< int >( ParallelThreshold ) )
+    {
+        int numberOfNodes = 0;
+        for ( int n = 0; n < count; ++n )
+        {
+            numberOfNodes += updateNode( n ) ? 1 : 0;
+        }
+        numberOfUpdatedNodes = numberOfNodes;
+        return;
+    }
+
+    std::atomic< int > numberOfNodes( 0 );
+    for ( size_t l = 0; l < levels.size(); ++l )
+    {
+        const std::vector< int >& level = levels[ l ];
+        JobSystem::instance().parallelFor( 0, level.size(), ParallelThreshold / 4, [&]( size_t begin, size_t end )
+        {
+            int rangeNodes = 0;
+            for ( size_t k = begin; k < end; ++k )
+            {
+                rangeNodes += updateNode( level[ k ] ) ? 1 : 0;
+            }
+            numberOfNodes += rangeNodes;
+        } );
+    }
+    numberOfUpdatedNodes = numberOfNodes;
+}
+
+bool SceneGraph::updateNode( int n )
+{
+    const int p = parent[ n ];
+    const bool parentUpdated = ( p >= 0 ) && updated[ p ];
+    updated[ n ] = dirty[ n ] | static_cast< unsigned char >( parentUpdated );
+    dirty[ n ] = 0;
+    if ( !updated[ n ] )
+        return false;
+
+    world[ n ] = ( p >= 0 ) ? world[ p ] * local[ n ] : local[ n ];
+    normal[ n ] = glm::transpose( glm::inverse( glm::mat3( world[ n ] ) ) );
+    return true;
+}
@@ -0,0 +1,68 @@
+#ifndef SCENEGRAPH_H
+#define SCENEGRAPH_H
+
+// STL
+#include <cstddef>
+#include <vector>
+
+// glm
+#include <glm/glm.hpp>
+
+/******************************************************************************
+ * Scene graph
+ *
+ * Nodes are stored in flat arrays, one entry per node (structure of arrays).
+ * A node is created after its parent, so the arrays are ordered by depth:
+ * parents always come before their children. The world matrices are then
+ * updated in one linear pass, without recursion: a node is recomputed when
+ * its local matrix changed or when its parent was recomputed earlier in the
+ * same pass, the other (clean) subtrees are skipped.
+ *
+ * Big graphs are updated level after level instead, each level split over
+ * the job system.
+ *
+ * The normal matrix (inverse transpose of the world linear part) is cached
+ * with the world matrix: eye space normal matrix = mat3( view ) * normal,
+ * the view being a rigid transform.
+ ******************************************************************************/
+class SceneGraph{
+public:
+    // - below this number of nodes the update runs on the calling thread
+    static const size_t ParallelThreshold = 4096;
+
+    // - per node: parent (-1: root), local and world matrices, world normal matrix
+    std::vector< int > parent;
+    std::vector< glm::mat4 > local;
+    std::vector< glm::mat4 > world;
+    std::vector< glm::mat3 > normal;
+    // - local matrix changed since the last update
+    std::vector< unsigned char > dirty;
+    // - depth of each node, nodes of each depth
+    std::vector< int > depth;
+    std::vector< std::vector< int > > levels;
+
+    // - last update
+    int numberOfUpdatedNodes;
+
+    SceneGraph();
+
+    // - the parent must already exist (or be -1)
+    int addNode( int parentNode, const glm::mat4& localMatrix );
+    int size() const { return static_cast< int >( parent.size() ); }
+
+    void setLocal( int node, const glm::mat4& localMatrix );
+    // - local matrix giving this world matrix under the current parent world matrix
+    void setWorld( int node, const glm::mat4& worldMatrix );
+
+    // - world and normal matrices of the dirty subtrees (once per frame)
+    void update();
+
+private:
+    // - recomputed during the current update (read by the children)
+    std::vector< unsigned char > updated;
+
+    // - true when recomputed
+    bool updateNode( int n );
+};
+
+#endif
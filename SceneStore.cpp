@@ -0,0 +1,245 @@
+#include "SceneStore.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+
+#include "Picking.h"
+#include "JobSystem.h"
+
+SceneStore::SceneStore(){
+    numberOfVisibleEntities = 0;
+    numberOfImpostorEntities = 0;
+}
+
+/******************************************************************************
+ * Entities
+ ******************************************************************************/
+SceneStore::Entity SceneStore::create( int sceneNode, uint32_t meshIndex, uint32_t textureKey, const glm::vec3& boundsMin, const glm::vec3& boundsMax )
+{
+    Entity entity;
+    if ( !freeEntities.empty() )
+    {
+        entity = freeEntities.back();
+        freeEntities.pop_back();
+    }
+    else
+    {
+        entity = static_cast< Entity >( indices.size() );
+        indices.push_back( -1 );
+    }
+    indices[ entity ] = static_cast< int >( entities.size() );
+    entities.push_back( entity );
+
+    node.push_back( sceneNode );
+    world.push_back( glm::mat4( 1.f ) );
+    localMin.push_back( boundsMin );
+    localMax.push_back( boundsMax );
+    worldSphere.push_back( glm::vec4( 0.5f * ( boundsMin + boundsMax ), 0.5f * glm::length( boundsMax - boundsMin ) ) );
+    mesh.push_back( meshIndex );
+    texture.push_back( textureKey );
+    selected.push_back( 0 );
+    visible.push_back( 1 );
+    lod.push_back( 0 );
+
+    return entity;
+}
+
+void SceneStore::destroy( Entity entity )
+{
+    const int index = indexOf( entity );
+    if ( index < 0 )
+        return;
+
+    // The last entity fills the hole
+    const int last = static_cast< int >( entities.size() ) - 1;
+    if ( index != last )
+    {
+        node[ index ] = node[ last ];
+        world[ index ] = world[ last ];
+        localMin[ index ] = localMin[ last ];
+        localMax[ index ] = localMax[ last ];
+        worldSphere[ index ] = worldSphere[ last ];
+        mesh[ index ] = mesh[ last ];
+        texture[ index ] = texture[ last ];
+        selected[ index ] = selected[ last ];
+        visible[ index ] = visible[ last ];
+        lod[ index ] = lod[ last ];
+        entities[ index ] = entities[ last ];
+        indices[ entities[ index ] ] = index;
+    }
+
+    node.pop_back();
+    world.pop_back();
+    localMin.pop_back();
+    localMax.pop_back();
+    worldSphere.pop_back();
+    mesh.pop_back();
+    texture.pop_back();
+    selected.pop_back();
+    visible.pop_back();
+    lod.pop_back();
+    entities.pop_back();
+
+    indices[ entity ] = -1;
+    freeEntities.push_back( entity );
+}
+
+void SceneStore::clear()
+{
+    while ( !entities.empty() )
+    {
+        destroy( entities.back() );
+    }
+}
+
+int SceneStore::indexOf( Entity entity ) const
+{
+    return ( entity < indices.size() ) ? indices[ entity ] : -1;
+}
+
+SceneStore::Entity SceneStore::entityOfMesh( uint32_t meshIndex ) const
+{
+    const std::vector< uint32_t >::const_iterator found = std::find( mesh.begin(), mesh.end(), meshIndex );
+    return ( found != mesh.end() ) ? entities[ found - mesh.begin() ] : InvalidEntity;
+}
+
+/******************************************************************************
+ * Run "function( begin, end )" over ranges of the dense indices
+ ******************************************************************************/
+template< typename Function >
+void SceneStore::forEachRange( Function function ) const
+{
+    const size_t count = entities.size();
+    if ( count < ParallelThreshold )
+    {
+        function( 0, count );
+        return;
+    }
+
+    JobSystem::instance().parallelFor( 0, count, ParallelThreshold / 4, function );
+}
+
+/******************************************************************************
+ * Transform system
+ * - the sphere radius follows the largest axis scale
+ ******************************************************************************/
+void SceneStore::updateTransforms( const SceneGraph& graph )
+{
+    forEachRange( [&]( size_t begin, size_t end )
+    {
+        for ( size_t e = begin; e < end; ++e )
+        {
+            const glm::mat4& matrix = graph.world[ node[ e ] ];
+            world[ e ] = matrix;
+
+            const glm::vec3 center = 0.5f * ( localMin[ e ] + localMax[ e ] );
+            const float radius = 0.5f * glm::length( localMax[ e ] - localMin[ e ] );
+            const float scale = std::sqrt( std::max( glm::dot( glm::vec3( matrix[ 0 ] ), glm::vec3( matrix[ 0 ] ) ),
+                                           std::max( glm::dot( glm::vec3( matrix[ 1 ] ), glm::vec3( matrix[ 1 ] ) ),
+                                                     glm::dot( glm::vec3( matrix[ 2 ] ), glm::vec3( matrix[ 2 ] ) ) ) ) );
+            worldSphere[ e ] = glm::vec4( glm::vec3( matrix * glm::vec4( center, 1.f ) ), radius * scale );
+        }
+    } );
+}
+
+/******************************************************************************
+ * Culling system
+ * - frustum planes extracted from the view projection (Gribb-Hartmann)
+ ******************************************************************************/
+void SceneStore::cull( const glm::mat4& viewProjection )
+{
+    const glm::mat4 m = glm::transpose( viewProjection );
+    glm::vec4 planes[ 6 ] = { m[ 3 ] + m[ 0 ], m[ 3 ] - m[ 0 ], m[ 3 ] + m[ 1 ], m[ 3 ] - m[ 1 ], m[ 3 ] + m[ 2 ], m[ 3 ] - m[ 2 ] };
+    for ( int p = 0; p < 6; ++p )
+    {
+        planes[ p ] /= glm::length( glm::vec3( planes[ p ] ) );
+    }
+
+    forEachRange( [&]( size_t begin, size_t end )
+    {
+        for ( size_t e = begin; e < end; ++e )
+        {
+            const glm::vec4 sphere = worldSphere[ e ];
+            unsigned char inside = 1;
+            for ( int p = 0; p < 6; ++p )
+            {
+                inside &= static_cast< unsigned char >( glm::dot( glm::vec3( planes[ p ] ), glm::vec3( sphere ) ) + planes[ p ].w >= -sphere.w );
+            }
+            visible[ e ] = inside;
+        }
+    } );
+
+    numberOfVisibleEntities = static_cast< int >( std::count( visible.begin(), visible.end(), 1 ) );
+}
+
+/******************************************************************************
+ * Level of detail system
+ ******************************************************************************/
+void SceneStore::selectLod( const glm::vec3& cameraPosition, float impostorDistance )
+{
+    const float distance2 = impostorDistance * impostorDistance;
+    forEachRange( [&]( size_t begin, size_t end )
+    {
+        for ( size_t e = begin; e < end; ++e )
+        {
+            const glm::vec3 d = glm::vec3( worldSphere[ e ] ) - cameraPosition;
+            lod[ e ] = static_cast< unsigned char >( visible[ e ] && glm::dot( d, d ) >= distance2 );
+        }
+    } );
+
+    numberOfImpostorEntities = static_cast< int >( std::count( lod.begin(), lod.end(), 1 ) );
+}
+
+/******************************************************************************
+ * Picking system
+ * - spheres first, boxes (oriented by the world matrix) for the candidates
+ ******************************************************************************/
+SceneStore::Entity SceneStore::pick( const glm::vec3& rayOrigin, const glm::vec3& rayDirection, float& distance ) const
+{
+    Entity nearest = InvalidEntity;
+    for ( size_t e = 0; e < entities.size(); ++e )
+    {
+        const glm::vec3 toCenter = glm::vec3( worldSphere[ e ] ) - rayOrigin;
+        const float along = glm::dot( toCenter, rayDirection );
+        if ( glm::dot( toCenter, toCenter ) - along * along > worldSphere[ e ].w * worldSphere[ e ].w )
+            continue;
+
+        float hit;
+        if ( Picking::TestRayOBBIntersection( rayOrigin, rayDirection, localMin[ e ], localMax[ e ], world[ e ], hit )
+             && ( nearest == InvalidEntity || hit < distance ) )
+        {
+            nearest = entities[ e ];
+            distance = hit;
+        }
+    }
+    return nearest;
+}
+
+void SceneStore::select( Entity entity )
+{
+    std::fill( selected.begin(), selected.end(), 0 );
+    const int index = indexOf( entity );
+    if ( index >= 0 )
+    {
+        selected[ index ] = 1;
+    }
+}
+
+/******************************************************************************
+ * Submission system
+ ******************************************************************************/
+void SceneStore::submit( RenderQueue& queue, unsigned int pass, unsigned int program, const glm::mat4& viewMatrix,
+                         const std::vector< bool >& meshDrawn ) const
+{
+    // - view depth of the sphere centers: third row of the view matrix
+    const glm::vec4 depthRow( viewMatrix[ 0 ][ 2 ], viewMatrix[ 1 ][ 2 ], viewMatrix[ 2 ][ 2 ], viewMatrix[ 3 ][ 2 ] );
+    for ( size_t e = 0; e < entities.size(); ++e )
+    {
+        if ( !meshDrawn[ mesh[ e ] ] )
+            continue;
+
+        const float depth = -glm::dot( depthRow, glm::vec4( glm::vec3( worldSphere[ e ] ), 1.f ) );
+        queue.push( RenderQueue::makeKey( pass, program, texture[ e ], depth ), mesh[ e ] );
+    }
+}
@@ -0,0 +1,100 @@
+#ifndef SCENESTORE_H
+#define SCENESTORE_H
+
+// STL
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// glm
+#include <glm/glm.hpp>
+
+#include "RenderQueue.h"
+#include "SceneGraph.h"
+
+/******************************************************************************
+ * Scene store (entities and components)
+ *
+ * An entity is an id; its components live in dense arrays, at the same index
+ * in every array, so each system is one linear pass over the arrays it
+ * reads. Destroying an entity moves the last one into its place (the id to
+ * index table follows), the arrays never have holes.
+ *
+ * Components:
+ * - transform: scene graph node, world matrix copied from the graph
+ * - bounds: local box, world sphere
+ * - renderable: mesh index, texture part of the sort key
+ * - selection (highlight of the drawn mesh and impostor)
+ * and the per frame outputs of the systems: visible (view frustum) and level
+ * of detail (0: mesh, 1: impostor).
+ *
+ * The passes over the entities (transforms, culling, level of detail) are
+ * split in ranges run by the job system for big scenes.
+ ******************************************************************************/
+class SceneStore{
+public:
+    typedef uint32_t Entity;
+    static const Entity InvalidEntity = 0xFFFFFFFFu;
+
+    // - below this number of entities the systems run on the calling thread
+    static const size_t ParallelThreshold = 4096;
+
+    // Components
+    // - transform
+    std::vector< int > node;
+    std::vector< glm::mat4 > world;
+    // - bounds: local box, world sphere (center, radius)
+    std::vector< glm::vec3 > localMin;
+    std::vector< glm::vec3 > localMax;
+    std::vector< glm::vec4 > worldSphere;
+    // - renderable
+    std::vector< uint32_t > mesh;
+    std::vector< uint32_t > texture;
+    // - selection
+    std::vector< unsigned char > selected;
+    // - system outputs
+    std::vector< unsigned char > visible;
+    std::vector< unsigned char > lod;
+    // - entity of each index
+    std::vector< Entity > entities;
+
+    // - last frame
+    int numberOfVisibleEntities;
+    int numberOfImpostorEntities;
+
+    SceneStore();
+
+    Entity create( int sceneNode, uint32_t meshIndex, uint32_t textureKey, const glm::vec3& boundsMin, const glm::vec3& boundsMax );
+    void destroy( Entity entity );
+    void clear();
+    // - dense index of an entity (-1: destroyed)
+    int indexOf( Entity entity ) const;
+    // - entity drawing a mesh (InvalidEntity: none)
+    Entity entityOfMesh( uint32_t meshIndex ) const;
+    size_t size() const { return entities.size(); }
+
+    // Systems
+    // - world matrices and spheres from the scene graph
+    void updateTransforms( const SceneGraph& graph );
+    // - spheres against the view frustum
+    void cull( const glm::mat4& viewProjection );
+    // - visible entities further than the distance are impostors
+    void selectLod( const glm::vec3& cameraPosition, float impostorDistance );
+    // - nearest entity whose world box is hit by the ray (InvalidEntity: none)
+    Entity pick( const glm::vec3& rayOrigin, const glm::vec3& rayDirection, float& distance ) const;
+    // - only this entity selected (InvalidEntity: none)
+    void select( Entity entity );
+    // - one item per entity drawn by the pass (by mesh), sorted by material then depth
+    void submit( RenderQueue& queue, unsigned int pass, unsigned int program, const glm::mat4& viewMatrix,
+                 const std::vector< bool >& meshDrawn ) const;
+
+private:
+    // - entity id -> dense index (-1: free id)
+    std::vector< int > indices;
+    std::vector< Entity > freeEntities;
+
+    template< typename Function >
+    void forEachRange( Function function ) const;
+};
+
+#endif
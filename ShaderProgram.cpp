@@ -0,0 +1,166 @@
+#include "ShaderProgram.h"
+
+#include "GLStateCache.h"
+
+GLuint ShaderProgram::create( const char* vertexShaderSource, const char* fragmentShaderSource, const std::string& name )
+{
+    std::cout << "- initialize " << name << " shader program..." << std::endl;
+
+    GLuint program = glCreateProgram();
+
+    GLuint vertexShader = glCreateShader( GL_VERTEX_SHADER );
+    GLuint fragmentShader = glCreateShader( GL_FRAGMENT_SHADER );
+
+    bool statusOK = compile( vertexShader, vertexShaderSource, name + " vertex" );
+    statusOK = compile( fragmentShader, fragmentShaderSource, name + " fragment" ) && statusOK;
+
+    glAttachShader( program, vertexShader );
+    glAttachShader( program, fragmentShader );
+
+    statusOK = statusOK && link( program, name );
+
+    // Shaders are kept alive by the program
+    glDeleteShader( vertexShader );
+    glDeleteShader( fragmentShader );
+
+    if ( !statusOK )
+    {
+        GLStateCache::forgetProgram( program );
+        glDeleteProgram( program );
+        return 0;
+    }
+
+    return program;
+}
+
+GLuint ShaderProgram::create( const char* vertexShaderSource, const char* tessellationControlShaderSource,
+                              const char* tessellationEvaluationShaderSource, const char* fragmentShaderSource, const std::string& name )
+{
+    std::cout << "- initialize " << name << " shader program..." << std::endl;
+
+    GLuint program = glCreateProgram();
+
+    const GLenum types[ 4 ] = { GL_VERTEX_SHADER, GL_TESS_CONTROL_SHADER, GL_TESS_EVALUATION_SHADER, GL_FRAGMENT_SHADER };
+    const char* sources[ 4 ] = { vertexShaderSource, tessellationControlShaderSource, tessellationEvaluationShaderSource, fragmentShaderSource };
+    const char* stages[ 4 ] = { " vertex", " tessellation control", " tessellation evaluation", " fragment" };
+
+    bool statusOK = true;
+    for ( int s = 0; s < 4; ++s )
+    {
+        GLuint shader = glCreateShader( types[ s ] );
+        statusOK = compile( shader, sources[ s ], name + stages[ s ] ) && statusOK;
+        glAttachShader( program, shader );
+        // - kept alive by the program
+        glDeleteShader( shader );
+    }
+
+    statusOK = statusOK && link( program, name );
+
+    if ( !statusOK )
+    {
+        GLStateCache::forgetProgram( program );
+        glDeleteProgram( program );
+        return 0;
+    }
+
+    return program;
+}
+
+GLuint ShaderProgram::create( const char* vertexShaderSource, const char* geometryShaderSource,
+                              const std::vector< std::string >& varyings, const std::string& name )
+{
+    std::cout << "- initialize " << name << " shader program..." << std::endl;
+
+    GLuint program = glCreateProgram();
+
+    GLuint vertexShader = glCreateShader( GL_VERTEX_SHADER );
+    GLuint geometryShader = glCreateShader( GL_GEOMETRY_SHADER );
+
+    bool statusOK = compile( vertexShader, vertexShaderSource, name + " vertex" );
+    statusOK = compile( geometryShader, geometryShaderSource, name + " geometry" ) && statusOK;
+
+    glAttachShader( program, vertexShader );
+    glAttachShader( program, geometryShader );
+
+    // Captured outputs must be declared before linking
+    std::vector< const char* > names;
+    for ( size_t v = 0; v < varyings.size(); ++v )
+    {
+        names.push_back( varyings[ v ].c_str() );
+    }
+    glTransformFeedbackVaryings( program, static_cast< GLsizei >( names.size() ), names.data(), GL_INTERLEAVED_ATTRIBS );
+
+    statusOK = statusOK && link( program, name );
+
+    // Shaders are kept alive by the program
+    glDeleteShader( vertexShader );
+    glDeleteShader( geometryShader );
+
+    if ( !statusOK )
+    {
+        GLStateCache::forgetProgram( program );
+        glDeleteProgram( program );
+        return 0;
+    }
+
+    return program;
+}
+
+bool ShaderProgram::compile( GLuint shader, const char* source, const std::string& name )
+{
+    glShaderSource( shader, 1, &source, nullptr );
+    glCompileShader( shader );
+
+    GLint compileStatus;
+    glGetShaderiv( shader, GL_COMPILE_STATUS, &compileStatus );
+    if ( compileStatus == GL_FALSE )
+    {
+        std::cout << "Error: " << name << " shader "<< std::endl;
+
+        GLint logInfoLength = 0;
+        glGetShaderiv( shader, GL_INFO_LOG_LENGTH, &logInfoLength );
+        if ( logInfoLength > 0 )
+        {
+            GLchar* infoLog = new GLchar[ logInfoLength ];
+            GLsizei length = 0;
+            glGetShaderInfoLog( shader, logInfoLength, &length, infoLog );
+            std::cout << infoLog << std::endl;
+            delete[] infoLog;
+        }
+
+        return false;
+    }
+
+    return true;
+}
+
+bool ShaderProgram::link( GLuint program, const std::string& name )
+{
+    glLinkProgram( program );
+
+    // Check linking status
+    GLint linkStatus = 0;
+    glGetProgramiv( program, GL_LINK_STATUS, &linkStatus );
+    if ( linkStatus == GL_FALSE )
+    {
+        GLint logInfoLength = 0;
+        glGetProgramiv( program, GL_INFO_LOG_LENGTH, &logInfoLength );
+        if ( logInfoLength > 0 )
+        {
+            // Return information log for program object
+            GLchar* infoLog = new GLchar[ logInfoLength ];
+            GLsizei length = 0;
+            glGetProgramInfoLog( program, logInfoLength, &length, infoLog );
+
+            // LOG
+            std::cout << "\nShaderProgram::link() - " << name << " link ERROR" << std::endl;
+            std::cout << infoLog << std::endl;
+
+            delete[] infoLog;
+        }
+
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,47 @@
+#ifndef SHADERPROGRAM_H
+#define SHADERPROGRAM_H
+
+// STL
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Graphics
+// - GLEW (always before "gl.h")
+#include <GL/glew.h>
+// - GL
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+
+class ShaderProgram{
+public:
+    ShaderProgram() = delete;
+    // Compile and link a program, returns 0 (and logs) on error
+    static GLuint create(
+        const char* vertexShaderSource,     // Vertex shader source code
+        const char* fragmentShaderSource,   // Fragment shader source code
+        const std::string& name             // Name used in logs
+    );
+    // Same with tessellation control and evaluation stages (GL 4.0)
+    static GLuint create(
+        const char* vertexShaderSource,
+        const char* tessellationControlShaderSource,
+        const char* tessellationEvaluationShaderSource,
+        const char* fragmentShaderSource,
+        const std::string& name
+    );
+    // Transform feedback program: vertex and geometry stages, captured varyings (interleaved), no rasterization
+    static GLuint create(
+        const char* vertexShaderSource,
+        const char* geometryShaderSource,
+        const std::vector< std::string >& varyings,
+        const std::string& name
+    );
+private:
+    static bool compile( GLuint shader, const char* source, const std::string& name );
+    static bool link( GLuint program, const std::string& name );
+};
+
+#endif
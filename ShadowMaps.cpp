@@ -0,0 +1,372 @@
+#include "ShadowMaps.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+
+#include "ShaderProgram.h"
+#include "GLStateCache.h"
+
+const std::string ShadowMaps::ShaderSource =
+    "precision highp sampler2DArrayShadow;\n"
+    "\n"
+    "// UNIFORM\n"
+    "// - shadow maps (one layer per cascade)\n"
+    "uniform sampler2DArrayShadow shadowMap;\n"
+    "// - eye-space to shadow map space [0,1]\n"
+    "uniform mat4 shadowMatrices[ 4 ];\n"
+    "uniform vec4 shadowSplits;\n"
+    "uniform int shadowCascades;\n"
+    "uniform float shadowTexelSize;\n"
+    "\n"
+    "// 1.0: lit, 0.0: in shadow\n"
+    "float cascadedShadow( vec3 eyePosition )\n"
+    "{\n"
+    "    int cascade = 0;\n"
+    "    for ( ; cascade < shadowCascades; ++cascade )\n"
+    "    {\n"
+    "        if ( -eyePosition.z < shadowSplits[ cascade ] )\n"
+    "            break;\n"
+    "    }\n"
+    "    if ( cascade >= shadowCascades )\n"
+    "        return 1.0;\n"
+    "\n"
+    "    vec3 p = ( shadowMatrices[ cascade ] * vec4( eyePosition, 1.0 ) ).xyz;\n"
+    "    if ( any( lessThan( p, vec3( 0.0 ) ) ) || any( greaterThan( p, vec3( 1.0 ) ) ) )\n"
+    "        return 1.0;\n"
+    "\n"
+    "    // 3x3 PCF (each tap is itself bilinearly filtered by the hardware)\n"
+    "    float shadow = 0.0;\n"
+    "    for ( int y = -1; y <= 1; ++y )\n"
+    "        for ( int x = -1; x <= 1; ++x )\n"
+    "            shadow += texture( shadowMap, vec4( p.xy + vec2( x, y ) * shadowTexelSize, float( cascade ), p.z - 0.002 ) );\n"
+    "    return shadow / 9.0;\n"
+    "}\n";
+
+ShadowMaps::ShadowMaps(){
+    enabled = true;
+    resolution = 1024;
+    numberOfCascades = 4;
+    updateInterval[ 0 ] = 1;
+    updateInterval[ 1 ] = 1;
+    updateInterval[ 2 ] = 2;
+    updateInterval[ 3 ] = 4;
+    maxDistance = 30.f;
+    splitLambda = 0.75f;
+
+    lightDirection = glm::vec3( 0.f, -1.f, 0.f );
+    sceneRadius = 20.f;
+
+    mShadowMapTexture = 0;
+    mShadowMapFramebuffer = 0;
+    mDepthShaderProgram = 0;
+
+    for ( int c = 0; c < MaxCascades; ++c )
+    {
+        splitDistances[ c ] = 0.f;
+        renderedCenters[ c ] = glm::vec3( 0.f );
+    }
+
+    numberOfRenderedCascades = 0;
+    frameIndex = 0;
+}
+
+bool ShadowMaps::initializeShadowMaps(){
+    bool statusOK = true;
+
+    std::cout << "Initialize shadow maps..." << std::endl;
+
+    if ( statusOK )
+    {
+        statusOK = initializeShadowMapTexture();
+    }
+
+    if ( statusOK )
+    {
+        statusOK = initializeShaderProgram();
+    }
+
+    return statusOK;
+}
+
+/******************************************************************************
+ * Initialize shadow map texture
+ * - depth texture array with one layer per cascade, compared in the shaders
+ ******************************************************************************/
+bool ShadowMaps::initializeShadowMapTexture()
+{
+    bool statusOK = true;
+
+    std::cout << "- initialize shadow map texture " << resolution << "x" << resolution << "..." << std::endl;
+
+    glGenTextures( 1, &mShadowMapTexture );
+    GLStateCache::bindTexture( TextureUnit, GL_TEXTURE_2D_ARRAY, mShadowMapTexture );
+    glTexImage3D( GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution, resolution, MaxCascades, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr );
+    glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+    glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+    glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE );
+    glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL );
+    GLStateCache::bindTexture( TextureUnit, GL_TEXTURE_2D_ARRAY, 0 );
+
+    glGenFramebuffers( 1, &mShadowMapFramebuffer );
+    GLStateCache::bindFramebuffer( mShadowMapFramebuffer );
+    glFramebufferTextureLayer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, mShadowMapTexture, 0, 0 );
+    // - depth only
+    const GLenum drawBuffers[] = { GL_NONE };
+    glDrawBuffers( 1, drawBuffers );
+    glReadBuffer( GL_NONE );
+
+    if ( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE )
+    {
+        std::cout << "Error: shadow map framebuffer is incomplete" << std::endl;
+        statusOK = false;
+    }
+
+    GLStateCache::bindFramebuffer( 0 );
+
+    return statusOK;
+}
+
+/******************************************************************************
+ * Initialize shader program
+ * - depth only, works with the terrain and model vertex arrays (position at 0)
+ ******************************************************************************/
+bool ShadowMaps::initializeShaderProgram()
+{
+    // Vertex shader
+    const char* vertexShaderSource =
+        "#version 300 es\n"
+        "\n"
+        "// INPUT\n"
+        "layout (location = 0) in vec3 position;\n"
+        "\n"
+        "// UNIFORM\n"
+        "uniform mat4 viewMatrix;\n"
+        "uniform mat4 projectionMatrix;\n"
+        "uniform mat4 modelMatrix;\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    gl_Position = projectionMatrix * viewMatrix * modelMatrix * vec4( position, 1.0 );\n"
+        "}\n";
+
+    // Fragment shader
+    const char* fragmentShaderSource =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "}\n";
+
+    mDepthShaderProgram = ShaderProgram::create( vertexShaderSource, fragmentShaderSource, "shadow depth" );
+
+    return mDepthShaderProgram != 0;
+}
+
+/******************************************************************************
+ * Change the shadow map resolution (re-allocates the texture)
+ ******************************************************************************/
+void ShadowMaps::setResolution( int pResolution )
+{
+    if ( pResolution == resolution )
+    {
+        return;
+    }
+
+    GLStateCache::forgetFramebuffer( mShadowMapFramebuffer );
+    GLStateCache::forgetTexture( mShadowMapTexture );
+    glDeleteFramebuffers( 1, &mShadowMapFramebuffer );
+    glDeleteTextures( 1, &mShadowMapTexture );
+    resolution = pResolution;
+    initializeShadowMapTexture();
+
+    // Force all cascades to be rendered again
+    frameIndex = 0;
+}
+
+/******************************************************************************
+ * Fit a cascade to its slice of the camera frustum
+ *
+ * Returns false when the cascade keeps its previous shadow map this frame.
+ ******************************************************************************/
+bool ShadowMaps::update( int cascade, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix )
+{
+    // Split distances (mix of uniform and logarithmic distributions)
+    const float zNear = projectionMatrix[ 3 ][ 2 ] / ( projectionMatrix[ 2 ][ 2 ] - 1.f );
+    for ( int c = 0; c < numberOfCascades; ++c )
+    {
+        const float ratio = static_cast< float >( c + 1 ) / numberOfCascades;
+        const float logarithmic = zNear * std::pow( maxDistance / zNear, ratio );
+        const float uniform = zNear + ( maxDistance - zNear ) * ratio;
+        splitDistances[ c ] = splitLambda * logarithmic + ( 1.f - splitLambda ) * uniform;
+    }
+
+    const float sliceNear = ( cascade == 0 ) ? zNear : splitDistances[ cascade - 1 ];
+    const float sliceFar = splitDistances[ cascade ];
+
+    // Slice corners in world space: frustum edges (at depth 1) scaled to the slice depths
+    const glm::mat4 inverseProjectionMatrix = glm::inverse( projectionMatrix );
+    const glm::mat4 inverseViewMatrix = glm::inverse( viewMatrix );
+    glm::vec3 corners[ 8 ];
+    glm::vec3 center( 0.f );
+    for ( int corner = 0; corner < 4; ++corner )
+    {
+        glm::vec4 p = inverseProjectionMatrix * glm::vec4( ( corner & 1 ) ? 1.f : -1.f, ( corner & 2 ) ? 1.f : -1.f, 1.f, 1.f );
+        const glm::vec3 edge = glm::vec3( p ) / -p.z;
+        corners[ 2 * corner ] = glm::vec3( inverseViewMatrix * glm::vec4( edge * sliceNear, 1.f ) );
+        corners[ 2 * corner + 1 ] = glm::vec3( inverseViewMatrix * glm::vec4( edge * sliceFar, 1.f ) );
+        center += corners[ 2 * corner ] + corners[ 2 * corner + 1 ];
+    }
+    center /= 8.f;
+
+    // Bounding sphere: its size does not change when the camera turns
+    float radius = 0.f;
+    for ( int corner = 0; corner < 8; ++corner )
+    {
+        radius = std::max( radius, glm::length( corners[ corner ] - center ) );
+    }
+    radius = std::ceil( radius * 16.f ) / 16.f;
+
+    // Light-space box, pulled back so that casters outside of the slice are kept
+    const glm::vec3 direction = glm::normalize( lightDirection );
+    const glm::vec3 up = ( std::fabs( direction.y ) > 0.99f ) ? glm::vec3( 0.f, 0.f, 1.f ) : glm::vec3( 0.f, 1.f, 0.f );
+    const float distance = sceneRadius + radius;
+    glm::mat4 lightViewMatrix = glm::lookAt( center - direction * distance, center, up );
+
+    // Lazily updated cascade: kept while its slice moved by at most one shadow map
+    // texel across the light since it was rendered (fast camera: rendered now)
+    if ( frameIndex % std::max( 1, updateInterval[ cascade ] ) != 0 )
+    {
+        const glm::vec3 moved = glm::mat3( lightViewMatrix ) * ( center - renderedCenters[ cascade ] );
+        const float texelSize = 2.f * radius / resolution;
+        if ( std::max( std::fabs( moved.x ), std::fabs( moved.y ) ) <= texelSize )
+        {
+            return false;
+        }
+    }
+
+    glm::mat4 lightProjectionMatrix = glm::ortho( -radius, radius, -radius, radius, 0.f, 2.f * distance );
+
+    // Snap the world origin to a shadow map texel
+    const glm::vec4 origin = lightProjectionMatrix * lightViewMatrix * glm::vec4( 0.f, 0.f, 0.f, 1.f );
+    const glm::vec2 texel = glm::vec2( origin ) * ( resolution * 0.5f );
+    const glm::vec2 offset = ( glm::round( texel ) - texel ) * ( 2.f / resolution );
+    lightProjectionMatrix[ 3 ][ 0 ] += offset.x;
+    lightProjectionMatrix[ 3 ][ 1 ] += offset.y;
+
+    lightViewMatrices[ cascade ] = lightViewMatrix;
+    lightProjectionMatrices[ cascade ] = lightProjectionMatrix;
+    renderedCenters[ cascade ] = center;
+
+    return true;
+}
+
+/******************************************************************************
+ * Start the depth pass of a cascade: casters are drawn after this call
+ ******************************************************************************/
+void ShadowMaps::beginCascade( int cascade )
+{
+    GLStateCache::bindFramebuffer( mShadowMapFramebuffer );
+    glFramebufferTextureLayer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, mShadowMapTexture, 0, cascade );
+    GLStateCache::viewport( 0, 0, resolution, resolution );
+
+    glClearDepth( 1.f );
+    glClear( GL_DEPTH_BUFFER_BIT );
+
+    // Slope scaled bias against shadow acne
+    GLStateCache::enable( GL_POLYGON_OFFSET_FILL );
+    glPolygonOffset( 2.f, 4.f );
+
+    ++numberOfRenderedCascades;
+}
+
+void ShadowMaps::endCascades( int windowWidth, int windowHeight )
+{
+    GLStateCache::disable( GL_POLYGON_OFFSET_FILL );
+    GLStateCache::bindFramebuffer( 0 );
+    GLStateCache::viewport( 0, 0, windowWidth, windowHeight );
+
+    ++frameIndex;
+}
+
+/******************************************************************************
+ * Test a bounding box (in model space) against the light-space box of a
+ * cascade (depth is not tested: casters behind the slice still cast shadows)
+ ******************************************************************************/
+bool ShadowMaps::isInCascade( int cascade, const glm::vec3& aabb_min, const glm::vec3& aabb_max, const glm::mat4& modelMatrix ) const
+{
+    const glm::mat4 matrix = lightProjectionMatrices[ cascade ] * lightViewMatrices[ cascade ] * modelMatrix;
+
+    glm::vec2 ndcMin( 1.f );
+    glm::vec2 ndcMax( -1.f );
+    for ( int corner = 0; corner < 8; ++corner )
+    {
+        const glm::vec4 p = matrix * glm::vec4( ( corner & 1 ) ? aabb_max.x : aabb_min.x,
+                                                ( corner & 2 ) ? aabb_max.y : aabb_min.y,
+                                                ( corner & 4 ) ? aabb_max.z : aabb_min.z,
+                                                1.f );
+        ndcMin = glm::min( ndcMin, glm::vec2( p ) );
+        ndcMax = glm::max( ndcMax, glm::vec2( p ) );
+    }
+
+    return ndcMax.x >= -1.f && ndcMax.y >= -1.f && ndcMin.x <= 1.f && ndcMin.y <= 1.f;
+}
+
+/******************************************************************************
+ * Send shadow uniforms to a program using "ShaderSource"
+ ******************************************************************************/
+void ShadowMaps::setUniforms( GLuint program, const glm::mat4& viewMatrix )
+{
+    GLint uniformLocation;
+
+    GLStateCache::useProgram( program );
+
+    uniformLocation = glGetUniformLocation( program, "shadowMap" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1i( uniformLocation, TextureUnit );
+    }
+    uniformLocation = glGetUniformLocation( program, "shadowMatrices" );
+    if ( uniformLocation >= 0 )
+    {
+        // Eye-space -> light clip-space -> [0,1]
+        const glm::mat4 bias = glm::translate( glm::mat4(), glm::vec3( 0.5f ) ) * glm::scale( glm::mat4(), glm::vec3( 0.5f ) );
+        const glm::mat4 inverseViewMatrix = glm::inverse( viewMatrix );
+        glm::mat4 shadowMatrices[ MaxCascades ];
+        for ( int c = 0; c < MaxCascades; ++c )
+        {
+            shadowMatrices[ c ] = bias * lightProjectionMatrices[ c ] * lightViewMatrices[ c ] * inverseViewMatrix;
+        }
+        glUniformMatrix4fv( uniformLocation, MaxCascades, GL_FALSE, glm::value_ptr( shadowMatrices[ 0 ] ) );
+    }
+    uniformLocation = glGetUniformLocation( program, "shadowSplits" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform4fv( uniformLocation, 1, splitDistances );
+    }
+    uniformLocation = glGetUniformLocation( program, "shadowCascades" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1i( uniformLocation, enabled ? numberOfCascades : 0 );
+    }
+    uniformLocation = glGetUniformLocation( program, "shadowTexelSize" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1f( uniformLocation, 1.f / resolution );
+    }
+}
+
+void ShadowMaps::bindTexture()
+{
+    GLStateCache::bindTexture( TextureUnit, GL_TEXTURE_2D_ARRAY, mShadowMapTexture );
+}
+
+void ShadowMaps::unbindTexture()
+{
+    GLStateCache::bindTexture( TextureUnit, GL_TEXTURE_2D_ARRAY, 0 );
+}
@@ -0,0 +1,96 @@
+#ifndef SHADOWMAPS_H
+#define SHADOWMAPS_H
+
+// STL
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Graphics
+// - GLEW (always before "gl.h")
+#include <GL/glew.h>
+// - GL
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+
+// glm
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+/******************************************************************************
+ * Cascaded shadow maps for a directional light
+ *
+ * The camera frustum (up to maxDistance) is split in cascades, each one is
+ * covered by a light-space orthographic box fitted to the bounding sphere of
+ * its slice and snapped to shadow map texels, so shadows do not shimmer when
+ * the camera moves or turns. Quality/cost budget: resolution, number of
+ * cascades and update interval (in frames) of each cascade; a cascade is
+ * rendered earlier when its slice moved by more than one shadow map texel.
+ ******************************************************************************/
+class ShadowMaps{
+public:
+    static const int MaxCascades = 4;
+
+    // - texture unit used by the shadow map array
+    static const int TextureUnit = 4;
+
+    // - GLSL: uniforms and "float cascadedShadow( eyePosition )"
+    static const std::string ShaderSource;
+
+    // - when disabled, shaders see no cascade and everything is lit
+    bool enabled;
+
+    // - budget
+    int resolution;
+    int numberOfCascades;
+    int updateInterval[ MaxCascades ];
+    // - camera depth covered by the cascades and split distribution (0: uniform, 1: logarithmic)
+    float maxDistance;
+    float splitLambda;
+
+    // - light
+    glm::vec3 lightDirection;
+    // - radius of the scene, casters in this range are never clipped
+    float sceneRadius;
+
+    // - GL resources
+    GLuint mShadowMapTexture;
+    GLuint mShadowMapFramebuffer;
+    GLuint mDepthShaderProgram;
+
+    // - cascades (only updated when the cascade is rendered)
+    glm::mat4 lightViewMatrices[ MaxCascades ];
+    glm::mat4 lightProjectionMatrices[ MaxCascades ];
+    float splitDistances[ MaxCascades ];
+    // - center of the camera slice when each cascade was last rendered
+    glm::vec3 renderedCenters[ MaxCascades ];
+
+    // - statistics of the last frame
+    int numberOfRenderedCascades;
+
+    ShadowMaps();
+
+    // Methode d'initialisation
+    bool initializeShadowMaps();
+    bool initializeShadowMapTexture();
+    bool initializeShaderProgram();
+
+    void setResolution( int pResolution );
+
+    bool update( int cascade, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix );
+    void beginCascade( int cascade );
+    void endCascades( int windowWidth, int windowHeight );
+    bool isInCascade( int cascade, const glm::vec3& aabb_min, const glm::vec3& aabb_max, const glm::mat4& modelMatrix ) const;
+
+    void setUniforms( GLuint program, const glm::mat4& viewMatrix );
+    void bindTexture();
+    void unbindTexture();
+
+private:
+    unsigned int frameIndex;
+};
+
+#endif
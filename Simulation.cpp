@@ -0,0 +1,176 @@
+#include "Simulation.h"
+
+// STL
+#include <algorithm>
+#include <limits>
+
+// glm
+#include <glm/gtc/matrix_transform.hpp>
+
+Simulation::Simulation(){
+    timeStep = 1.0 / 120.0;
+    cameraSpeed = 3.f;
+    numberOfSteps = 0;
+    running = false;
+
+    std::fill( moves, moves + NumberOfMoves, false );
+    pendingLook = glm::vec2( 0.f );
+    minimumEyeHeight = -std::numeric_limits< float >::max();
+    inputSequence = 0;
+    publishedInputSequence = 0;
+    moving = false;
+    hasSnapshot = false;
+}
+
+Simulation::~Simulation()
+{
+    stop();
+}
+
+void Simulation::start( const State& initialState )
+{
+    stop();
+    running = true;
+    thread = std::thread( &Simulation::run, this, initialState );
+}
+
+void Simulation::stop()
+{
+    running = false;
+    if ( thread.joinable() )
+    {
+        thread.join();
+    }
+}
+
+/******************************************************************************
+ * Input
+ ******************************************************************************/
+void Simulation::setMove( Move move, bool active )
+{
+    std::lock_guard< std::mutex > lock( inputMutex );
+    // - key repeat: a held key is pressed again, nothing changes
+    if ( moves[ move ] == active )
+        return;
+    moves[ move ] = active;
+    ++inputSequence;
+}
+
+void Simulation::look( float deltaYaw, float deltaPitch )
+{
+    std::lock_guard< std::mutex > lock( inputMutex );
+    pendingLook += glm::vec2( deltaYaw, deltaPitch );
+    ++inputSequence;
+}
+
+void Simulation::setMinimumEyeHeight( float height )
+{
+    std::lock_guard< std::mutex > lock( inputMutex );
+    minimumEyeHeight = height;
+}
+
+/******************************************************************************
+ * Update thread
+ * - steps are due at fixed times; after a stall (over 0.25 s late) the
+ *   schedule restarts instead of catching up
+ ******************************************************************************/
+void Simulation::run( State state )
+{
+    const Clock::duration step = std::chrono::duration_cast< Clock::duration >( std::chrono::duration< double >( timeStep ) );
+    Clock::time_point due = Clock::now();
+
+    State previous = state;
+    while ( running )
+    {
+        std::this_thread::sleep_until( due );
+        if ( Clock::now() - due > std::chrono::milliseconds( 250 ) )
+        {
+            due = Clock::now();
+        }
+
+        long sequence;
+        {
+            std::lock_guard< std::mutex > lock( inputMutex );
+            sequence = inputSequence;
+        }
+
+        previous = state;
+        this->step( state );
+        due += step;
+        ++numberOfSteps;
+
+        Snapshot& snapshot = snapshots.writeBuffer();
+        snapshot.previous = previous;
+        snapshot.current = state;
+        snapshot.nextStepTime = due;
+        snapshots.publish();
+
+        moving = ( state.cameraEye != previous.cameraEye || state.yaw != previous.yaw || state.pitch != previous.pitch || state.roll != previous.roll );
+        publishedInputSequence = sequence;
+    }
+}
+
+void Simulation::step( State& state )
+{
+    bool active[ NumberOfMoves ];
+    glm::vec2 deltaLook;
+    float minimumHeight;
+    {
+        std::lock_guard< std::mutex > lock( inputMutex );
+        std::copy( moves, moves + NumberOfMoves, active );
+        deltaLook = pendingLook;
+        pendingLook = glm::vec2( 0.f );
+        minimumHeight = minimumEyeHeight;
+    }
+
+    state.yaw += deltaLook.x;
+    state.pitch += deltaLook.y;
+
+    // Camera axes: rows of the view rotation (same as display())
+    glm::mat4 rotate = glm::rotate( glm::mat4( 1.f ), state.roll, glm::vec3( 0.f, 0.f, 1.f ) );
+    rotate = glm::rotate( rotate, state.pitch, glm::vec3( 1.f, 0.f, 0.f ) );
+    rotate = glm::rotate( rotate, state.yaw, glm::vec3( 0.f, 1.f, 0.f ) );
+    const glm::vec3 right( rotate[ 0 ][ 0 ], rotate[ 1 ][ 0 ], rotate[ 2 ][ 0 ] );
+    const glm::vec3 up( rotate[ 0 ][ 1 ], rotate[ 1 ][ 1 ], rotate[ 2 ][ 1 ] );
+    const glm::vec3 back( rotate[ 0 ][ 2 ], rotate[ 1 ][ 2 ], rotate[ 2 ][ 2 ] );
+
+    const glm::vec3 direction = right * static_cast< float >( active[ MoveRight ] - active[ MoveLeft ] )
+                              + up * static_cast< float >( active[ MoveUp ] - active[ MoveDown ] )
+                              + back * static_cast< float >( active[ MoveBackward ] - active[ MoveForward ] );
+    if ( glm::dot( direction, direction ) > 0.f )
+    {
+        state.cameraEye += glm::normalize( direction ) * cameraSpeed * static_cast< float >( timeStep );
+    }
+    state.cameraEye.y = std::max( state.cameraEye.y, minimumHeight );
+
+    state.time += timeStep;
+}
+
+/******************************************************************************
+ * Blend the two states of the last snapshot
+ * - the render shows the scene one step late, so the shown time always
+ *   falls between the two states
+ ******************************************************************************/
+bool Simulation::interpolate( Clock::time_point time, State& state )
+{
+    hasSnapshot = snapshots.update() || hasSnapshot;
+    if ( !hasSnapshot )
+        return false;
+
+    const Snapshot& snapshot = snapshots.readBuffer();
+    const double behind = std::chrono::duration< double >( snapshot.nextStepTime - time ).count();
+    const float t = static_cast< float >( glm::clamp( 1.0 - behind / timeStep, 0.0, 1.0 ) );
+
+    state.cameraEye = glm::mix( snapshot.previous.cameraEye, snapshot.current.cameraEye, t );
+    state.yaw = glm::mix( snapshot.previous.yaw, snapshot.current.yaw, t );
+    state.pitch = glm::mix( snapshot.previous.pitch, snapshot.current.pitch, t );
+    state.roll = glm::mix( snapshot.previous.roll, snapshot.current.roll, t );
+    state.time = snapshot.previous.time + ( snapshot.current.time - snapshot.previous.time ) * t;
+    return true;
+}
+
+bool Simulation::isActive()
+{
+    std::lock_guard< std::mutex > lock( inputMutex );
+    return moving || inputSequence != publishedInputSequence || std::find( moves, moves + NumberOfMoves, true ) != moves + NumberOfMoves;
+}
@@ -0,0 +1,107 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+// STL
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+// glm
+#include <glm/glm.hpp>
+
+#include "TripleBuffer.h"
+
+/******************************************************************************
+ * Simulation (fixed time step update thread)
+ *
+ * The camera and the animated scene state are integrated on their own
+ * thread at a fixed rate, from the input held at each step (keys down, mouse
+ * moves), so motion does not depend on the key repeat nor on the frame rate.
+ * Each step publishes an immutable snapshot, the previous and the new state,
+ * through a triple buffer; the render thread blends them at its own time, so
+ * the picture moves smoothly even when the frame and step rates differ.
+ ******************************************************************************/
+class Simulation{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    struct State
+    {
+        glm::vec3 cameraEye;
+        float yaw;
+        float pitch;
+        float roll;
+        // - seconds since start (scene animation)
+        double time;
+    };
+
+    struct Snapshot
+    {
+        State previous;
+        State current;
+        // - when the next step is due: until then the render blends from previous to current
+        Clock::time_point nextStepTime;
+    };
+
+    enum Move
+    {
+        MoveForward,
+        MoveBackward,
+        MoveLeft,
+        MoveRight,
+        MoveUp,
+        MoveDown,
+        NumberOfMoves
+    };
+
+    // - seconds per step
+    double timeStep;
+    // - world units per second
+    float cameraSpeed;
+
+    // - steps since start
+    std::atomic< long > numberOfSteps;
+
+    Simulation();
+    ~Simulation();
+
+    void start( const State& initialState );
+    void stop();
+
+    // Input (GLUT thread)
+    // - repeated presses of a held key are ignored
+    void setMove( Move move, bool active );
+    // - angles added at the next step
+    void look( float deltaYaw, float deltaPitch );
+    // - lowest camera height (terrain under the camera)
+    void setMinimumEyeHeight( float height );
+
+    // Render thread
+    // - latest states blended at the given time (false before the first step)
+    bool interpolate( Clock::time_point time, State& state );
+    // - keys held, input not yet stepped, or the last step moved the camera
+    bool isActive();
+
+private:
+    std::thread thread;
+    std::atomic< bool > running;
+
+    // - input, written by the GLUT thread
+    std::mutex inputMutex;
+    bool moves[ NumberOfMoves ];
+    glm::vec2 pendingLook;
+    float minimumEyeHeight;
+    // - input events received, input events published by the update thread
+    long inputSequence;
+    std::atomic< long > publishedInputSequence;
+    std::atomic< bool > moving;
+
+    TripleBuffer< Snapshot > snapshots;
+    bool hasSnapshot;
+
+    void run( State state );
+    void step( State& state );
+};
+
+#endif
@@ -208,7 +208,8 @@ bool SkyBox::initializeCubemapShader(){
     "{     																																 \n"
         " 		pos = position;																					 			   \n"
         "    // Send position to Clip-space                                    \n"
-      "    gl_Position = uModelViewProjectionMatrix * vec4( position, 1.0 ); \n"
+      "    // - at the far plane (z = w) so it is only drawn where the scene left the cleared depth \n"
+      "    gl_Position = ( uModelViewProjectionMatrix * vec4( position, 1.0 ) ).xyww; \n"
         "}                                                                     \n"
     };
 
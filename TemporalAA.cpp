@@ -0,0 +1,322 @@
+#include "TemporalAA.h"
+
+// glm
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "ShaderProgram.h"
+#include "GLStateCache.h"
+
+namespace
+{
+    // - radical inverse of index in the given base, in [0,1)
+    float halton( int index, int base )
+    {
+        float result = 0.f;
+        float fraction = 1.f / base;
+        for ( ; index > 0; index /= base, fraction /= base )
+        {
+            result += fraction * ( index % base );
+        }
+        return result;
+    }
+}
+
+TemporalAA::TemporalAA(){
+    enabled = true;
+    historyWeight = 0.9f;
+
+    width = 0;
+    height = 0;
+
+    for ( int h = 0; h < 2; ++h )
+    {
+        mHistoryTextures[ h ] = 0;
+        mHistoryFramebuffers[ h ] = 0;
+    }
+
+    mResolveShaderProgram = 0;
+    mPresentShaderProgram = 0;
+    mFullScreenVertexArray = 0;
+
+    jitter = glm::vec2( 0.f );
+
+    frameIndex = 0;
+    historyIndex = 0;
+    historyValid = false;
+}
+
+bool TemporalAA::initializeTemporalAA(){
+    bool statusOK = true;
+
+    std::cout << "Initialize temporal anti-aliasing..." << std::endl;
+
+    glGenTextures( 2, mHistoryTextures );
+    glGenFramebuffers( 2, mHistoryFramebuffers );
+
+    if ( statusOK )
+    {
+        statusOK = initializeShaderProgram();
+    }
+
+    return statusOK;
+}
+
+/******************************************************************************
+ * Initialize shader programs
+ * - resolve: scene + history into the new history
+ * - present: new history blended into the output (premultiplied alpha)
+ ******************************************************************************/
+bool TemporalAA::initializeShaderProgram()
+{
+    glGenVertexArrays( 1, &mFullScreenVertexArray );
+
+    // Vertex shader: full-screen triangle generated from the vertex ID
+    const char* vertexShaderSource =
+        "#version 300 es\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    vec2 position = vec2( float( ( gl_VertexID & 1 ) << 2 ) - 1.0, float( ( gl_VertexID & 2 ) << 1 ) - 1.0 );\n"
+        "    gl_Position = vec4( position, 0.0, 1.0 );\n"
+        "}\n";
+
+    // Fragment shader: resolve
+    const char* resolveShaderSource =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "precision highp int;\n"
+        "\n"
+        "// UNIFORM\n"
+        "uniform sampler2D colorTexture;\n"
+        "uniform sampler2D depthTexture;\n"
+        "uniform sampler2D historyTexture;\n"
+        "// - rendered area of the scene textures (texels), window size (pixels)\n"
+        "uniform vec2 sceneSize;\n"
+        "uniform vec2 outputSize;\n"
+        "// - sub-pixel offset of the scene this frame (scene texels)\n"
+        "uniform vec2 jitter;\n"
+        "// - current clip space (without jitter) to previous clip space\n"
+        "uniform mat4 reprojectionMatrix;\n"
+        "uniform float historyWeight;\n"
+        "\n"
+        "// OUTPUT\n"
+        "layout( location = 0 ) out vec4 fragmentColor;\n"
+        "\n"
+        "// - scene texel, clamped to the rendered area\n"
+        "ivec2 texel( ivec2 t )\n"
+        "{\n"
+        "    return clamp( t, ivec2( 0 ), ivec2( sceneSize ) - 1 );\n"
+        "}\n"
+        "\n"
+        "// - premultiplied color: the sky (depth 1) is transparent\n"
+        "vec4 sceneColor( ivec2 t )\n"
+        "{\n"
+        "    float covered = ( texelFetch( depthTexture, t, 0 ).r < 1.0 ) ? 1.0 : 0.0;\n"
+        "    return vec4( texelFetch( colorTexture, t, 0 ).rgb * covered, covered );\n"
+        "}\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    vec2 uv = gl_FragCoord.xy / outputSize;\n"
+        "\n"
+        "    // Current frame at the pixel center: the jittered scene shows it moved by the jitter\n"
+        "    vec2 position = uv * sceneSize - 0.5 + jitter;\n"
+        "    ivec2 base = ivec2( floor( position ) );\n"
+        "    vec2 f = position - vec2( base );\n"
+        "    vec4 current = mix( mix( sceneColor( texel( base ) ), sceneColor( texel( base + ivec2( 1, 0 ) ) ), f.x ),\n"
+        "                        mix( sceneColor( texel( base + ivec2( 0, 1 ) ) ), sceneColor( texel( base + ivec2( 1, 1 ) ) ), f.x ), f.y );\n"
+        "\n"
+        "    // 3x3 neighborhood: color box, closest depth (edges follow the foreground)\n"
+        "    ivec2 nearest = ivec2( floor( position + 0.5 ) );\n"
+        "    vec4 lowest = current;\n"
+        "    vec4 highest = current;\n"
+        "    float closest = 1.0;\n"
+        "    for ( int y = -1; y <= 1; ++y )\n"
+        "    {\n"
+        "        for ( int x = -1; x <= 1; ++x )\n"
+        "        {\n"
+        "            ivec2 p = texel( nearest + ivec2( x, y ) );\n"
+        "            vec4 c = sceneColor( p );\n"
+        "            lowest = min( lowest, c );\n"
+        "            highest = max( highest, c );\n"
+        "            closest = min( closest, texelFetch( depthTexture, p, 0 ).r );\n"
+        "        }\n"
+        "    }\n"
+        "\n"
+        "    // Where this point was in the previous frame\n"
+        "    vec4 previous = reprojectionMatrix * vec4( uv * 2.0 - 1.0, closest * 2.0 - 1.0, 1.0 );\n"
+        "    vec2 previousUv = previous.xy / previous.w * 0.5 + 0.5;\n"
+        "    float weight = historyWeight;\n"
+        "    if ( any( lessThan( previousUv, vec2( 0.0 ) ) ) || any( greaterThan( previousUv, vec2( 1.0 ) ) ) )\n"
+        "        weight = 0.0;\n"
+        "\n"
+        "    vec4 history = clamp( texture( historyTexture, previousUv ), lowest, highest );\n"
+        "    fragmentColor = mix( current, history, weight );\n"
+        "}\n";
+
+    // Fragment shader: present
+    const char* presentShaderSource =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "\n"
+        "// UNIFORM\n"
+        "uniform sampler2D historyTexture;\n"
+        "\n"
+        "// OUTPUT\n"
+        "layout( location = 0 ) out vec4 fragmentColor;\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    fragmentColor = texelFetch( historyTexture, ivec2( gl_FragCoord.xy ), 0 );\n"
+        "}\n";
+
+    mResolveShaderProgram = ShaderProgram::create( vertexShaderSource, resolveShaderSource, "temporal anti-aliasing resolve" );
+    mPresentShaderProgram = ShaderProgram::create( vertexShaderSource, presentShaderSource, "temporal anti-aliasing present" );
+
+    return mResolveShaderProgram != 0 && mPresentShaderProgram != 0;
+}
+
+/******************************************************************************
+ * History textures at the window size (RGBA16F: no banding from the repeated blends)
+ ******************************************************************************/
+void TemporalAA::resize( int pWidth, int pHeight )
+{
+    if ( pWidth == width && pHeight == height )
+    {
+        return;
+    }
+    width = pWidth;
+    height = pHeight;
+
+    for ( int h = 0; h < 2; ++h )
+    {
+        GLStateCache::bindTexture( 0, GL_TEXTURE_2D, mHistoryTextures[ h ] );
+        glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_HALF_FLOAT, nullptr );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+
+        GLStateCache::bindFramebuffer( mHistoryFramebuffers[ h ] );
+        glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mHistoryTextures[ h ], 0 );
+        if ( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE )
+        {
+            std::cout << "Error: temporal anti-aliasing history framebuffer is incomplete" << std::endl;
+        }
+    }
+    GLStateCache::bindTexture( 0, GL_TEXTURE_2D, 0 );
+    GLStateCache::bindFramebuffer( 0 );
+
+    historyValid = false;
+}
+
+/******************************************************************************
+ * Sub-pixel jitter
+ * - clip space translation: whole scene pixels are 2 / size in NDC
+ ******************************************************************************/
+glm::mat4 TemporalAA::jitterProjection( const glm::mat4& projectionMatrix, int sceneWidth, int sceneHeight )
+{
+    frameIndex = ( frameIndex + 1 ) % NumberOfJitterSamples;
+    jitter = glm::vec2( halton( frameIndex + 1, 2 ) - 0.5f, halton( frameIndex + 1, 3 ) - 0.5f );
+
+    const glm::vec3 offset( 2.f * jitter.x / sceneWidth, 2.f * jitter.y / sceneHeight, 0.f );
+    return glm::translate( glm::mat4( 1.f ), offset ) * projectionMatrix;
+}
+
+void TemporalAA::invalidate()
+{
+    historyValid = false;
+}
+
+/******************************************************************************
+ * Resolve pass
+ ******************************************************************************/
+void TemporalAA::resolvePass( GLuint colorTexture, GLuint depthTexture, int sceneWidth, int sceneHeight,
+                              const glm::mat4& viewProjectionMatrix, GLuint outputFramebuffer, int outputWidth, int outputHeight )
+{
+    GLint uniformLocation;
+
+    resize( outputWidth, outputHeight );
+    const int target = 1 - historyIndex;
+
+    // Scene + history -> new history
+    GLStateCache::bindFramebuffer( mHistoryFramebuffers[ target ] );
+    GLStateCache::viewport( 0, 0, width, height );
+    GLStateCache::useProgram( mResolveShaderProgram );
+    GLStateCache::depthFunc( GL_ALWAYS );
+    GLStateCache::depthMask( GL_FALSE );
+
+    const GLuint textures[] = { colorTexture, depthTexture, mHistoryTextures[ historyIndex ] };
+    const char* samplers[] = { "colorTexture", "depthTexture", "historyTexture" };
+    for ( int unit = 0; unit < 3; ++unit )
+    {
+        GLStateCache::bindTexture( unit, GL_TEXTURE_2D, textures[ unit ] );
+        uniformLocation = glGetUniformLocation( mResolveShaderProgram, samplers[ unit ] );
+        if ( uniformLocation >= 0 )
+        {
+            glUniform1i( uniformLocation, unit );
+        }
+    }
+
+    uniformLocation = glGetUniformLocation( mResolveShaderProgram, "sceneSize" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform2f( uniformLocation, static_cast< float >( sceneWidth ), static_cast< float >( sceneHeight ) );
+    }
+    uniformLocation = glGetUniformLocation( mResolveShaderProgram, "outputSize" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform2f( uniformLocation, static_cast< float >( width ), static_cast< float >( height ) );
+    }
+    uniformLocation = glGetUniformLocation( mResolveShaderProgram, "jitter" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform2fv( uniformLocation, 1, glm::value_ptr( jitter ) );
+    }
+    uniformLocation = glGetUniformLocation( mResolveShaderProgram, "reprojectionMatrix" );
+    if ( uniformLocation >= 0 )
+    {
+        const glm::mat4 reprojectionMatrix = previousViewProjectionMatrix * glm::inverse( viewProjectionMatrix );
+        glUniformMatrix4fv( uniformLocation, 1, GL_FALSE, glm::value_ptr( reprojectionMatrix ) );
+    }
+    uniformLocation = glGetUniformLocation( mResolveShaderProgram, "historyWeight" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1f( uniformLocation, historyValid ? historyWeight : 0.f );
+    }
+
+    GLStateCache::bindVertexArray( mFullScreenVertexArray );
+    glDrawArrays( GL_TRIANGLES, 0, 3 );
+
+    // New history over the output (HDR target of the post-processing)
+    GLStateCache::bindFramebuffer( outputFramebuffer );
+    GLStateCache::viewport( 0, 0, outputWidth, outputHeight );
+    GLStateCache::useProgram( mPresentShaderProgram );
+    GLStateCache::bindTexture( 0, GL_TEXTURE_2D, mHistoryTextures[ target ] );
+    uniformLocation = glGetUniformLocation( mPresentShaderProgram, "historyTexture" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1i( uniformLocation, 0 );
+    }
+    GLStateCache::enable( GL_BLEND );
+    glBlendFunc( GL_ONE, GL_ONE_MINUS_SRC_ALPHA );
+    glDrawArrays( GL_TRIANGLES, 0, 3 );
+
+    // Reset GL state(s)
+    // - scene textures are render targets again next frame
+    GLStateCache::disable( GL_BLEND );
+    for ( int unit = 0; unit < 3; ++unit )
+    {
+        GLStateCache::bindTexture( unit, GL_TEXTURE_2D, 0 );
+    }
+    GLStateCache::depthMask( GL_TRUE );
+    GLStateCache::depthFunc( GL_LESS );
+
+    historyIndex = target;
+    historyValid = true;
+    previousViewProjectionMatrix = viewProjectionMatrix;
+}
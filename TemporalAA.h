@@ -0,0 +1,86 @@
+#ifndef TEMPORALAA_H
+#define TEMPORALAA_H
+
+// STL
+#include <iostream>
+
+// Graphics
+// - GLEW (always before "gl.h")
+#include <GL/glew.h>
+// - GL
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+
+// glm
+#include <glm/glm.hpp>
+
+/******************************************************************************
+ * Temporal anti-aliasing
+ *
+ * Each frame the scene projection is moved by a sub-pixel offset (Halton 2,3
+ * sequence, 8 positions), so successive frames sample different points of
+ * each pixel. The resolve pass, at the window resolution, blends the current
+ * scene with the history of the previous frames:
+ * - the history is fetched where the pixel was the previous frame: the
+ *   closest depth around the pixel, unprojected with the current camera and
+ *   projected with the previous one (camera motion, the scene is static),
+ * - it is clamped to the color box of the 3x3 scene texels around the pixel,
+ *   so disoccluded or changed pixels do not leave ghosts,
+ * - colors are premultiplied by the scene coverage (0 where the sky is), the
+ *   result is blended over the skybox.
+ *
+ * The resolve reads the scene at its own (dynamic) resolution, so it also
+ * replaces the upscale of the dynamic resolution.
+ ******************************************************************************/
+class TemporalAA{
+public:
+    static const int NumberOfJitterSamples = 8;
+
+    bool enabled;
+    // - weight of the history in the blend (higher: smoother edges, slower response)
+    float historyWeight;
+
+    // - history size (window)
+    int width;
+    int height;
+
+    // - history: the last resolved frame and the one being written
+    GLuint mHistoryTextures[ 2 ];
+    GLuint mHistoryFramebuffers[ 2 ];
+
+    GLuint mResolveShaderProgram;
+    GLuint mPresentShaderProgram;
+    GLuint mFullScreenVertexArray;
+
+    // - sub-pixel offset of the current frame (scene pixels)
+    glm::vec2 jitter;
+
+    TemporalAA();
+
+    // Methode d'initialisation
+    bool initializeTemporalAA();
+    bool initializeShaderProgram();
+
+    // - next offset of the sequence applied to the projection (scene size in pixels)
+    glm::mat4 jitterProjection( const glm::mat4& projectionMatrix, int sceneWidth, int sceneHeight );
+
+    // - history dropped (next frame starts from the current one only)
+    void invalidate();
+
+    // - scene textures resolved with the history, then blended into the output framebuffer
+    // - viewProjectionMatrix: current camera, without jitter
+    void resolvePass( GLuint colorTexture, GLuint depthTexture, int sceneWidth, int sceneHeight,
+                      const glm::mat4& viewProjectionMatrix, GLuint outputFramebuffer, int outputWidth, int outputHeight );
+
+private:
+    int frameIndex;
+    int historyIndex;
+    bool historyValid;
+    glm::mat4 previousViewProjectionMatrix;
+
+    void resize( int pWidth, int pHeight );
+};
+
+#endif
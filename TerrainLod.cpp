@@ -0,0 +1,281 @@
+#include "TerrainLod.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+
+const std::string TerrainLod::ShaderSource =
+    "// UNIFORM\n"
+    "// - level of the tile being drawn\n"
+    "uniform int lodLevel;\n"
+    "// - world distances where the vertices of this level start and end morphing\n"
+    "uniform vec2 morphRange;\n"
+    "uniform vec3 cameraPosition;\n"
+    "\n"
+    "// morph: height on the next coarser level, level where the vertex appears\n"
+    "vec3 morphVertex( vec3 position, vec2 morph, mat4 modelMatrix )\n"
+    "{\n"
+    "    if ( int( morph.y ) != lodLevel )\n"
+    "        return position;\n"
+    "    float d = distance( ( modelMatrix * vec4( position, 1.0 ) ).xyz, cameraPosition );\n"
+    "    float t = clamp( ( d - morphRange.x ) / ( morphRange.y - morphRange.x ), 0.0, 1.0 );\n"
+    "    return vec3( position.x, mix( position.y, morph.x, t ), position.z );\n"
+    "}\n";
+
+TerrainLod::TerrainLod(){
+    tileCells = 64;
+    numberOfLevels = 5;
+    lodDistance = 2.5f;
+    morphFraction = 0.4f;
+    skirtDepth = 0.05f;
+
+    numberOfTiles = 0;
+    numberOfSelectedTriangles = 0;
+}
+
+/******************************************************************************
+ * Coarsest level whose lattice contains grid vertex (j,i)
+ ******************************************************************************/
+int TerrainLod::latticeLevel( int j, int i ) const
+{
+    int level = 0;
+    while ( level + 1 < numberOfLevels && ( j % ( 2 << level ) ) == 0 && ( i % ( 2 << level ) ) == 0 )
+    {
+        ++level;
+    }
+    return level;
+}
+
+/******************************************************************************
+ * Morph attribute of grid vertex (j,i)
+ *
+ * On level l+1 the vertex is the middle of a cell edge or of the cell
+ * diagonal (same diagonal as the triangles), so its height there is the mean
+ * of the two ends. Vertices of the coarsest level never morph.
+ ******************************************************************************/
+glm::vec2 TerrainLod::morphOf( const std::vector< glm::vec3 >& points, int nb, int j, int i ) const
+{
+    const int level = latticeLevel( j, i );
+    const float heigth = points[ j * nb + i ].y;
+    if ( level + 1 >= numberOfLevels )
+    {
+        return glm::vec2( heigth, static_cast< float >( NoMorph ) );
+    }
+
+    const int half = 1 << level;
+    const int dj = ( j % ( 2 * half ) ) ? half : 0;
+    const int di = ( i % ( 2 * half ) ) ? half : 0;
+    const float coarse = 0.5f * ( points[ ( j - dj ) * nb + ( i - di ) ].y + points[ ( j + dj ) * nb + ( i + di ) ].y );
+
+    return glm::vec2( coarse, static_cast< float >( level ) );
+}
+
+/******************************************************************************
+ * Build the skirts, the morph attributes and the index ranges of all tiles
+ ******************************************************************************/
+bool TerrainLod::build( int nb, std::vector< glm::vec3 >& points, std::vector< glm::vec3 >& normals,
+                        std::vector< glm::vec2 >& morphs, std::vector< GLuint >& indices )
+{
+    std::cout << "Initialize terrain LOD..." << std::endl;
+
+    if ( nb < 2 || ( nb - 1 ) % tileCells != 0 )
+    {
+        std::cout << "Error: terrain LOD: " << nb - 1 << " grid cells are not a multiple of " << tileCells << std::endl;
+        return false;
+    }
+    numberOfTiles = ( nb - 1 ) / tileCells;
+
+    // Levels: a tile keeps at least one cell
+    while ( numberOfLevels > 1 && ( 1 << ( numberOfLevels - 1 ) ) > tileCells )
+    {
+        --numberOfLevels;
+    }
+
+    // Morph attributes of the grid
+    morphs.resize( nb * nb );
+    for ( int j = 0; j < nb; ++j )
+    {
+        for ( int i = 0; i < nb; ++i )
+        {
+            morphs[ j * nb + i ] = morphOf( points, nb, j, i );
+        }
+    }
+
+    // Skirt vertices: lowered copies of the vertices on tile borders (they morph the same way)
+    std::vector< GLuint >& skirt = skirtVertices;
+    skirt.assign( nb * nb, 0 );
+    for ( int j = 0; j < nb; ++j )
+    {
+        for ( int i = 0; i < nb; ++i )
+        {
+            if ( j % tileCells != 0 && i % tileCells != 0 )
+                continue;
+            const int k = j * nb + i;
+            skirt[ k ] = static_cast< GLuint >( points.size() );
+            points.push_back( points[ k ] - glm::vec3( 0.f, skirtDepth, 0.f ) );
+            normals.push_back( normals[ k ] );
+            morphs.push_back( morphs[ k ] - glm::vec2( skirtDepth, 0.f ) );
+        }
+    }
+
+    // Index ranges
+    indices.clear();
+    ranges.resize( numberOfTiles * numberOfTiles * numberOfLevels );
+    tileMin.resize( numberOfTiles * numberOfTiles );
+    tileMax.resize( numberOfTiles * numberOfTiles );
+    for ( int tj = 0; tj < numberOfTiles; ++tj )
+    {
+        for ( int ti = 0; ti < numberOfTiles; ++ti )
+        {
+            const int tile = tj * numberOfTiles + ti;
+            const int j0 = tj * tileCells;
+            const int i0 = ti * tileCells;
+            const int j1 = j0 + tileCells;
+            const int i1 = i0 + tileCells;
+
+            computeTileBounds( points, nb, tile );
+
+            for ( int level = 0; level < numberOfLevels; ++level )
+            {
+                const int s = 1 << level;
+                Range& range = ranges[ tile * numberOfLevels + level ];
+                range.offset = static_cast< GLsizei >( indices.size() );
+
+                // - same triangles as the full grid, one vertex out of s
+                for ( int j = j0 + s; j <= j1; j += s )
+                {
+                    for ( int i = i0 + s; i <= i1; i += s )
+                    {
+                        const GLuint k = j * nb + i;
+                        indices.push_back( k );
+                        indices.push_back( k - s * nb );
+                        indices.push_back( k - s * nb - s );
+
+                        indices.push_back( k );
+                        indices.push_back( k - s * nb - s );
+                        indices.push_back( k - s );
+                    }
+                }
+
+                // - skirts: one quad per border edge
+                for ( int e = 0; e < tileCells; e += s )
+                {
+                    const GLuint edges[ 4 ][ 2 ] = {
+                        { static_cast< GLuint >( j0 * nb + i0 + e ), static_cast< GLuint >( j0 * nb + i0 + e + s ) },
+                        { static_cast< GLuint >( j1 * nb + i0 + e ), static_cast< GLuint >( j1 * nb + i0 + e + s ) },
+                        { static_cast< GLuint >( ( j0 + e ) * nb + i0 ), static_cast< GLuint >( ( j0 + e + s ) * nb + i0 ) },
+                        { static_cast< GLuint >( ( j0 + e ) * nb + i1 ), static_cast< GLuint >( ( j0 + e + s ) * nb + i1 ) }
+                    };
+                    for ( int b = 0; b < 4; ++b )
+                    {
+                        const GLuint a = edges[ b ][ 0 ];
+                        const GLuint c = edges[ b ][ 1 ];
+                        indices.push_back( a );
+                        indices.push_back( c );
+                        indices.push_back( skirt[ c ] );
+
+                        indices.push_back( a );
+                        indices.push_back( skirt[ c ] );
+                        indices.push_back( skirt[ a ] );
+                    }
+                }
+
+                range.count = static_cast< GLsizei >( indices.size() ) - range.offset;
+            }
+        }
+    }
+
+    tileLevels.assign( numberOfTiles * numberOfTiles, 0 );
+
+    std::cout << "- " << numberOfTiles << "x" << numberOfTiles << " tiles, " << numberOfLevels << " levels" << std::endl;
+
+    return true;
+}
+
+/******************************************************************************
+ * Local bounds of a tile, skirts included
+ ******************************************************************************/
+void TerrainLod::computeTileBounds( const std::vector< glm::vec3 >& points, int nb, int tile )
+{
+    const int j0 = ( tile / numberOfTiles ) * tileCells;
+    const int i0 = ( tile % numberOfTiles ) * tileCells;
+
+    tileMin[ tile ] = tileMax[ tile ] = points[ j0 * nb + i0 ];
+    for ( int j = j0; j <= j0 + tileCells; ++j )
+    {
+        for ( int i = i0; i <= i0 + tileCells; ++i )
+        {
+            tileMin[ tile ] = glm::min( tileMin[ tile ], points[ j * nb + i ] );
+            tileMax[ tile ] = glm::max( tileMax[ tile ], points[ j * nb + i ] );
+        }
+    }
+    tileMin[ tile ].y -= skirtDepth;
+}
+
+/******************************************************************************
+ * Update the bounds of the tiles touching the grid vertices [j0,j1] x [i0,i1]
+ ******************************************************************************/
+void TerrainLod::updateTileBounds( const std::vector< glm::vec3 >& points, int nb, int j0, int i0, int j1, int i1 )
+{
+    const int last = numberOfTiles - 1;
+    for ( int tj = std::max( ( j0 - 1 ) / tileCells, 0 ); tj <= std::min( j1 / tileCells, last ); ++tj )
+    {
+        for ( int ti = std::max( ( i0 - 1 ) / tileCells, 0 ); ti <= std::min( i1 / tileCells, last ); ++ti )
+        {
+            computeTileBounds( points, nb, tj * numberOfTiles + ti );
+        }
+    }
+}
+
+/******************************************************************************
+ * Choose the level of each tile from the camera distance to its bounds
+ *
+ * A tile switches to level l+1 when its closest point is at the end of the
+ * level l range: all its vertices are then fully morphed.
+ ******************************************************************************/
+void TerrainLod::select( const glm::vec3& cameraPosition, const glm::mat4& modelMatrix )
+{
+    numberOfSelectedTriangles = 0;
+    for ( size_t tile = 0; tile < tileLevels.size(); ++tile )
+    {
+        // World bounds
+        glm::vec3 worldMin( 1e30f );
+        glm::vec3 worldMax( -1e30f );
+        for ( int c = 0; c < 8; ++c )
+        {
+            const glm::vec3 corner( ( c & 1 ) ? tileMax[ tile ].x : tileMin[ tile ].x,
+                                    ( c & 2 ) ? tileMax[ tile ].y : tileMin[ tile ].y,
+                                    ( c & 4 ) ? tileMax[ tile ].z : tileMin[ tile ].z );
+            const glm::vec3 p = glm::vec3( modelMatrix * glm::vec4( corner, 1.f ) );
+            worldMin = glm::min( worldMin, p );
+            worldMax = glm::max( worldMax, p );
+        }
+
+        const float distance = glm::length( cameraPosition - glm::clamp( cameraPosition, worldMin, worldMax ) );
+
+        int level = 0;
+        while ( level + 1 < numberOfLevels && distance >= lodDistance * ( 1 << level ) )
+        {
+            ++level;
+        }
+        tileLevels[ tile ] = level;
+        numberOfSelectedTriangles += ranges[ tile * numberOfLevels + level ].count / 3;
+    }
+}
+
+void TerrainLod::setLevelUniforms( GLuint program, int level ) const
+{
+    GLint uniformLocation;
+
+    uniformLocation = glGetUniformLocation( program, "lodLevel" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1i( uniformLocation, level );
+    }
+    uniformLocation = glGetUniformLocation( program, "morphRange" );
+    if ( uniformLocation >= 0 )
+    {
+        const float end = lodDistance * ( 1 << level );
+        glUniform2f( uniformLocation, ( 1.f - morphFraction ) * end, end );
+    }
+}
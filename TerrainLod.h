@@ -0,0 +1,99 @@
+#ifndef TERRAINLOD_H
+#define TERRAINLOD_H
+
+// STL
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Graphics
+// - GLEW (always before "gl.h")
+#include <GL/glew.h>
+// - GL
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+
+// glm
+#include <glm/glm.hpp>
+
+/******************************************************************************
+ * Terrain level of detail
+ *
+ * The grid is cut in square tiles; level l of a tile uses one grid vertex out
+ * of 2^l in each direction (all levels index the same vertex buffer). Tiles
+ * take coarser levels with the camera distance, each level covering twice
+ * the distance of the previous one.
+ *
+ * Geomorphing: a vertex first used by level l gets, as a vertex attribute,
+ * its height on the triangles of level l+1. Near the end of the level l range
+ * the vertex shader slides it to that height, so when the tile switches to
+ * level l+1 the surface is already the same and nothing pops.
+ *
+ * Skirts hanging below the tile borders hide the cracks between neighbouring
+ * tiles of different levels.
+ ******************************************************************************/
+class TerrainLod{
+public:
+    // - GLSL (vertex shader): uniforms and "vec3 morphVertex( position, morph, modelMatrix )"
+    static const std::string ShaderSource;
+
+    // - lattice level of the vertices that never morph
+    static const int NoMorph = 255;
+
+    // - tile size in grid cells (power of two dividing the number of cells)
+    int tileCells;
+    int numberOfLevels;
+    // - world distance covered by the finest level
+    float lodDistance;
+    // - fraction of a level range where its vertices morph (end of the range)
+    float morphFraction;
+    // - local height of the skirts
+    float skirtDepth;
+
+    int numberOfTiles;
+
+    // - index buffer range of each tile at each level: [ tile * numberOfLevels + level ]
+    struct Range{
+        GLsizei offset;
+        GLsizei count;
+    };
+    std::vector< Range > ranges;
+
+    // - local bounds of each tile
+    std::vector< glm::vec3 > tileMin;
+    std::vector< glm::vec3 > tileMax;
+
+    // - skirt vertex of each grid vertex (0: none)
+    std::vector< GLuint > skirtVertices;
+
+    // - last selection
+    std::vector< int > tileLevels;
+    int numberOfSelectedTriangles;
+
+    TerrainLod();
+
+    // - nb x nb grid (vertex k = j * nb + i): adds the skirt vertices, fills morph attributes and indices
+    bool build( int nb, std::vector< glm::vec3 >& points, std::vector< glm::vec3 >& normals,
+                std::vector< glm::vec2 >& morphs, std::vector< GLuint >& indices );
+
+    // - morph attribute of grid vertex (j,i)
+    glm::vec2 morphOf( const std::vector< glm::vec3 >& points, int nb, int j, int i ) const;
+    // - grid distance up to which a height change moves the morph attributes
+    int morphReach() const { return ( numberOfLevels > 1 ) ? 1 << ( numberOfLevels - 2 ) : 0; }
+
+    // - after an edit of the grid vertices [j0,j1] x [i0,i1]
+    void updateTileBounds( const std::vector< glm::vec3 >& points, int nb, int j0, int i0, int j1, int i1 );
+
+    void select( const glm::vec3& cameraPosition, const glm::mat4& modelMatrix );
+
+    // - lodLevel and morphRange uniforms of the current program
+    void setLevelUniforms( GLuint program, int level ) const;
+
+private:
+    int latticeLevel( int j, int i ) const;
+    void computeTileBounds( const std::vector< glm::vec3 >& points, int nb, int tile );
+};
+
+#endif
@@ -0,0 +1,352 @@
+#include "TerrainTessellation.h"
+
+#include "GLStateCache.h"
+
+// STL
+#include <algorithm>
+
+const std::string TerrainTessellation::VertexShaderSource =
+    "#version 400 core\n"
+    "\n"
+    "// INPUT\n"
+    "layout (location = 0) in vec3 position;\n"
+    "// - height bounds of the patch\n"
+    "layout (location = 1) in vec2 bounds;\n"
+    "\n"
+    "// OUTPUT\n"
+    "out vec3 patchCorner;\n"
+    "out vec2 patchBounds;\n"
+    "\n"
+    "// MAIN\n"
+    "void main( void )\n"
+    "{\n"
+    "    patchCorner = position;\n"
+    "    patchBounds = bounds;\n"
+    "}\n";
+
+const std::string TerrainTessellation::ControlShaderSource =
+    "#version 400 core\n"
+    "\n"
+    "layout( vertices = 4 ) out;\n"
+    "\n"
+    "// INPUT\n"
+    "in vec3 patchCorner[];\n"
+    "in vec2 patchBounds[];\n"
+    "\n"
+    "// UNIFORM\n"
+    "uniform mat4 viewMatrix;\n"
+    "uniform mat4 projectionMatrix;\n"
+    "uniform mat4 modelMatrix;\n"
+    "uniform vec2 viewportSize;\n"
+    "uniform float pixelsPerEdge;\n"
+    "uniform float maxTessellationLevel;\n"
+    "\n"
+    "// OUTPUT\n"
+    "out vec3 controlPosition[];\n"
+    "\n"
+    "// Level of an edge: screen diameter of its bounding sphere (only depends on the edge)\n"
+    "float edgeLevel( vec3 a, vec3 b )\n"
+    "{\n"
+    "    vec3 worldA = ( modelMatrix * vec4( a, 1.0 ) ).xyz;\n"
+    "    vec3 worldB = ( modelMatrix * vec4( b, 1.0 ) ).xyz;\n"
+    "    vec4 center = viewMatrix * vec4( 0.5 * ( worldA + worldB ), 1.0 );\n"
+    "    float pixels = distance( worldA, worldB ) * projectionMatrix[ 1 ][ 1 ] * 0.5 * viewportSize.y / max( -center.z, 0.001 );\n"
+    "    return clamp( pixels / pixelsPerEdge, 1.0, maxTessellationLevel );\n"
+    "}\n"
+    "\n"
+    "// True when the patch bounds are outside one of the frustum planes\n"
+    "bool outsideFrustum()\n"
+    "{\n"
+    "    vec3 below = vec3( 0.0 );\n"
+    "    vec3 above = vec3( 0.0 );\n"
+    "    for ( int c = 0; c < 8; ++c )\n"
+    "    {\n"
+    "        vec3 corner = vec3( ( c & 1 ) != 0 ? patchCorner[ 2 ].x : patchCorner[ 0 ].x,\n"
+    "                            ( c & 2 ) != 0 ? patchBounds[ 0 ].y : patchBounds[ 0 ].x,\n"
+    "                            ( c & 4 ) != 0 ? patchCorner[ 2 ].z : patchCorner[ 0 ].z );\n"
+    "        vec4 clip = projectionMatrix * viewMatrix * modelMatrix * vec4( corner, 1.0 );\n"
+    "        below += vec3( lessThan( clip.xyz, vec3( -clip.w ) ) );\n"
+    "        above += vec3( greaterThan( clip.xyz, vec3( clip.w ) ) );\n"
+    "    }\n"
+    "    return any( equal( below, vec3( 8.0 ) ) ) || any( equal( above, vec3( 8.0 ) ) );\n"
+    "}\n"
+    "\n"
+    "// MAIN\n"
+    "void main( void )\n"
+    "{\n"
+    "    controlPosition[ gl_InvocationID ] = patchCorner[ gl_InvocationID ];\n"
+    "\n"
+    "    if ( gl_InvocationID == 0 )\n"
+    "    {\n"
+    "        if ( outsideFrustum() )\n"
+    "        {\n"
+    "            // - a zero outer level discards the patch\n"
+    "            gl_TessLevelOuter[ 0 ] = 0.0;\n"
+    "            gl_TessLevelOuter[ 1 ] = 0.0;\n"
+    "            gl_TessLevelOuter[ 2 ] = 0.0;\n"
+    "            gl_TessLevelOuter[ 3 ] = 0.0;\n"
+    "            gl_TessLevelInner[ 0 ] = 0.0;\n"
+    "            gl_TessLevelInner[ 1 ] = 0.0;\n"
+    "        }\n"
+    "        else\n"
+    "        {\n"
+    "            // - corners: 0 (u=0,v=0), 1 (u=1,v=0), 2 (u=1,v=1), 3 (u=0,v=1)\n"
+    "            gl_TessLevelOuter[ 0 ] = edgeLevel( patchCorner[ 0 ], patchCorner[ 3 ] );\n"
+    "            gl_TessLevelOuter[ 1 ] = edgeLevel( patchCorner[ 0 ], patchCorner[ 1 ] );\n"
+    "            gl_TessLevelOuter[ 2 ] = edgeLevel( patchCorner[ 1 ], patchCorner[ 2 ] );\n"
+    "            gl_TessLevelOuter[ 3 ] = edgeLevel( patchCorner[ 3 ], patchCorner[ 2 ] );\n"
+    "            gl_TessLevelInner[ 0 ] = max( gl_TessLevelOuter[ 1 ], gl_TessLevelOuter[ 3 ] );\n"
+    "            gl_TessLevelInner[ 1 ] = max( gl_TessLevelOuter[ 0 ], gl_TessLevelOuter[ 2 ] );\n"
+    "        }\n"
+    "    }\n"
+    "}\n";
+
+const std::string TerrainTessellation::EvaluationShaderSource =
+    "layout( quads, fractional_even_spacing, ccw ) in;\n"
+    "\n"
+    "// INPUT\n"
+    "in vec3 controlPosition[];\n"
+    "\n"
+    "// UNIFORM\n"
+    "// - grid heights: texel (s,t) is grid vertex (j=t,i=s)\n"
+    "uniform sampler2D heightTexture;\n"
+    "uniform float heightGridSize;\n"
+    "\n"
+    "float gridHeight( vec2 xz )\n"
+    "{\n"
+    "    vec2 uv = ( xz.yx + 1.0 ) * 0.5 + 0.5 / heightGridSize;\n"
+    "    return textureLod( heightTexture, uv, 0.0 ).r;\n"
+    "}\n"
+    "\n"
+    "// Displaced position of the generated vertex (local space) and its normal\n"
+    "vec3 patchPosition( out vec3 normal )\n"
+    "{\n"
+    "    vec3 bottom = mix( controlPosition[ 0 ], controlPosition[ 1 ], gl_TessCoord.x );\n"
+    "    vec3 top = mix( controlPosition[ 3 ], controlPosition[ 2 ], gl_TessCoord.x );\n"
+    "    vec2 xz = mix( bottom, top, gl_TessCoord.y ).xz;\n"
+    "\n"
+    "    float gridStep = 2.0 / heightGridSize;\n"
+    "    float dx = gridHeight( xz + vec2( gridStep, 0.0 ) ) - gridHeight( xz - vec2( gridStep, 0.0 ) );\n"
+    "    float dz = gridHeight( xz + vec2( 0.0, gridStep ) ) - gridHeight( xz - vec2( 0.0, gridStep ) );\n"
+    "    normal = normalize( vec3( -dx, 2.0 * gridStep, -dz ) );\n"
+    "\n"
+    "    return vec3( xz.x, gridHeight( xz ), xz.y );\n"
+    "}\n";
+
+TerrainTessellation::TerrainTessellation(){
+    supported = false;
+    enabled = true;
+
+    patchCells = 32;
+    pixelsPerEdge = 8.f;
+
+    gridResolution = 0;
+    numberOfPatchesPerSide = 0;
+    numberOfPatches = 0;
+
+    mPatchVertexArray = 0;
+    mPatchVertexBuffer = 0;
+    mHeightTexture = 0;
+}
+
+/******************************************************************************
+ * Initialize tessellation
+ * - an unsupported context is not an error: the CPU grid is used instead
+ ******************************************************************************/
+bool TerrainTessellation::initializeTessellation( const std::vector< glm::vec3 >& points, int nb )
+{
+    std::cout << "Initialize terrain tessellation..." << std::endl;
+
+    supported = GLEW_VERSION_4_0 || GLEW_ARB_tessellation_shader;
+    if ( !supported )
+    {
+        std::cout << "- tessellation shaders not supported, CPU grid only" << std::endl;
+        return true;
+    }
+
+    // Levels above the grid cells of a patch would only interpolate the heights
+    GLint maxLevel = 64;
+    glGetIntegerv( GL_MAX_TESS_GEN_LEVEL, &maxLevel );
+    patchCells = std::min( patchCells, static_cast< int >( maxLevel ) );
+
+    if ( nb < 2 || ( nb - 1 ) % patchCells != 0 )
+    {
+        std::cout << "- " << nb - 1 << " grid cells are not a multiple of " << patchCells << ", CPU grid only" << std::endl;
+        supported = false;
+        return true;
+    }
+
+    gridResolution = nb;
+    numberOfPatchesPerSide = ( nb - 1 ) / patchCells;
+
+    // Height texture: one texel per grid vertex, rows along j
+    std::vector< float > heights( nb * nb );
+    for ( int k = 0; k < nb * nb; ++k )
+    {
+        heights[ k ] = points[ k ].y;
+    }
+    glGenTextures( 1, &mHeightTexture );
+    GLStateCache::bindTexture( TextureUnit, GL_TEXTURE_2D, mHeightTexture );
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+    glTexImage2D( GL_TEXTURE_2D, 0, GL_R32F, nb, nb, 0, GL_RED, GL_FLOAT, heights.data() );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+
+    // Patches: 4 corners and the height bounds of the covered cells
+    const int patches = numberOfPatchesPerSide;
+    numberOfPatches = patches * patches;
+    std::vector< glm::vec3 > corners;
+    std::vector< glm::vec2 > bounds;
+    corners.reserve( 4 * numberOfPatches );
+    bounds.reserve( 4 * numberOfPatches );
+    for ( int pj = 0; pj < patches; ++pj )
+    {
+        for ( int pi = 0; pi < patches; ++pi )
+        {
+            glm::vec3 patchCorners[ 4 ];
+            glm::vec2 heightBounds;
+            patchVertices( points, pj, pi, patchCorners, heightBounds );
+            for ( int c = 0; c < 4; ++c )
+            {
+                corners.push_back( patchCorners[ c ] );
+                bounds.push_back( heightBounds );
+            }
+        }
+    }
+
+    const GLsizeiptr cornersSize = corners.size() * sizeof( glm::vec3 );
+    const GLsizeiptr boundsSize = bounds.size() * sizeof( glm::vec2 );
+    glGenBuffers( 1, &mPatchVertexBuffer );
+    glBindBuffer( GL_ARRAY_BUFFER, mPatchVertexBuffer );
+    glBufferData( GL_ARRAY_BUFFER, cornersSize + boundsSize, nullptr, GL_STATIC_DRAW );
+    glBufferSubData( GL_ARRAY_BUFFER, 0, cornersSize, corners.data() );
+    glBufferSubData( GL_ARRAY_BUFFER, cornersSize, boundsSize, bounds.data() );
+
+    glGenVertexArrays( 1, &mPatchVertexArray );
+    glBindVertexArray( mPatchVertexArray );
+    glVertexAttribPointer( 0, 3, GL_FLOAT, GL_FALSE, 0, 0 );
+    glEnableVertexAttribArray( 0 );
+    glVertexAttribPointer( 1, 2, GL_FLOAT, GL_FALSE, 0, (void*)cornersSize );
+    glEnableVertexAttribArray( 1 );
+    glBindVertexArray( 0 );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+    std::cout << "- " << patches << "x" << patches << " patches of " << patchCells << " cells" << std::endl;
+
+    return true;
+}
+
+/******************************************************************************
+ * Corners and height bounds of patch (pj,pi)
+ ******************************************************************************/
+void TerrainTessellation::patchVertices( const std::vector< glm::vec3 >& points, int pj, int pi, glm::vec3 corners[ 4 ], glm::vec2& heightBounds ) const
+{
+    const int nb = gridResolution;
+    const int j0 = pj * patchCells;
+    const int i0 = pi * patchCells;
+    const int j1 = j0 + patchCells;
+    const int i1 = i0 + patchCells;
+
+    heightBounds = glm::vec2( points[ j0 * nb + i0 ].y );
+    for ( int j = j0; j <= j1; ++j )
+    {
+        for ( int i = i0; i <= i1; ++i )
+        {
+            heightBounds.x = std::min( heightBounds.x, points[ j * nb + i ].y );
+            heightBounds.y = std::max( heightBounds.y, points[ j * nb + i ].y );
+        }
+    }
+
+    corners[ 0 ] = points[ j0 * nb + i0 ];
+    corners[ 1 ] = points[ j1 * nb + i0 ];
+    corners[ 2 ] = points[ j1 * nb + i1 ];
+    corners[ 3 ] = points[ j0 * nb + i1 ];
+}
+
+/******************************************************************************
+ * Update the heights of the grid vertices [j0,j1] x [i0,i1]
+ * - only this rectangle of the height texture and the patches touching it
+ ******************************************************************************/
+void TerrainTessellation::updateHeights( const std::vector< glm::vec3 >& points, int j0, int i0, int j1, int i1 )
+{
+    if ( !supported )
+        return;
+
+    const int nb = gridResolution;
+    const int width = i1 - i0 + 1;
+    const int height = j1 - j0 + 1;
+
+    std::vector< float > heights( width * height );
+    for ( int j = j0; j <= j1; ++j )
+    {
+        for ( int i = i0; i <= i1; ++i )
+        {
+            heights[ ( j - j0 ) * width + ( i - i0 ) ] = points[ j * nb + i ].y;
+        }
+    }
+    GLStateCache::bindTexture( TextureUnit, GL_TEXTURE_2D, mHeightTexture );
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+    glTexSubImage2D( GL_TEXTURE_2D, 0, i0, j0, width, height, GL_RED, GL_FLOAT, heights.data() );
+
+    const GLsizeiptr cornersSize = 4 * numberOfPatches * sizeof( glm::vec3 );
+    const int last = numberOfPatchesPerSide - 1;
+    GLStateCache::bindArrayBuffer( mPatchVertexBuffer );
+    for ( int pj = std::max( ( j0 - 1 ) / patchCells, 0 ); pj <= std::min( j1 / patchCells, last ); ++pj )
+    {
+        for ( int pi = std::max( ( i0 - 1 ) / patchCells, 0 ); pi <= std::min( i1 / patchCells, last ); ++pi )
+        {
+            glm::vec3 corners[ 4 ];
+            glm::vec2 heightBounds;
+            patchVertices( points, pj, pi, corners, heightBounds );
+            const glm::vec2 bounds[ 4 ] = { heightBounds, heightBounds, heightBounds, heightBounds };
+
+            const int patch = pj * numberOfPatchesPerSide + pi;
+            glBufferSubData( GL_ARRAY_BUFFER, 4 * patch * sizeof( glm::vec3 ), sizeof( corners ), corners );
+            glBufferSubData( GL_ARRAY_BUFFER, cornersSize + 4 * patch * sizeof( glm::vec2 ), sizeof( bounds ), bounds );
+        }
+    }
+}
+
+/******************************************************************************
+ * Draw the patches
+ ******************************************************************************/
+void TerrainTessellation::draw( GLuint program ) const
+{
+    GLint uniformLocation;
+
+    GLint viewport[ 4 ];
+    glGetIntegerv( GL_VIEWPORT, viewport );
+
+    uniformLocation = glGetUniformLocation( program, "viewportSize" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform2f( uniformLocation, static_cast< float >( viewport[ 2 ] ), static_cast< float >( viewport[ 3 ] ) );
+    }
+    uniformLocation = glGetUniformLocation( program, "pixelsPerEdge" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1f( uniformLocation, pixelsPerEdge );
+    }
+    uniformLocation = glGetUniformLocation( program, "maxTessellationLevel" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1f( uniformLocation, static_cast< float >( patchCells ) );
+    }
+    uniformLocation = glGetUniformLocation( program, "heightGridSize" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1f( uniformLocation, static_cast< float >( gridResolution ) );
+    }
+    uniformLocation = glGetUniformLocation( program, "heightTexture" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1i( uniformLocation, TextureUnit );
+    }
+    GLStateCache::bindTexture( TextureUnit, GL_TEXTURE_2D, mHeightTexture );
+
+    GLStateCache::bindVertexArray( mPatchVertexArray );
+    glPatchParameteri( GL_PATCH_VERTICES, 4 );
+    glDrawArrays( GL_PATCHES, 0, 4 * numberOfPatches );
+}
@@ -0,0 +1,81 @@
+#ifndef TERRAINTESSELLATION_H
+#define TERRAINTESSELLATION_H
+
+// STL
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Graphics
+// - GLEW (always before "gl.h")
+#include <GL/glew.h>
+// - GL
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+
+// glm
+#include <glm/glm.hpp>
+
+/******************************************************************************
+ * Terrain hardware tessellation (GL 4.0)
+ *
+ * The grid is submitted as a coarse set of square patches. The control shader
+ * gives each patch edge a tessellation level from the screen size of the edge
+ * (so both patches sharing an edge agree and no crack appears) and drops the
+ * patches outside the frustum; the evaluation shader displaces the generated
+ * vertices with the grid heights stored in a texture. Triangle density then
+ * follows the screen, up to one triangle pair per grid cell.
+ *
+ * Tessellation shaders do not exist in GLES 3.0: when the context does not
+ * support them (or the program does not build) the terrain keeps the tiled
+ * CPU grid (see TerrainLod).
+ ******************************************************************************/
+class TerrainTessellation{
+public:
+    // - texture unit used by the height texture
+    static const int TextureUnit = 8;
+
+    // - GLSL (#version 400): patch vertex shader and control shader
+    static const std::string VertexShaderSource;
+    static const std::string ControlShaderSource;
+    // - GLSL: evaluation shader header, "vec3 patchPosition( out normal )" (local space)
+    static const std::string EvaluationShaderSource;
+
+    // - GL 4.0 or ARB_tessellation_shader, and programs built
+    bool supported;
+    bool enabled;
+
+    // - patch size in grid cells (divides the number of cells)
+    int patchCells;
+    // - target screen length of a generated edge
+    float pixelsPerEdge;
+
+    int gridResolution;
+    int numberOfPatchesPerSide;
+    int numberOfPatches;
+
+    GLuint mPatchVertexArray;
+    GLuint mPatchVertexBuffer;
+    GLuint mHeightTexture;
+
+    TerrainTessellation();
+
+    // Methode d'initialisation
+    // - nb x nb grid (vertex k = j * nb + i, only the first nb * nb points are read)
+    bool initializeTessellation( const std::vector< glm::vec3 >& points, int nb );
+
+    bool active() const { return supported && enabled; }
+
+    // - after an edit of the grid vertices [j0,j1] x [i0,i1] (GL thread)
+    void updateHeights( const std::vector< glm::vec3 >& points, int j0, int i0, int j1, int i1 );
+
+    // - patch uniforms, height texture and draw command (program already in use)
+    void draw( GLuint program ) const;
+
+private:
+    void patchVertices( const std::vector< glm::vec3 >& points, int pj, int pi, glm::vec3 corners[ 4 ], glm::vec2& heightBounds ) const;
+};
+
+#endif
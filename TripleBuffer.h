@@ -0,0 +1,49 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+// STL
+#include <atomic>
+
+/******************************************************************************
+ * Triple buffer (one writer thread, one reader thread)
+ *
+ * The writer fills its back buffer then publishes it: the back buffer is
+ * exchanged with the middle one. The reader takes the middle buffer when a
+ * new one was published. Neither side ever waits, and the reader always
+ * sees the last complete value.
+ ******************************************************************************/
+template< typename T >
+class TripleBuffer{
+public:
+    TripleBuffer() : middle( 1 ), back( 0 ), front( 2 ) {}
+
+    // Writer
+    T& writeBuffer() { return buffers[ back ]; }
+    void publish()
+    {
+        back = middle.exchange( back | NewBit ) & IndexMask;
+    }
+
+    // Reader
+    // - false when nothing was published since the last call
+    bool update()
+    {
+        if ( ( middle.load() & NewBit ) == 0 )
+            return false;
+        front = middle.exchange( front ) & IndexMask;
+        return true;
+    }
+    const T& readBuffer() const { return buffers[ front ]; }
+
+private:
+    static const unsigned int IndexMask = 3;
+    static const unsigned int NewBit = 4;
+
+    T buffers[ 3 ];
+    // - index of the middle buffer, and whether it is newer than the front one
+    std::atomic< unsigned int > middle;
+    unsigned int back;
+    unsigned int front;
+};
+
+#endif
@@ -0,0 +1,946 @@
+#include "Vegetation.h"
+
+#include "GLStateCache.h"
+#include "GroundPlacement.h"
+#include "ShaderProgram.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+// glm
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace
+{
+    // Bounding sphere of the tree in instance space (base at the origin, height 1)
+    const glm::vec3 TreeCenter( 0.f, 0.5f, 0.f );
+    const float TreeRadius = 0.6f;
+    // Impostor width relative to its height
+    const float ImpostorWidth = 0.7f;
+
+    const char* MeshVertexShaderSource =
+        "#version 300 es\n"
+        "\n"
+        "// INPUT\n"
+        "layout (location = 0) in vec3 position;\n"
+        "layout (location = 1) in vec3 normal;\n"
+        "layout (location = 2) in vec3 color;\n"
+        "// - instance transform rows\n"
+        "layout (location = 3) in vec4 instanceRow0;\n"
+        "layout (location = 4) in vec4 instanceRow1;\n"
+        "layout (location = 5) in vec4 instanceRow2;\n"
+        "\n"
+        "// UNIFORM\n"
+        "uniform mat4 viewMatrix;\n"
+        "uniform mat4 projectionMatrix;\n"
+        "uniform vec3 lightPosition;\n"
+        "uniform vec3 lightColor;\n"
+        "\n"
+        "// OUTPUT\n"
+        "out vec3 vertexColor;\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    vec4 p = vec4( position, 1.0 );\n"
+        "    vec3 worldPosition = vec3( dot( instanceRow0, p ), dot( instanceRow1, p ), dot( instanceRow2, p ) );\n"
+        "    // - rotation and uniform scale: the linear part transforms the normal\n"
+        "    mat3 linear = transpose( mat3( instanceRow0.xyz, instanceRow1.xyz, instanceRow2.xyz ) );\n"
+        "    vec3 worldNormal = normalize( linear * normal );\n"
+        "\n"
+        "    vec3 L = normalize( lightPosition - worldPosition );\n"
+        "    float diffuse = max( 0.0, dot( worldNormal, L ) );\n"
+        "    vertexColor = color * lightColor * ( 0.3 + 0.7 * diffuse );\n"
+        "\n"
+        "    gl_Position = projectionMatrix * viewMatrix * vec4( worldPosition, 1.0 );\n"
+        "}\n";
+
+    const char* ImpostorVertexShaderSource =
+        "#version 300 es\n"
+        "\n"
+        "// INPUT\n"
+        "// - quad corner in [0,1]^2\n"
+        "layout (location = 0) in vec2 corner;\n"
+        "layout (location = 3) in vec4 instanceRow0;\n"
+        "layout (location = 4) in vec4 instanceRow1;\n"
+        "layout (location = 5) in vec4 instanceRow2;\n"
+        "\n"
+        "// UNIFORM\n"
+        "uniform mat4 viewMatrix;\n"
+        "uniform mat4 projectionMatrix;\n"
+        "uniform vec3 cameraPosition;\n"
+        "uniform vec3 lightPosition;\n"
+        "uniform vec3 lightColor;\n"
+        "uniform float impostorWidth;\n"
+        "\n"
+        "// OUTPUT\n"
+        "out vec2 impostorUV;\n"
+        "out vec3 vertexLight;\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    vec3 base = vec3( instanceRow0.w, instanceRow1.w, instanceRow2.w );\n"
+        "    float height = length( vec3( instanceRow0.y, instanceRow1.y, instanceRow2.y ) );\n"
+        "\n"
+        "    // Turned toward the camera around the vertical (trees stay upright)\n"
+        "    vec3 toCamera = cameraPosition - base;\n"
+        "    vec3 right = normalize( vec3( toCamera.z, 0.0, -toCamera.x ) + vec3( 1e-6, 0.0, 0.0 ) );\n"
+        "    vec3 worldPosition = base + right * ( corner.x - 0.5 ) * impostorWidth * height + vec3( 0.0, corner.y * height, 0.0 );\n"
+        "\n"
+        "    // Rounded crown: normal between the view direction and the vertical\n"
+        "    vec3 worldNormal = normalize( vec3( toCamera.x, length( toCamera.xz ) + 1e-6, toCamera.z ) );\n"
+        "    vec3 L = normalize( lightPosition - worldPosition );\n"
+        "    vertexLight = lightColor * ( 0.3 + 0.7 * max( 0.0, dot( worldNormal, L ) ) );\n"
+        "    impostorUV = corner;\n"
+        "\n"
+        "    gl_Position = projectionMatrix * viewMatrix * vec4( worldPosition, 1.0 );\n"
+        "}\n";
+
+    const char* MeshFragmentShaderSource =
+        "#version 300 es\n"
+        "precision mediump float;\n"
+        "\n"
+        "in vec3 vertexColor;\n"
+        "\n"
+        "out vec4 fragmentColor;\n"
+        "\n"
+        "void main( void )\n"
+        "{\n"
+        "    fragmentColor = vec4( vertexColor, 1.0 );\n"
+        "}\n";
+
+    // Silhouette of the tree mesh (trunk, then a crown narrowing to the top)
+    const char* ImpostorFragmentShaderSource =
+        "#version 300 es\n"
+        "precision mediump float;\n"
+        "\n"
+        "in vec2 impostorUV;\n"
+        "in vec3 vertexLight;\n"
+        "\n"
+        "out vec4 fragmentColor;\n"
+        "\n"
+        "void main( void )\n"
+        "{\n"
+        "    float x = abs( impostorUV.x - 0.5 );\n"
+        "    float y = impostorUV.y;\n"
+        "    vec3 color;\n"
+        "    if ( y >= 0.2 && x < 0.5 * ( 1.0 - ( y - 0.2 ) / 0.8 ) )\n"
+        "        color = vec3( 0.1, 0.35, 0.12 );\n"
+        "    else if ( y < 0.3 && x < 0.05 )\n"
+        "        color = vec3( 0.35, 0.22, 0.1 );\n"
+        "    else\n"
+        "        discard;\n"
+        "    fragmentColor = vec4( color * vertexLight, 1.0 );\n"
+        "}\n";
+
+    // Hash of the seed, the tile, the candidate and a channel (same result on every run)
+    unsigned int hash( unsigned int seed, unsigned int tile, unsigned int candidate, unsigned int channel )
+    {
+        unsigned int h = seed ^ ( tile * 0x9E3779B1u ) ^ ( candidate * 0x85EBCA77u ) ^ ( channel * 0xC2B2AE3Du );
+        h ^= h >> 16;
+        h *= 0x7FEB352Du;
+        h ^= h >> 15;
+        h *= 0x846CA68Bu;
+        h ^= h >> 16;
+        return h;
+    }
+
+    float random01( unsigned int h )
+    {
+        return static_cast< float >( h >> 8 ) * ( 1.f / 16777216.f );
+    }
+
+    // Frustum planes (normals inward, normalized) of a view projection matrix
+    void frustumPlanes( const glm::mat4& viewProjection, glm::vec4 planes[ 6 ] )
+    {
+        const glm::mat4 m = glm::transpose( viewProjection );
+        planes[ 0 ] = m[ 3 ] + m[ 0 ];
+        planes[ 1 ] = m[ 3 ] - m[ 0 ];
+        planes[ 2 ] = m[ 3 ] + m[ 1 ];
+        planes[ 3 ] = m[ 3 ] - m[ 1 ];
+        planes[ 4 ] = m[ 3 ] + m[ 2 ];
+        planes[ 5 ] = m[ 3 ] - m[ 2 ];
+        for ( int p = 0; p < 6; ++p )
+        {
+            planes[ p ] /= glm::length( glm::vec3( planes[ p ] ) );
+        }
+    }
+
+    bool boxInFrustum( const glm::vec4 planes[ 6 ], const glm::vec3& boxMin, const glm::vec3& boxMax )
+    {
+        for ( int p = 0; p < 6; ++p )
+        {
+            // - corner furthest along the plane normal
+            const glm::vec3 corner( planes[ p ].x >= 0.f ? boxMax.x : boxMin.x,
+                                    planes[ p ].y >= 0.f ? boxMax.y : boxMin.y,
+                                    planes[ p ].z >= 0.f ? boxMax.z : boxMin.z );
+            if ( glm::dot( glm::vec3( planes[ p ] ), corner ) + planes[ p ].w < 0.f )
+                return false;
+        }
+        return true;
+    }
+
+    struct MeshVertex{
+        glm::vec3 position;
+        glm::vec3 normal;
+        glm::vec3 color;
+    };
+
+    // Open cone (or cylinder when both radii are equal) around the y axis
+    void addCone( std::vector< MeshVertex >& vertices, std::vector< GLuint >& indices, int segments,
+                  float y0, float radius0, float y1, float radius1, const glm::vec3& color )
+    {
+        const float pi = 3.14159265f;
+        const float slope = ( radius0 - radius1 ) / ( y1 - y0 );
+        const GLuint first = static_cast< GLuint >( vertices.size() );
+        for ( int s = 0; s <= segments; ++s )
+        {
+            const float angle = 2.f * pi * s / segments;
+            const glm::vec3 direction( std::cos( angle ), 0.f, std::sin( angle ) );
+            const glm::vec3 normal = glm::normalize( direction + glm::vec3( 0.f, slope, 0.f ) );
+            vertices.push_back( { glm::vec3( radius0 * direction.x, y0, radius0 * direction.z ), normal, color } );
+            vertices.push_back( { glm::vec3( radius1 * direction.x, y1, radius1 * direction.z ), normal, color } );
+        }
+        for ( int s = 0; s < segments; ++s )
+        {
+            const GLuint k = first + 2 * s;
+            indices.push_back( k );
+            indices.push_back( k + 2 );
+            indices.push_back( k + 1 );
+            indices.push_back( k + 1 );
+            indices.push_back( k + 2 );
+            indices.push_back( k + 3 );
+        }
+    }
+}
+
+const std::string Vegetation::CullVertexShaderSource =
+    "#version 330 core\n"
+    "\n"
+    "// INPUT\n"
+    "layout (location = 0) in vec4 instanceRow0;\n"
+    "layout (location = 1) in vec4 instanceRow1;\n"
+    "layout (location = 2) in vec4 instanceRow2;\n"
+    "\n"
+    "// UNIFORM\n"
+    "uniform vec4 frustumPlanes[ 6 ];\n"
+    "uniform vec3 cameraPosition;\n"
+    "// - distances of the level of detail being culled\n"
+    "uniform vec2 lodRange;\n"
+    "// - bounding sphere in instance space\n"
+    "uniform vec4 boundingSphere;\n"
+    "\n"
+    "// OUTPUT\n"
+    "out vec4 vertexRow0;\n"
+    "out vec4 vertexRow1;\n"
+    "out vec4 vertexRow2;\n"
+    "out float vertexKept;\n"
+    "\n"
+    "// MAIN\n"
+    "void main( void )\n"
+    "{\n"
+    "    vec4 c = vec4( boundingSphere.xyz, 1.0 );\n"
+    "    vec3 center = vec3( dot( instanceRow0, c ), dot( instanceRow1, c ), dot( instanceRow2, c ) );\n"
+    "    float radius = boundingSphere.w * length( vec3( instanceRow0.y, instanceRow1.y, instanceRow2.y ) );\n"
+    "\n"
+    "    float d = distance( vec3( instanceRow0.w, instanceRow1.w, instanceRow2.w ), cameraPosition );\n"
+    "    vertexKept = ( d >= lodRange.x && d < lodRange.y ) ? 1.0 : 0.0;\n"
+    "    for ( int p = 0; p < 6; ++p )\n"
+    "    {\n"
+    "        if ( dot( frustumPlanes[ p ].xyz, center ) + frustumPlanes[ p ].w < -radius )\n"
+    "            vertexKept = 0.0;\n"
+    "    }\n"
+    "\n"
+    "    vertexRow0 = instanceRow0;\n"
+    "    vertexRow1 = instanceRow1;\n"
+    "    vertexRow2 = instanceRow2;\n"
+    "}\n";
+
+const std::string Vegetation::CullGeometryShaderSource =
+    "#version 330 core\n"
+    "\n"
+    "layout( points ) in;\n"
+    "layout( points, max_vertices = 1 ) out;\n"
+    "\n"
+    "// INPUT\n"
+    "in vec4 vertexRow0[];\n"
+    "in vec4 vertexRow1[];\n"
+    "in vec4 vertexRow2[];\n"
+    "in float vertexKept[];\n"
+    "\n"
+    "// OUTPUT (captured)\n"
+    "out vec4 keptRow0;\n"
+    "out vec4 keptRow1;\n"
+    "out vec4 keptRow2;\n"
+    "\n"
+    "// MAIN: only the kept instances are written\n"
+    "void main( void )\n"
+    "{\n"
+    "    if ( vertexKept[ 0 ] > 0.5 )\n"
+    "    {\n"
+    "        keptRow0 = vertexRow0[ 0 ];\n"
+    "        keptRow1 = vertexRow1[ 0 ];\n"
+    "        keptRow2 = vertexRow2[ 0 ];\n"
+    "        EmitVertex();\n"
+    "        EndPrimitive();\n"
+    "    }\n"
+    "}\n";
+
+Vegetation::Vegetation(){
+    enabled = true;
+    gpuCulling = false;
+
+    tilesPerSide = 16;
+    candidatesPerTileSide = 16;
+    density = 0.6f;
+    // - grass band of the terrain shader
+    heightBand = glm::vec2( 0.3f, 0.6f );
+    minimumNormalY = 0.8f;
+    scaleRange = glm::vec2( 0.12f, 0.3f );
+    normalAlignment = 0.2f;
+    seed = 1234u;
+
+    nearDistance = 3.f;
+    farDistance = 6.f;
+
+    maxResidentTiles = 128;
+    maxGeneratedTilesPerFrame = 4;
+
+    numberOfResidentTiles = 0;
+    numberOfVisibleTiles = 0;
+    numberOfMeshInstances = 0;
+    numberOfImpostorInstances = 0;
+
+    mCullShaderProgram = 0;
+    mMeshShaderProgram = 0;
+    mImpostorShaderProgram = 0;
+    mInstanceBuffer = 0;
+    mInstanceVertexArray = 0;
+    for ( int s = 0; s < NumberOfCullSets; ++s )
+    {
+        mMeshInstanceBuffers[ s ] = 0;
+        mImpostorInstanceBuffers[ s ] = 0;
+        mCullQueries[ s ][ 0 ] = 0;
+        mCullQueries[ s ][ 1 ] = 0;
+        cullIssued[ s ] = false;
+    }
+    cullSet = 0;
+    drawSet = -1;
+    mMeshVertexBuffer = 0;
+    mMeshIndexBuffer = 0;
+    mMeshVertexArray = 0;
+    mImpostorVertexBuffer = 0;
+    mImpostorVertexArray = 0;
+    numberOfMeshIndices = 0;
+
+    instancesPerSlot = 0;
+    frame = 0;
+}
+
+/******************************************************************************
+ * Initialize vegetation
+ * - no GL 3.3 is not an error: the instances are culled on the CPU
+ ******************************************************************************/
+bool Vegetation::initializeVegetation()
+{
+    std::cout << "Initialize vegetation..." << std::endl;
+
+    tiles.assign( tilesPerSide * tilesPerSide, Tile() );
+    for ( size_t t = 0; t < tiles.size(); ++t )
+    {
+        tiles[ t ].slot = -1;
+        tiles[ t ].lastFrame = -1;
+    }
+    instancesPerSlot = candidatesPerTileSide * candidatesPerTileSide;
+    freeSlots.clear();
+    for ( int slot = maxResidentTiles - 1; slot >= 0; --slot )
+    {
+        freeSlots.push_back( slot );
+    }
+
+    mMeshShaderProgram = ShaderProgram::create( MeshVertexShaderSource, MeshFragmentShaderSource, "vegetation mesh" );
+    mImpostorShaderProgram = ShaderProgram::create( ImpostorVertexShaderSource, ImpostorFragmentShaderSource, "vegetation impostor" );
+    if ( mMeshShaderProgram == 0 || mImpostorShaderProgram == 0 )
+    {
+        return false;
+    }
+
+    gpuCulling = GLEW_VERSION_3_3;
+    if ( gpuCulling )
+    {
+        const std::vector< std::string > varyings = { "keptRow0", "keptRow1", "keptRow2" };
+        mCullShaderProgram = ShaderProgram::create( CullVertexShaderSource.c_str(), CullGeometryShaderSource.c_str(), varyings, "vegetation culling" );
+        gpuCulling = ( mCullShaderProgram != 0 );
+    }
+    if ( !gpuCulling )
+    {
+        std::cout << "- geometry shaders not supported, instances culled on the CPU" << std::endl;
+    }
+
+    // Instances: one fixed slot per resident tile, 3 rows per instance
+    const GLsizeiptr instanceSize = 3 * sizeof( glm::vec4 );
+    const GLsizeiptr capacity = static_cast< GLsizeiptr >( maxResidentTiles ) * instancesPerSlot * instanceSize;
+    glGenBuffers( 1, &mInstanceBuffer );
+    glBindBuffer( GL_ARRAY_BUFFER, mInstanceBuffer );
+    glBufferData( GL_ARRAY_BUFFER, capacity, nullptr, GL_DYNAMIC_DRAW );
+
+    glGenVertexArrays( 1, &mInstanceVertexArray );
+    glBindVertexArray( mInstanceVertexArray );
+    for ( int r = 0; r < 3; ++r )
+    {
+        glVertexAttribPointer( r, 4, GL_FLOAT, GL_FALSE, instanceSize, (void*)( r * sizeof( glm::vec4 ) ) );
+        glEnableVertexAttribArray( r );
+    }
+    glBindVertexArray( 0 );
+
+    // Kept instances of each level (written by transform feedback or by the CPU, the CPU uses set 0)
+    glGenBuffers( NumberOfCullSets, mMeshInstanceBuffers );
+    glGenBuffers( NumberOfCullSets, mImpostorInstanceBuffers );
+    for ( int s = 0; s < NumberOfCullSets; ++s )
+    {
+        glBindBuffer( GL_ARRAY_BUFFER, mMeshInstanceBuffers[ s ] );
+        glBufferData( GL_ARRAY_BUFFER, capacity, nullptr, GL_DYNAMIC_COPY );
+        glBindBuffer( GL_ARRAY_BUFFER, mImpostorInstanceBuffers[ s ] );
+        glBufferData( GL_ARRAY_BUFFER, capacity, nullptr, GL_DYNAMIC_COPY );
+        glGenQueries( 2, mCullQueries[ s ] );
+    }
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+    initializeMesh();
+
+    std::cout << "- " << tilesPerSide << "x" << tilesPerSide << " tiles, up to " << instancesPerSlot << " instances per tile, "
+              << maxResidentTiles << " resident tiles" << std::endl;
+
+    return true;
+}
+
+/******************************************************************************
+ * Tree mesh (trunk and two crown cones) and impostor quad
+ * - both take their instances from the kept instance buffers (divisor 1)
+ ******************************************************************************/
+void Vegetation::initializeMesh()
+{
+    std::vector< MeshVertex > vertices;
+    std::vector< GLuint > indices;
+    const glm::vec3 trunk( 0.35f, 0.22f, 0.1f );
+    const glm::vec3 crown( 0.1f, 0.35f, 0.12f );
+    addCone( vertices, indices, 6, 0.f, 0.05f, 0.3f, 0.05f, trunk );
+    addCone( vertices, indices, 8, 0.2f, 0.35f, 0.75f, 0.f, crown );
+    addCone( vertices, indices, 8, 0.5f, 0.25f, 1.f, 0.f, crown );
+    numberOfMeshIndices = static_cast< int >( indices.size() );
+
+    const GLsizeiptr instanceSize = 3 * sizeof( glm::vec4 );
+
+    glGenBuffers( 1, &mMeshVertexBuffer );
+    glBindBuffer( GL_ARRAY_BUFFER, mMeshVertexBuffer );
+    glBufferData( GL_ARRAY_BUFFER, vertices.size() * sizeof( MeshVertex ), vertices.data(), GL_STATIC_DRAW );
+
+    glGenVertexArrays( 1, &mMeshVertexArray );
+    glBindVertexArray( mMeshVertexArray );
+    glVertexAttribPointer( 0, 3, GL_FLOAT, GL_FALSE, sizeof( MeshVertex ), (void*)0 );
+    glEnableVertexAttribArray( 0 );
+    glVertexAttribPointer( 1, 3, GL_FLOAT, GL_FALSE, sizeof( MeshVertex ), (void*)sizeof( glm::vec3 ) );
+    glEnableVertexAttribArray( 1 );
+    glVertexAttribPointer( 2, 3, GL_FLOAT, GL_FALSE, sizeof( MeshVertex ), (void*)( 2 * sizeof( glm::vec3 ) ) );
+    glEnableVertexAttribArray( 2 );
+    glBindBuffer( GL_ARRAY_BUFFER, mMeshInstanceBuffers[ 0 ] );
+    for ( int r = 0; r < 3; ++r )
+    {
+        glVertexAttribPointer( 3 + r, 4, GL_FLOAT, GL_FALSE, instanceSize, (void*)( r * sizeof( glm::vec4 ) ) );
+        glEnableVertexAttribArray( 3 + r );
+        glVertexAttribDivisor( 3 + r, 1 );
+    }
+    glGenBuffers( 1, &mMeshIndexBuffer );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, mMeshIndexBuffer );
+    glBufferData( GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof( GLuint ), indices.data(), GL_STATIC_DRAW );
+    glBindVertexArray( 0 );
+
+    const glm::vec2 corners[ 4 ] = { glm::vec2( 0.f, 0.f ), glm::vec2( 1.f, 0.f ), glm::vec2( 0.f, 1.f ), glm::vec2( 1.f, 1.f ) };
+    glGenBuffers( 1, &mImpostorVertexBuffer );
+    glBindBuffer( GL_ARRAY_BUFFER, mImpostorVertexBuffer );
+    glBufferData( GL_ARRAY_BUFFER, sizeof( corners ), corners, GL_STATIC_DRAW );
+
+    glGenVertexArrays( 1, &mImpostorVertexArray );
+    glBindVertexArray( mImpostorVertexArray );
+    glVertexAttribPointer( 0, 2, GL_FLOAT, GL_FALSE, 0, 0 );
+    glEnableVertexAttribArray( 0 );
+    glBindBuffer( GL_ARRAY_BUFFER, mImpostorInstanceBuffers[ 0 ] );
+    for ( int r = 0; r < 3; ++r )
+    {
+        glVertexAttribPointer( 3 + r, 4, GL_FLOAT, GL_FALSE, instanceSize, (void*)( r * sizeof( glm::vec4 ) ) );
+        glEnableVertexAttribArray( 3 + r );
+        glVertexAttribDivisor( 3 + r, 1 );
+    }
+    glBindVertexArray( 0 );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+/******************************************************************************
+ * Local rectangle of a tile (row along j, as the terrain grid)
+ ******************************************************************************/
+void Vegetation::tileRectangle( int tile, glm::vec2& localMin, glm::vec2& localMax ) const
+{
+    const float size = 2.f / tilesPerSide;
+    const int tj = tile / tilesPerSide;
+    const int ti = tile % tilesPerSide;
+    localMin = glm::vec2( -1.f + tj * size, -1.f + ti * size );
+    localMax = localMin + glm::vec2( size );
+}
+
+/******************************************************************************
+ * Generate the instances of a tile
+ *
+ * One candidate per cell of a candidatesPerTileSide grid, jittered in its
+ * cell. Heights and normals come from one batch query; the candidates kept by
+ * the rules are placed on the ground with a random yaw and height.
+ ******************************************************************************/
+void Vegetation::generate( int tile, const HeightPyramid& heightfield, const glm::mat4& terrainMatrix, Tile& data ) const
+{
+    glm::vec2 localMin;
+    glm::vec2 localMax;
+    tileRectangle( tile, localMin, localMax );
+    const float cellSize = ( localMax.x - localMin.x ) / candidatesPerTileSide;
+
+    const int count = candidatesPerTileSide * candidatesPerTileSide;
+    std::vector< float > x( count );
+    std::vector< float > z( count );
+    for ( int c = 0; c < count; ++c )
+    {
+        const int cj = c / candidatesPerTileSide;
+        const int ci = c % candidatesPerTileSide;
+        x[ c ] = localMin.x + ( cj + random01( hash( seed, tile, c, 0 ) ) ) * cellSize;
+        z[ c ] = localMin.y + ( ci + random01( hash( seed, tile, c, 1 ) ) ) * cellSize;
+    }
+
+    std::vector< float > heights( count );
+    std::vector< glm::vec3 > normals( count );
+    GroundPlacement::sampleGround( heightfield, x.data(), z.data(), count, heights.data(), normals.data() );
+
+    // Density rules
+    std::vector< glm::vec2 > positions;
+    std::vector< float > yaws;
+    std::vector< float > scales;
+    for ( int c = 0; c < count; ++c )
+    {
+        const float bandHeight = heights[ c ] + 1.f;
+        if ( bandHeight < heightBand.x || bandHeight >= heightBand.y )
+            continue;
+        if ( normals[ c ].y < minimumNormalY )
+            continue;
+        if ( random01( hash( seed, tile, c, 2 ) ) >= density )
+            continue;
+
+        const glm::vec4 world = terrainMatrix * glm::vec4( x[ c ], 0.f, z[ c ], 1.f );
+        positions.push_back( glm::vec2( world.x, world.z ) );
+        yaws.push_back( 2.f * 3.14159265f * random01( hash( seed, tile, c, 3 ) ) );
+        scales.push_back( scaleRange.x + ( scaleRange.y - scaleRange.x ) * random01( hash( seed, tile, c, 4 ) ) );
+    }
+
+    std::vector< glm::mat4 > transforms;
+    GroundPlacement::placeInstances( heightfield, terrainMatrix, positions, yaws, normalAlignment, transforms );
+
+    data.instances.clear();
+    data.instances.reserve( 3 * transforms.size() );
+    data.boundsMin = glm::vec3( 1e30f );
+    data.boundsMax = glm::vec3( -1e30f );
+    for ( size_t n = 0; n < transforms.size(); ++n )
+    {
+        const glm::mat4 transform = glm::scale( transforms[ n ], glm::vec3( scales[ n ] ) );
+        for ( int r = 0; r < 3; ++r )
+        {
+            data.instances.push_back( glm::vec4( transform[ 0 ][ r ], transform[ 1 ][ r ], transform[ 2 ][ r ], transform[ 3 ][ r ] ) );
+        }
+
+        const glm::vec3 center( transform * glm::vec4( TreeCenter, 1.f ) );
+        const float radius = TreeRadius * scales[ n ];
+        data.boundsMin = glm::min( data.boundsMin, center - glm::vec3( radius ) );
+        data.boundsMax = glm::max( data.boundsMax, center + glm::vec3( radius ) );
+    }
+}
+
+/******************************************************************************
+ * Tiles residency
+ ******************************************************************************/
+void Vegetation::evict( int tile )
+{
+    Tile& data = tiles[ tile ];
+    if ( data.slot < 0 )
+        return;
+
+    freeSlots.push_back( data.slot );
+    data.slot = -1;
+    // - release the memory, the tile is generated again when needed
+    std::vector< glm::vec4 >().swap( data.instances );
+    --numberOfResidentTiles;
+}
+
+void Vegetation::clear()
+{
+    for ( size_t t = 0; t < tiles.size(); ++t )
+    {
+        evict( static_cast< int >( t ) );
+    }
+}
+
+void Vegetation::invalidate( const glm::vec2& localMin, const glm::vec2& localMax )
+{
+    for ( size_t t = 0; t < tiles.size(); ++t )
+    {
+        glm::vec2 tileMin;
+        glm::vec2 tileMax;
+        tileRectangle( static_cast< int >( t ), tileMin, tileMax );
+        if ( tileMin.x <= localMax.x && tileMax.x >= localMin.x && tileMin.y <= localMax.y && tileMax.y >= localMin.y )
+        {
+            evict( static_cast< int >( t ) );
+        }
+    }
+}
+
+/******************************************************************************
+ * Update
+ *
+ * Tiles within farDistance are wanted; the nearest missing ones are
+ * generated (a few per frame), taking the slot of the least recently wanted
+ * tile when none is free. The wanted tiles inside the frustum are then culled
+ * instance by instance.
+ ******************************************************************************/
+void Vegetation::update( const HeightPyramid& heightfield, const glm::mat4& terrainMatrix, const glm::vec3& cameraPosition,
+                         const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix )
+{
+    numberOfVisibleTiles = 0;
+    numberOfMeshInstances = 0;
+    numberOfImpostorInstances = 0;
+    if ( !enabled || tiles.empty() )
+        return;
+
+    ++frame;
+
+    // Instances are stored in world space
+    if ( terrainMatrix != mTerrainMatrix )
+    {
+        clear();
+        mTerrainMatrix = terrainMatrix;
+    }
+
+    // Wanted tiles (world distance of the camera to the tile rectangle)
+    std::vector< std::pair< float, int > > missing;
+    for ( size_t t = 0; t < tiles.size(); ++t )
+    {
+        glm::vec2 localMin;
+        glm::vec2 localMax;
+        tileRectangle( static_cast< int >( t ), localMin, localMax );
+        const glm::vec3 corner0( terrainMatrix * glm::vec4( localMin.x, 0.f, localMin.y, 1.f ) );
+        const glm::vec3 corner1( terrainMatrix * glm::vec4( localMax.x, 0.f, localMax.y, 1.f ) );
+        const glm::vec2 worldMin = glm::min( glm::vec2( corner0.x, corner0.z ), glm::vec2( corner1.x, corner1.z ) );
+        const glm::vec2 worldMax = glm::max( glm::vec2( corner0.x, corner0.z ), glm::vec2( corner1.x, corner1.z ) );
+        const glm::vec2 camera( cameraPosition.x, cameraPosition.z );
+        const float distance = glm::length( camera - glm::clamp( camera, worldMin, worldMax ) );
+        if ( distance > farDistance )
+            continue;
+
+        if ( tiles[ t ].slot >= 0 )
+            tiles[ t ].lastFrame = frame;
+        else
+            missing.push_back( std::make_pair( distance, static_cast< int >( t ) ) );
+    }
+
+    // Generate the nearest missing tiles
+    std::sort( missing.begin(), missing.end() );
+    const int generated = std::min( static_cast< int >( missing.size() ), maxGeneratedTilesPerFrame );
+    for ( int m = 0; m < generated; ++m )
+    {
+        if ( freeSlots.empty() )
+        {
+            int oldest = -1;
+            for ( size_t t = 0; t < tiles.size(); ++t )
+            {
+                if ( tiles[ t ].slot >= 0 && tiles[ t ].lastFrame != frame && ( oldest < 0 || tiles[ t ].lastFrame < tiles[ oldest ].lastFrame ) )
+                    oldest = static_cast< int >( t );
+            }
+            if ( oldest < 0 )
+                break;
+            evict( oldest );
+        }
+
+        const int tile = missing[ m ].second;
+        Tile& data = tiles[ tile ];
+        generate( tile, heightfield, terrainMatrix, data );
+        data.slot = freeSlots.back();
+        freeSlots.pop_back();
+        data.lastFrame = frame;
+        ++numberOfResidentTiles;
+
+        if ( !data.instances.empty() )
+        {
+            const GLintptr offset = static_cast< GLintptr >( data.slot ) * instancesPerSlot * 3 * sizeof( glm::vec4 );
+            GLStateCache::bindArrayBuffer( mInstanceBuffer );
+            glBufferSubData( GL_ARRAY_BUFFER, offset, data.instances.size() * sizeof( glm::vec4 ), data.instances.data() );
+        }
+    }
+
+    // Tiles wanted this frame, not empty and inside the frustum
+    glm::vec4 planes[ 6 ];
+    frustumPlanes( projectionMatrix * viewMatrix, planes );
+    visibleTiles.clear();
+    for ( size_t t = 0; t < tiles.size(); ++t )
+    {
+        const Tile& data = tiles[ t ];
+        if ( data.slot < 0 || data.lastFrame != frame || data.instances.empty() )
+            continue;
+        if ( boxInFrustum( planes, data.boundsMin, data.boundsMax ) )
+            visibleTiles.push_back( static_cast< int >( t ) );
+    }
+    numberOfVisibleTiles = static_cast< int >( visibleTiles.size() );
+    if ( visibleTiles.empty() )
+    {
+        // - older culling outputs are out of date from now on
+        numberOfMeshInstances = 0;
+        numberOfImpostorInstances = 0;
+        std::fill( cullIssued, cullIssued + NumberOfCullSets, false );
+        drawSet = -1;
+        return;
+    }
+
+    if ( gpuCulling )
+        cullOnGpu( planes, cameraPosition );
+    else
+        cullOnCpu( planes, cameraPosition );
+}
+
+/******************************************************************************
+ * Instance culling with transform feedback
+ *
+ * One pass per level over the instances of the visible tiles, rasterizer
+ * off: the geometry shader writes only the instances inside the frustum and
+ * in the distance range of the level, into the next set of output buffers.
+ * The numbers written come back through queries; the draws use the newest
+ * set whose queries are available, without waiting. Only when none is (first
+ * frames, GPU more than two frames late) does the CPU wait for the oldest
+ * pass still pending.
+ ******************************************************************************/
+void Vegetation::cullOnGpu( const glm::vec4 planes[ 6 ], const glm::vec3& cameraPosition )
+{
+    GLint uniformLocation;
+
+    GLStateCache::useProgram( mCullShaderProgram );
+    uniformLocation = glGetUniformLocation( mCullShaderProgram, "frustumPlanes" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform4fv( uniformLocation, 6, glm::value_ptr( planes[ 0 ] ) );
+    }
+    uniformLocation = glGetUniformLocation( mCullShaderProgram, "cameraPosition" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform3fv( uniformLocation, 1, glm::value_ptr( cameraPosition ) );
+    }
+    uniformLocation = glGetUniformLocation( mCullShaderProgram, "boundingSphere" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform4f( uniformLocation, TreeCenter.x, TreeCenter.y, TreeCenter.z, TreeRadius );
+    }
+    const GLint lodRangeLocation = glGetUniformLocation( mCullShaderProgram, "lodRange" );
+
+    GLStateCache::bindVertexArray( mInstanceVertexArray );
+    GLStateCache::enable( GL_RASTERIZER_DISCARD );
+
+    cullSet = ( cullSet + 1 ) % NumberOfCullSets;
+    const GLuint outputs[ 2 ] = { mMeshInstanceBuffers[ cullSet ], mImpostorInstanceBuffers[ cullSet ] };
+    const glm::vec2 ranges[ 2 ] = { glm::vec2( 0.f, nearDistance ), glm::vec2( nearDistance, farDistance ) };
+    for ( int level = 0; level < 2; ++level )
+    {
+        glUniform2fv( lodRangeLocation, 1, glm::value_ptr( ranges[ level ] ) );
+        glBindBufferBase( GL_TRANSFORM_FEEDBACK_BUFFER, 0, outputs[ level ] );
+        glBeginQuery( GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, mCullQueries[ cullSet ][ level ] );
+        glBeginTransformFeedback( GL_POINTS );
+        for ( size_t v = 0; v < visibleTiles.size(); ++v )
+        {
+            const Tile& data = tiles[ visibleTiles[ v ] ];
+            glDrawArrays( GL_POINTS, data.slot * instancesPerSlot, static_cast< GLsizei >( data.instances.size() / 3 ) );
+        }
+        glEndTransformFeedback();
+        glEndQuery( GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN );
+    }
+    glBindBufferBase( GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0 );
+
+    GLStateCache::disable( GL_RASTERIZER_DISCARD );
+    cullIssued[ cullSet ] = true;
+
+    // Newest set with its counts known
+    for ( int k = 0; k < NumberOfCullSets; ++k )
+    {
+        if ( readCullCounts( ( cullSet - k + NumberOfCullSets ) % NumberOfCullSets, false ) )
+            return;
+    }
+
+    // - nothing drawable left: wait for the oldest pass still pending
+    for ( int k = NumberOfCullSets - 1; k >= 0; --k )
+    {
+        const int set = ( cullSet - k + NumberOfCullSets ) % NumberOfCullSets;
+        if ( readCullCounts( set, true ) )
+            return;
+    }
+}
+
+/******************************************************************************
+ * Counts of a culling output set, false when not issued (or not available
+ * yet when not waiting)
+ ******************************************************************************/
+bool Vegetation::readCullCounts( int set, bool wait )
+{
+    if ( !cullIssued[ set ] )
+        return false;
+
+    if ( !wait )
+    {
+        GLuint available[ 2 ] = { GL_FALSE, GL_FALSE };
+        glGetQueryObjectuiv( mCullQueries[ set ][ 0 ], GL_QUERY_RESULT_AVAILABLE, &available[ 0 ] );
+        glGetQueryObjectuiv( mCullQueries[ set ][ 1 ], GL_QUERY_RESULT_AVAILABLE, &available[ 1 ] );
+        if ( available[ 0 ] == GL_FALSE || available[ 1 ] == GL_FALSE )
+            return false;
+    }
+
+    GLuint written[ 2 ] = { 0, 0 };
+    glGetQueryObjectuiv( mCullQueries[ set ][ 0 ], GL_QUERY_RESULT, &written[ 0 ] );
+    glGetQueryObjectuiv( mCullQueries[ set ][ 1 ], GL_QUERY_RESULT, &written[ 1 ] );
+    numberOfMeshInstances = static_cast< int >( written[ 0 ] );
+    numberOfImpostorInstances = static_cast< int >( written[ 1 ] );
+    drawSet = set;
+    return true;
+}
+
+/******************************************************************************
+ * Instance culling on the CPU (same tests as the culling shaders)
+ ******************************************************************************/
+void Vegetation::cullOnCpu( const glm::vec4 planes[ 6 ], const glm::vec3& cameraPosition )
+{
+    meshInstances.clear();
+    impostorInstances.clear();
+    for ( size_t v = 0; v < visibleTiles.size(); ++v )
+    {
+        const std::vector< glm::vec4 >& instances = tiles[ visibleTiles[ v ] ].instances;
+        for ( size_t n = 0; n < instances.size(); n += 3 )
+        {
+            const glm::vec4& row0 = instances[ n ];
+            const glm::vec4& row1 = instances[ n + 1 ];
+            const glm::vec4& row2 = instances[ n + 2 ];
+
+            const float d = glm::distance( glm::vec3( row0.w, row1.w, row2.w ), cameraPosition );
+            if ( d >= farDistance )
+                continue;
+
+            const glm::vec4 c( TreeCenter, 1.f );
+            const glm::vec3 center( glm::dot( row0, c ), glm::dot( row1, c ), glm::dot( row2, c ) );
+            const float radius = TreeRadius * glm::length( glm::vec3( row0.y, row1.y, row2.y ) );
+            bool inside = true;
+            for ( int p = 0; p < 6 && inside; ++p )
+            {
+                inside = glm::dot( glm::vec3( planes[ p ] ), center ) + planes[ p ].w >= -radius;
+            }
+            if ( !inside )
+                continue;
+
+            std::vector< glm::vec4 >& kept = ( d < nearDistance ) ? meshInstances : impostorInstances;
+            kept.insert( kept.end(), instances.begin() + n, instances.begin() + n + 3 );
+        }
+    }
+
+    numberOfMeshInstances = static_cast< int >( meshInstances.size() / 3 );
+    numberOfImpostorInstances = static_cast< int >( impostorInstances.size() / 3 );
+    drawSet = 0;
+    if ( !meshInstances.empty() )
+    {
+        GLStateCache::bindArrayBuffer( mMeshInstanceBuffers[ 0 ] );
+        glBufferSubData( GL_ARRAY_BUFFER, 0, meshInstances.size() * sizeof( glm::vec4 ), meshInstances.data() );
+    }
+    if ( !impostorInstances.empty() )
+    {
+        GLStateCache::bindArrayBuffer( mImpostorInstanceBuffers[ 0 ] );
+        glBufferSubData( GL_ARRAY_BUFFER, 0, impostorInstances.size() * sizeof( glm::vec4 ), impostorInstances.data() );
+    }
+}
+
+/******************************************************************************
+ * Draw both levels
+ ******************************************************************************/
+void Vegetation::draw( const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix,
+                       const glm::vec3& lightPosition, const glm::vec3& lightColor ) const
+{
+    if ( !enabled )
+        return;
+
+    const GLuint programs[ 2 ] = { mMeshShaderProgram, mImpostorShaderProgram };
+    const int counts[ 2 ] = { numberOfMeshInstances, numberOfImpostorInstances };
+    const glm::vec3 cameraPosition( glm::inverse( viewMatrix )[ 3 ] );
+    for ( int level = 0; level < 2; ++level )
+    {
+        if ( counts[ level ] == 0 )
+            continue;
+
+        const GLuint program = programs[ level ];
+        GLint uniformLocation;
+
+        GLStateCache::useProgram( program );
+        uniformLocation = glGetUniformLocation( program, "viewMatrix" );
+        if ( uniformLocation >= 0 )
+        {
+            glUniformMatrix4fv( uniformLocation, 1, GL_FALSE, glm::value_ptr( viewMatrix ) );
+        }
+        uniformLocation = glGetUniformLocation( program, "projectionMatrix" );
+        if ( uniformLocation >= 0 )
+        {
+            glUniformMatrix4fv( uniformLocation, 1, GL_FALSE, glm::value_ptr( projectionMatrix ) );
+        }
+        uniformLocation = glGetUniformLocation( program, "lightPosition" );
+        if ( uniformLocation >= 0 )
+        {
+            glUniform3fv( uniformLocation, 1, glm::value_ptr( lightPosition ) );
+        }
+        uniformLocation = glGetUniformLocation( program, "lightColor" );
+        if ( uniformLocation >= 0 )
+        {
+            glUniform3fv( uniformLocation, 1, glm::value_ptr( lightColor ) );
+        }
+        uniformLocation = glGetUniformLocation( program, "cameraPosition" );
+        if ( uniformLocation >= 0 )
+        {
+            glUniform3fv( uniformLocation, 1, glm::value_ptr( cameraPosition ) );
+        }
+        uniformLocation = glGetUniformLocation( program, "impostorWidth" );
+        if ( uniformLocation >= 0 )
+        {
+            glUniform1f( uniformLocation, ImpostorWidth );
+        }
+
+        if ( level == 0 )
+        {
+            GLStateCache::bindVertexArray( mMeshVertexArray );
+            bindInstances( mMeshInstanceBuffers[ drawSet ] );
+            glDrawElementsInstanced( GL_TRIANGLES, numberOfMeshIndices, GL_UNSIGNED_INT, 0, counts[ level ] );
+        }
+        else
+        {
+            GLStateCache::bindVertexArray( mImpostorVertexArray );
+            bindInstances( mImpostorInstanceBuffers[ drawSet ] );
+            glDrawArraysInstanced( GL_TRIANGLE_STRIP, 0, 4, counts[ level ] );
+        }
+    }
+}
+
+/******************************************************************************
+ * Instance attributes (rows 3 to 5) of the bound vertex array from a kept
+ * instance buffer
+ ******************************************************************************/
+void Vegetation::bindInstances( GLuint buffer ) const
+{
+    const GLsizei instanceSize = 3 * sizeof( glm::vec4 );
+
+    GLStateCache::bindArrayBuffer( buffer );
+    for ( int r = 0; r < 3; ++r )
+    {
+        glVertexAttribPointer( 3 + r, 4, GL_FLOAT, GL_FALSE, instanceSize, (void*)( r * sizeof( glm::vec4 ) ) );
+    }
+}
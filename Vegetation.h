@@ -0,0 +1,158 @@
+#ifndef VEGETATION_H
+#define VEGETATION_H
+
+// STL
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Graphics
+// - GLEW (always before "gl.h")
+#include <GL/glew.h>
+// - GL
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+
+// glm
+#include <glm/glm.hpp>
+
+#include "HeightPyramid.h"
+
+/******************************************************************************
+ * Procedural vegetation
+ *
+ * The terrain is cut in square tiles. The instances of a tile are generated
+ * the first time the camera comes close enough: candidates jittered on a
+ * grid are kept by density rules (height band of the terrain shader grass,
+ * maximum slope) and placed on the ground. Everything derives from a hash of
+ * the seed and the tile, so a tile evicted to bound the memory comes back
+ * identical.
+ *
+ * Each frame the tiles are culled against the frustum on the CPU, then the
+ * instances of the visible tiles are culled one by one and split by distance
+ * (mesh near the camera, camera facing impostor further away): a transform
+ * feedback pass with a geometry shader writes the kept instances when the
+ * context supports it (GL 3.3), a CPU loop otherwise. Both levels are then
+ * drawn instanced. The GPU pass writes into a ring of output buffers and
+ * the draws take the newest one whose counts are already known, so the
+ * CPU never waits for the culling (the trees may lag a frame behind).
+ *
+ * Instance: affine transform stored as its first 3 rows (scale, tilt, yaw and
+ * position), tree base at the origin, height 1 along y.
+ ******************************************************************************/
+class Vegetation{
+public:
+    // - output buffers of the GPU culling (frames in flight)
+    static const int NumberOfCullSets = 3;
+
+    // - GLSL (#version 330): culling pass
+    static const std::string CullVertexShaderSource;
+    static const std::string CullGeometryShaderSource;
+
+    bool enabled;
+    // - GL 3.3 and culling program built (CPU culling otherwise)
+    bool gpuCulling;
+
+    // Density rules
+    // - tiles per side of the terrain and candidates per side of a tile
+    int tilesPerSide;
+    int candidatesPerTileSide;
+    // - fraction of the candidates kept where the rules pass
+    float density;
+    // - band of terrain shader heights (local height + 1) where vegetation grows
+    glm::vec2 heightBand;
+    // - lowest normal y (steeper slopes stay bare)
+    float minimumNormalY;
+    // - world height range of the trees
+    glm::vec2 scaleRange;
+    // - how much the trees lean with the slope (0: upright)
+    float normalAlignment;
+    unsigned int seed;
+
+    // Levels of detail (world distances): mesh up to nearDistance, impostor up to farDistance
+    float nearDistance;
+    float farDistance;
+
+    // Memory: resident tiles, tiles generated per frame
+    int maxResidentTiles;
+    int maxGeneratedTilesPerFrame;
+
+    // - last frame
+    int numberOfResidentTiles;
+    int numberOfVisibleTiles;
+    int numberOfMeshInstances;
+    int numberOfImpostorInstances;
+
+    // - programs
+    GLuint mCullShaderProgram;
+    GLuint mMeshShaderProgram;
+    GLuint mImpostorShaderProgram;
+    // - instances of the resident tiles, one fixed slot per tile
+    GLuint mInstanceBuffer;
+    GLuint mInstanceVertexArray;
+    // - kept instances of each level, per culling output set
+    GLuint mMeshInstanceBuffers[ NumberOfCullSets ];
+    GLuint mImpostorInstanceBuffers[ NumberOfCullSets ];
+    GLuint mCullQueries[ NumberOfCullSets ][ 2 ];
+    // - tree mesh and impostor quad
+    GLuint mMeshVertexBuffer;
+    GLuint mMeshIndexBuffer;
+    GLuint mMeshVertexArray;
+    GLuint mImpostorVertexBuffer;
+    GLuint mImpostorVertexArray;
+    int numberOfMeshIndices;
+
+    Vegetation();
+
+    // Methode d'initialisation
+    bool initializeVegetation();
+
+    // - generate the missing tiles around the camera, cull and split the instances (once per frame)
+    void update( const HeightPyramid& heightfield, const glm::mat4& terrainMatrix, const glm::vec3& cameraPosition,
+                 const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix );
+    // - forget the tiles over a terrain local rectangle (after an edit)
+    void invalidate( const glm::vec2& localMin, const glm::vec2& localMax );
+
+    // - both levels, forward shading with the main light
+    void draw( const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix,
+               const glm::vec3& lightPosition, const glm::vec3& lightColor ) const;
+
+private:
+    struct Tile{
+        // - instance buffer slot, -1 when not resident
+        int slot;
+        int lastFrame;
+        // - rows of the instance transforms (3 per instance)
+        std::vector< glm::vec4 > instances;
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+    };
+    // - every tile of the terrain (row along j)
+    std::vector< Tile > tiles;
+    std::vector< int > freeSlots;
+    std::vector< int > visibleTiles;
+    int instancesPerSlot;
+    int frame;
+    glm::mat4 mTerrainMatrix;
+    // - CPU culling output (reused every frame)
+    std::vector< glm::vec4 > meshInstances;
+    std::vector< glm::vec4 > impostorInstances;
+    // - GPU culling: set written last, sets with a culling pass issued, set drawn (-1: none)
+    int cullSet;
+    bool cullIssued[ NumberOfCullSets ];
+    int drawSet;
+
+    void generate( int tile, const HeightPyramid& heightfield, const glm::mat4& terrainMatrix, Tile& data ) const;
+    void evict( int tile );
+    void clear();
+    void tileRectangle( int tile, glm::vec2& localMin, glm::vec2& localMax ) const;
+    void cullOnGpu( const glm::vec4 planes[ 6 ], const glm::vec3& cameraPosition );
+    void cullOnCpu( const glm::vec4 planes[ 6 ], const glm::vec3& cameraPosition );
+    bool readCullCounts( int set, bool wait );
+    void bindInstances( GLuint buffer ) const;
+    void initializeMesh();
+};
+
+#endif
@@ -0,0 +1,779 @@
+#include "VirtualTexture.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <sstream>
+
+//SOIL
+#include "SOIL.h"
+
+#include "ShaderProgram.h"
+#include "GLStateCache.h"
+
+const std::string VirtualTexture::ShaderSource =
+    "precision highp usampler2D;\n"
+    "\n"
+    "// UNIFORM\n"
+    "// - per virtual page (mip level = pyramid level): cache page xy, level of the resident page\n"
+    "uniform usampler2D pageTable;\n"
+    "uniform sampler2D pageCache;\n"
+    "// - pages per side at the finest level, number of levels\n"
+    "uniform float virtualPages;\n"
+    "uniform int virtualLevels;\n"
+    "// - image uv to virtual uv (the pyramid is padded to a power of two)\n"
+    "uniform vec2 virtualScale;\n"
+    "// - tile size, border, page size (tile + borders), cache size (texels)\n"
+    "uniform vec4 pageCacheLayout;\n"
+    "uniform float virtualLodBias;\n"
+    "\n"
+    "// Pyramid level of a virtual uv\n"
+    "float virtualLevel( vec2 uv )\n"
+    "{\n"
+    "    vec2 texel = uv * virtualPages * pageCacheLayout.x;\n"
+    "    vec2 dx = dFdx( texel );\n"
+    "    vec2 dy = dFdy( texel );\n"
+    "    float lod = 0.5 * log2( max( dot( dx, dx ), dot( dy, dy ) ) ) + virtualLodBias;\n"
+    "    return clamp( floor( lod ), 0.0, float( virtualLevels - 1 ) );\n"
+    "}\n"
+    "\n"
+    "vec3 virtualTexture( vec2 imageUV )\n"
+    "{\n"
+    "    vec2 uv = clamp( imageUV * virtualScale, 0.0, 0.99999 );\n"
+    "    float level = virtualLevel( uv );\n"
+    "    uvec4 entry = texelFetch( pageTable, ivec2( uv * virtualPages / exp2( level ) ), int( level ) );\n"
+    "    vec2 inPage = fract( uv * virtualPages / exp2( float( entry.b ) ) );\n"
+    "    vec2 texel = vec2( entry.rg ) * pageCacheLayout.z + pageCacheLayout.y + inPage * pageCacheLayout.x;\n"
+    "    return textureLod( pageCache, texel / pageCacheLayout.w, 0.0 ).rgb;\n"
+    "}\n";
+
+namespace
+{
+    // Read an RGB image of size x size texels, false if missing or of another size
+    bool readImage( const std::string& filename, int size, std::vector< unsigned char >& pixels )
+    {
+        int width;
+        int height;
+        unsigned char* image = SOIL_load_image( filename.c_str(), &width, &height, 0, SOIL_LOAD_RGB );
+        if ( image == nullptr )
+        {
+            return false;
+        }
+        const bool statusOK = ( width == size && height == size );
+        if ( statusOK )
+        {
+            pixels.assign( image, image + size * size * 3 );
+        }
+        SOIL_free_image_data( image );
+        return statusOK;
+    }
+}
+
+VirtualTexture::VirtualTexture(){
+    enabled = false;
+
+    imageWidth = 0;
+    imageHeight = 0;
+    tileSize = 128;
+    border = 4;
+    numberOfLevels = 0;
+    numberOfPages = 0;
+
+    cachePages = 16;
+    uploadsPerFrame = 8;
+    feedbackDivisor = 8;
+
+    mPageTableTexture = 0;
+    mPageCacheTexture = 0;
+    mFeedbackFramebuffer = 0;
+    mFeedbackColorTexture = 0;
+    mFeedbackDepthRenderbuffer = 0;
+    mFeedbackShaderProgram = 0;
+
+    numberOfResidentPages = 0;
+    numberOfRequestedPages = 0;
+
+    frameIndex = 0;
+    pageTableDirty = false;
+
+    mFeedbackPixelBuffers[ 0 ] = 0;
+    mFeedbackPixelBuffers[ 1 ] = 0;
+    feedbackWidth = 0;
+    feedbackHeight = 0;
+    feedbackPending[ 0 ] = false;
+    feedbackPending[ 1 ] = false;
+
+    stopLoader = false;
+    numberOfDecodingTiles = 0;
+}
+
+VirtualTexture::~VirtualTexture(){
+    if ( loaderThread.joinable() )
+    {
+        {
+            std::lock_guard< std::mutex > lock( loaderMutex );
+            stopLoader = true;
+        }
+        loaderCondition.notify_all();
+        loaderThread.join();
+    }
+}
+
+int VirtualTexture::pageIndex( int level, int x, int y ) const
+{
+    return levelOffsets[ level ] + y * ( numberOfPages >> level ) + x;
+}
+
+void VirtualTexture::pageCoordinates( int page, int& level, int& x, int& y ) const
+{
+    level = 0;
+    while ( level + 1 < numberOfLevels && page >= levelOffsets[ level + 1 ] )
+    {
+        ++level;
+    }
+    const int pages = numberOfPages >> level;
+    x = ( page - levelOffsets[ level ] ) % pages;
+    y = ( page - levelOffsets[ level ] ) / pages;
+}
+
+std::string VirtualTexture::tileFilename( int level, int x, int y ) const
+{
+    std::ostringstream filename;
+    filename << directory << "/tile_" << level << "_" << x << "_" << y << ".tga";
+    return filename.str();
+}
+
+/******************************************************************************
+ * Initialize virtual texture
+ * - stays disabled (without error) when the directory holds no pyramid
+ ******************************************************************************/
+bool VirtualTexture::initializeVirtualTexture( const std::string& pDirectory )
+{
+    std::cout << "Initialize virtual texture..." << std::endl;
+
+    directory = pDirectory;
+
+    std::ifstream description( ( directory + "/pyramid.txt" ).c_str() );
+    if ( !( description >> imageWidth >> imageHeight >> tileSize >> border >> numberOfLevels ) || numberOfLevels < 1 || numberOfLevels > 9 )
+    {
+        std::cout << "- no tile pyramid in " << directory << ": virtual texture desactif" << std::endl;
+        enabled = false;
+        return true;
+    }
+    numberOfPages = 1 << ( numberOfLevels - 1 );
+
+    const int pageSize = tileSize + 2 * border;
+
+    // Cache size is bounded by the GL limit
+    GLint maxTextureSize = 0;
+    glGetIntegerv( GL_MAX_TEXTURE_SIZE, &maxTextureSize );
+    cachePages = std::max( 1, std::min( cachePages, static_cast< int >( maxTextureSize ) / pageSize ) );
+
+    // Virtual pages of all levels
+    levelOffsets.resize( numberOfLevels );
+    int numberOfVirtualPages = 0;
+    for ( int level = 0; level < numberOfLevels; ++level )
+    {
+        levelOffsets[ level ] = numberOfVirtualPages;
+        numberOfVirtualPages += ( numberOfPages >> level ) * ( numberOfPages >> level );
+    }
+    pageSlots.assign( numberOfVirtualPages, Absent );
+    pageRequestFrames.assign( numberOfVirtualPages, 0 );
+    pageTable.resize( numberOfVirtualPages * 4 );
+
+    slotPages.assign( cachePages * cachePages, -1 );
+    slotFrames.assign( cachePages * cachePages, 0 );
+
+    // Physical page cache
+    glGenTextures( 1, &mPageCacheTexture );
+    GLStateCache::bindTexture( PageCacheTextureUnit, GL_TEXTURE_2D, mPageCacheTexture );
+    glTexImage2D( GL_TEXTURE_2D, 0, GL_RGB8, cachePages * pageSize, cachePages * pageSize, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+
+    // Page table: one mip level per pyramid level
+    glGenTextures( 1, &mPageTableTexture );
+    GLStateCache::bindTexture( PageTableTextureUnit, GL_TEXTURE_2D, mPageTableTexture );
+    for ( int level = 0; level < numberOfLevels; ++level )
+    {
+        glTexImage2D( GL_TEXTURE_2D, level, GL_RGBA8UI, numberOfPages >> level, numberOfPages >> level, 0, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, nullptr );
+    }
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, numberOfLevels - 1 );
+
+    // The coarsest page is loaded now and never evicted: every page has a fallback
+    Tile root;
+    root.page = pageIndex( numberOfLevels - 1, 0, 0 );
+    if ( ! readImage( tileFilename( numberOfLevels - 1, 0, 0 ), pageSize, root.pixels ) )
+    {
+        std::cout << "Error: virtual texture: cannot read " << tileFilename( numberOfLevels - 1, 0, 0 ) << std::endl;
+        return false;
+    }
+    uploadTile( root );
+    uploadPageTable();
+
+    if ( ! initializeFeedback() )
+    {
+        return false;
+    }
+
+    stopLoader = false;
+    loaderThread = std::thread( &VirtualTexture::loadTiles, this );
+
+    std::cout << "- " << imageWidth << "x" << imageHeight << ", " << numberOfLevels << " levels, "
+              << cachePages * cachePages << " cache pages of " << tileSize << "+" << 2 * border << " texels" << std::endl;
+
+    enabled = true;
+
+    return true;
+}
+
+/******************************************************************************
+ * Initialize feedback shader program and read back buffers
+ * - the framebuffer is allocated at the first beginFeedback()
+ ******************************************************************************/
+bool VirtualTexture::initializeFeedback()
+{
+    // Vertex shader
+    const char* vertexShaderSource =
+        "#version 300 es\n"
+        "\n"
+        "// INPUT\n"
+        "layout (location = 0) in vec3 position;\n"
+        "\n"
+        "// UNIFORM\n"
+        "uniform mat4 viewMatrix;\n"
+        "uniform mat4 projectionMatrix;\n"
+        "uniform mat4 modelMatrix;\n"
+        "\n"
+        "// OUTPUT\n"
+        "out vec2 imageUV;\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    imageUV = position.xz * 0.5 + 0.5;\n"
+        "    gl_Position = projectionMatrix * viewMatrix * modelMatrix * vec4( position, 1.0 );\n"
+        "}\n";
+
+    // Fragment shader
+    // - page x, page y, level (8 bits each), alpha 0 where nothing is drawn
+    const std::string fragmentShaderSource =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "\n"
+        + ShaderSource +
+        "\n"
+        "// INPUT\n"
+        "in vec2 imageUV;\n"
+        "\n"
+        "// OUTPUT\n"
+        "layout( location = 0 ) out vec4 fragmentColor;\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    vec2 uv = clamp( imageUV * virtualScale, 0.0, 0.99999 );\n"
+        "    float level = virtualLevel( uv );\n"
+        "    vec2 page = floor( uv * virtualPages / exp2( level ) );\n"
+        "    fragmentColor = vec4( page, level, 255.0 ) / 255.0;\n"
+        "}\n";
+
+    mFeedbackShaderProgram = ShaderProgram::create( vertexShaderSource, fragmentShaderSource.c_str(), "virtual texture feedback" );
+
+    glGenBuffers( 2, mFeedbackPixelBuffers );
+
+    return mFeedbackShaderProgram != 0;
+}
+
+void VirtualTexture::resizeFeedback( int width, int height )
+{
+    feedbackWidth = width;
+    feedbackHeight = height;
+
+    if ( mFeedbackFramebuffer == 0 )
+    {
+        glGenFramebuffers( 1, &mFeedbackFramebuffer );
+        glGenTextures( 1, &mFeedbackColorTexture );
+        glGenRenderbuffers( 1, &mFeedbackDepthRenderbuffer );
+    }
+
+    GLStateCache::bindTexture( PageCacheTextureUnit, GL_TEXTURE_2D, mFeedbackColorTexture );
+    glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+
+    glBindRenderbuffer( GL_RENDERBUFFER, mFeedbackDepthRenderbuffer );
+    glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height );
+    glBindRenderbuffer( GL_RENDERBUFFER, 0 );
+
+    GLStateCache::bindFramebuffer( mFeedbackFramebuffer );
+    glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mFeedbackColorTexture, 0 );
+    glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mFeedbackDepthRenderbuffer );
+    if ( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE )
+    {
+        std::cout << "Error: virtual texture feedback framebuffer is incomplete" << std::endl;
+    }
+
+    // Read backs of the old size are dropped
+    for ( int b = 0; b < 2; ++b )
+    {
+        glBindBuffer( GL_PIXEL_PACK_BUFFER, mFeedbackPixelBuffers[ b ] );
+        glBufferData( GL_PIXEL_PACK_BUFFER, width * height * 4, nullptr, GL_STREAM_READ );
+        feedbackSizes[ b ][ 0 ] = width;
+        feedbackSizes[ b ][ 1 ] = height;
+        feedbackPending[ b ] = false;
+    }
+    glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+}
+
+/******************************************************************************
+ * Feedback pass
+ ******************************************************************************/
+void VirtualTexture::beginFeedback( int width, int height )
+{
+    const int w = std::max( 1, width / feedbackDivisor );
+    const int h = std::max( 1, height / feedbackDivisor );
+    if ( w != feedbackWidth || h != feedbackHeight )
+    {
+        resizeFeedback( w, h );
+    }
+
+    GLStateCache::bindFramebuffer( mFeedbackFramebuffer );
+    GLStateCache::viewport( 0, 0, feedbackWidth, feedbackHeight );
+    glClearColor( 0.f, 0.f, 0.f, 0.f );
+    glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+}
+
+void VirtualTexture::endFeedback( int width, int height )
+{
+    // Read this frame asynchronously, process the previous one
+    const int current = frameIndex % 2;
+    const int previous = 1 - current;
+
+    glBindBuffer( GL_PIXEL_PACK_BUFFER, mFeedbackPixelBuffers[ current ] );
+    glPixelStorei( GL_PACK_ALIGNMENT, 4 );
+    glReadPixels( 0, 0, feedbackWidth, feedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, nullptr );
+    feedbackPending[ current ] = true;
+
+    if ( feedbackPending[ previous ] )
+    {
+        const int w = feedbackSizes[ previous ][ 0 ];
+        const int h = feedbackSizes[ previous ][ 1 ];
+        glBindBuffer( GL_PIXEL_PACK_BUFFER, mFeedbackPixelBuffers[ previous ] );
+        const void* pixels = glMapBufferRange( GL_PIXEL_PACK_BUFFER, 0, w * h * 4, GL_MAP_READ_BIT );
+        if ( pixels != nullptr )
+        {
+            processFeedback( static_cast< const unsigned char* >( pixels ), w, h );
+            glUnmapBuffer( GL_PIXEL_PACK_BUFFER );
+        }
+        feedbackPending[ previous ] = false;
+    }
+    glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+
+    GLStateCache::bindFramebuffer( 0 );
+    GLStateCache::viewport( 0, 0, width, height );
+}
+
+/******************************************************************************
+ * Mark the pages seen in a feedback image and request the missing ones
+ *
+ * Resident pages (and their ancestors used as fallback) are marked as used
+ * this frame. Requests of previous frames still waiting are dropped: the
+ * loader always works on what the camera needs now, coarse levels first.
+ ******************************************************************************/
+void VirtualTexture::processFeedback( const unsigned char* pixels, int width, int height )
+{
+    {
+        std::lock_guard< std::mutex > lock( loaderMutex );
+        for ( size_t r = 0; r < requests.size(); ++r )
+        {
+            pageSlots[ requests[ r ] ] = Absent;
+        }
+        requests.clear();
+    }
+
+    std::vector< int > newRequests;
+    for ( int p = 0; p < width * height; ++p )
+    {
+        const unsigned char* pixel = pixels + 4 * p;
+        if ( pixel[ 3 ] == 0 || pixel[ 2 ] >= numberOfLevels )
+            continue;
+
+        int level = pixel[ 2 ];
+        int x = pixel[ 0 ];
+        int y = pixel[ 1 ];
+        if ( x >= ( numberOfPages >> level ) || y >= ( numberOfPages >> level ) )
+            continue;
+
+        for ( ; level < numberOfLevels; ++level, x /= 2, y /= 2 )
+        {
+            const int page = pageIndex( level, x, y );
+            if ( pageRequestFrames[ page ] == frameIndex )
+                break;
+            pageRequestFrames[ page ] = frameIndex;
+
+            if ( pageSlots[ page ] >= 0 )
+            {
+                slotFrames[ pageSlots[ page ] ] = frameIndex;
+            }
+            else if ( pageSlots[ page ] == Absent )
+            {
+                newRequests.push_back( page );
+            }
+        }
+    }
+
+    // Coarse levels first (their pages have the highest indices)
+    std::sort( newRequests.begin(), newRequests.end(), std::greater< int >() );
+    numberOfRequestedPages = static_cast< int >( newRequests.size() );
+
+    {
+        std::lock_guard< std::mutex > lock( loaderMutex );
+        for ( size_t r = 0; r < newRequests.size(); ++r )
+        {
+            pageSlots[ newRequests[ r ] ] = Loading;
+            requests.push_back( newRequests[ r ] );
+        }
+    }
+    loaderCondition.notify_one();
+}
+
+/******************************************************************************
+ * Loader thread: decode requested tiles until the object is destroyed
+ ******************************************************************************/
+void VirtualTexture::loadTiles()
+{
+    const int pageSize = tileSize + 2 * border;
+
+    for ( ;; )
+    {
+        Tile tile;
+        {
+            std::unique_lock< std::mutex > lock( loaderMutex );
+            loaderCondition.wait( lock, [this]() { return stopLoader || !requests.empty(); } );
+            if ( stopLoader )
+                return;
+            tile.page = requests.front();
+            requests.pop_front();
+            ++numberOfDecodingTiles;
+        }
+
+        int level;
+        int x;
+        int y;
+        pageCoordinates( tile.page, level, x, y );
+        if ( ! readImage( tileFilename( level, x, y ), pageSize, tile.pixels ) )
+        {
+            tile.pixels.clear();
+        }
+
+        std::lock_guard< std::mutex > lock( loaderMutex );
+        decodedTiles.push_back( std::move( tile ) );
+        --numberOfDecodingTiles;
+    }
+}
+
+/******************************************************************************
+ * Copy a decoded tile into a free or least recently used cache page
+ * - pages needed by the last feedback are kept, the tile waits otherwise
+ ******************************************************************************/
+void VirtualTexture::uploadTile( const Tile& tile )
+{
+    int slot = -1;
+    for ( int s = 0; s < static_cast< int >( slotPages.size() ); ++s )
+    {
+        // - slot 0 holds the coarsest page
+        if ( slotPages[ s ] < 0 )
+        {
+            slot = s;
+            break;
+        }
+        if ( s > 0 && slotFrames[ s ] + 1 < frameIndex && ( slot < 0 || slotFrames[ s ] < slotFrames[ slot ] ) )
+        {
+            slot = s;
+        }
+    }
+    if ( slot < 0 )
+    {
+        pageSlots[ tile.page ] = Absent;
+        return;
+    }
+
+    if ( slotPages[ slot ] >= 0 )
+    {
+        pageSlots[ slotPages[ slot ] ] = Absent;
+        --numberOfResidentPages;
+    }
+
+    const int pageSize = tileSize + 2 * border;
+    GLStateCache::bindTexture( PageCacheTextureUnit, GL_TEXTURE_2D, mPageCacheTexture );
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+    glTexSubImage2D( GL_TEXTURE_2D, 0, ( slot % cachePages ) * pageSize, ( slot / cachePages ) * pageSize, pageSize, pageSize, GL_RGB, GL_UNSIGNED_BYTE, tile.pixels.data() );
+
+    pageSlots[ tile.page ] = slot;
+    slotPages[ slot ] = tile.page;
+    slotFrames[ slot ] = frameIndex;
+    ++numberOfResidentPages;
+    pageTableDirty = true;
+}
+
+/******************************************************************************
+ * Rebuild the page table: absent pages point to their closest resident ancestor
+ ******************************************************************************/
+void VirtualTexture::uploadPageTable()
+{
+    GLStateCache::bindTexture( PageTableTextureUnit, GL_TEXTURE_2D, mPageTableTexture );
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+
+    for ( int level = numberOfLevels - 1; level >= 0; --level )
+    {
+        const int pages = numberOfPages >> level;
+        for ( int y = 0; y < pages; ++y )
+        {
+            for ( int x = 0; x < pages; ++x )
+            {
+                const int page = pageIndex( level, x, y );
+                unsigned char* entry = &pageTable[ 4 * page ];
+                const int slot = pageSlots[ page ];
+                if ( slot >= 0 )
+                {
+                    entry[ 0 ] = static_cast< unsigned char >( slot % cachePages );
+                    entry[ 1 ] = static_cast< unsigned char >( slot / cachePages );
+                    entry[ 2 ] = static_cast< unsigned char >( level );
+                    entry[ 3 ] = 255;
+                }
+                else if ( level + 1 < numberOfLevels )
+                {
+                    const unsigned char* parent = &pageTable[ 4 * pageIndex( level + 1, x / 2, y / 2 ) ];
+                    std::copy( parent, parent + 4, entry );
+                }
+            }
+        }
+        glTexSubImage2D( GL_TEXTURE_2D, level, 0, 0, pages, pages, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, &pageTable[ 4 * levelOffsets[ level ] ] );
+    }
+
+    pageTableDirty = false;
+}
+
+/******************************************************************************
+ * Upload the tiles decoded since the last frame (within the frame budget)
+ ******************************************************************************/
+void VirtualTexture::update()
+{
+    if ( ! enabled )
+    {
+        return;
+    }
+
+    ++frameIndex;
+
+    std::vector< Tile > tiles;
+    {
+        std::lock_guard< std::mutex > lock( loaderMutex );
+        const size_t n = std::min( decodedTiles.size(), static_cast< size_t >( uploadsPerFrame ) );
+        std::move( decodedTiles.begin(), decodedTiles.begin() + n, std::back_inserter( tiles ) );
+        decodedTiles.erase( decodedTiles.begin(), decodedTiles.begin() + n );
+    }
+
+    for ( size_t t = 0; t < tiles.size(); ++t )
+    {
+        if ( tiles[ t ].pixels.empty() )
+        {
+            std::cout << "Error: virtual texture: cannot read page " << tiles[ t ].page << std::endl;
+            pageSlots[ tiles[ t ].page ] = Missing;
+        }
+        else
+        {
+            uploadTile( tiles[ t ] );
+        }
+    }
+
+    if ( pageTableDirty )
+    {
+        uploadPageTable();
+    }
+}
+
+bool VirtualTexture::isStreaming()
+{
+    if ( ! enabled )
+    {
+        return false;
+    }
+
+    std::lock_guard< std::mutex > lock( loaderMutex );
+    return numberOfRequestedPages > 0 || ! requests.empty() || numberOfDecodingTiles > 0 || ! decodedTiles.empty();
+}
+
+/******************************************************************************
+ * Set the uniforms of a program using ShaderSource
+ * - sampler units are always set: samplers of different types must not share unit 0
+ ******************************************************************************/
+void VirtualTexture::setUniforms( GLuint program )
+{
+    GLint uniformLocation;
+
+    GLStateCache::useProgram( program );
+
+    uniformLocation = glGetUniformLocation( program, "pageTable" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1i( uniformLocation, PageTableTextureUnit );
+    }
+    uniformLocation = glGetUniformLocation( program, "pageCache" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1i( uniformLocation, PageCacheTextureUnit );
+    }
+    uniformLocation = glGetUniformLocation( program, "virtualPages" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1f( uniformLocation, static_cast< float >( numberOfPages ) );
+    }
+    uniformLocation = glGetUniformLocation( program, "virtualLevels" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1i( uniformLocation, numberOfLevels );
+    }
+    uniformLocation = glGetUniformLocation( program, "virtualScale" );
+    if ( uniformLocation >= 0 )
+    {
+        const float virtualSize = static_cast< float >( numberOfPages * tileSize );
+        glUniform2f( uniformLocation, imageWidth / virtualSize, imageHeight / virtualSize );
+    }
+    uniformLocation = glGetUniformLocation( program, "pageCacheLayout" );
+    if ( uniformLocation >= 0 )
+    {
+        const int pageSize = tileSize + 2 * border;
+        glUniform4f( uniformLocation, static_cast< float >( tileSize ), static_cast< float >( border ), static_cast< float >( pageSize ), static_cast< float >( cachePages * pageSize ) );
+    }
+    // - the feedback framebuffer is feedbackDivisor times smaller: same levels as the full frame
+    uniformLocation = glGetUniformLocation( program, "virtualLodBias" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1f( uniformLocation, ( program == mFeedbackShaderProgram ) ? -std::log2( static_cast< float >( feedbackDivisor ) ) : 0.f );
+    }
+}
+
+void VirtualTexture::bindTextures()
+{
+    GLStateCache::bindTexture( PageTableTextureUnit, GL_TEXTURE_2D, mPageTableTexture );
+    GLStateCache::bindTexture( PageCacheTextureUnit, GL_TEXTURE_2D, mPageCacheTexture );
+}
+
+/******************************************************************************
+ * Cut an image in a tile pyramid
+ *
+ * The image is padded (edge texels repeated) to a power of two number of
+ * tiles per side; each level halves the previous one. Tiles are saved with
+ * "border" texels of their neighbours on each side, so bilinear filtering
+ * never reads another cache page. The directory must exist.
+ ******************************************************************************/
+bool VirtualTexture::buildPyramid( const std::string& imageFilename, const std::string& pDirectory, int pTileSize, int pBorder )
+{
+    std::cout << "Build tile pyramid of " << imageFilename << "..." << std::endl;
+
+    int width;
+    int height;
+    unsigned char* image = SOIL_load_image( imageFilename.c_str(), &width, &height, 0, SOIL_LOAD_RGB );
+    if ( image == nullptr )
+    {
+        std::cout << "Error: SOIL loading error: " << SOIL_last_result() << std::endl;
+        return false;
+    }
+
+    int pages = 1;
+    int levels = 1;
+    while ( pages * pTileSize < std::max( width, height ) && pages < 256 )
+    {
+        pages *= 2;
+        ++levels;
+    }
+    if ( pages * pTileSize < std::max( width, height ) )
+    {
+        std::cout << "Warning: image cropped to " << pages * pTileSize << " texels (256 tiles per side)" << std::endl;
+        width = std::min( width, pages * pTileSize );
+        height = std::min( height, pages * pTileSize );
+    }
+
+    // Finest level, padded
+    int size = pages * pTileSize;
+    std::vector< unsigned char > level( size * size * 3 );
+    for ( int y = 0; y < size; ++y )
+    {
+        const int sy = std::min( y, height - 1 );
+        for ( int x = 0; x < size; ++x )
+        {
+            const int sx = std::min( x, width - 1 );
+            std::copy( image + 3 * ( sx + sy * width ), image + 3 * ( sx + sy * width ) + 3, &level[ 3 * ( x + y * size ) ] );
+        }
+    }
+    SOIL_free_image_data( image );
+
+    const int pageSize = pTileSize + 2 * pBorder;
+    std::vector< unsigned char > tile( pageSize * pageSize * 3 );
+    bool statusOK = true;
+
+    for ( int l = 0; l < levels && statusOK; ++l )
+    {
+        const int levelPages = pages >> l;
+        for ( int ty = 0; ty < levelPages && statusOK; ++ty )
+        {
+            for ( int tx = 0; tx < levelPages && statusOK; ++tx )
+            {
+                for ( int y = 0; y < pageSize; ++y )
+                {
+                    const int sy = std::min( std::max( ty * pTileSize + y - pBorder, 0 ), size - 1 );
+                    for ( int x = 0; x < pageSize; ++x )
+                    {
+                        const int sx = std::min( std::max( tx * pTileSize + x - pBorder, 0 ), size - 1 );
+                        std::copy( &level[ 3 * ( sx + sy * size ) ], &level[ 3 * ( sx + sy * size ) ] + 3, &tile[ 3 * ( x + y * pageSize ) ] );
+                    }
+                }
+
+                std::ostringstream filename;
+                filename << pDirectory << "/tile_" << l << "_" << tx << "_" << ty << ".tga";
+                if ( SOIL_save_image( filename.str().c_str(), SOIL_SAVE_TYPE_TGA, pageSize, pageSize, 3, tile.data() ) == 0 )
+                {
+                    std::cout << "Error: cannot write " << filename.str() << std::endl;
+                    statusOK = false;
+                }
+            }
+        }
+
+        // Next level: 2x2 box filter
+        if ( l + 1 < levels )
+        {
+            const int half = size / 2;
+            std::vector< unsigned char > next( half * half * 3 );
+            for ( int y = 0; y < half; ++y )
+                for ( int x = 0; x < half; ++x )
+                    for ( int c = 0; c < 3; ++c )
+                    {
+                        const int sum = level[ 3 * ( 2 * x + 2 * y * size ) + c ] + level[ 3 * ( 2 * x + 1 + 2 * y * size ) + c ]
+                                      + level[ 3 * ( 2 * x + ( 2 * y + 1 ) * size ) + c ] + level[ 3 * ( 2 * x + 1 + ( 2 * y + 1 ) * size ) + c ];
+                        next[ 3 * ( x + y * half ) + c ] = static_cast< unsigned char >( ( sum + 2 ) / 4 );
+                    }
+            level.swap( next );
+            size = half;
+        }
+    }
+
+    if ( statusOK )
+    {
+        std::ofstream description( ( pDirectory + "/pyramid.txt" ).c_str() );
+        description << width << " " << height << " " << pTileSize << " " << pBorder << " " << levels << std::endl;
+        statusOK = static_cast< bool >( description );
+    }
+
+    std::cout << "- " << levels << " levels, " << pages << "x" << pages << " tiles at the finest level" << std::endl;
+
+    return statusOK;
+}
@@ -0,0 +1,146 @@
+#ifndef VIRTUALTEXTURE_H
+#define VIRTUALTEXTURE_H
+
+// STL
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Graphics
+// - GLEW (always before "gl.h")
+#include <GL/glew.h>
+// - GL
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+
+/******************************************************************************
+ * Virtual texture
+ *
+ * A big image is cut in a pyramid of square tiles stored on disk
+ * ("tile_<level>_<x>_<y>.tga" plus a "pyramid.txt" description, see
+ * buildPyramid()). Only the tiles seen by the camera are resident, in the
+ * pages of a physical cache texture; a page table texture (one mip level per
+ * pyramid level) gives for each virtual page the cache page to sample, or the
+ * one of its closest resident ancestor while it is loading.
+ *
+ * Each frame a feedback pass renders the pages needed by the surface in a
+ * small framebuffer, read back one frame later (no stall). Missing pages are
+ * decoded by a background thread, then uploaded within a per frame budget,
+ * replacing the least recently used pages. The coarsest page always stays.
+ *
+ * Pages are addressed with 8 bits: up to 256 x 256 pages at the finest level.
+ ******************************************************************************/
+class VirtualTexture{
+public:
+    // - texture units used by the shaders
+    static const int PageTableTextureUnit = 6;
+    static const int PageCacheTextureUnit = 7;
+
+    // - GLSL: uniforms and "vec3 virtualTexture( uv )", uv in [0,1] over the image
+    static const std::string ShaderSource;
+
+    bool enabled;
+
+    // - pyramid
+    std::string directory;
+    int imageWidth;
+    int imageHeight;
+    int tileSize;
+    int border;
+    int numberOfLevels;
+    // - pages per side at the finest level (power of two)
+    int numberOfPages;
+
+    // - budget
+    int cachePages;
+    int uploadsPerFrame;
+    int feedbackDivisor;
+
+    GLuint mPageTableTexture;
+    GLuint mPageCacheTexture;
+    GLuint mFeedbackFramebuffer;
+    GLuint mFeedbackColorTexture;
+    GLuint mFeedbackDepthRenderbuffer;
+    GLuint mFeedbackShaderProgram;
+
+    // - statistics
+    int numberOfResidentPages;
+    int numberOfRequestedPages;
+
+    VirtualTexture();
+    ~VirtualTexture();
+
+    // Methode d'initialisation
+    bool initializeVirtualTexture( const std::string& pDirectory );
+
+    // - cut an image in a tile pyramid readable by initializeVirtualTexture() (whole image in memory)
+    static bool buildPyramid( const std::string& imageFilename, const std::string& pDirectory, int pTileSize, int pBorder );
+
+    // - upload decoded pages and the page table (GL thread, once per frame)
+    void update();
+    // - pages requested by the feedback are still loading (more frames are needed)
+    bool isStreaming();
+
+    // - feedback pass: draw the textured surfaces with mFeedbackShaderProgram in between
+    void beginFeedback( int width, int height );
+    void endFeedback( int width, int height );
+
+    void setUniforms( GLuint program );
+    void bindTextures();
+
+private:
+    struct Tile{
+        int page;
+        // - empty: the tile could not be read
+        std::vector< unsigned char > pixels;
+    };
+
+    // - per virtual page (all levels): cache slot, or one of the states below
+    enum { Absent = -1, Loading = -2, Missing = -3 };
+    std::vector< int > pageSlots;
+    std::vector< unsigned int > pageRequestFrames;
+    std::vector< int > levelOffsets;
+
+    // - per cache slot: virtual page (-1: free), last frame it was needed
+    std::vector< int > slotPages;
+    std::vector< unsigned int > slotFrames;
+
+    unsigned int frameIndex;
+    bool pageTableDirty;
+    std::vector< unsigned char > pageTable;
+
+    // - feedback read back through two pixel buffers
+    GLuint mFeedbackPixelBuffers[ 2 ];
+    int feedbackWidth;
+    int feedbackHeight;
+    int feedbackSizes[ 2 ][ 2 ];
+    bool feedbackPending[ 2 ];
+
+    // - loader thread
+    std::thread loaderThread;
+    std::mutex loaderMutex;
+    std::condition_variable loaderCondition;
+    std::deque< int > requests;
+    std::vector< Tile > decodedTiles;
+    int numberOfDecodingTiles;
+    bool stopLoader;
+
+    int pageIndex( int level, int x, int y ) const;
+    void pageCoordinates( int page, int& level, int& x, int& y ) const;
+    std::string tileFilename( int level, int x, int y ) const;
+
+    bool initializeFeedback();
+    void resizeFeedback( int width, int height );
+    void processFeedback( const unsigned char* pixels, int width, int height );
+    void uploadTile( const Tile& tile );
+    void uploadPageTable();
+    void loadTiles();
+};
+
+#endif
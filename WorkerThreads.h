@@ -0,0 +1,17 @@
+#ifndef WORKERTHREADS_H
+#define WORKERTHREADS_H
+
+// STL
+#include <algorithm>
+#include <thread>
+
+/******************************************************************************
+ * Number of threads used by the CPU side jobs (culling, light binning...)
+ * - size of the job system pool, and of the per thread data of the jobs
+ ******************************************************************************/
+inline unsigned int numberOfWorkerThreads()
+{
+    return std::max( 1u, std::thread::hardware_concurrency() );
+}
+
+#endif
@@ -10,7 +10,9 @@
 
 // System
 #include <cstdio>
+#include <cstdlib>
 #include <cmath>
+#include <limits>
 
 // Graphics
 // - GLEW (always before "gl.h")
@@ -45,6 +47,26 @@
 #include "SkyBox.h"
 #include "HeigthMap.h"
 #include "Picking.h"
+#include "GroundPlacement.h"
+#include "OcclusionBuffer.h"
+#include "PointLight.h"
+#include "DeferredRenderer.h"
+#include "LightClusters.h"
+#include "ShaderProgram.h"
+#include "ShadowMaps.h"
+#include "RenderGraph.h"
+#include "GLStateCache.h"
+#include "RenderQueue.h"
+#include "Materials.h"
+#include "Vegetation.h"
+#include "ModelImpostors.h"
+#include "SceneStore.h"
+#include "JobSystem.h"
+#include "Simulation.h"
+#include "FramePacer.h"
+#include "DynamicResolution.h"
+#include "TemporalAA.h"
+#include "PostProcess.h"
 
 
 
@@ -83,6 +105,8 @@ int numberOfIndices_;
 
 // Model3D
 Model3D model;
+// - one entity per mesh: components and per frame systems (transforms, culling, level of detail, picking)
+SceneStore sceneStore;
 //Texture
 GLuint mModelShaderProgram;
 
@@ -91,6 +115,65 @@ GLuint mModelShaderProgram;
 SkyBox CubeMap;
 
 HeigthMap terrain;
+// - height brush applied under the camera (local radius, height change per key press)
+HeigthMap::BrushMode brushMode = HeigthMap::BrushRaise;
+float brushRadius = 0.05f;
+float brushStrength = 0.02f;
+// - terrain point picked with the right button (local xz), else the brush goes under the camera
+glm::vec2 brushCenter;
+bool brushCenterPicked = false;
+// - camera collision: minimum height above the terrain
+float cameraGroundClearance = 0.2f;
+// - instanced trees scattered over the terrain tiles
+Vegetation vegetation;
+ModelImpostors impostors;
+
+// CPU occlusion culling (terrain occludes models)
+OcclusionBuffer occlusionBuffer;
+bool useOcclusionCulling = true;
+std::vector< bool > meshVisible;
+// - selection component of the scene store, per mesh (highlight)
+std::vector< bool > meshSelected;
+// - forward pass: meshes drawn as geometry / as impostors (reused each frame)
+std::vector< bool > meshDrawn;
+std::vector< bool > meshImpostor;
+
+// Deferred shading
+DeferredRenderer deferredRenderer;
+bool useDeferredShading = false;
+// - shader program writing the G-buffer for the model meshes
+GLuint geometryShaderProgram;
+// Clustered forward shading
+LightClusters lightClusters;
+bool useClusteredShading = false;
+// - shader program looping over the lights of the fragment cluster for the model meshes
+GLuint clusteredShaderProgram;
+
+// Cascaded shadow maps (forward path)
+ShadowMaps shadowMaps;
+// - per cascade visibility of the model meshes
+std::vector< bool > shadowCasterVisible;
+
+// Model draw items sorted by material key (reused every frame)
+RenderQueue modelQueue;
+
+// Frame passes (skybox, culling, shadows, shading paths)
+RenderGraph renderGraph;
+
+// Per-frame parameters shared by the render passes
+struct FrameParameters
+{
+    glm::mat4 projectionMatrix;
+    // - projection of the scene shading passes (sub-pixel jitter of the temporal anti-aliasing)
+    glm::mat4 sceneProjectionMatrix;
+    glm::mat4 modelMatrix;
+    int currentTime;
+};
+FrameParameters frame;
+
+// - dynamic point lights over the terrain
+std::vector< PointLight > lights;
+const int numberOfLights = 256;
 
 // Shader program
 GLuint shaderProgram;
@@ -106,14 +189,23 @@ float _cameraAspect;
 float _cameraZNear;
 float _cameraZFar;
 
-float Speed = 0.1f;
-
 float yaw = 0;
 float pitch = 0;
 float roll = 0;
 
 glm::mat4 viewMatrix =glm::mat4(1.0f);
 
+// Camera motion integrated at a fixed time step on the update thread
+Simulation simulation;
+// - when frames are drawn: on demand, target frame rate, vsync
+FramePacer framePacer;
+// - 3D scene rendered at a scale of the window fitting the GPU frame time budget
+DynamicResolution dynamicResolution;
+// - jittered scene accumulated over the frames (replaces the upscale when active)
+TemporalAA temporalAA;
+// - HDR composite, bloom, exposure and tone mapping to the back buffer
+PostProcess postProcess;
+
 bool isMousePressed = false;
 glm::vec2 mouseLastPosition;
 
@@ -152,8 +244,15 @@ bool checkExtensions();
 bool initializeArrayBuffer();
 bool initializeVertexArray();
 bool initializeShaderProgram();
+bool initializeGeometryShaderProgram();
+bool initializeClusteredShaderProgram();
+bool initializeRenderGraph();
+void initializeLights();
 void initializeCamera();
 bool finalize();
+void stopBackgroundWork();
+glm::mat4 terrainModelMatrix();
+void keepCameraAboveTerrain();
 
 
 /******************************************************************************
@@ -214,6 +313,11 @@ bool initialize()
         statusOK = initializeVertexArray();
     }
 
+    if ( statusOK )
+    {
+        statusOK = model.materials.initializeMaterials();
+    }
+
 
     if ( statusOK )
     {
@@ -230,12 +334,117 @@ bool initialize()
             statusOK = terrain.initializeHeigthMap();
     }
 
+    if ( statusOK )
+    {
+        statusOK = vegetation.initializeVegetation();
+    }
+
+    if ( statusOK )
+    {
+        statusOK = initializeGeometryShaderProgram();
+    }
+
+    if ( statusOK )
+    {
+        statusOK = deferredRenderer.initializeDeferredRenderer();
+    }
+
+    if ( statusOK )
+    {
+        statusOK = initializeClusteredShaderProgram();
+    }
+
+    if ( statusOK )
+    {
+        statusOK = lightClusters.initializeLightClusters();
+    }
+
+    if ( statusOK )
+    {
+        // Terrain cube (scaled like the skybox) is the whole scene
+        shadowMaps.sceneRadius = CubeMap.scale * std::sqrt( 3.f );
+        statusOK = shadowMaps.initializeShadowMaps();
+    }
+
+    if ( statusOK )
+    {
+        statusOK = impostors.initializeImpostors( model, vertexArrays );
+    }
+
+    if ( statusOK )
+    {
+        // One entity per model mesh (texture key: 0 no texture, else texture array + 1)
+        sceneStore.clear();
+        for ( int i = 0; i < model.nb_mesh; i++ )
+        {
+            const int material = model.meshMaterial[ i ];
+            const unsigned int texture = ( material >= 0 ) ? model.materials.materials[ material ].array + 1 : 0;
+            sceneStore.create( model.meshNode[ i ], static_cast< uint32_t >( i ), texture, model.bounds_min[ i ], model.bounds_max[ i ] );
+        }
+    }
+
+    if ( statusOK )
+    {
+        statusOK = dynamicResolution.initializeDynamicResolution();
+    }
+
+    if ( statusOK )
+    {
+        statusOK = temporalAA.initializeTemporalAA();
+    }
+
+    if ( statusOK )
+    {
+        statusOK = postProcess.initializePostProcess();
+    }
+
+    if ( statusOK )
+    {
+        statusOK = initializeRenderGraph();
+    }
+
+    if ( statusOK )
+    {
+        statusOK = framePacer.initializeFramePacer();
+    }
+
+    // Initialization changed the GL state directly
+    GLStateCache::invalidate();
+
+    initializeLights();
 
     initializeCamera();
 
     return statusOK;
 }
 
+/******************************************************************************
+ * Initialize the point lights
+ * - scattered just above the terrain surface (night scene)
+ ******************************************************************************/
+void initializeLights()
+{
+    std::cout << "Initialize lights..." << std::endl;
+
+    // Fixed seed: same scene at each launch
+    srand( 1 );
+
+    const int nb = terrain.gridResolution;
+    lights.resize( numberOfLights );
+    for ( int l = 0; l < numberOfLights; ++l )
+    {
+        const int j = rand() % nb;
+        const int i = rand() % nb;
+        // Same parametrization as the terrain grid, then terrain model matrix (scale)
+        const glm::vec3 position( ((float)j/(float)nb)*2-1, terrain.heigthAt( j, i, nb ), ((float)i/(float)nb)*2-1 );
+
+        PointLight& light = lights[ l ];
+        light.position = position * CubeMap.scale + glm::vec3( 0.f, 0.2f + 0.8f * rand() / (float)RAND_MAX, 0.f );
+        light.radius = 1.f + 2.f * rand() / (float)RAND_MAX;
+        light.color = 2.f * glm::vec3( rand() / (float)RAND_MAX, rand() / (float)RAND_MAX, rand() / (float)RAND_MAX );
+    }
+}
+
 /******************************************************************************
  * Initialize the camera
  ******************************************************************************/
@@ -265,6 +474,15 @@ bool finalize()
     return statusOK;
 }
 
+/******************************************************************************
+ * Stop the threads using the job system
+ * - at exit (GLUT exit path or end of main), before the job system is destroyed
+ ******************************************************************************/
+void stopBackgroundWork()
+{
+    terrain.horizonMap.stopBake();
+}
+
 /******************************************************************************
  * Check GL extensions
  ******************************************************************************/
@@ -619,6 +837,7 @@ bool initializeShaderProgram()
                 "// OUTPUT                                     \n"
                 "out vec4 vertexColor;                               \n"
                 "out vec2 uv;\n"
+                "out vec3 shadowEyePosition;\n"
                 "                                              \n"
                 "// MAIN                                       \n"
                 "void main( void )                             \n"
@@ -639,6 +858,7 @@ bool initializeShaderProgram()
                 "    vec3 L = normalize( eyeLightPosition.xyz - eyePosition.xyz );                      \n"
                 "    float diffuse = max( 0.0, dot( eyeNormal, L ) );                                   \n"
                 "    vertexColor = vec4( lightColor, 1.0 ) * vec4( materialKd, 1 ) * diffuse;                 \n"
+                "    shadowEyePosition = eyePosition.xyz;\n"
                 //"    vertexColor = vec4( lightColor, 1.0 ) * vec4( materialKd, 1 );                 \n"
                 "                                                                                       \n"
                 "#if 0                                                                                 \n"
@@ -657,18 +877,21 @@ bool initializeShaderProgram()
     };
 
     // Fragment shader
+    // - shadow and material code is inserted between the header and the main
     const char* fragmentShaderSource[] = {
         "#version 300 es                                  \n"
         "precision highp float;                           \n"
-        "                                               \n"
+        "                                               \n",
+        ShadowMaps::ShaderSource.c_str(),
+        MaterialLibrary::ShaderSource.c_str(),
         "                                               \n"
         "// INPUT                                       \n"
         "in vec4 vertexColor;                                 \n"
         "in vec2 uv;\n"
+        "in vec3 shadowEyePosition;\n"
         "                                               \n"
         "// UNIFORM                                     \n"
         "uniform vec3 meshColor;                        \n"
-        "uniform sampler2D diffuseTex; \n"
         "                                               \n"
         "// OUTPUT                                      \n"
         "layout( location = 0 ) out vec4 fragmentColor;     \n"
@@ -677,7 +900,7 @@ bool initializeShaderProgram()
         "void main( void )                              \n"
         "{                                                  \n"
         //" vec4 diffuse_color = vec4(vec2(uv.s,1.f-uv.t),0,1);\n"
-        "    fragmentColor = vertexColor;                     \n"
+        "    fragmentColor = vec4( materialAlbedo( uv ) * vertexColor.rgb * ( 0.3 + 0.7 * cascadedShadow( shadowEyePosition ) ), vertexColor.a );\n"
         "}                                                  \n"
     };
 
@@ -685,7 +908,7 @@ bool initializeShaderProgram()
 #if 1
     // Load from string
     glShaderSource( vertexShader, 1, vertexShaderSource, nullptr );
-    glShaderSource( fragmentShader, 1, fragmentShaderSource, nullptr );
+    glShaderSource( fragmentShader, 4, fragmentShaderSource, nullptr );
 #else
     // TEST
     // Load from files
@@ -694,7 +917,7 @@ bool initializeShaderProgram()
     getFileContent( vertexShaderFilename, vertexShaderFileContent );
     const char* sourceCode = vertexShaderFileContent.c_str();
     glShaderSource( vertexShader, 1, &sourceCode, nullptr );
-    glShaderSource( fragmentShader, 1, fragmentShaderSource, nullptr );
+    glShaderSource( fragmentShader, 4, fragmentShaderSource, nullptr );
 #endif
 
     glCompileShader( vertexShader );
@@ -742,105 +965,142 @@ bool initializeShaderProgram()
 }
 
 /******************************************************************************
- * Callback to display the scene
+ * Initialize geometry shader program (deferred shading)
+ * - model meshes write albedo and eye-space normal into the G-buffer
  ******************************************************************************/
-void display( void )
+bool initializeGeometryShaderProgram()
 {
-    // Timer info
-    const int currentTime = glutGet( GLUT_ELAPSED_TIME );
-
-    // Enable the Z-test in the OpenGL fixed pipeline
-    glEnable( GL_DEPTH_TEST );
-
-    //--------------------------------------------------------------------------------
-    // START frame
-    //--------------------------------------------------------------------------------
-    // Clear the color buffer (of the main framebuffer)
-    // - color used to clear
-    glClearColor( 0.f, 0.f, 0.f, 0.f );
-    glClearDepth( 1.f );
-    // - clear the "color" framebuffer
-    glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
-
-    //--------------------------------------------------------------------------------
-    // Camera
-    //--------------------------------------------------------------------------------
-    // Retrieve camera parameters
-    const glm::mat4 projectionMatrix = glm::perspective( _cameraFovY, _cameraAspect, _cameraZNear, _cameraZFar );
-
-    glm::mat4 matrixRoll  = glm::mat4(1.0f);
-    glm::mat4 matrixPitch = glm::mat4(1.0f);
-    glm::mat4 matrixYaw   = glm::mat4(1.0f);
+    // Vertex shader
+    const char* vertexShaderSource =
+        "#version 300 es\n"
+        "\n"
+        "// INPUT\n"
+        "layout (location = 0) in vec3 position;\n"
+        "layout (location = 1) in vec3 normal;\n"
+        "layout (location = 2) in vec2 tex;\n"
+        "\n"
+        "// UNIFORM\n"
+        "uniform mat4 viewMatrix;\n"
+        "uniform mat4 projectionMatrix;\n"
+        "uniform mat4 modelMatrix;\n"
+        "uniform mat3 normalMatrix;\n"
+        "\n"
+        "// OUTPUT\n"
+        "out vec3 eyeNormal;\n"
+        "out vec2 uv;\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    eyeNormal = normalMatrix * normal;\n"
+        "    uv = tex;\n"
+        "    gl_Position = projectionMatrix * viewMatrix * modelMatrix * vec4( position, 1.0 );\n"
+        "}\n";
 
-    matrixRoll  = glm::rotate(matrixRoll,  roll,  glm::vec3(0.0f, 0.0f, 1.0f));
-    matrixPitch = glm::rotate(matrixPitch, pitch, glm::vec3(1.0f, 0.0f, 0.0f));
-    matrixYaw   = glm::rotate(matrixYaw,  yaw,    glm::vec3(0.0f, 1.0f, 0.0f));
+    // Fragment shader
+    const std::string fragmentShaderSource =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "\n"
+        + MaterialLibrary::ShaderSource +
+        "\n"
+        "// INPUT\n"
+        "in vec3 eyeNormal;\n"
+        "in vec2 uv;\n"
+        "\n"
+        "// UNIFORM\n"
+        "uniform vec3 materialKd;\n"
+        "\n"
+        "// OUTPUT\n"
+        "layout( location = 0 ) out vec4 gAlbedo;\n"
+        "layout( location = 1 ) out vec4 gNormal;\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    gAlbedo = vec4( materialAlbedo( uv ) * materialKd, 1.0 );\n"
+        "    gNormal = vec4( normalize( eyeNormal ) * 0.5 + 0.5, 1.0 );\n"
+        "}\n";
+
+    geometryShaderProgram = ShaderProgram::create( vertexShaderSource, fragmentShaderSource.c_str(), "model geometry" );
+
+    return geometryShaderProgram != 0;
+}
 
-    glm::mat4 rotate = matrixRoll * matrixPitch * matrixYaw;
-    glm::mat4 translate = glm::mat4(1.0f);
-    translate = glm::translate(translate, -_cameraEye);
+/******************************************************************************
+ * Initialize clustered shader program (clustered forward shading)
+ * - model meshes lit per pixel by the lights of the fragment cluster
+ ******************************************************************************/
+bool initializeClusteredShaderProgram()
+{
+    // Vertex shader
+    const char* vertexShaderSource =
+        "#version 300 es\n"
+        "\n"
+        "// INPUT\n"
+        "layout (location = 0) in vec3 position;\n"
+        "layout (location = 1) in vec3 normal;\n"
+        "layout (location = 2) in vec2 tex;\n"
+        "\n"
+        "// UNIFORM\n"
+        "uniform mat4 viewMatrix;\n"
+        "uniform mat4 projectionMatrix;\n"
+        "uniform mat4 modelMatrix;\n"
+        "uniform mat3 normalMatrix;\n"
+        "\n"
+        "// OUTPUT\n"
+        "out vec3 eyePosition;\n"
+        "out vec3 eyeNormal;\n"
+        "out vec2 uv;\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    vec4 eye = viewMatrix * modelMatrix * vec4( position, 1.0 );\n"
+        "    eyePosition = eye.xyz;\n"
+        "    eyeNormal = normalMatrix * normal;\n"
+        "    uv = tex;\n"
+        "    gl_Position = projectionMatrix * eye;\n"
+        "}\n";
 
-    viewMatrix = rotate * translate;
+    // Fragment shader
+    const std::string fragmentShaderSource =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "\n"
+        + LightClusters::ShaderSource
+        + MaterialLibrary::ShaderSource +
+        "\n"
+        "// INPUT\n"
+        "in vec3 eyePosition;\n"
+        "in vec3 eyeNormal;\n"
+        "in vec2 uv;\n"
+        "\n"
+        "// UNIFORM\n"
+        "uniform vec3 materialKd;\n"
+        "\n"
+        "// OUTPUT\n"
+        "layout( location = 0 ) out vec4 fragmentColor;\n"
+        "\n"
+        "// MAIN\n"
+        "void main( void )\n"
+        "{\n"
+        "    fragmentColor = vec4( clusteredLighting( eyePosition, normalize( eyeNormal ), materialAlbedo( uv ) * materialKd ), 1.0 );\n"
+        "}\n";
+
+    clusteredShaderProgram = ShaderProgram::create( vertexShaderSource, fragmentShaderSource.c_str(), "model clustered" );
+
+    return clusteredShaderProgram != 0;
+}
 
+/******************************************************************************
+ * Draw the heigth map with the given shader program
+ ******************************************************************************/
+void drawTerrain( GLuint program, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, const glm::mat4& modelMatrix, const int currentTime )
+{
     GLint uniformLocation;
 
-    // Retrieve 3D model / scene parameters
-    glm::mat4 modelMatrix;
-    const bool useMeshAnimation = false; // TODO: use keyboard to activate/deactivate
-    if ( useMeshAnimation )
-    {
-        modelMatrix = glm::rotate( modelMatrix, static_cast< float >( currentTime ) * 0.001f, glm::vec3( 0.0f, 1.f, 0.f ) );
-    }
-
-
-    //--------------------------------------------------------------------------------
-    // Cubemap
-    //--------------------------------------------------------------------------------
-
-    // Activation de la cubemap
-    glActiveTexture( GL_TEXTURE0 );
-    glBindTexture(GL_TEXTURE_CUBE_MAP, CubeMap.texture );
-
-
-    // Set shader program
-    glUseProgram( CubeMap.mCubeMapShaderProgram );
-
-    // Model view projection matrix
-    uniformLocation = glGetUniformLocation( CubeMap.mCubeMapShaderProgram, "uModelViewProjectionMatrix" );
-    if ( uniformLocation >= 0 )
-    {
-            glm::mat4 modelMatrix = glm::mat4( 1.f );
-            modelMatrix = glm::scale( modelMatrix, glm::vec3( CubeMap.scale, CubeMap.scale, CubeMap.scale ) );
-            glm::mat4 MVP = projectionMatrix * viewMatrix * modelMatrix;
-            glUniformMatrix4fv( uniformLocation, 1/*count*/, GL_FALSE/*transpose*/, glm::value_ptr( MVP ) );
-    }
-
-    uniformLocation = glGetUniformLocation( CubeMap.mCubeMapShaderProgram, "skybox" );
-    if ( uniformLocation >= 0 )
-    {
-            glUniform1i(uniformLocation, 0);
-    }
-
-    // Modify GL state(s)
-    // ...
-    //glPolygonMode( GL_FRONT_AND_BACK, GL_LINE );
-
-    // Draw command
-    const GLsizei nbCubemapIndices = 6/*nb faces*/ * 2/*2 triangles per face*/ * 3/*nb indices per triangle*/;
-    glBindVertexArray( CubeMap.mCubemapVertexArray );
-    glDrawElements( GL_TRIANGLES/*mode*/, nbCubemapIndices/*count*/, GL_UNSIGNED_INT/*type*/, 0/*indices*/ );
-
-    // Reset GL state(s)
-    glUseProgram( 0 );
-    glBindVertexArray( 0 );
-    glBindTexture( GL_TEXTURE_CUBE_MAP, 0 );
-
-
-    //--------------------------------------------------------------------------------
-    // Heigthmap
-    //--------------------------------------------------------------------------------
-
-    glUseProgram( terrain.mHeigthMapShaderProgram );
+    GLStateCache::useProgram( program );
 
     //glPolygonMode( GL_FRONT_AND_BACK, GL_LINE );
 
@@ -849,77 +1109,105 @@ void display( void )
         //--------------------
         // Retrieve 3D model / scene parameters
         // Animation
-        uniformLocation = glGetUniformLocation( terrain.mHeigthMapShaderProgram, "time" );
+        uniformLocation = glGetUniformLocation( program, "time" );
         //std::cout << uniformLocation << std::endl;
         if ( uniformLocation >= 0 )
         {
             glUniform1f( uniformLocation, static_cast< float >( currentTime ) );
         }
 
-        uniformLocation = glGetUniformLocation( terrain.mHeigthMapShaderProgram, "viewMatrix" );
+        uniformLocation = glGetUniformLocation( program, "viewMatrix" );
         if ( uniformLocation >= 0 )
         {
             glUniformMatrix4fv( uniformLocation, 1, GL_FALSE, glm::value_ptr( viewMatrix ) );
         }
         // - projection matrix
-        uniformLocation = glGetUniformLocation( terrain.mHeigthMapShaderProgram, "projectionMatrix" );
+        uniformLocation = glGetUniformLocation( program, "projectionMatrix" );
         if ( uniformLocation >= 0 )
         {
             glUniformMatrix4fv( uniformLocation, 1, GL_FALSE, glm::value_ptr( projectionMatrix ) );
         }
         // Mesh
         // - model matrix
-        uniformLocation = glGetUniformLocation( terrain.mHeigthMapShaderProgram, "modelMatrix" );
+        const glm::mat4 modelMatrix_heigth = glm::scale( modelMatrix, glm::vec3( CubeMap.scale, CubeMap.scale, CubeMap.scale ) );
+        uniformLocation = glGetUniformLocation( program, "modelMatrix" );
         if ( uniformLocation >= 0 )
         {
-            glm::mat4 modelMatrix_heigth = glm::scale( modelMatrix, glm::vec3( CubeMap.scale, CubeMap.scale, CubeMap.scale ) );
             glUniformMatrix4fv( uniformLocation, 1, GL_FALSE, glm::value_ptr(modelMatrix_heigth ) );
         }
-        // - normal matrix
-        uniformLocation = glGetUniformLocation(  terrain.mHeigthMapShaderProgram, "normalMatrix" );
+        // - normal matrix (of the scaled terrain)
+        uniformLocation = glGetUniformLocation(  program, "normalMatrix" );
         if ( uniformLocation >= 0 )
         {
-            glm::mat3 normalMatrix = glm::transpose( glm::inverse( glm::mat3( viewMatrix * modelMatrix ) ) );
+            glm::mat3 normalMatrix = glm::transpose( glm::inverse( glm::mat3( viewMatrix * modelMatrix_heigth ) ) );
             glUniformMatrix3fv( uniformLocation, 1, GL_FALSE, glm::value_ptr( normalMatrix ) );
         }
         // - mesh color
-        uniformLocation = glGetUniformLocation(  terrain.mHeigthMapShaderProgram, "meshColor" );
+        uniformLocation = glGetUniformLocation(  program, "meshColor" );
         if ( uniformLocation >= 0 )
         {
             glUniform3fv( uniformLocation, 1, glm::value_ptr( _meshColor ) );
         }
-        uniformLocation = glGetUniformLocation(  terrain.mHeigthMapShaderProgram, "materialKd" );
+        uniformLocation = glGetUniformLocation(  program, "materialKd" );
         if ( uniformLocation >= 0 )
         {
             _materialKd = glm::vec3( 0.f, 0.f, 1.f );
             glUniform3fv( uniformLocation, 1, glm::value_ptr( _materialKd ) );
         }
-        uniformLocation = glGetUniformLocation(  terrain.mHeigthMapShaderProgram, "materialKs" );
+        uniformLocation = glGetUniformLocation(  program, "materialKs" );
         if ( uniformLocation >= 0 )
         {
             _materialKs = glm::vec3( 1.f, 1.f, 1.f );
             glUniform3fv( uniformLocation, 1, glm::value_ptr( _materialKs ) );
         }
-        uniformLocation = glGetUniformLocation(  terrain.mHeigthMapShaderProgram, "materialShininess" );
+        uniformLocation = glGetUniformLocation(  program, "materialShininess" );
         if ( uniformLocation >= 0 )
         {
             _materialShininess = 20.f;
             glUniform1f( uniformLocation, _materialShininess );
         }
         // - light
-        uniformLocation = glGetUniformLocation(  terrain.mHeigthMapShaderProgram, "lightPosition" );
+        uniformLocation = glGetUniformLocation(  program, "lightPosition" );
         if ( uniformLocation >= 0 )
         {
             _lightPosition = glm::vec3( 0.f, 10.f, 0.f );
             glUniform3fv( uniformLocation, 1, glm::value_ptr( _lightPosition ) );
         }
         // - light
-        uniformLocation = glGetUniformLocation(  terrain.mHeigthMapShaderProgram, "lightColor" );
+        uniformLocation = glGetUniformLocation(  program, "lightColor" );
         if ( uniformLocation >= 0 )
         {
             _lightColor = glm::vec3( 1.f, 1.f, 1.f );
             glUniform3fv( uniformLocation, 1, glm::value_ptr( _lightColor ) );
         }
+        // - sky visibility
+        uniformLocation = glGetUniformLocation(  program, "horizonMap" );
+        if ( uniformLocation >= 0 )
+        {
+            glUniform1i( uniformLocation, HorizonMap::TextureUnit );
+            terrain.horizonMap.bindTexture();
+        }
+        // - level of detail
+        uniformLocation = glGetUniformLocation(  program, "cameraPosition" );
+        if ( uniformLocation >= 0 )
+        {
+            glUniform3fv( uniformLocation, 1, glm::value_ptr( _cameraEye ) );
+        }
+        // - imagery (virtual texture)
+        uniformLocation = glGetUniformLocation(  program, "virtualTextureEnabled" );
+        if ( uniformLocation >= 0 )
+        {
+            glUniform1i( uniformLocation, terrain.virtualTexture.enabled ? 1 : 0 );
+        }
+        uniformLocation = glGetUniformLocation(  program, "pageTable" );
+        if ( uniformLocation >= 0 )
+        {
+            terrain.virtualTexture.setUniforms( program );
+            if ( terrain.virtualTexture.enabled )
+            {
+                terrain.virtualTexture.bindTextures();
+            }
+        }
 
         //--------------------
         // Render scene
@@ -928,125 +1216,156 @@ void display( void )
         // Set GL state(s) (fixed pipeline)
         //glPolygonMode( GL_FRONT_AND_BACK, GL_LINE );
 
+        // - GL 4.0 path: patches tessellated on the GPU
+        if ( program != 0 && program == terrain.mHeigthMapTessellationShaderProgram )
+        {
+            terrain.tessellation.draw( program );
+            return;
+        }
+
         // - bind VAO as current vertex array (in OpenGL state machine)
-        glBindVertexArray( terrain.mHeigthMapVertexArray );
+        GLStateCache::bindVertexArray( terrain.mHeigthMapVertexArray );
 
         /*glActiveTexture( GL_TEXTURE0 );
         glBindTexture( GL_TEXTURE_2D, terrain.texture );*/
-        // - draw command
-        glDrawElements(
-             GL_TRIANGLES,      // mode
-             terrain.numberOfIndices_,  // count
-             GL_UNSIGNED_INT,   // data type
-             (void*)0           // element array buffer offset
-        );
+        // - draw commands: tiles at their level of detail (selected once per frame), one level after the other
+        const TerrainLod& lod = terrain.lod;
+        for ( int level = 0; level < lod.numberOfLevels; level++ )
+        {
+            bool levelUniformsSet = false;
+            for ( size_t tile = 0; tile < lod.tileLevels.size(); tile++ )
+            {
+                if ( lod.tileLevels[ tile ] != level )
+                    continue;
+
+                if ( !levelUniformsSet )
+                {
+                    lod.setLevelUniforms( program, level );
+                    levelUniformsSet = true;
+                }
+
+                const TerrainLod::Range& range = lod.ranges[ tile * lod.numberOfLevels + level ];
+                glDrawElements(
+                     GL_TRIANGLES,      // mode
+                     range.count,       // count
+                     GL_UNSIGNED_INT,   // data type
+                     (void*)( range.offset * sizeof( GLuint ) )  // element array buffer offset
+                );
+            }
+        }
 
-        // - unbind VAO (0 is the default resource ID in OpenGL)
-        glBindVertexArray( 0 );
+        // Program and VAO stay bound: the state cache skips them if the next draw uses them
+}
 
-        // Reset GL state(s) (fixed pipeline)
-        //glPolygonMode( GL_FRONT_AND_BACK, GL_FILL );
+/******************************************************************************
+ * Draw the visible meshes of the 3D model with the given shader program
+ * - meshes are sorted by texture array then front to back, per-frame uniforms are sent once
+ * - materials of the same size share a texture array: only the layer uniform changes
+ ******************************************************************************/
+void drawModels( GLuint program, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, const glm::mat4& modelMatrix, const int currentTime, const std::vector< bool >& visible )
+{
+    GLint uniformLocation;
 
-        // Deactivate current shader program
-        glUseProgram( 0 );
-        glPolygonMode( GL_FRONT_AND_BACK, GL_FILL);
+    // Collect the visible meshes (submission system of the scene store)
+    modelQueue.clear();
+    sceneStore.submit( modelQueue, 0, program, viewMatrix, visible );
+    if ( modelQueue.items.empty() )
+        return;
+    modelQueue.sort();
 
+    GLStateCache::useProgram( program );
 
     //--------------------------------------------------------------------------------
-    // Activate shader program
+    // Send per-frame uniforms to GPU
     //--------------------------------------------------------------------------------
-    for(int i=0;i<model.nb_mesh;i++){
-        glUseProgram( shaderProgram );
 
+    uniformLocation = glGetUniformLocation( program, "diffuseTex" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1i(uniformLocation, MaterialLibrary::TextureUnit);
+    }
+    // Camera
+    // - view matrix
+    uniformLocation = glGetUniformLocation( program, "viewMatrix" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniformMatrix4fv( uniformLocation, 1, GL_FALSE, glm::value_ptr( viewMatrix ) );
+    }
+    // - projection matrix
+    uniformLocation = glGetUniformLocation( program, "projectionMatrix" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniformMatrix4fv( uniformLocation, 1, GL_FALSE, glm::value_ptr( projectionMatrix ) );
+    }
+    // - mesh color
+    uniformLocation = glGetUniformLocation( program, "meshColor" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform3fv( uniformLocation, 1, glm::value_ptr( _meshColor ) );
+    }
+    uniformLocation = glGetUniformLocation( program, "materialKs" );
+    if ( uniformLocation >= 0 )
+    {
+        _materialKs = glm::vec3( 1.f, 1.f, 1.f );
+        glUniform3fv( uniformLocation, 1, glm::value_ptr( _materialKs ) );
+    }
+    uniformLocation = glGetUniformLocation( program, "materialShininess" );
+    if ( uniformLocation >= 0 )
+    {
+        _materialShininess = 20.f;
+        glUniform1f( uniformLocation, _materialShininess );
+    }
+    // - light
+    uniformLocation = glGetUniformLocation( program, "lightPosition" );
+    if ( uniformLocation >= 0 )
+    {
+        _lightPosition = glm::vec3( 0.f, 2.f, 3.f );
+        glUniform3fv( uniformLocation, 1, glm::value_ptr( _lightPosition ) );
+    }
+    // - light
+    uniformLocation = glGetUniformLocation( program, "lightColor" );
+    if ( uniformLocation >= 0 )
+    {
+        _lightColor = glm::vec3( 1.f, 1.f, 1.f );
+        glUniform3fv( uniformLocation, 1, glm::value_ptr( _lightColor ) );
+    }
+    // Animation
+    uniformLocation = glGetUniformLocation( program, "time" );
+    if ( uniformLocation >= 0 )
+    {
+        glUniform1f( uniformLocation, static_cast< float >( currentTime ) );
+    }
+
+    const GLint modelMatrixLocation = glGetUniformLocation( program, "modelMatrix" );
+    const GLint normalMatrixLocation = glGetUniformLocation( program, "normalMatrix" );
+    const GLint materialKdLocation = glGetUniformLocation( program, "materialKd" );
+    const GLint materialLayerLocation = glGetUniformLocation( program, "materialLayer" );
 
+    for ( size_t q = 0; q < modelQueue.items.size(); q++ ){
+        const int i = static_cast< int >( modelQueue.items[ q ].index );
 
         //--------------------------------------------------------------------------------
-        // Send uniforms to GPU
+        // Send per-mesh uniforms to GPU
         //--------------------------------------------------------------------------------
 
-        // - view matrix
-        uniformLocation = glGetUniformLocation( shaderProgram, "diffuseTex" );
-        if ( uniformLocation >= 0 )
-        {
-            if(model.AllTexture[i][0].size() > 0){
-
-                glUniform1i(uniformLocation, 0);
-            }
-
-        }
-        // Camera
-        // - view matrix
-        uniformLocation = glGetUniformLocation( shaderProgram, "viewMatrix" );
-        if ( uniformLocation >= 0 )
-        {
-            glUniformMatrix4fv( uniformLocation, 1, GL_FALSE, glm::value_ptr( viewMatrix ) );
-        }
-        // - projection matrix
-        uniformLocation = glGetUniformLocation( shaderProgram, "projectionMatrix" );
-        if ( uniformLocation >= 0 )
-        {
-            glUniformMatrix4fv( uniformLocation, 1, GL_FALSE, glm::value_ptr( projectionMatrix ) );
-        }
-        // Mesh
         // - model matrix
-        uniformLocation = glGetUniformLocation( shaderProgram, "modelMatrix" );
-        if ( uniformLocation >= 0 )
-        {
-            glUniformMatrix4fv( uniformLocation, 1, GL_FALSE, glm::value_ptr( model.transform[i] ) );
-        }
-        // - normal matrix
-        uniformLocation = glGetUniformLocation( shaderProgram, "normalMatrix" );
-        if ( uniformLocation >= 0 )
+        if ( modelMatrixLocation >= 0 )
         {
-            glm::mat3 normalMatrix = glm::transpose( glm::inverse( glm::mat3( viewMatrix * modelMatrix ) ) );
-            glUniformMatrix3fv( uniformLocation, 1, GL_FALSE, glm::value_ptr( normalMatrix ) );
+            glUniformMatrix4fv( modelMatrixLocation, 1, GL_FALSE, glm::value_ptr( model.transform(i) ) );
         }
-        // - mesh color
-        uniformLocation = glGetUniformLocation( shaderProgram, "meshColor" );
-        if ( uniformLocation >= 0 )
+        // - normal matrix of the mesh (world one cached by the scene graph, the view is rigid)
+        if ( normalMatrixLocation >= 0 )
         {
-            glUniform3fv( uniformLocation, 1, glm::value_ptr( _meshColor ) );
+            const glm::mat3 normalMatrix = glm::mat3( viewMatrix ) * model.normalTransform(i);
+            glUniformMatrix3fv( normalMatrixLocation, 1, GL_FALSE, glm::value_ptr( normalMatrix ) );
         }
-        uniformLocation = glGetUniformLocation( shaderProgram, "materialKd" );
-        if ( uniformLocation >= 0 )
+        if ( materialKdLocation >= 0 )
         {
-            if(i==model.selectedModel)
+            if(meshSelected[i])
                 _materialKd = glm::vec3( 0.f, 1.f, 0.f );
             else
                 _materialKd = glm::vec3( 0.f, 0.f, 1.f );
-            glUniform3fv( uniformLocation, 1, glm::value_ptr( _materialKd ) );
-        }
-        uniformLocation = glGetUniformLocation( shaderProgram, "materialKs" );
-        if ( uniformLocation >= 0 )
-        {
-            _materialKs = glm::vec3( 1.f, 1.f, 1.f );
-            glUniform3fv( uniformLocation, 1, glm::value_ptr( _materialKs ) );
-        }
-        uniformLocation = glGetUniformLocation( shaderProgram, "materialShininess" );
-        if ( uniformLocation >= 0 )
-        {
-            _materialShininess = 20.f;
-            glUniform1f( uniformLocation, _materialShininess );
-        }
-        // - light
-        uniformLocation = glGetUniformLocation( shaderProgram, "lightPosition" );
-        if ( uniformLocation >= 0 )
-        {
-            _lightPosition = glm::vec3( 0.f, 2.f, 3.f );
-            glUniform3fv( uniformLocation, 1, glm::value_ptr( _lightPosition ) );
-        }
-        // - light
-        uniformLocation = glGetUniformLocation( shaderProgram, "lightColor" );
-        if ( uniformLocation >= 0 )
-        {
-            _lightColor = glm::vec3( 1.f, 1.f, 1.f );
-            glUniform3fv( uniformLocation, 1, glm::value_ptr( _lightColor ) );
-        }
-        // Animation
-        uniformLocation = glGetUniformLocation( shaderProgram, "time" );
-        if ( uniformLocation >= 0 )
-        {
-            glUniform1f( uniformLocation, static_cast< float >( currentTime ) );
+            glUniform3fv( materialKdLocation, 1, glm::value_ptr( _materialKd ) );
         }
 
         //--------------------------------------------------------------------------------
@@ -1056,12 +1375,10 @@ void display( void )
         //glPolygonMode( GL_FRONT_AND_BACK, GL_LINE );
 
         // - bind VAO as current vertex array (in OpenGL state machine)
-        glBindVertexArray( vertexArrays[i] );
+        GLStateCache::bindVertexArray( vertexArrays[i] );
 
-        glActiveTexture(GL_TEXTURE0); // active proper texture unit before binding
-
-        // and finally bind the texture
-        glBindTexture(GL_TEXTURE_2D, model.AllTexture[i][0][0].id);
+        // and finally the material (texture array bound only when the image size changes)
+        model.materials.bindMaterial( materialLayerLocation, model.meshMaterial[i] );
 
         // - draw command
         glDrawElements(
@@ -1070,15 +1387,381 @@ void display( void )
              GL_UNSIGNED_INT,   // data type
              (void*)0           // element array buffer offset
             );
-        // - unbind VAO (0 is the default resource ID in OpenGL)
-        glBindVertexArray( 0 );
-        // Reset GL state(s) (fixed pipeline)
-        //glPolygonMode( GL_FRONT_AND_BACK, GL_FILL );
+    }
+}
+
+/******************************************************************************
+ * Render passes
+ * - registered in the render graph by initializeRenderGraph(), they read the
+ *   camera from "viewMatrix" and "frame"
+ ******************************************************************************/
+
+/******************************************************************************
+ * Occlusion culling
+ * - terrain is rasterized on CPU, then model bounds are tested before any draw is submitted
+ ******************************************************************************/
+void occlusionCullingPass()
+{
+    const glm::mat4 terrainMatrix = glm::scale( frame.modelMatrix, glm::vec3( CubeMap.scale, CubeMap.scale, CubeMap.scale ) );
+    occlusionBuffer.clear();
+    occlusionBuffer.rasterize( terrain.occluderPoints, terrain.occluderIndices, frame.projectionMatrix * viewMatrix * terrainMatrix );
+    for ( int i = 0; i < model.nb_mesh; i++ )
+    {
+        meshVisible[ i ] = meshVisible[ i ] && occlusionBuffer.isVisible( model.bounds_min[ i ], model.bounds_max[ i ], frame.projectionMatrix * viewMatrix * model.transform( i ) );
+    }
+}
+
+/******************************************************************************
+ * Shadow maps
+ * - depth of the casters, seen from the light, for each cascade due this frame
+ ******************************************************************************/
+void shadowPass()
+{
+    shadowMaps.numberOfRenderedCascades = 0;
+    for ( int c = 0; c < shadowMaps.numberOfCascades; c++ )
+    {
+        if ( !shadowMaps.update( c, viewMatrix, frame.projectionMatrix ) )
+            continue;
+
+        shadowCasterVisible.assign( model.nb_mesh, true );
+        for ( int i = 0; i < model.nb_mesh; i++ )
+        {
+            shadowCasterVisible[ i ] = shadowMaps.isInCascade( c, model.bounds_min[ i ], model.bounds_max[ i ], model.transform( i ) );
+        }
+
+        shadowMaps.beginCascade( c );
+        drawTerrain( shadowMaps.mDepthShaderProgram, shadowMaps.lightViewMatrices[ c ], shadowMaps.lightProjectionMatrices[ c ], frame.modelMatrix, frame.currentTime );
+        drawModels( shadowMaps.mDepthShaderProgram, shadowMaps.lightViewMatrices[ c ], shadowMaps.lightProjectionMatrices[ c ], frame.modelMatrix, frame.currentTime, shadowCasterVisible );
+    }
+    shadowMaps.endCascades( renderGraph.width, renderGraph.height );
+}
+
+/******************************************************************************
+ * Virtual texture feedback
+ * - pages of the terrain imagery seen this frame, read back next frame
+ ******************************************************************************/
+void virtualTextureFeedbackPass()
+{
+    terrain.virtualTexture.beginFeedback( renderGraph.width, renderGraph.height );
+    drawTerrain( terrain.virtualTexture.mFeedbackShaderProgram, viewMatrix, frame.projectionMatrix, frame.modelMatrix, frame.currentTime );
+    terrain.virtualTexture.endFeedback( renderGraph.width, renderGraph.height );
+}
+
+/******************************************************************************
+ * Skybox
+ * - drawn first at the window resolution into the HDR target, the scene is
+ *   blended over it
+ ******************************************************************************/
+void skyboxPass()
+{
+    GLint uniformLocation;
+
+    postProcess.beginComposite( renderGraph.width, renderGraph.height );
+
+    // Activation de la cubemap
+    GLStateCache::bindTexture( 0, GL_TEXTURE_CUBE_MAP, CubeMap.texture );
+
+
+    // Set shader program
+    GLStateCache::useProgram( CubeMap.mCubeMapShaderProgram );
+
+    // Model view projection matrix
+    uniformLocation = glGetUniformLocation( CubeMap.mCubeMapShaderProgram, "uModelViewProjectionMatrix" );
+    if ( uniformLocation >= 0 )
+    {
+            glm::mat4 modelMatrix = glm::mat4( 1.f );
+            modelMatrix = glm::scale( modelMatrix, glm::vec3( CubeMap.scale, CubeMap.scale, CubeMap.scale ) );
+            glm::mat4 MVP = frame.projectionMatrix * viewMatrix * modelMatrix;
+            glUniformMatrix4fv( uniformLocation, 1/*count*/, GL_FALSE/*transpose*/, glm::value_ptr( MVP ) );
+    }
 
-        // Deactivate current shader program
-        glUseProgram( 0 );
+    uniformLocation = glGetUniformLocation( CubeMap.mCubeMapShaderProgram, "skybox" );
+    if ( uniformLocation >= 0 )
+    {
+            glUniform1i(uniformLocation, 0);
     }
 
+    // Draw command
+    // - the HDR target has no depth attachment: no depth test against the scene
+    const GLsizei nbCubemapIndices = 6/*nb faces*/ * 2/*2 triangles per face*/ * 3/*nb indices per triangle*/;
+    GLStateCache::bindVertexArray( CubeMap.mCubemapVertexArray );
+    glDrawElements( GL_TRIANGLES/*mode*/, nbCubemapIndices/*count*/, GL_UNSIGNED_INT/*type*/, 0/*indices*/ );
+}
+
+/******************************************************************************
+ * Scene target
+ * - the shading passes write the scene textures (reused, not cleared by the graph)
+ ******************************************************************************/
+void clearSceneTarget()
+{
+    glClearColor( 0.f, 0.f, 0.f, 0.f );
+    glClearDepth( 1.f );
+    glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+}
+
+/******************************************************************************
+ * Dynamic resolution upscale
+ * - scene textures over the skybox in the HDR target
+ ******************************************************************************/
+void upscalePass()
+{
+    postProcess.bindComposite();
+    dynamicResolution.upscalePass( renderGraph.texture( "scene color" ), renderGraph.texture( "scene depth" ), renderGraph.width, renderGraph.height );
+}
+
+/******************************************************************************
+ * Temporal anti-aliasing
+ * - scene textures accumulated with the previous frames, over the skybox
+ ******************************************************************************/
+void temporalAntiAliasingPass()
+{
+    temporalAA.resolvePass( renderGraph.texture( "scene color" ), renderGraph.texture( "scene depth" ), renderGraph.viewportWidth, renderGraph.viewportHeight,
+                            frame.projectionMatrix * viewMatrix, postProcess.mHdrFramebuffer, renderGraph.width, renderGraph.height );
+}
+
+/******************************************************************************
+ * Post-processing
+ * - HDR target (skybox and scene) to the back buffer: bloom, exposure, tone mapping
+ ******************************************************************************/
+void postProcessPass()
+{
+    postProcess.execute();
+}
+
+/******************************************************************************
+ * Deferred shading
+ * - geometry pass into the G-buffer, then lighting pass into the scene textures
+ ******************************************************************************/
+void deferredGeometryPass()
+{
+    deferredRenderer.beginGeometryPass();
+    drawTerrain( terrain.mHeigthMapGeometryShaderProgram, viewMatrix, frame.sceneProjectionMatrix, frame.modelMatrix, frame.currentTime );
+    drawModels( geometryShaderProgram, viewMatrix, frame.sceneProjectionMatrix, frame.modelMatrix, frame.currentTime, meshVisible );
+}
+
+void deferredLightingPass()
+{
+    clearSceneTarget();
+    deferredRenderer.resize( renderGraph.viewportWidth, renderGraph.viewportHeight );
+    deferredRenderer.lightingPass( lights, viewMatrix, frame.sceneProjectionMatrix,
+                                   renderGraph.texture( "gbuffer albedo" ), renderGraph.texture( "gbuffer normal" ), renderGraph.texture( "gbuffer depth" ) );
+}
+
+/******************************************************************************
+ * Clustered forward shading
+ * - lights are binned to the frustum clusters, then shaded in the forward pass
+ ******************************************************************************/
+void clusteredPass()
+{
+    clearSceneTarget();
+    lightClusters.build( lights, viewMatrix, frame.sceneProjectionMatrix, renderGraph.viewportWidth, renderGraph.viewportHeight );
+    lightClusters.setUniforms( terrain.mHeigthMapClusteredShaderProgram, viewMatrix );
+    lightClusters.setUniforms( clusteredShaderProgram, viewMatrix );
+
+    lightClusters.bindTextures();
+    drawTerrain( terrain.mHeigthMapClusteredShaderProgram, viewMatrix, frame.sceneProjectionMatrix, frame.modelMatrix, frame.currentTime );
+    drawModels( clusteredShaderProgram, viewMatrix, frame.sceneProjectionMatrix, frame.modelMatrix, frame.currentTime, meshVisible );
+    lightClusters.unbindTextures();
+}
+
+/******************************************************************************
+ * Forward shading (main light and shadows)
+ ******************************************************************************/
+void forwardPass()
+{
+    // Tessellated terrain when the context supports it, tiled CPU grid otherwise
+    const GLuint terrainProgram = terrain.tessellation.active() ? terrain.mHeigthMapTessellationShaderProgram : terrain.mHeigthMapShaderProgram;
+
+    clearSceneTarget();
+    shadowMaps.setUniforms( terrainProgram, viewMatrix );
+    shadowMaps.setUniforms( shaderProgram, viewMatrix );
+
+    shadowMaps.bindTexture();
+    drawTerrain( terrainProgram, viewMatrix, frame.sceneProjectionMatrix, frame.modelMatrix, frame.currentTime );
+    // Distant meshes leave the list and are drawn as impostors
+    meshDrawn.assign( meshVisible.begin(), meshVisible.end() );
+    meshImpostor.assign( model.nb_mesh, false );
+    for ( size_t e = 0; e < sceneStore.size(); e++ )
+    {
+        const uint32_t i = sceneStore.mesh[ e ];
+        if ( sceneStore.lod[ e ] && meshVisible[ i ] )
+        {
+            meshDrawn[ i ] = false;
+            meshImpostor[ i ] = true;
+        }
+    }
+    impostors.select( model, _cameraEye, meshImpostor, meshSelected );
+    drawModels( shaderProgram, viewMatrix, frame.sceneProjectionMatrix, frame.modelMatrix, frame.currentTime, meshDrawn );
+    impostors.draw( viewMatrix, frame.sceneProjectionMatrix, _lightPosition, _lightColor );
+    vegetation.draw( viewMatrix, frame.sceneProjectionMatrix, _lightPosition, _lightColor );
+    shadowMaps.unbindTexture();
+}
+
+/******************************************************************************
+ * Initialize the render graph
+ *
+ * Passes are declared with the resources they read and write; the graph
+ * orders them (the scene textures are blended over the skybox in the HDR
+ * target once shaded, then post-processed into the back buffer) and drops
+ * the passes of the disabled shading paths.
+ ******************************************************************************/
+bool initializeRenderGraph()
+{
+    std::cout << "Initialize render graph..." << std::endl;
+
+    DeferredRenderer::declareGBuffer( renderGraph );
+    DynamicResolution::declareSceneTarget( renderGraph );
+
+    const std::string backBuffer = RenderGraph::BackBuffer;
+    const std::vector< std::string > sceneTarget = { "scene color", "scene depth" };
+
+    renderGraph.addPass( "skybox", {}, { "hdr color" }, skyboxPass );
+    renderGraph.addPass( "occlusion culling", {}, { "mesh visibility" }, occlusionCullingPass,
+                         []() { return useOcclusionCulling; } );
+    renderGraph.addPass( "shadow maps", {}, { "shadow map" }, shadowPass,
+                         []() { return shadowMaps.enabled; } );
+    renderGraph.addPass( "deferred geometry", { "mesh visibility" }, { "gbuffer albedo", "gbuffer normal", "gbuffer depth" }, deferredGeometryPass,
+                         []() { return useDeferredShading; } );
+    renderGraph.addPass( "deferred lighting", { "gbuffer albedo", "gbuffer normal", "gbuffer depth" }, sceneTarget, deferredLightingPass,
+                         []() { return useDeferredShading; } );
+    renderGraph.addPass( "clustered forward", { "mesh visibility" }, sceneTarget, clusteredPass,
+                         []() { return useClusteredShading; } );
+    renderGraph.addPass( "virtual texture feedback", {}, { "virtual texture pages" }, virtualTextureFeedbackPass,
+                         []() { return terrain.virtualTexture.enabled; } );
+    renderGraph.addPass( "forward", { "mesh visibility", "shadow map", "virtual texture pages" }, sceneTarget, forwardPass,
+                         []() { return !useDeferredShading && !useClusteredShading; } );
+    renderGraph.addPass( "upscale", { "scene color", "scene depth", "hdr color" }, { "hdr color" }, upscalePass,
+                         []() { return !temporalAA.enabled; } );
+    renderGraph.addPass( "temporal anti-aliasing", { "scene color", "scene depth", "hdr color" }, { "hdr color" }, temporalAntiAliasingPass,
+                         []() { return temporalAA.enabled; } );
+    renderGraph.addPass( "post process", { "hdr color" }, { backBuffer }, postProcessPass );
+
+    return true;
+}
+
+/******************************************************************************
+ * Callback to display the scene
+ ******************************************************************************/
+void display( void )
+{
+    // Timer info
+    const int currentTime = glutGet( GLUT_ELAPSED_TIME );
+    framePacer.beginFrame();
+
+    GLStateCache::beginFrame();
+
+    // Enable the Z-test in the OpenGL fixed pipeline
+    GLStateCache::enable( GL_DEPTH_TEST );
+
+    //--------------------------------------------------------------------------------
+    // START frame
+    //--------------------------------------------------------------------------------
+    // Clear the color buffer (of the main framebuffer)
+    // - color used to clear
+    glClearColor( 0.f, 0.f, 0.f, 0.f );
+    glClearDepth( 1.f );
+    // - clear the "color" framebuffer
+    glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+
+    // GL work queued by the jobs
+    JobSystem::instance().executeMainThreadJobs();
+
+    // Pick up the terrain horizon map once its background bake is over
+    terrain.horizonMap.update();
+
+    // Upload the imagery pages decoded in the background
+    terrain.virtualTexture.update();
+
+    // Upload the terrain regions edited since the last frame
+    terrain.updateEditedRegions();
+
+    //--------------------------------------------------------------------------------
+    // Camera
+    //--------------------------------------------------------------------------------
+    // Camera state of the update thread, blended for this frame
+    Simulation::State state;
+    const bool simulated = simulation.interpolate( Simulation::Clock::now(), state );
+    if ( simulated )
+    {
+        _cameraEye = state.cameraEye;
+        yaw = state.yaw;
+        pitch = state.pitch;
+        roll = state.roll;
+    }
+    keepCameraAboveTerrain();
+
+    // Retrieve camera parameters
+    frame.projectionMatrix = glm::perspective( _cameraFovY, _cameraAspect, _cameraZNear, _cameraZFar );
+
+    glm::mat4 matrixRoll  = glm::mat4(1.0f);
+    glm::mat4 matrixPitch = glm::mat4(1.0f);
+    glm::mat4 matrixYaw   = glm::mat4(1.0f);
+
+    matrixRoll  = glm::rotate(matrixRoll,  roll,  glm::vec3(0.0f, 0.0f, 1.0f));
+    matrixPitch = glm::rotate(matrixPitch, pitch, glm::vec3(1.0f, 0.0f, 0.0f));
+    matrixYaw   = glm::rotate(matrixYaw,  yaw,    glm::vec3(0.0f, 1.0f, 0.0f));
+
+    glm::mat4 rotate = matrixRoll * matrixPitch * matrixYaw;
+    glm::mat4 translate = glm::mat4(1.0f);
+    translate = glm::translate(translate, -_cameraEye);
+
+    viewMatrix = rotate * translate;
+
+    // Retrieve 3D model / scene parameters
+    frame.modelMatrix = glm::mat4();
+    frame.currentTime = currentTime;
+    const bool useMeshAnimation = false; // TODO: use keyboard to activate/deactivate
+    if ( useMeshAnimation )
+    {
+        const float animationTime = simulated ? static_cast< float >( state.time ) : static_cast< float >( currentTime ) * 0.001f;
+        frame.modelMatrix = glm::rotate( frame.modelMatrix, animationTime, glm::vec3( 0.0f, 1.f, 0.f ) );
+        // - an animated scene never settles
+        framePacer.requestRedraw();
+    }
+
+    // CPU work of the frame on the job system
+    JobSystem& jobs = JobSystem::instance();
+    JobCounter sceneGraphJob;
+    JobCounter frameJobs;
+    const glm::mat4 viewProjectionMatrix = frame.projectionMatrix * viewMatrix;
+    const float impostorDistance = ( impostors.enabled && impostors.ready ) ? impostors.distance : std::numeric_limits< float >::max();
+
+    // - world matrices of the meshes moved since the last frame
+    jobs.run( [&]() { model.scene.update(); }, &sceneGraphJob );
+    // - then the scene systems: transforms, view frustum, level of detail
+    jobs.runAfter( sceneGraphJob, [&]()
+    {
+        sceneStore.updateTransforms( model.scene );
+        sceneStore.cull( viewProjectionMatrix );
+        sceneStore.selectLod( _cameraEye, impostorDistance );
+    }, &frameJobs );
+    // - terrain tiles level of detail (same for all passes of the frame)
+    jobs.run( [&]() { terrain.lod.select( _cameraEye, terrainModelMatrix() ); }, &frameJobs );
+
+    // Vegetation tiles around the camera, instances culled and split by distance (GL, this thread)
+    vegetation.update( terrain.heightPyramid, terrainModelMatrix(), _cameraEye, viewMatrix, frame.projectionMatrix );
+
+    jobs.wait( frameJobs );
+
+    // Meshes in the view frustum, unless the occlusion culling pass hides them
+    meshVisible.assign( model.nb_mesh, false );
+    meshSelected.assign( model.nb_mesh, false );
+    for ( size_t e = 0; e < sceneStore.size(); e++ )
+    {
+        meshVisible[ sceneStore.mesh[ e ] ] = ( sceneStore.visible[ e ] != 0 );
+        meshSelected[ sceneStore.mesh[ e ] ] = ( sceneStore.selected[ e ] != 0 );
+    }
+
+    //--------------------------------------------------------------------------------
+    // Render passes
+    //--------------------------------------------------------------------------------
+    renderGraph.resize( glutGet( GLUT_WINDOW_WIDTH ), glutGet( GLUT_WINDOW_HEIGHT ) );
+    dynamicResolution.beginFrame( renderGraph.width, renderGraph.height );
+    renderGraph.setViewport( dynamicResolution.renderWidth, dynamicResolution.renderHeight );
+    frame.sceneProjectionMatrix = temporalAA.enabled ? temporalAA.jitterProjection( frame.projectionMatrix, renderGraph.viewportWidth, renderGraph.viewportHeight ) : frame.projectionMatrix;
+    renderGraph.execute();
+    dynamicResolution.endFrame();
+
 
     //--------------------------------------------------------------------------------
     // END frame
@@ -1087,9 +1770,98 @@ void display( void )
     glFlush();
     // Swap buffers for "double buffering" display mode (=> swap "back" and "front" framebuffers)
     glutSwapBuffers();
+
+    framePacer.endFrame();
 }
 
 
+/******************************************************************************
+ * Terrain ray casting
+ ******************************************************************************/
+glm::mat4 terrainModelMatrix()
+{
+    return glm::scale( frame.modelMatrix, glm::vec3( CubeMap.scale, CubeMap.scale, CubeMap.scale ) );
+}
+
+// Terrain point under the mouse (GLUT window coordinates)
+bool pickTerrain( int x, int y, glm::vec3& point, glm::vec3& normal )
+{
+    const int width = glutGet( GLUT_WINDOW_WIDTH );
+    const int height = glutGet( GLUT_WINDOW_HEIGHT );
+
+    glm::vec3 ray_origin;
+    glm::vec3 ray_direction;
+    Picking::ScreenPosToWorldRay( x, height - y, width, height, viewMatrix, frame.projectionMatrix, ray_origin, ray_direction );
+
+    float distance;
+    return Picking::TestRayHeightfieldIntersection( ray_origin, ray_direction, terrain.heightPyramid, terrainModelMatrix(), distance, point, normal );
+}
+
+// Mesh under the mouse (picking system of the scene store), -1: none
+int pickMesh( int x, int y )
+{
+    const int width = glutGet( GLUT_WINDOW_WIDTH );
+    const int height = glutGet( GLUT_WINDOW_HEIGHT );
+
+    glm::vec3 ray_origin;
+    glm::vec3 ray_direction;
+    Picking::ScreenPosToWorldRay( x, height - y, width, height, viewMatrix, frame.projectionMatrix, ray_origin, ray_direction );
+
+    float distance;
+    const SceneStore::Entity entity = sceneStore.pick( ray_origin, ray_direction, distance );
+    sceneStore.select( entity );
+    return ( entity != SceneStore::InvalidEntity ) ? static_cast< int >( sceneStore.mesh[ sceneStore.indexOf( entity ) ] ) : -1;
+}
+
+// Camera collision: the eye stays above the surface below it
+void keepCameraAboveTerrain()
+{
+    float distance;
+    glm::vec3 point;
+    glm::vec3 normal;
+    const glm::vec3 above( _cameraEye.x, 2.f * CubeMap.scale, _cameraEye.z );
+    if ( Picking::TestRayHeightfieldIntersection( above, glm::vec3( 0.f, -1.f, 0.f ), terrain.heightPyramid, terrainModelMatrix(), distance, point, normal ) )
+    {
+        _cameraEye.y = std::max( _cameraEye.y, point.y + cameraGroundClearance );
+        simulation.setMinimumEyeHeight( point.y + cameraGroundClearance );
+    }
+}
+
+// Meshes [first,last] put down on the terrain (one batch query)
+// - the bottom center of each mesh bounds goes to the ground height below it
+void groundMeshes( int first, int last )
+{
+    const glm::mat4 terrainMatrix = terrainModelMatrix();
+    const glm::mat4 toLocal = glm::inverse( terrainMatrix );
+    const int count = last - first + 1;
+
+    std::vector< glm::vec3 > bases( count );
+    std::vector< float > x( count );
+    std::vector< float > z( count );
+    for ( int n = 0; n < count; ++n )
+    {
+        const int i = first + n;
+        const glm::vec3 base( 0.5f * ( model.bounds_min[ i ].x + model.bounds_max[ i ].x ),
+                              model.bounds_min[ i ].y,
+                              0.5f * ( model.bounds_min[ i ].z + model.bounds_max[ i ].z ) );
+        bases[ n ] = glm::vec3( model.transform( i ) * glm::vec4( base, 1.f ) );
+        const glm::vec4 local = toLocal * glm::vec4( bases[ n ], 1.f );
+        x[ n ] = local.x;
+        z[ n ] = local.z;
+    }
+
+    std::vector< float > heights( count );
+    GroundPlacement::sampleGround( terrain.heightPyramid, x.data(), z.data(), count, heights.data(), nullptr );
+
+    for ( int n = 0; n < count; ++n )
+    {
+        const float ground = ( terrainMatrix * glm::vec4( x[ n ], heights[ n ], z[ n ], 1.f ) ).y;
+        glm::mat4 transform = model.transform( first + n );
+        transform[ 3 ].y += ground - bases[ n ].y;
+        model.setTransform( first + n, transform );
+    }
+}
+
 /******************************************************************************
  * Callback for KeyBoardEvent
  ******************************************************************************/
@@ -1097,30 +1869,148 @@ void keyboard_CB(unsigned char key, int x, int y)
 {
     switch(key){
 
+    // Camera moves while the key is held (update thread)
     case 'z':
-        _cameraEye += -Speed * glm::vec3(viewMatrix[0][2], viewMatrix[1][2], viewMatrix[2][2]);
+        simulation.setMove( Simulation::MoveForward, true );
     break;
 
     case 's':
-        _cameraEye += Speed * glm::vec3(viewMatrix[0][2], viewMatrix[1][2], viewMatrix[2][2]);
+        simulation.setMove( Simulation::MoveBackward, true );
     break;
 
     case 'q':
-        _cameraEye += -Speed * glm::vec3(viewMatrix[0][0], viewMatrix[1][0], viewMatrix[2][0]);
+        simulation.setMove( Simulation::MoveLeft, true );
         break;
 
     case 'd':
-        _cameraEye += Speed * glm::vec3(viewMatrix[0][0], viewMatrix[1][0], viewMatrix[2][0]);
+        simulation.setMove( Simulation::MoveRight, true );
     break;
 
     case ' ':
-        _cameraEye += Speed * glm::vec3(viewMatrix[0][1], viewMatrix[1][1], viewMatrix[2][1]);
+        simulation.setMove( Simulation::MoveUp, true );
     break;
 
     case 'x':
-        _cameraEye += -Speed * glm::vec3(viewMatrix[0][1], viewMatrix[1][1], viewMatrix[2][1]);
+        simulation.setMove( Simulation::MoveDown, true );
     break;
 
+    case 'l':
+        useDeferredShading = !useDeferredShading;
+        useClusteredShading = false;
+        std::cout << "Deferred shading " << ( useDeferredShading ? "actif" : "desactif" ) << std::endl;
+        break;
+
+    case 'k':
+        useClusteredShading = !useClusteredShading;
+        useDeferredShading = false;
+        std::cout << "Clustered forward shading " << ( useClusteredShading ? "actif" : "desactif" ) << std::endl;
+        break;
+
+    case 'c':
+        useOcclusionCulling = !useOcclusionCulling;
+        std::cout << "Occlusion culling " << ( useOcclusionCulling ? "actif" : "desactif" ) << std::endl;
+        break;
+
+    case 'f':
+        GLStateCache::printStatistics();
+        break;
+
+    case 'h':
+        shadowMaps.enabled = !shadowMaps.enabled;
+        std::cout << "Ombres " << ( shadowMaps.enabled ? "actif" : "desactif" ) << std::endl;
+        break;
+
+    case 'b':
+        brushMode = static_cast< HeigthMap::BrushMode >( ( brushMode + 1 ) % HeigthMap::NumberOfBrushModes );
+        {
+            const char* brushNames[ HeigthMap::NumberOfBrushModes ] = { "relever", "abaisser", "lisser", "aplanir" };
+            std::cout << "Pinceau " << brushNames[ brushMode ] << std::endl;
+        }
+        break;
+
+    case 'n':
+        // Picked terrain point, or the one under the camera (terrain model matrix is a scale)
+        {
+            const glm::vec2 center = brushCenterPicked ? brushCenter : glm::vec2( _cameraEye.x, _cameraEye.z ) / CubeMap.scale;
+            terrain.applyBrush( brushMode, center, brushRadius, brushStrength );
+            // - trees of the edited tiles are generated again on the new ground
+            vegetation.invalidate( center - glm::vec2( brushRadius ), center + glm::vec2( brushRadius ) );
+        }
+        break;
+
+    case 'g':
+        // Selected mesh, or every mesh of the model, back on the ground
+        if ( meshSelect != -1 )
+            groundMeshes( meshSelect, meshSelect );
+        else
+            groundMeshes( 0, model.nb_mesh - 1 );
+        std::cout << "Pose au sol" << std::endl;
+        break;
+
+    case 'j':
+        vegetation.enabled = !vegetation.enabled;
+        std::cout << "Vegetation " << ( vegetation.enabled ? "actif" : "desactif" ) << std::endl;
+        break;
+
+    case 'm':
+        impostors.enabled = !impostors.enabled;
+        std::cout << "Imposteurs " << ( impostors.enabled ? "actif" : "desactif" ) << std::endl;
+        break;
+
+    case 'a':
+        dynamicResolution.enabled = !dynamicResolution.enabled;
+        std::cout << "Resolution dynamique " << ( dynamicResolution.enabled ? "actif" : "desactif" )
+                  << " (echelle " << dynamicResolution.scale << ", GPU " << dynamicResolution.gpuFrameTime << " ms)" << std::endl;
+        break;
+
+    case '1':
+        temporalAA.enabled = !temporalAA.enabled;
+        temporalAA.invalidate();
+        std::cout << "Anti-aliasing temporel " << ( temporalAA.enabled ? "actif" : "desactif" ) << std::endl;
+        break;
+
+    case '2':
+        postProcess.bloomEnabled = !postProcess.bloomEnabled;
+        std::cout << "Bloom " << ( postProcess.bloomEnabled ? "actif" : "desactif" ) << std::endl;
+        break;
+
+    case '3':
+        postProcess.autoExposure = !postProcess.autoExposure;
+        std::cout << "Exposition automatique " << ( postProcess.autoExposure ? "actif" : "desactif" ) << std::endl;
+        break;
+
+    case 'u':
+        framePacer.onDemand = !framePacer.onDemand;
+        std::cout << "Rendu a la demande " << ( framePacer.onDemand ? "actif" : "desactif" ) << std::endl;
+        break;
+
+    case 'w':
+        // - target frame rate: 30, 60, 120, no limit
+        framePacer.targetFrameRate = ( framePacer.targetFrameRate == 0.f ) ? 30.f : ( framePacer.targetFrameRate >= 120.f ? 0.f : 2.f * framePacer.targetFrameRate );
+        framePacer.paceDivisor = 1;
+        // - GPU budget of the dynamic resolution, with a margin for the CPU and the swap
+        dynamicResolution.frameTimeBudget = ( framePacer.targetFrameRate > 0.f ) ? 0.85f * 1000.f / framePacer.targetFrameRate : 1000.f / 60.f;
+        std::cout << "Images par seconde cible " << framePacer.targetFrameRate << " (" << framePacer.frameRate() << " fps, "
+                  << framePacer.frameWorkTime << " ms par image, ecart " << framePacer.frameJitter << " ms)" << std::endl;
+        break;
+
+    case 'y':
+        // - swap interval: vsync, adaptive vsync, off
+        if ( framePacer.setSwapInterval( ( framePacer.swapInterval == 1 ) ? -1 : ( framePacer.swapInterval < 0 ? 0 : 1 ) ) )
+        {
+            std::cout << "Synchronisation verticale " << ( framePacer.swapInterval == 0 ? "desactif" : ( framePacer.swapInterval < 0 ? "adaptatif" : "actif" ) ) << std::endl;
+        }
+        else
+        {
+            std::cout << "Synchronisation verticale non supportee" << std::endl;
+        }
+        break;
+
+    case 'v':
+        terrain.tessellation.enabled = !terrain.tessellation.enabled;
+        std::cout << "Tessellation " << ( terrain.tessellation.active() ? "actif" : "desactif" ) << std::endl;
+        break;
+
     case '\t':
         if(model.nb_mesh-1 == meshSelect || meshSelect < 0){
             meshSelect = 0;
@@ -1129,6 +2019,7 @@ void keyboard_CB(unsigned char key, int x, int y)
             meshSelect++;
             model.setSelect(meshSelect);
         }
+        sceneStore.select( sceneStore.entityOfMesh( static_cast< uint32_t >( meshSelect ) ) );
         std::cout << "mesh "<< meshSelect << std::endl;
         break;
 
@@ -1194,13 +2085,13 @@ void keyboard_CB(unsigned char key, int x, int y)
         if(meshSelect != -1){
             glm::mat4 trans;
             if(translateMode == 1){
-                trans = glm::translate(model.transform[model.selectedModel], glm::vec3(xAxe,yAxe,zAxe));
+                trans = glm::translate(model.transform(model.selectedModel), glm::vec3(xAxe,yAxe,zAxe));
             }else if (rotateMode ==1){
-                trans = glm::rotate(model.transform[model.selectedModel], glm::radians(10.f) ,glm::vec3(xAxe,yAxe,zAxe));
+                trans = glm::rotate(model.transform(model.selectedModel), glm::radians(10.f) ,glm::vec3(xAxe,yAxe,zAxe));
             }else if (scaleMode ==1){
-                trans = glm::scale(model.transform[model.selectedModel], glm::vec3(1+xAxe/2,1+yAxe/2,1+zAxe/2));
+                trans = glm::scale(model.transform(model.selectedModel), glm::vec3(1+xAxe/2,1+yAxe/2,1+zAxe/2));
             }
-            model.transform[meshSelect] = trans;
+            model.setTransform(meshSelect, trans);
         }
         break;
 
@@ -1208,23 +2099,37 @@ void keyboard_CB(unsigned char key, int x, int y)
         if(meshSelect != -1){
             glm::mat4 trans;
             if(translateMode == 1){
-                trans = glm::translate(model.transform[model.selectedModel], glm::vec3(-xAxe,-yAxe,-zAxe));
+                trans = glm::translate(model.transform(model.selectedModel), glm::vec3(-xAxe,-yAxe,-zAxe));
             }else if (rotateMode ==1){
-                trans = glm::rotate(model.transform[model.selectedModel], glm::radians(-10.f) ,glm::vec3(xAxe,yAxe,zAxe));
+                trans = glm::rotate(model.transform(model.selectedModel), glm::radians(-10.f) ,glm::vec3(xAxe,yAxe,zAxe));
             }else if (scaleMode ==1){
-                trans = glm::scale(model.transform[model.selectedModel], glm::vec3(1-xAxe/2,1-yAxe/2,1-zAxe/2));
+                trans = glm::scale(model.transform(model.selectedModel), glm::vec3(1-xAxe/2,1-yAxe/2,1-zAxe/2));
             }
-            model.transform[meshSelect] = trans;
+            model.setTransform(meshSelect, trans);
         }
         break;
     }
 
-
     glutPostRedisplay();
 }
 
 
 
+/******************************************************************************
+ * Callback for KeyBoard release: end of the camera moves
+ ******************************************************************************/
+void keyboardUp_CB(unsigned char key, int x, int y)
+{
+    switch(key){
+    case 'z': simulation.setMove( Simulation::MoveForward, false ); break;
+    case 's': simulation.setMove( Simulation::MoveBackward, false ); break;
+    case 'q': simulation.setMove( Simulation::MoveLeft, false ); break;
+    case 'd': simulation.setMove( Simulation::MoveRight, false ); break;
+    case ' ': simulation.setMove( Simulation::MoveUp, false ); break;
+    case 'x': simulation.setMove( Simulation::MoveDown, false ); break;
+    }
+}
+
 void special_CB(int key, int x, int y)
 {
     switch (key) {
@@ -1291,7 +2196,7 @@ void mouse_CB(int button, int state, int x, int y){
                 ray_direction,
                 model.aabb_min[i],
                 model.aabb_max[i],
-                model.transform[i],
+                model.transform(i),
                 intersection_distance) && (!isSelected || intersection_distance < previous_distance)
             ){
                 model.setSelect(i);
@@ -1304,6 +2209,36 @@ void mouse_CB(int button, int state, int x, int y){
             model.setSelect(-1);
     }*/
 
+    // Mesh picking: middle button selects the mesh under the mouse
+    if((button==GLUT_MIDDLE_BUTTON)&&(state==GLUT_DOWN)){
+        meshSelect = pickMesh( x, y );
+        model.setSelect(meshSelect);
+        std::cout << "mesh "<< meshSelect << std::endl;
+    }
+
+    // Terrain picking: brush target, and the selected mesh is put down there
+    if((button==GLUT_RIGHT_BUTTON)&&(state==GLUT_DOWN)){
+        glm::vec3 point;
+        glm::vec3 normal;
+        if ( pickTerrain( x, y, point, normal ) )
+        {
+            std::cout << "Terrain " << point.x << " " << point.y << " " << point.z << std::endl;
+            brushCenter = glm::vec2( point.x, point.z ) / CubeMap.scale;
+            brushCenterPicked = true;
+
+            if ( meshSelect != -1 )
+            {
+                // - bottom center of the mesh bounds on the surface
+                const glm::vec3 base( 0.5f * ( model.bounds_min[ meshSelect ].x + model.bounds_max[ meshSelect ].x ),
+                                      model.bounds_min[ meshSelect ].y,
+                                      0.5f * ( model.bounds_min[ meshSelect ].z + model.bounds_max[ meshSelect ].z ) );
+                glm::mat4 transform = model.transform( meshSelect );
+                transform[ 3 ] = glm::vec4( point - glm::mat3( transform ) * base, 1.f );
+                model.setTransform( meshSelect, transform );
+            }
+        }
+    }
+
     //ZOOM
     if(button==3){
         if(_cameraFovY >= 1.0f && _cameraFovY <= 45.0f)
@@ -1332,8 +2267,7 @@ void mouseMove(int x, int y){
 
     const float mouse_Sensitivity = 0.01f;
 
-    yaw   += mouse_Sensitivity * mouse_delta.x;
-    pitch += mouse_Sensitivity * mouse_delta.y;
+    simulation.look( mouse_Sensitivity * mouse_delta.x, mouse_Sensitivity * mouse_delta.y );
 
     mouseLastPosition = glm::vec2(x, y);
 
@@ -1345,8 +2279,27 @@ void mouseMove(int x, int y){
  ******************************************************************************/
 void idle( void )
 {
-    // Mark current window as needing to be redisplayed
-    glutPostRedisplay();
+    // Scene still changing: camera moving, terrain pages streaming, horizon bake to upload
+    if ( simulation.isActive() || terrain.virtualTexture.isStreaming() || terrain.horizonMap.isBakeReady() )
+    {
+        framePacer.requestRedraw();
+    }
+
+    // - the temporal anti-aliasing needs a couple of jitter cycles to converge,
+    //   the exposure its adaptation time
+    int settleFrames = temporalAA.enabled ? 2 * TemporalAA::NumberOfJitterSamples : 3;
+    if ( postProcess.autoExposure )
+    {
+        const float frameRate = ( framePacer.targetFrameRate > 0.f ) ? framePacer.targetFrameRate : 60.f;
+        settleFrames = std::max( settleFrames, static_cast< int >( frameRate * postProcess.adaptationTime ) );
+    }
+    framePacer.settleFrames = settleFrames;
+
+    // Mark current window as needing to be redisplayed, at the frame pacer time
+    if ( framePacer.wait() )
+    {
+        glutPostRedisplay();
+    }
 }
 
 /******************************************************************************
@@ -1364,6 +2317,8 @@ int main( int argc, char** argv )
     CubeMap.ImgRepository = dataRepository+"/../LMG_project/Map/";
 
     terrain.ImgRepository = dataRepository+"/../LMG_project/HeigthMap/chili.jpg";
+    terrain.ImageryRepository = dataRepository+"/../LMG_project/HeigthMap/imagery";
+    terrain.ImagerySource = dataRepository+"/../LMG_project/HeigthMap/imagery.jpg";
 
     //Load le mesh 3D
     model.loadMesh(dataRepository+"/../LMG_project/Model3D/meute.obj");
@@ -1391,6 +2346,7 @@ int main( int argc, char** argv )
 
     //Event KeyBoard and Mouse
     glutKeyboardFunc(keyboard_CB);
+    glutKeyboardUpFunc(keyboardUp_CB);
     glutSpecialFunc(special_CB);
     glutMouseFunc(mouse_CB);
     glutMotionFunc(mouseMove);
@@ -1410,9 +2366,23 @@ int main( int argc, char** argv )
         exit( -1 );
     }
 
+    // Job system created on this thread: the GLUT thread is its thread 0
+    JobSystem::instance();
+    // - registered after it: called at exit before the job system is destroyed
+    std::atexit( stopBackgroundWork );
+
     // Initialize all your resources (graphics, data, etc...)
     initialize();
 
+    // Start the update thread from the initial camera
+    Simulation::State initialState;
+    initialState.cameraEye = _cameraEye;
+    initialState.yaw = yaw;
+    initialState.pitch = pitch;
+    initialState.roll = roll;
+    initialState.time = 0.0;
+    simulation.start( initialState );
+
     // Enter the GLUT main event loop (waiting for events: keyboard, mouse, refresh screen, etc...)
     glutMainLoop();
 
@@ -0,0 +1,204 @@
+/******************************************************************************
+ * Height pyramid checks (no GL)
+ * - ray casts against a brute-force test over all the grid triangles
+ * - brush edits: update() gives the same levels as a fresh build()
+ ******************************************************************************/
+
+// STL
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include "../HeightPyramid.h"
+
+namespace
+{
+    int numberOfFailures = 0;
+
+    void check( bool condition, const char* name )
+    {
+        if ( !condition )
+        {
+            std::cout << "FAILED: " << name << std::endl;
+            ++numberOfFailures;
+        }
+    }
+
+    float random( float low, float high )
+    {
+        return low + ( high - low ) * std::rand() / RAND_MAX;
+    }
+
+    // Grid of plane(): x = j / nb * 2 - 1, z = i / nb * 2 - 1, k = j * nb + i
+    std::vector< glm::vec3 > randomGrid( int nb )
+    {
+        std::vector< glm::vec3 > points( nb * nb );
+        for ( int j = 0; j < nb; ++j )
+        {
+            for ( int i = 0; i < nb; ++i )
+            {
+                const float x = static_cast< float >( j ) / nb * 2.f - 1.f;
+                const float z = static_cast< float >( i ) / nb * 2.f - 1.f;
+                const float y = 0.15f * std::sin( 7.f * x ) * std::cos( 5.f * z ) + random( -0.02f, 0.02f );
+                points[ j * nb + i ] = glm::vec3( x, y, z );
+            }
+        }
+        return points;
+    }
+
+    // Moller-Trumbore, t of the hit or a negative value
+    float intersectTriangle( const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c )
+    {
+        const glm::vec3 ab = b - a;
+        const glm::vec3 ac = c - a;
+        const glm::vec3 p = glm::cross( direction, ac );
+        const float determinant = glm::dot( ab, p );
+        if ( std::fabs( determinant ) < 1e-12f )
+            return -1.f;
+        const glm::vec3 s = origin - a;
+        const float u = glm::dot( s, p ) / determinant;
+        if ( u < 0.f || u > 1.f )
+            return -1.f;
+        const glm::vec3 q = glm::cross( s, ab );
+        const float v = glm::dot( direction, q ) / determinant;
+        if ( v < 0.f || u + v > 1.f )
+            return -1.f;
+        return glm::dot( ac, q ) / determinant;
+    }
+
+    // Nearest hit over the two triangles of every cell, in local space
+    bool bruteForce( const std::vector< glm::vec3 >& points, int nb, const glm::vec3& origin, const glm::vec3& direction, float& distance )
+    {
+        distance = std::numeric_limits< float >::max();
+        for ( int j = 0; j < nb - 1; ++j )
+        {
+            for ( int i = 0; i < nb - 1; ++i )
+            {
+                const glm::vec3& c00 = points[ j * nb + i ];
+                const glm::vec3& c01 = points[ j * nb + i + 1 ];
+                const glm::vec3& c10 = points[ ( j + 1 ) * nb + i ];
+                const glm::vec3& c11 = points[ ( j + 1 ) * nb + i + 1 ];
+                const float t0 = intersectTriangle( origin, direction, c11, c01, c00 );
+                const float t1 = intersectTriangle( origin, direction, c11, c00, c10 );
+                if ( t0 >= 0.f )
+                    distance = std::min( distance, t0 );
+                if ( t1 >= 0.f )
+                    distance = std::min( distance, t1 );
+            }
+        }
+        return distance < std::numeric_limits< float >::max();
+    }
+
+    // Rays hitting (or missing) the pyramid exactly as the brute-force test
+    int compareRays( const HeightPyramid& pyramid, const std::vector< glm::vec3 >& points, int nb, int count )
+    {
+        int mismatches = 0;
+        for ( int r = 0; r < count; ++r )
+        {
+            // - half of them from above toward the grid, the others grazing it
+            glm::vec3 origin;
+            glm::vec3 direction;
+            if ( r % 2 == 0 )
+            {
+                origin = glm::vec3( random( -1.2f, 1.2f ), random( 0.3f, 1.5f ), random( -1.2f, 1.2f ) );
+                direction = glm::vec3( random( -1.f, 1.f ), random( -0.3f, 0.2f ), random( -1.f, 1.f ) ) - origin;
+            }
+            else
+            {
+                origin = glm::vec3( random( -1.2f, 1.2f ), random( -0.1f, 0.3f ), random( -1.2f, 1.2f ) );
+                direction = glm::vec3( random( -1.f, 1.f ), random( -0.1f, 0.02f ), random( -1.f, 1.f ) );
+            }
+
+            float expected;
+            const bool expectedHit = bruteForce( points, nb, origin, direction, expected );
+            float distance;
+            glm::vec3 point;
+            glm::vec3 normal;
+            const bool hit = pyramid.intersect( origin, direction, distance, point, normal );
+
+            if ( hit != expectedHit || ( hit && std::fabs( distance - expected ) > 1e-4f * std::max( 1.f, expected ) ) )
+            {
+                ++mismatches;
+            }
+            else if ( hit && ( normal.y <= 0.f || glm::length( point - ( origin + direction * distance ) ) > 1e-5f ) )
+            {
+                ++mismatches;
+            }
+        }
+        return mismatches;
+    }
+
+    bool sameLevels( const HeightPyramid& a, const HeightPyramid& b )
+    {
+        if ( a.levels.size() != b.levels.size() || a.heights != b.heights )
+            return false;
+        for ( size_t l = 0; l < a.levels.size(); ++l )
+        {
+            if ( a.levels[ l ] != b.levels[ l ] )
+                return false;
+        }
+        return true;
+    }
+
+    // Brush edit of the vertices [j0,j1] x [i0,i1]
+    void edit( std::vector< glm::vec3 >& points, int nb, int j0, int i0, int j1, int i1, float amount )
+    {
+        for ( int j = j0; j <= j1; ++j )
+        {
+            for ( int i = i0; i <= i1; ++i )
+            {
+                points[ j * nb + i ].y += amount * random( 0.5f, 1.f );
+            }
+        }
+    }
+}
+
+int main()
+{
+    std::srand( 4321 );
+    const int nb = 129;
+    std::vector< glm::vec3 > points = randomGrid( nb );
+
+    HeightPyramid pyramid;
+    pyramid.build( points, nb );
+    check( pyramid.levels.back().size() == 1, "pyramid ends with a single root node" );
+
+    // Ray casts
+    check( compareRays( pyramid, points, nb, 1000 ) == 0, "ray casts match the brute-force test" );
+
+    // Straight down at a grid vertex: the height of the vertex
+    {
+        const int j = 40;
+        const int i = 70;
+        const glm::vec3 vertex = points[ j * nb + i ];
+        float distance;
+        glm::vec3 point;
+        glm::vec3 normal;
+        const bool hit = pyramid.intersect( vertex + glm::vec3( 0.f, 2.f, 0.f ), glm::vec3( 0.f, -1.f, 0.f ), distance, point, normal );
+        check( hit && std::fabs( point.y - vertex.y ) < 1e-5f, "vertical ray hits the vertex height" );
+    }
+
+    // Brush edits, inside the grid and on its borders: same as a fresh build
+    {
+        const int regions[ 3 ][ 4 ] = { { 40, 10, 60, 30 }, { 0, 0, 5, 12 }, { 100, 120, nb - 1, nb - 1 } };
+        for ( int e = 0; e < 3; ++e )
+        {
+            const int* region = regions[ e ];
+            edit( points, nb, region[ 0 ], region[ 1 ], region[ 2 ], region[ 3 ], ( e == 1 ) ? -0.3f : 0.4f );
+            pyramid.update( points, region[ 0 ], region[ 1 ], region[ 2 ], region[ 3 ] );
+
+            HeightPyramid rebuilt;
+            rebuilt.build( points, nb );
+            check( sameLevels( pyramid, rebuilt ), "update after a brush edit matches a fresh build" );
+        }
+        check( compareRays( pyramid, points, nb, 200 ) == 0, "ray casts after brush edits match the brute-force test" );
+    }
+
+    if ( numberOfFailures == 0 )
+    {
+        std::cout << "All height pyramid checks passed" << std::endl;
+    }
+    return ( numberOfFailures == 0 ) ? 0 : 1;
+}
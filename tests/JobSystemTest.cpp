@@ -0,0 +1,176 @@
+/******************************************************************************
+ * Job system checks (no GL)
+ * - forEachTask (jobs and task slots), parallelFor, dependencies and nested waits against serial
+ *   results, frame waits that never pick up background jobs
+ ******************************************************************************/
+
+// STL
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#include "../JobSystem.h"
+
+namespace
+{
+    int numberOfFailures = 0;
+
+    // Plain function tasks (task slots): visits[ task ] of a vector of counters
+    void visit( void* context, unsigned int task )
+    {
+        ++( *static_cast< std::vector< std::atomic< int > >* >( context ) )[ task ];
+    }
+
+    // Nested: each task runs a whole forEachTask() of its own, more than the task slots
+    void visitNested( void* context, unsigned int task )
+    {
+        std::vector< std::atomic< int > >& visits = *static_cast< std::vector< std::atomic< int > >* >( context );
+        std::vector< std::atomic< int > > inner( 16 );
+        for ( size_t t = 0; t < inner.size(); ++t )
+            inner[ t ] = 0;
+        JobSystem::instance().forEachTask( 16, visit, &inner );
+        bool once = true;
+        for ( size_t t = 0; t < inner.size(); ++t )
+            once = once && ( inner[ t ] == 1 );
+        if ( once )
+            ++visits[ task ];
+    }
+
+    void check( bool condition, const char* name )
+    {
+        if ( !condition )
+        {
+            std::cout << "FAILED: " << name << std::endl;
+            ++numberOfFailures;
+        }
+    }
+}
+
+int main()
+{
+    // This thread is thread 0 (as the GLUT thread in main.cpp)
+    JobSystem& jobs = JobSystem::instance();
+    const std::thread::id mainThread = std::this_thread::get_id();
+    std::cout << "Job system: " << jobs.numberOfThreads() << " threads" << std::endl;
+
+    // forEachTask: every task once
+    {
+        const unsigned int n = 1000;
+        std::vector< std::atomic< int > > visits( n );
+        for ( unsigned int t = 0; t < n; ++t )
+            visits[ t ] = 0;
+        jobs.forEachTask( n, [&]( unsigned int task ) { ++visits[ task ]; } );
+        bool once = true;
+        for ( unsigned int t = 0; t < n; ++t )
+            once = once && ( visits[ t ] == 1 );
+        check( once, "forEachTask runs every task once" );
+    }
+
+    // forEachTask with a plain function, nested in more tasks than there are slots
+    {
+        const unsigned int n = 64;
+        std::vector< std::atomic< int > > visits( n );
+        for ( unsigned int t = 0; t < n; ++t )
+            visits[ t ] = 0;
+        jobs.forEachTask( n, visit, &visits );
+        bool once = true;
+        for ( unsigned int t = 0; t < n; ++t )
+            once = once && ( visits[ t ] == 1 );
+        check( once, "forEachTask (plain function) runs every task once" );
+
+        for ( unsigned int t = 0; t < n; ++t )
+            visits[ t ] = 0;
+        jobs.forEachTask( n, visitNested, &visits );
+        once = true;
+        for ( unsigned int t = 0; t < n; ++t )
+            once = once && ( visits[ t ] == 1 );
+        check( once, "nested forEachTask (plain function)" );
+    }
+
+    // parallelFor: ranges cover [begin,end[ exactly, same sum as serial
+    {
+        std::vector< long long > values( 100000 );
+        std::iota( values.begin(), values.end(), 1 );
+        std::vector< long long > partial( values.size(), 0 );
+        jobs.parallelFor( 0, values.size(), 256, [&]( size_t begin, size_t end )
+        {
+            for ( size_t v = begin; v < end; ++v )
+                partial[ v ] = values[ v ] * 2;
+        } );
+        check( std::accumulate( partial.begin(), partial.end(), 0LL ) == 2 * std::accumulate( values.begin(), values.end(), 0LL ),
+               "parallelFor matches the serial sum" );
+    }
+
+    // runAfter: continuations see all the jobs of their dependency done
+    {
+        JobCounter first;
+        JobCounter second;
+        std::atomic< int > done( 0 );
+        std::atomic< bool > ordered( true );
+        for ( int j = 0; j < 64; ++j )
+            jobs.run( [&]() { ++done; }, &first );
+        for ( int j = 0; j < 16; ++j )
+            jobs.runAfter( first, [&]() { if ( done.load() < 64 ) ordered = false; }, &second );
+        jobs.wait( second );
+        check( first.done() && ordered, "runAfter waits for its dependency" );
+    }
+
+    // Nested waits: jobs spreading their own tasks (level-wise updates)
+    {
+        JobCounter outer;
+        std::atomic< int > total( 0 );
+        for ( int j = 0; j < 8; ++j )
+        {
+            jobs.run( [&]()
+            {
+                jobs.forEachTask( 32, [&]( unsigned int ) { ++total; } );
+            }, &outer );
+        }
+        jobs.wait( outer );
+        check( total == 8 * 32, "nested forEachTask inside jobs" );
+    }
+
+    // A wait of a pool thread never picks up background work: a long job
+    // queued by a thread outside of the pool (as the horizon bake thread)
+    // only ends once the frame wait is over (or after a timeout when the
+    // frame wait ran it itself)
+    {
+        std::atomic< bool > queued( false );
+        std::atomic< bool > frameDone( false );
+        std::atomic< bool > backgroundDone( false );
+        std::thread::id backgroundThread;
+        std::thread bake( [&]()
+        {
+            JobCounter background;
+            jobs.run( [&]()
+            {
+                backgroundThread = std::this_thread::get_id();
+                const std::chrono::steady_clock::time_point timeout = std::chrono::steady_clock::now() + std::chrono::seconds( 5 );
+                while ( !frameDone && std::chrono::steady_clock::now() < timeout )
+                    std::this_thread::yield();
+                backgroundDone = true;
+            }, &background );
+            queued = true;
+            jobs.wait( background );
+        } );
+        while ( !queued )
+            std::this_thread::yield();
+
+        JobCounter frame;
+        jobs.run( []() {}, &frame );
+        jobs.wait( frame );
+        const bool backgroundRunning = !backgroundDone;
+        frameDone = true;
+        bake.join();
+        check( backgroundRunning && backgroundThread != mainThread, "frame wait leaves background jobs" );
+    }
+
+    if ( numberOfFailures == 0 )
+    {
+        std::cout << "All job system checks passed" << std::endl;
+    }
+    return ( numberOfFailures == 0 ) ? 0 : 1;
+}
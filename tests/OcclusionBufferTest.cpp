@@ -0,0 +1,137 @@
+/******************************************************************************
+ * Occlusion buffer checks (no GL)
+ * - known triangles rasterized with the expected depths, box tests
+ * - AVX2 and scalar paths give the same depth buffer (when the CPU has AVX2)
+ ******************************************************************************/
+
+// STL
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "../OcclusionBuffer.h"
+#include "../CpuFeatures.h"
+
+namespace
+{
+    int numberOfFailures = 0;
+
+    void check( bool condition, const char* name )
+    {
+        if ( !condition )
+        {
+            std::cout << "FAILED: " << name << std::endl;
+            ++numberOfFailures;
+        }
+    }
+
+    // Random triangles in [-1.2,1.2]^2 (clip space, identity transform), some of them off screen
+    void randomTriangles( int count, std::vector< glm::vec3 >& points, std::vector< unsigned int >& indices )
+    {
+        std::srand( 1234 );
+        for ( int t = 0; t < 3 * count; ++t )
+        {
+            const float x = 2.4f * std::rand() / RAND_MAX - 1.2f;
+            const float y = 2.4f * std::rand() / RAND_MAX - 1.2f;
+            const float z = 2.f * std::rand() / RAND_MAX - 1.f;
+            points.push_back( glm::vec3( x, y, z ) );
+            indices.push_back( static_cast< unsigned int >( t ) );
+        }
+    }
+
+    void rasterize( OcclusionBuffer& buffer, const std::vector< glm::vec3 >& points, const std::vector< unsigned int >& indices )
+    {
+        buffer.clear();
+        buffer.rasterize( points, indices, glm::mat4( 1.f ) );
+    }
+}
+
+int main()
+{
+    const glm::mat4 identity( 1.f );
+
+    // Full screen quad at z = 0 (depth 0.5), both windings
+    {
+        std::vector< glm::vec3 > points;
+        points.push_back( glm::vec3( -1.f, -1.f, 0.f ) );
+        points.push_back( glm::vec3(  1.f, -1.f, 0.f ) );
+        points.push_back( glm::vec3(  1.f,  1.f, 0.f ) );
+        points.push_back( glm::vec3( -1.f,  1.f, 0.f ) );
+        std::vector< unsigned int > indices;
+        const unsigned int quad[] = { 0, 1, 2, 0, 3, 2 };
+        indices.assign( quad, quad + 6 );
+
+        for ( int path = 0; path < 2; ++path )
+        {
+            OcclusionBuffer buffer;
+            buffer.useAvx2 = ( path == 1 ) && cpuHasAvx2();
+            rasterize( buffer, points, indices );
+
+            bool covered = true;
+            for ( size_t p = 0; p < buffer.depth.size(); ++p )
+                covered = covered && std::fabs( buffer.depth[ p ] - 0.5f ) < 1e-6f;
+            check( covered, "full screen quad covers every pixel at depth 0.5" );
+
+            check( !buffer.isVisible( glm::vec3( -0.5f, -0.5f, 0.2f ), glm::vec3( 0.5f, 0.5f, 0.4f ), identity ), "box behind the quad is hidden" );
+            check( buffer.isVisible( glm::vec3( -0.5f, -0.5f, -0.4f ), glm::vec3( 0.5f, 0.5f, 0.4f ), identity ), "box crossing the quad is visible" );
+        }
+    }
+
+    // Triangle over the left half of the screen only
+    {
+        std::vector< glm::vec3 > points;
+        points.push_back( glm::vec3( -1.f, -3.f, -0.5f ) );
+        points.push_back( glm::vec3(  0.f,  0.f, -0.5f ) );
+        points.push_back( glm::vec3( -1.f,  3.f, -0.5f ) );
+        std::vector< unsigned int > indices;
+        indices.push_back( 0 );
+        indices.push_back( 1 );
+        indices.push_back( 2 );
+
+        OcclusionBuffer buffer;
+        rasterize( buffer, points, indices );
+        const int row = OcclusionBuffer::Height / 2;
+        check( std::fabs( buffer.depth[ row * OcclusionBuffer::Width + 1 ] - 0.25f ) < 1e-6f, "pixel inside the triangle at depth 0.25" );
+        check( buffer.depth[ row * OcclusionBuffer::Width + OcclusionBuffer::Width - 2 ] == 1.f, "pixel outside the triangle stays far" );
+    }
+
+    // AVX2 and scalar paths on many triangles
+    if ( cpuHasAvx2() )
+    {
+        std::vector< glm::vec3 > points;
+        std::vector< unsigned int > indices;
+        randomTriangles( 2000, points, indices );
+
+        OcclusionBuffer scalar;
+        scalar.useAvx2 = false;
+        rasterize( scalar, points, indices );
+        OcclusionBuffer simd;
+        simd.useAvx2 = true;
+        rasterize( simd, points, indices );
+
+        int differences = 0;
+        for ( size_t p = 0; p < scalar.depth.size(); ++p )
+            differences += ( scalar.depth[ p ] != simd.depth[ p ] );
+        check( differences == 0, "AVX2 and scalar depth buffers match" );
+
+        int mismatches = 0;
+        for ( int b = 0; b < 500; ++b )
+        {
+            const glm::vec3 center( 1.8f * std::rand() / RAND_MAX - 0.9f, 1.8f * std::rand() / RAND_MAX - 0.9f, 1.6f * std::rand() / RAND_MAX - 0.8f );
+            const glm::vec3 extent( 0.01f + 0.2f * std::rand() / RAND_MAX );
+            mismatches += ( scalar.isVisible( center - extent, center + extent, identity ) != simd.isVisible( center - extent, center + extent, identity ) );
+        }
+        check( mismatches == 0, "AVX2 and scalar box tests match" );
+    }
+    else
+    {
+        std::cout << "No AVX2 on this CPU: scalar path only" << std::endl;
+    }
+
+    if ( numberOfFailures == 0 )
+    {
+        std::cout << "All occlusion buffer checks passed" << std::endl;
+    }
+    return ( numberOfFailures == 0 ) ? 0 : 1;
+}
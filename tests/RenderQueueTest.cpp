@@ -0,0 +1,127 @@
+/******************************************************************************
+ * Render queue checks (no GL)
+ * - radix sort against std::stable_sort, small and parallel queues
+ * - a second sort of a queue of the same size does not allocate
+ ******************************************************************************/
+
+// STL
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+
+#include "../RenderQueue.h"
+#include "../JobSystem.h"
+
+// Allocations of the whole program (all threads)
+namespace
+{
+    std::atomic< long > numberOfAllocations( 0 );
+}
+
+void* operator new( std::size_t size )
+{
+    ++numberOfAllocations;
+    void* memory = std::malloc( size ? size : 1 );
+    if ( !memory )
+        throw std::bad_alloc();
+    return memory;
+}
+
+void operator delete( void* memory ) noexcept
+{
+    std::free( memory );
+}
+
+void operator delete( void* memory, std::size_t ) noexcept
+{
+    std::free( memory );
+}
+
+namespace
+{
+    int numberOfFailures = 0;
+
+    void check( bool condition, const char* name )
+    {
+        if ( !condition )
+        {
+            std::cout << "FAILED: " << name << std::endl;
+            ++numberOfFailures;
+        }
+    }
+
+    // Keys with a few passes, programs and textures, and random depths
+    uint64_t randomKey()
+    {
+        return RenderQueue::makeKey( std::rand() % 3, std::rand() % 20, std::rand() % 300, 100.f * std::rand() / RAND_MAX );
+    }
+
+    void fill( RenderQueue& queue, std::vector< RenderQueue::Item >& expected, size_t size )
+    {
+        queue.clear();
+        expected.clear();
+        for ( size_t i = 0; i < size; ++i )
+        {
+            queue.push( randomKey(), static_cast< uint32_t >( i ) );
+            expected.push_back( queue.items.back() );
+        }
+        std::stable_sort( expected.begin(), expected.end(), []( const RenderQueue::Item& a, const RenderQueue::Item& b ) { return a.key < b.key; } );
+    }
+
+    bool sameItems( const std::vector< RenderQueue::Item >& a, const std::vector< RenderQueue::Item >& b )
+    {
+        if ( a.size() != b.size() )
+            return false;
+        for ( size_t i = 0; i < a.size(); ++i )
+        {
+            if ( a[ i ].key != b[ i ].key || a[ i ].index != b[ i ].index )
+                return false;
+        }
+        return true;
+    }
+}
+
+int main()
+{
+    std::srand( 2024 );
+    JobSystem& jobs = JobSystem::instance();
+    std::cout << "Job system: " << jobs.numberOfThreads() << " threads" << std::endl;
+
+    std::vector< RenderQueue::Item > expected;
+
+    // Below the parallel threshold (sorted on this thread)
+    {
+        RenderQueue queue;
+        fill( queue, expected, 1000 );
+        queue.sort();
+        check( sameItems( queue.items, expected ), "small queue sorted and stable" );
+    }
+
+    // 50k items: parallel sort, twice; the second one must not allocate
+    {
+        const size_t size = 50000;
+        RenderQueue queue;
+        queue.numberOfThreads = std::max( 4u, jobs.numberOfThreads() );
+        expected.reserve( size );
+
+        fill( queue, expected, size );
+        queue.sort();
+        check( sameItems( queue.items, expected ), "50k queue sorted and stable" );
+
+        fill( queue, expected, size );
+        const long allocations = numberOfAllocations.load();
+        queue.sort();
+        const long sortAllocations = numberOfAllocations.load() - allocations;
+        check( sameItems( queue.items, expected ), "50k queue sorted again" );
+        check( sortAllocations == 0, "second sort of the same size does not allocate" );
+    }
+
+    if ( numberOfFailures == 0 )
+    {
+        std::cout << "All render queue checks passed" << std::endl;
+    }
+    return ( numberOfFailures == 0 ) ? 0 : 1;
+}